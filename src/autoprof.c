@@ -0,0 +1,767 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * libmeas-autoprof: automatic function-level timing for code built with
+ * -finstrument-functions
+ *
+ * Each thread owns a shadow stack and an open addressing table of the
+ * functions it called (keyed by address), so the hooks take no lock and
+ * make no atomic operation. A function already in the table is found in
+ * its home slot unless it collided, with no call out of the hook. The
+ * table of an exiting thread is folded into a retired table and reused.
+ * Time is read from the TSC where available and
+ * converted to nanoseconds when written. Symbols are resolved from the
+ * ELF files of the process mappings when writing, or on the first call of
+ * a function when filters are set.
+ *
+ * Environment: MEAS_AUTOPROF_INCLUDE and MEAS_AUTOPROF_EXCLUDE hold comma
+ * separated shell patterns of function names; MEAS_AUTOPROF_OUTPUT is a
+ * file written at exit.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <util.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/**
+ * Functions of a thread table (3/4 used at most)
+ */
+#define AUTOPROF_FUNCS_BITS 11
+#define AUTOPROF_FUNCS      (1 << AUTOPROF_FUNCS_BITS)
+
+/**
+ * Depth of the shadow stacks (deeper calls are not timed)
+ */
+#define AUTOPROF_DEPTH 256
+
+/**
+ * Log2 buckets of the inclusive time histograms (in ticks)
+ */
+#define AUTOPROF_BUCKETS 40
+
+/**
+ * Filter patterns and resolved symbols
+ */
+#define AUTOPROF_PATTERNS 32
+#define AUTOPROF_MAPS     256
+#define AUTOPROF_SYMBOL   256
+
+/**
+ * Function of a thread table
+ */
+struct autoprof_func {
+	void *fn;
+	int excluded;
+	unsigned long calls;
+	unsigned long long inclusive;	/* Ticks */
+	unsigned long long self;
+	unsigned long long max;
+	unsigned int hist[AUTOPROF_BUCKETS];
+};
+
+/**
+ * Shadow stack frame
+ */
+struct autoprof_frame {
+	struct autoprof_func *func;		/* NULL: not timed */
+	unsigned long long start;
+	unsigned long long child;		/* Inclusive time of the timed callees */
+};
+
+/**
+ * Thread state
+ */
+struct autoprof_thread {
+	int tid;
+	int busy;						/* Inside a cold path (hooks are ignored) */
+	unsigned int depth;
+	unsigned int nfuncs;
+	unsigned long lost;				/* Calls of functions not fitting the table */
+	struct autoprof_frame stack[AUTOPROF_DEPTH];
+	struct autoprof_func funcs[AUTOPROF_FUNCS];
+	struct autoprof_thread *next;
+};
+
+/**
+ * Executable mapping of a file
+ */
+struct autoprof_map {
+	unsigned long start;
+	unsigned long end;
+	unsigned long offset;
+	char path[512];
+	meas_symtab *symtab;
+	int loaded;
+};
+
+/**
+ * Home slot of a function in a thread table (Fibonacci hashing)
+ */
+#define AUTOPROF_HOME(fn) \
+	util_hash((unsigned long long)(fn), AUTOPROF_FUNCS_BITS)
+
+/**
+ * Tables of the live threads (ending with the statistics of the exited
+ * threads), tables free for reuse, filters and symbol resolution state
+ */
+static struct autoprof_thread retired;
+static struct autoprof_thread *threads = &retired;
+static struct autoprof_thread *free_threads = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static int enabled = TRUE;
+static char *patterns[AUTOPROF_PATTERNS];
+static int includes[AUTOPROF_PATTERNS];
+static unsigned int npatterns = 0;
+static struct autoprof_map maps[AUTOPROF_MAPS];
+static unsigned int nmaps = 0;
+static unsigned long long tsc0, ns0;
+
+/* Initial-exec: a plain offset from the thread pointer, even from the shared library */
+static __thread struct autoprof_thread *thread_state __attribute__ ((tls_model ("initial-exec"))) = NULL;
+static __thread int thread_exited __attribute__ ((tls_model ("initial-exec"))) = FALSE;
+
+/**
+ * Hooks called by instrumented code
+ */
+void __cyg_profile_func_enter(void *fn, void *site) __attribute__ ((no_instrument_function));
+void __cyg_profile_func_exit(void *fn, void *site) __attribute__ ((no_instrument_function));
+
+/**
+ * static functions
+ */
+static struct autoprof_thread *thread_init(void) __attribute__ ((noinline));
+static void thread_exit(void *arg);
+static void key_init(void);
+static struct autoprof_func *lookup(struct autoprof_thread *t, void *fn) __attribute__ ((noinline));
+static struct autoprof_func *find(struct autoprof_thread *t, void *fn, int add);
+static void add_table(struct autoprof_thread *dst, const struct autoprof_thread *src);
+static int filtered_out(void *fn);
+static const char *symbolize(void *fn, char *buf, size_t size);
+static void load_maps(void);
+static void add_patterns(const char *list, int include);
+static int merge(void *fn, struct autoprof_func *out);
+static void add_func(struct autoprof_func *dst, const struct autoprof_func *src);
+static int cmp_self(const void *a, const void *b);
+static void autoprof_init(void) __attribute__ ((constructor));
+static void autoprof_fini(void) __attribute__ ((destructor));
+
+
+/**
+ * Function entry hook
+ * @param fn Address of the function.
+ * @param site Call site.
+ */
+void __cyg_profile_func_enter(void *fn, void *site)
+{
+	struct autoprof_thread *t = thread_state;
+	struct autoprof_frame *fr;
+	struct autoprof_func *f;
+
+	if (__builtin_expect(t == NULL, 0) && (t = thread_init()) == NULL)
+		return;
+
+	if (__builtin_expect(t->depth >= AUTOPROF_DEPTH, 0)) {
+		t->depth++;
+		return;
+	}
+
+	fr = &t->stack[t->depth++];
+	fr->child = 0;
+	fr->func  = NULL;
+	if (!enabled || t->busy)
+		return;
+
+	/* Resolved functions are found in their home slot (no probing) */
+	f = &t->funcs[AUTOPROF_HOME(fn)];
+	if (__builtin_expect(f->fn != fn, 0))
+		f = lookup(t, fn);
+	else if (f->excluded)
+		f = NULL;
+
+	if (f != NULL) {
+		fr->func  = f;
+		fr->start = util_ticks();
+	}
+}
+
+
+/**
+ * Function exit hook
+ * @param fn Address of the function.
+ * @param site Call site.
+ */
+void __cyg_profile_func_exit(void *fn, void *site)
+{
+	unsigned long long now = util_ticks();
+	struct autoprof_thread *t = thread_state;
+	struct autoprof_frame *fr;
+	struct autoprof_func *f;
+	unsigned long long elapsed;
+	unsigned int b;
+
+	if (__builtin_expect(t == NULL || t->depth == 0, 0))
+		return;
+
+	if (__builtin_expect(--t->depth >= AUTOPROF_DEPTH, 0))
+		return;
+
+	fr = &t->stack[t->depth];
+	if ((f = fr->func) == NULL) {
+		/* Not timed: its callees count for the caller */
+		if (t->depth > 0)
+			t->stack[t->depth - 1].child += fr->child;
+		return;
+	}
+
+	elapsed = now - fr->start;
+	f->calls++;
+	f->inclusive += elapsed;
+	f->self      += elapsed - fr->child;
+	if (elapsed > f->max)
+		f->max = elapsed;
+
+	b = (elapsed > 0) ? 64 - __builtin_clzll(elapsed) : 0;
+	f->hist[(b < AUTOPROF_BUCKETS) ? b : AUTOPROF_BUCKETS - 1]++;
+
+	if (t->depth > 0)
+		t->stack[t->depth - 1].child += elapsed;
+}
+
+
+/**
+ * Add a filter on function names (before the functions are first called)
+ * With include patterns, only the functions matching one of them are
+ * timed; functions matching an exclude pattern are never timed. Functions
+ * not timed are transparent: their time counts as self time of the caller.
+ * @param pattern Shell pattern (see fnmatch).
+ * @param include TRUE to include, FALSE to exclude.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_autoprof_filter(const char *pattern, int include)
+{
+	int ret = FALSE;
+
+	if (pattern == NULL)
+		return(FALSE);
+
+	pthread_mutex_lock(&lock);
+	if (npatterns < AUTOPROF_PATTERNS && (patterns[npatterns] = strdup(pattern)) != NULL) {
+		includes[npatterns++] = include;
+		ret = TRUE;
+	}
+	pthread_mutex_unlock(&lock);
+
+	return(ret);
+}
+
+
+/**
+ * Enable or disable timing (calls made while disabled are not counted)
+ * @param enable TRUE to enable, FALSE to disable.
+ */
+void meas_autoprof_enable(int enable)
+{
+	__atomic_store_n(&enabled, enable ? TRUE : FALSE, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Statistics of a function, merged over every thread (live or exited)
+ * Threads still running may be slightly behind.
+ * @param fn Address of the function.
+ * @param stats Statistics (times in nanoseconds).
+ * @return FALSE if the function was not timed, TRUE otherwise.
+ */
+int meas_autoprof_get(void *fn, meas_autoprof_func *stats)
+{
+	struct autoprof_func f;
+	double scale;
+
+	if (stats == NULL || merge(fn, &f) == FALSE)
+		return(FALSE);
+
+	scale = (double)(util_monotonic_ns() - ns0) / (double)(util_ticks() - tsc0);
+
+	stats->fn        = fn;
+	stats->calls     = f.calls;
+	stats->inclusive = (unsigned long long)(f.inclusive * scale);
+	stats->self      = (unsigned long long)(f.self * scale);
+	stats->max       = (unsigned long long)(f.max * scale);
+	return(TRUE);
+}
+
+
+/**
+ * Write the functions timed by every thread (live or exited), by
+ * decreasing self time (times in nanoseconds)
+ * @param fp Output file.
+ * @return int Number of functions written or -1 on error.
+ */
+int meas_autoprof_write(FILE *fp)
+{
+	struct autoprof_thread *t;
+	struct autoprof_func *all, *f;
+	unsigned long lost = 0;
+	unsigned int n = 0, cap = 0, i, j;
+	char name[AUTOPROF_SYMBOL];
+	double scale;
+
+	if (fp == NULL)
+		return(-1);
+
+	scale = (double)(util_monotonic_ns() - ns0) / (double)(util_ticks() - tsc0);
+
+	pthread_mutex_lock(&lock);
+	for (t = threads; t != NULL; t = t->next) {
+		cap += t->nfuncs;
+	}
+
+	if ((all = (struct autoprof_func*)calloc(cap + 1, sizeof(struct autoprof_func))) == NULL) {
+		pthread_mutex_unlock(&lock);
+		return(-1);
+	}
+
+	/* Merge the tables */
+	for (t = threads; t != NULL; t = t->next) {
+		lost += t->lost;
+		for (i = 0; i < AUTOPROF_FUNCS; i++) {
+			f = &t->funcs[i];
+			if (f->fn == NULL || f->excluded || f->calls == 0)
+				continue;
+
+			for (j = 0; j < n && all[j].fn != f->fn; j++);
+			if (j == n)
+				all[n++].fn = f->fn;
+
+			add_func(&all[j], f);
+		}
+	}
+
+	qsort(all, n, sizeof(struct autoprof_func), cmp_self);
+
+	fprintf(fp, "========================== FUNCTIONS ===========================\n");
+	fprintf(fp, " FUNCTION                             CALLS                     \n");
+	fprintf(fp, "================================================================\n");
+	for (i = 0; i < n; i++) {
+		f = &all[i];
+		fprintf(fp, " %-*.*s   %lu\n", MAX_NAME_SIZE, MAX_NAME_SIZE,
+				symbolize(f->fn, name, sizeof(name)), f->calls);
+		fprintf(fp, "   inclusive / self     : %.0f / %.0f\n", f->inclusive * scale, f->self * scale);
+		fprintf(fp, "   mean / max           : %.1f / %.0f\n",
+				(f->inclusive * scale) / f->calls, f->max * scale);
+		fprintf(fp, "   ~p50 / p99           : %.0f / %.0f\n",
+				util_hist_percentile(f->hist, AUTOPROF_BUCKETS, f->calls, f->max, 50) * scale,
+				util_hist_percentile(f->hist, AUTOPROF_BUCKETS, f->calls, f->max, 99) * scale);
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (lost > 0)
+		fprintf(fp, " %lu calls lost (function tables full)\n", lost);
+	fprintf(fp, "----------------------------------------------------------------\n");
+
+	free(all);
+	return(ferror(fp) ? -1 : (int)n);
+}
+
+
+/**
+ * Thread state of the calling thread (taken from the free tables or
+ * allocated on its first call; none once the thread is exiting)
+ * @return struct autoprof_thread* NULL on error or the state.
+ */
+static struct autoprof_thread *thread_init(void)
+{
+	struct autoprof_thread *t;
+
+	if (thread_exited)
+		return(NULL);
+
+	pthread_once(&key_once, key_init);
+
+	pthread_mutex_lock(&lock);
+	if ((t = free_threads) != NULL)
+		free_threads = t->next;
+	pthread_mutex_unlock(&lock);
+
+	if (t == NULL && (t = (struct autoprof_thread*)calloc(1, sizeof(struct autoprof_thread))) == NULL)
+		return(NULL);
+
+	t->tid = (int)syscall(SYS_gettid);
+
+	pthread_mutex_lock(&lock);
+	t->next = threads;
+	threads = t;
+	pthread_mutex_unlock(&lock);
+
+	pthread_setspecific(key, t);
+	thread_state = t;
+	return(t);
+}
+
+
+/**
+ * Fold the table of an exiting thread into the retired table and keep
+ * it for reuse (calls made by the thread after this are not timed)
+ * @param arg The table.
+ */
+static void thread_exit(void *arg)
+{
+	struct autoprof_thread *t = (struct autoprof_thread*)arg, **p;
+
+	thread_state  = NULL;
+	thread_exited = TRUE;
+
+	pthread_mutex_lock(&lock);
+	for (p = &threads; *p != NULL && *p != t; p = &(*p)->next);
+	if (*p != NULL)
+		*p = t->next;
+
+	add_table(&retired, t);
+
+	memset(t, 0, sizeof(struct autoprof_thread));
+	t->next = free_threads;
+	free_threads = t;
+	pthread_mutex_unlock(&lock);
+}
+
+
+/**
+ * Create the key running thread_exit at thread exit
+ */
+static void key_init(void)
+{
+	pthread_key_create(&key, thread_exit);
+}
+
+
+/**
+ * Find (or add) a function not in its home slot in the table of a thread
+ * @param t The thread.
+ * @param fn Address of the function.
+ * @return struct autoprof_func* NULL if the function is not timed or the table is full.
+ */
+static struct autoprof_func *lookup(struct autoprof_thread *t, void *fn)
+{
+	struct autoprof_func *f;
+	unsigned long i;
+
+	for (i = AUTOPROF_HOME(fn);; i++) {
+		f = &t->funcs[i & (AUTOPROF_FUNCS - 1)];
+		if (f->fn == fn)
+			return(f->excluded ? NULL : f);
+		if (f->fn == NULL)
+			break;
+	}
+
+	/* First call of the function in this thread */
+	if (t->nfuncs >= (AUTOPROF_FUNCS / 4) * 3) {
+		t->lost++;
+		return(NULL);
+	}
+
+	t->busy = TRUE;
+	f->excluded = (npatterns > 0 && filtered_out(fn));
+	t->busy = FALSE;
+
+	__atomic_store_n(&f->fn, fn, __ATOMIC_RELEASE);
+	t->nfuncs++;
+
+	return(f->excluded ? NULL : f);
+}
+
+
+/**
+ * Find (or add, unfiltered) a function in a table
+ * The caller holds the lock.
+ * @param t The table.
+ * @param fn Address of the function.
+ * @param add TRUE to add the function when not found.
+ * @return struct autoprof_func* NULL if not found or the table is full.
+ */
+static struct autoprof_func *find(struct autoprof_thread *t, void *fn, int add)
+{
+	struct autoprof_func *f;
+	unsigned long i;
+
+	for (i = AUTOPROF_HOME(fn);; i++) {
+		f = &t->funcs[i & (AUTOPROF_FUNCS - 1)];
+		if (f->fn == fn)
+			return(f);
+		if (f->fn == NULL)
+			break;
+	}
+
+	if (!add || t->nfuncs >= (AUTOPROF_FUNCS / 4) * 3)
+		return(NULL);
+
+	f->fn = fn;
+	t->nfuncs++;
+	return(f);
+}
+
+
+/**
+ * Add the functions of a thread table to another (functions not fitting
+ * count as lost calls)
+ * The caller holds the lock.
+ * @param dst Table updated.
+ * @param src Table added.
+ */
+static void add_table(struct autoprof_thread *dst, const struct autoprof_thread *src)
+{
+	const struct autoprof_func *s;
+	struct autoprof_func *d;
+	unsigned int i;
+
+	dst->lost += src->lost;
+	for (i = 0; i < AUTOPROF_FUNCS; i++) {
+		s = &src->funcs[i];
+		if (s->fn == NULL)
+			continue;
+
+		if ((d = find(dst, s->fn, TRUE)) == NULL) {
+			dst->lost += s->calls;
+			continue;
+		}
+		d->excluded = s->excluded;
+		add_func(d, s);
+	}
+}
+
+
+/**
+ * Apply the filters to a function
+ * @param fn Address of the function.
+ * @return TRUE if the function must not be timed.
+ */
+static int filtered_out(void *fn)
+{
+	char name[AUTOPROF_SYMBOL];
+	int has_include = FALSE, included = FALSE, excluded = FALSE;
+	unsigned int i;
+
+	pthread_mutex_lock(&lock);
+	symbolize(fn, name, sizeof(name));
+	for (i = 0; i < npatterns; i++) {
+		if (includes[i]) {
+			has_include = TRUE;
+			if (fnmatch(patterns[i], name, 0) == 0)
+				included = TRUE;
+		} else if (fnmatch(patterns[i], name, 0) == 0) {
+			excluded = TRUE;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return(excluded || (has_include && !included));
+}
+
+
+/**
+ * Name of a function (from the symbol table of its file)
+ * The caller holds the lock.
+ * @param fn Address of the function.
+ * @param buf Buffer of the name.
+ * @param size Size of the buffer.
+ * @return const char* The name (the address when unknown).
+ */
+static const char *symbolize(void *fn, char *buf, size_t size)
+{
+	unsigned long addr = (unsigned long)fn;
+	struct autoprof_map *m = NULL;
+	const char *name = NULL;
+	unsigned int i, pass;
+
+	/* Reload the mappings once for code loaded after the last load */
+	for (pass = 0; pass < 2 && m == NULL; pass++) {
+		if (pass > 0 || nmaps == 0)
+			load_maps();
+		for (i = 0; i < nmaps; i++) {
+			if (addr >= maps[i].start && addr < maps[i].end) {
+				m = &maps[i];
+				break;
+			}
+		}
+	}
+
+	if (m != NULL) {
+		if (!m->loaded) {
+			m->symtab = meas_symtab_load(m->path);
+			m->loaded = TRUE;
+		}
+		name = meas_symtab_lookup(m->symtab, addr - m->start + m->offset, NULL);
+	}
+
+	if (name != NULL)
+		snprintf(buf, size, "%s", name);
+	else
+		snprintf(buf, size, "0x%lx", addr);
+
+	return(buf);
+}
+
+
+/**
+ * Load the executable file mappings of the process (symbol tables
+ * already loaded are kept)
+ */
+static void load_maps(void)
+{
+	struct autoprof_map map;
+	char line[1024], perms[8];
+	unsigned int i;
+	FILE *fp;
+
+	if ((fp = fopen("/proc/self/maps", "r")) == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		memset(&map, 0, sizeof(map));
+		if (sscanf(line, "%lx-%lx %7s %lx %*s %*s %511s", &map.start, &map.end,
+					perms, &map.offset, map.path) != 5)
+			continue;
+		if (perms[2] != 'x' || map.path[0] != '/')
+			continue;
+
+		for (i = 0; i < nmaps && maps[i].start != map.start; i++);
+		if (i == nmaps && nmaps < AUTOPROF_MAPS)
+			maps[nmaps++] = map;
+	}
+	fclose(fp);
+}
+
+
+/**
+ * Add comma separated filter patterns
+ * @param list The patterns (may be NULL).
+ * @param include TRUE for include patterns.
+ */
+static void add_patterns(const char *list, int include)
+{
+	char *copy, *pattern, *save;
+
+	if (list == NULL || (copy = strdup(list)) == NULL)
+		return;
+
+	for (pattern = strtok_r(copy, ",", &save); pattern != NULL; pattern = strtok_r(NULL, ",", &save)) {
+		meas_autoprof_filter(pattern, include);
+	}
+	free(copy);
+}
+
+
+/**
+ * Merge the statistics of a function over every thread (live or exited)
+ * @param fn Address of the function.
+ * @param out Merged statistics.
+ * @return FALSE if no thread timed the function, TRUE otherwise.
+ */
+static int merge(void *fn, struct autoprof_func *out)
+{
+	struct autoprof_thread *t;
+	struct autoprof_func *f;
+
+	memset(out, 0, sizeof(struct autoprof_func));
+	pthread_mutex_lock(&lock);
+	for (t = threads; t != NULL; t = t->next) {
+		if ((f = find(t, fn, FALSE)) != NULL && !f->excluded)
+			add_func(out, f);
+	}
+	pthread_mutex_unlock(&lock);
+
+	out->fn = fn;
+	return(out->calls > 0);
+}
+
+
+/**
+ * Add the statistics of a function to another
+ * @param dst Statistics updated.
+ * @param src Statistics added.
+ */
+static void add_func(struct autoprof_func *dst, const struct autoprof_func *src)
+{
+	unsigned int b;
+
+	dst->calls     += src->calls;
+	dst->inclusive += src->inclusive;
+	dst->self      += src->self;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	for (b = 0; b < AUTOPROF_BUCKETS; b++) {
+		dst->hist[b] += src->hist[b];
+	}
+}
+
+
+/**
+ * Compare two functions by decreasing self time (for qsort)
+ */
+static int cmp_self(const void *a, const void *b)
+{
+	unsigned long long x = ((const struct autoprof_func*)a)->self;
+	unsigned long long y = ((const struct autoprof_func*)b)->self;
+
+	return((x < y) - (x > y));
+}
+
+
+/**
+ * Read the filters from the environment and the reference of the tick
+ * to nanosecond conversion
+ */
+static void autoprof_init(void)
+{
+	ns0  = util_monotonic_ns();
+	tsc0 = util_ticks();
+
+	add_patterns(getenv("MEAS_AUTOPROF_INCLUDE"), TRUE);
+	add_patterns(getenv("MEAS_AUTOPROF_EXCLUDE"), FALSE);
+}
+
+
+/**
+ * Write MEAS_AUTOPROF_OUTPUT (if set) at exit
+ */
+static void autoprof_fini(void)
+{
+	const char *path = getenv("MEAS_AUTOPROF_OUTPUT");
+	FILE *fp;
+
+	if (path == NULL)
+		return;
+
+	meas_autoprof_enable(FALSE);
+	if ((fp = fopen(path, "w")) != NULL) {
+		meas_autoprof_write(fp);
+		fclose(fp);
+	}
+}
@@ -0,0 +1,330 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Statistical micro-benchmarks
+ */
+#include <meas.h>
+#include <util.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Default warmup time (100ms without the getjiffies patch)
+ */
+#define BENCH_DEF_WARMUP 100000000UL
+
+/**
+ * Default duration of a sample batch (10ms without the getjiffies patch)
+ */
+#define BENCH_DEF_SAMPLE_TIME 10000000UL
+
+/**
+ * Default number of sample batches
+ */
+#define BENCH_DEF_NSAMPLES 30
+
+/**
+ * Default number of bootstrap resamples
+ */
+#define BENCH_DEF_NRESAMPLES 1000
+
+/**
+ * Default confidence level
+ */
+#define BENCH_DEF_CONFIDENCE 0.95
+
+/**
+ * Max. growth factor of the iteration count between two batches
+ */
+#define BENCH_MAX_GROWTH 10
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static unsigned long run_batch(meas_clock *clock, const char *name,
+							   meas_bench_fn fn, void *ctx, unsigned long iters);
+static unsigned long next_iterations(unsigned long iters, unsigned long elapsed,
+									 unsigned long target);
+static void compute_stats(meas_bench *bench, const meas_bench_opts *opts, double *work);
+static double quantile(double *sorted, unsigned int n, double q);
+
+
+/**
+ * Fill benchmark options with default values
+ * @param opts Options to fill.
+ */
+void meas_bench_defaults(meas_bench_opts *opts)
+{
+	if (opts == NULL)
+		return;
+
+	opts->warmup_time = BENCH_DEF_WARMUP;
+	opts->sample_time = BENCH_DEF_SAMPLE_TIME;
+	opts->nsamples    = BENCH_DEF_NSAMPLES;
+	opts->nresamples  = BENCH_DEF_NRESAMPLES;
+	opts->confidence  = BENCH_DEF_CONFIDENCE;
+}
+
+
+/**
+ * Benchmark a function.
+ * The function is called repeatedly during the warmup, while the number of
+ * iterations per batch is grown until a batch lasts at least sample_time.
+ * Then nsamples batches are timed (with a meas_clock) and the per-iteration
+ * statistics are computed: median, MAD (median absolute deviation), min,
+ * bootstrap confidence interval of the median and outliers (Tukey fences).
+ * @param mst The meas user structure.
+ * @param name A name to the benchmark (useful for report visualization).
+ * @param fn Function to benchmark.
+ * @param ctx Argument passed to fn.
+ * @param opts Options (NULL for defaults, see meas_bench_defaults).
+ * @return NULL on error or the benchmark result (freed by meas_close).
+ */
+meas_bench *meas_bench_run(meas_t **mst, const char *name, meas_bench_fn fn,
+						   void *ctx, const meas_bench_opts *opts)
+{
+	meas_t *umst;
+	meas_bench_opts dopts;
+	meas_bench *bench;
+	meas_clock clock;
+	unsigned long iters, elapsed, warm;
+	double *work;
+	unsigned int i;
+
+	if (mst == NULL || *mst == NULL || fn == NULL || name == NULL)
+		return(NULL);
+
+	umst = *mst;
+	if (opts == NULL) {
+		meas_bench_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	if (opts->nsamples == 0)
+		return(NULL);
+
+	_libmeas_rt_violation(umst);
+
+	/* Samples are stored right after the structure */
+	bench = (meas_bench*)malloc(sizeof(meas_bench) + (sizeof(double) * opts->nsamples));
+	if (bench == NULL)
+		return(NULL);
+
+	if ((work = (double*)malloc(sizeof(double) * opts->nsamples)) == NULL) {
+		free(bench);
+		return(NULL);
+	}
+
+	strncpy(bench->name, name, MAX_NAME_SIZE - 1);
+	bench->name[MAX_NAME_SIZE - 1] = '\0';
+	bench->samples  = (double*)(bench + 1);
+	bench->nsamples = opts->nsamples;
+
+	memset(&clock, 0, sizeof(meas_clock));
+
+	/* Warmup and choose the number of iterations per batch */
+	iters   = 1;
+	elapsed = 0;
+	warm    = 0;
+	while (warm < opts->warmup_time || elapsed < opts->sample_time) {
+		elapsed = run_batch(&clock, name, fn, ctx, iters);
+		warm   += elapsed;
+
+		if (elapsed < opts->sample_time) {
+			iters = next_iterations(iters, elapsed, opts->sample_time);
+		}
+	}
+	bench->iterations = iters;
+
+	/* Measurement */
+	for (i = 0; i < bench->nsamples; i++) {
+		elapsed = run_batch(&clock, name, fn, ctx, iters);
+		bench->samples[i] = (double)elapsed / (double)iters;
+	}
+
+	compute_stats(bench, opts, work);
+	free(work);
+
+	if (llist_add(&umst->benchmarks, bench) == FALSE) {
+		free(bench);
+		return(NULL);
+	}
+
+	return(bench);
+}
+
+
+/**
+ * Time a batch of calls
+ * @param clock Clock used for measurement.
+ * @param name Clock name.
+ * @param fn Function to call.
+ * @param ctx Argument passed to fn.
+ * @param iters Number of calls.
+ * @return unsigned long Duration of the batch (in ticks).
+ */
+static unsigned long run_batch(meas_clock *clock, const char *name,
+							   meas_bench_fn fn, void *ctx, unsigned long iters)
+{
+	unsigned long i;
+
+	meas_start_clock(NULL, clock, name);
+	for (i = 0; i < iters; i++) {
+		fn(ctx);
+	}
+	meas_stop_clock(clock);
+
+	return(clock->interv);
+}
+
+
+/**
+ * Predict the number of iterations needed to reach the target duration
+ * @param iters Current number of iterations.
+ * @param elapsed Duration of the last batch.
+ * @param target Target duration.
+ * @return unsigned long Next number of iterations.
+ */
+static unsigned long next_iterations(unsigned long iters, unsigned long elapsed,
+									 unsigned long target)
+{
+	double predicted;
+
+	if (elapsed == 0)
+		return(iters * BENCH_MAX_GROWTH);
+
+	/* Aim a little above the target to converge quickly */
+	predicted = ((double)iters * (double)target * 1.2) / (double)elapsed;
+
+	if (predicted > (double)(iters * BENCH_MAX_GROWTH)) {
+		return(iters * BENCH_MAX_GROWTH);
+	} else if (predicted <= (double)iters) {
+		return(iters + 1);
+	} else {
+		return((unsigned long)predicted);
+	}
+}
+
+
+/**
+ * Compute the statistics of a benchmark
+ * @param bench The benchmark (with samples filled).
+ * @param opts Benchmark options.
+ * @param work Work buffer with room for nsamples doubles.
+ */
+static void compute_stats(meas_bench *bench, const meas_bench_opts *opts, double *work)
+{
+	unsigned int i, r, n = bench->nsamples;
+	unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+	double *medians, q1, q3, iqr, sum, alpha;
+
+	/* Order statistics */
+	memcpy(work, bench->samples, sizeof(double) * n);
+	qsort(work, n, sizeof(double), util_cmp_double);
+
+	bench->min    = work[0];
+	bench->max    = work[n - 1];
+	bench->median = quantile(work, n, 0.5);
+	q1  = quantile(work, n, 0.25);
+	q3  = quantile(work, n, 0.75);
+	iqr = q3 - q1;
+
+	for (i = 0, sum = 0; i < n; i++) {
+		sum += work[i];
+	}
+	bench->mean = sum / n;
+
+	/* Outliers (Tukey fences) */
+	bench->outliers_low  = 0;
+	bench->outliers_high = 0;
+	for (i = 0; i < n; i++) {
+		if (work[i] < (q1 - (1.5 * iqr))) {
+			bench->outliers_low++;
+		} else if (work[i] > (q3 + (1.5 * iqr))) {
+			bench->outliers_high++;
+		}
+	}
+
+	/* Median absolute deviation */
+	for (i = 0; i < n; i++) {
+		work[i] = bench->samples[i] > bench->median ?
+					bench->samples[i] - bench->median :
+					bench->median - bench->samples[i];
+	}
+	qsort(work, n, sizeof(double), util_cmp_double);
+	bench->mad = quantile(work, n, 0.5);
+
+	/* Bootstrap confidence interval of the median */
+	bench->confidence = opts->confidence;
+	bench->ci_low     = bench->median;
+	bench->ci_high    = bench->median;
+
+	if (opts->nresamples == 0)
+		return;
+
+	if ((medians = (double*)malloc(sizeof(double) * opts->nresamples)) == NULL)
+		return;
+
+	for (r = 0; r < opts->nresamples; r++) {
+		for (i = 0; i < n; i++) {
+			work[i] = bench->samples[util_xorshift(&seed) % n];
+		}
+		qsort(work, n, sizeof(double), util_cmp_double);
+		medians[r] = quantile(work, n, 0.5);
+	}
+
+	qsort(medians, opts->nresamples, sizeof(double), util_cmp_double);
+	alpha = (1.0 - opts->confidence) / 2.0;
+	bench->ci_low  = quantile(medians, opts->nresamples, alpha);
+	bench->ci_high = quantile(medians, opts->nresamples, 1.0 - alpha);
+
+	free(medians);
+}
+
+
+/**
+ * Quantile of a sorted vector (linear interpolation)
+ * @param sorted Sorted vector.
+ * @param n Number of elements.
+ * @param q Quantile (0 to 1).
+ * @return double The quantile.
+ */
+static double quantile(double *sorted, unsigned int n, double q)
+{
+	double pos, frac;
+	unsigned int i;
+
+	if (n == 1)
+		return(sorted[0]);
+
+	pos  = q * (n - 1);
+	i    = (unsigned int)pos;
+	frac = pos - i;
+
+	if (i >= n - 1)
+		return(sorted[n - 1]);
+
+	return(sorted[i] + (frac * (sorted[i + 1] - sorted[i])));
+}
+
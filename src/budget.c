@@ -0,0 +1,549 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Time budgets of timers
+ *
+ * meas_stop_clock compares each interval with the budget of its timer. An
+ * overrun is counted and recorded in place; the user callback is not
+ * called there: a notification goes to a bounded lock-free queue that is
+ * drained outside the measured code (meas_budget_drain, or the watchdog
+ * thread). The watchdog thread also catches regions still running past
+ * their budget, so a hang is reported before the region ends (if ever).
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/**
+ * Capacity of the notification queue (power of two)
+ */
+#define WATCHDOG_QUEUE 256
+
+/**
+ * Queued notification
+ */
+struct budget_event {
+	unsigned long seq;			/* Queue position the slot is ready for */
+	meas_clock *clock;
+	meas_budget *budget;		/* Budget of the timer when queued */
+	int kind;
+	unsigned long interval;
+	unsigned long time;
+};
+
+/**
+ * Notification queue (bounded multi-producer, multi-consumer) and
+ * watchdog thread of a meas_t
+ */
+struct _meas_watchdog {
+	meas_t *mst;
+	unsigned long tail __attribute__ ((aligned (MEAS_CACHE_LINE)));	/* Next position to fill */
+	unsigned long head __attribute__ ((aligned (MEAS_CACHE_LINE)));	/* Next position to drain */
+	unsigned long dropped;		/* Notifications lost with a full queue */
+	meas_budget *retired;		/* Released budgets (newest first), reused or freed with the watchdog */
+	struct budget_event events[WATCHDOG_QUEUE];
+	unsigned long period;		/* Scan period (ms), 0 without thread */
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t worker;
+};
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+void _libmeas_budget_overrun(meas_clock *clock, meas_budget *b, unsigned long now);
+void _libmeas_watchdog_free(meas_t *mst);
+
+/**
+ * static functions
+ */
+static meas_watchdog *get_watchdog(meas_t *mst);
+static meas_budget *reuse_budget(meas_watchdog *wd);
+static void notify(meas_clock *clock, meas_budget *b, int kind, unsigned long interval,
+				   unsigned long time);
+static int enqueue(meas_watchdog *wd, meas_clock *clock, meas_budget *b, int kind,
+				   unsigned long interval, unsigned long time);
+static int dequeue(meas_watchdog *wd, struct budget_event *ev);
+static void scan_running(meas_watchdog *wd);
+static void *watchdog_worker(void *arg);
+
+
+/**
+ * Set the time budget of a timer
+ * The timer must not be running.
+ * @param mst The meas user structure.
+ * @param clock The timer.
+ * @param budget Budget (in ticks, see meas_get_ticks).
+ * @param min_gap Min. time between two notifications of this timer (in ticks, 0: no limit).
+ * @param fn Callback (NULL: overruns are only counted and recorded).
+ * @param ctx Argument passed to the callback.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_clock_budget(meas_t **mst, meas_clock *clock, unsigned long budget,
+					  unsigned long min_gap, meas_budget_fn fn, void *ctx)
+{
+	meas_budget *b;
+	meas_watchdog *wd;
+
+	if (mst == NULL || *mst == NULL || clock == NULL || clock->budget != NULL ||
+			clock->state == TIMER_ST_RUNNING || budget == 0)
+		return(FALSE);
+
+	_libmeas_rt_violation(*mst);
+
+	if ((wd = get_watchdog(*mst)) == NULL)
+		return(FALSE);
+
+	if ((b = reuse_budget(wd)) != NULL)
+		memset(b, 0, sizeof(meas_budget));
+	else if ((b = (meas_budget*)calloc(1, sizeof(meas_budget))) == NULL)
+		return(FALSE);
+
+	b->budget   = budget;
+	b->min_gap  = min_gap;
+	b->fn       = fn;
+	b->ctx      = ctx;
+	b->watchdog = wd;
+
+	__atomic_store_n(&clock->budget, b, __ATOMIC_RELEASE);
+	return(TRUE);
+}
+
+
+/**
+ * Remove the time budget of a timer (pending notifications of the timer
+ * are discarded by the next drain). A running stop, the watchdog or a
+ * drain may still read the budget: it is retired, never freed before
+ * meas_close, and only reused (oldest first) by meas_clock_budget, so
+ * memory stays bounded by the budgets set at the same time.
+ * @param clock The timer.
+ */
+void meas_clock_release_budget(meas_clock *clock)
+{
+	meas_budget *b;
+	meas_watchdog *wd;
+
+	if (clock == NULL)
+		return;
+
+	if ((b = __atomic_exchange_n(&clock->budget, NULL, __ATOMIC_ACQ_REL)) == NULL)
+		return;
+
+	wd = b->watchdog;
+	do {
+		b->next = __atomic_load_n(&wd->retired, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&wd->retired, &b->next, b, TRUE,
+										  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Call the callbacks of the pending notifications
+ * Safe to call from any thread, concurrently with the watchdog.
+ * @param mst The meas user structure.
+ * @return int Number of notifications delivered.
+ */
+int meas_budget_drain(meas_t **mst)
+{
+	struct budget_event ev;
+	meas_budget *b;
+	int n = 0;
+
+	if (mst == NULL || *mst == NULL || (*mst)->watchdog == NULL)
+		return(0);
+
+	while (dequeue((*mst)->watchdog, &ev)) {
+		/* Notifications of a released budget are discarded */
+		b = __atomic_load_n(&ev.clock->budget, __ATOMIC_ACQUIRE);
+		if (b != NULL && b == ev.budget && b->fn != NULL) {
+			b->fn(ev.clock, ev.kind, ev.interval, ev.time, b->ctx);
+			n++;
+		}
+	}
+
+	return(n);
+}
+
+
+/**
+ * Number of notifications lost because the queue was full
+ * @param mst The meas user structure.
+ * @return unsigned long Lost notifications.
+ */
+unsigned long meas_budget_dropped(meas_t **mst)
+{
+	if (mst == NULL || *mst == NULL || (*mst)->watchdog == NULL)
+		return(0);
+
+	return(__atomic_load_n(&(*mst)->watchdog->dropped, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Start the watchdog thread: every period, it looks for timers running
+ * past their budget and drains the notifications
+ * @param mst The meas user structure.
+ * @param period Scan period in milliseconds.
+ * @return FALSE on error (or already started), TRUE otherwise.
+ */
+int meas_watchdog_start(meas_t **mst, unsigned long period)
+{
+	meas_watchdog *wd;
+
+	if (mst == NULL || *mst == NULL || period == 0)
+		return(FALSE);
+
+	if ((wd = get_watchdog(*mst)) == NULL || wd->period > 0)
+		return(FALSE);
+
+	wd->stop   = FALSE;
+	wd->period = period;
+	pthread_mutex_init(&wd->lock, NULL);
+	pthread_cond_init(&wd->cond, NULL);
+	if (pthread_create(&wd->worker, NULL, watchdog_worker, wd) != 0) {
+		pthread_cond_destroy(&wd->cond);
+		pthread_mutex_destroy(&wd->lock);
+		wd->period = 0;
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Stop the watchdog thread
+ * @param mst The meas user structure.
+ */
+void meas_watchdog_stop(meas_t **mst)
+{
+	meas_watchdog *wd;
+
+	if (mst == NULL || *mst == NULL || (*mst)->watchdog == NULL)
+		return;
+
+	wd = (*mst)->watchdog;
+	if (wd->period == 0)
+		return;
+
+	pthread_mutex_lock(&wd->lock);
+	wd->stop = TRUE;
+	pthread_cond_signal(&wd->cond);
+	pthread_mutex_unlock(&wd->lock);
+	pthread_join(wd->worker, NULL);
+	pthread_cond_destroy(&wd->cond);
+	pthread_mutex_destroy(&wd->lock);
+	wd->period = 0;
+}
+
+
+/**
+ * Record an interval over the budget of its timer (see meas_stop_clock)
+ * @param clock The timer.
+ * @param b Budget of the timer, loaded once by the caller.
+ * @param now End of the interval.
+ */
+void _libmeas_budget_overrun(meas_clock *clock, meas_budget *b, unsigned long now)
+{
+	meas_overrun *o;
+	unsigned long n;
+
+	n = __atomic_fetch_add(&b->overruns, 1, __ATOMIC_RELAXED);
+	o = &b->history[n % MEAS_BUDGET_HISTORY];
+	o->interval = clock->interv;
+	o->time     = now;
+
+	if (clock->interv > b->worst)
+		b->worst = clock->interv;
+
+	notify(clock, b, MEAS_BUDGET_OVERRUN, clock->interv, now);
+}
+
+
+/**
+ * Stop the watchdog and release the queue and the budgets of the timers,
+ * current and retired (see meas_close)
+ * @param mst The meas user structure.
+ */
+void _libmeas_watchdog_free(meas_t *mst)
+{
+	meas_budget *b, *next;
+	llist *tmp;
+
+	meas_watchdog_stop(&mst);
+
+	foreach(mst->timers, tmp) {
+		meas_clock_release_budget((meas_clock*)tmp->element);
+	}
+
+	for (b = mst->watchdog->retired; b != NULL; b = next) {
+		next = b->next;
+		free(b);
+	}
+
+	free(mst->watchdog);
+	mst->watchdog = NULL;
+}
+
+
+/**
+ * Return the notification queue of a meas_t (created on first use)
+ * @param mst The meas user structure.
+ * @return meas_watchdog* NULL on error or the queue.
+ */
+static meas_watchdog *get_watchdog(meas_t *mst)
+{
+	meas_watchdog *wd;
+	unsigned long i;
+
+	if (mst->watchdog != NULL)
+		return(mst->watchdog);
+
+	if (posix_memalign((void**)&wd, MEAS_CACHE_LINE, sizeof(meas_watchdog)) != 0)
+		return(NULL);
+
+	memset(wd, 0, sizeof(meas_watchdog));
+	wd->mst = mst;
+	for (i = 0; i < WATCHDOG_QUEUE; i++) {
+		wd->events[i].seq = i;
+	}
+
+	mst->watchdog = wd;
+	return(wd);
+}
+
+
+/**
+ * Take the oldest retired budget of a watchdog
+ * The list is detached at once (no ABA with concurrent callers) and the
+ * newer budgets are pushed back.
+ * @param wd The watchdog.
+ * @return meas_budget* NULL if none or the budget.
+ */
+static meas_budget *reuse_budget(meas_watchdog *wd)
+{
+	meas_budget *list, *b, **p;
+
+	if ((list = __atomic_exchange_n(&wd->retired, NULL, __ATOMIC_ACQUIRE)) == NULL)
+		return(NULL);
+
+	for (p = &list; (*p)->next != NULL; p = &(*p)->next);
+	b  = *p;
+	*p = NULL;
+
+	if (list != NULL) {
+		for (p = &list; *p != NULL; p = &(*p)->next);
+		do {
+			*p = __atomic_load_n(&wd->retired, __ATOMIC_RELAXED);
+		} while (!__atomic_compare_exchange_n(&wd->retired, p, list, TRUE,
+											  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	return(b);
+}
+
+
+/**
+ * Queue a notification, unless the rate limit of the timer skips it
+ * @param clock The timer.
+ * @param b Budget of the timer.
+ * @param kind MEAS_BUDGET_OVERRUN or MEAS_BUDGET_RUNNING.
+ * @param interval Interval (or elapsed time of a running region).
+ * @param time When it was seen (ticks).
+ */
+static void notify(meas_clock *clock, meas_budget *b, int kind, unsigned long interval,
+				   unsigned long time)
+{
+	unsigned long last;
+
+	if (b->fn == NULL)
+		return;
+
+	/* Rate limit: the thread moving last_notify forward notifies */
+	if (b->min_gap > 0) {
+		last = __atomic_load_n(&b->last_notify, __ATOMIC_RELAXED);
+		if ((last != 0 && time - last < b->min_gap) ||
+				!__atomic_compare_exchange_n(&b->last_notify, &last, time, FALSE,
+											 __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			__atomic_add_fetch(&b->suppressed, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	enqueue(b->watchdog, clock, b, kind, interval, time);
+}
+
+
+/**
+ * Add a notification to the queue (never blocks)
+ * @param wd The queue.
+ * @param clock The timer.
+ * @param b Budget of the timer.
+ * @param kind Notification kind.
+ * @param interval Interval.
+ * @param time Time.
+ * @return FALSE if the queue is full, TRUE otherwise.
+ */
+static int enqueue(meas_watchdog *wd, meas_clock *clock, meas_budget *b, int kind,
+				   unsigned long interval, unsigned long time)
+{
+	struct budget_event *ev;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = __atomic_load_n(&wd->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		ev   = &wd->events[pos & (WATCHDOG_QUEUE - 1)];
+		seq  = __atomic_load_n(&ev->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - pos);
+
+		if (diff == 0) {
+			/* Slot free: claim the position */
+			if (__atomic_compare_exchange_n(&wd->tail, &pos, pos + 1, TRUE,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Slot not drained yet: full */
+			__atomic_add_fetch(&wd->dropped, 1, __ATOMIC_RELAXED);
+			return(FALSE);
+		} else {
+			pos = __atomic_load_n(&wd->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	ev->clock    = clock;
+	ev->budget   = b;
+	ev->kind     = kind;
+	ev->interval = interval;
+	ev->time     = time;
+	__atomic_store_n(&ev->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return(TRUE);
+}
+
+
+/**
+ * Take the oldest notification of the queue
+ * @param wd The queue.
+ * @param ev The notification.
+ * @return FALSE if the queue is empty, TRUE otherwise.
+ */
+static int dequeue(meas_watchdog *wd, struct budget_event *ev)
+{
+	struct budget_event *slot;
+	unsigned long pos, seq;
+	long diff;
+
+	pos = __atomic_load_n(&wd->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &wd->events[pos & (WATCHDOG_QUEUE - 1)];
+		seq  = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long)(seq - (pos + 1));
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&wd->head, &pos, pos + 1, TRUE,
+											__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			return(FALSE);
+		} else {
+			pos = __atomic_load_n(&wd->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	memcpy(ev, slot, sizeof(struct budget_event));
+	__atomic_store_n(&slot->seq, pos + WATCHDOG_QUEUE, __ATOMIC_RELEASE);
+
+	return(TRUE);
+}
+
+
+/**
+ * Look for timers running past their budget (each activation is
+ * reported once)
+ * @param wd The watchdog.
+ */
+static void scan_running(meas_watchdog *wd)
+{
+	meas_clock *clock;
+	meas_budget *b;
+	unsigned long now, start, end;
+	llist *tmp;
+
+	now = meas_get_ticks();
+	foreach(wd->mst->timers, tmp) {
+		clock = (meas_clock*)tmp->element;
+		b = __atomic_load_n(&clock->budget, __ATOMIC_ACQUIRE);
+		if (b == NULL || __atomic_load_n(&clock->state, __ATOMIC_ACQUIRE) != TIMER_ST_RUNNING)
+			continue;
+
+		/* A start time not after the last end time is the one of a finished activation */
+		start = __atomic_load_n(&clock->start_time, __ATOMIC_RELAXED);
+		end   = __atomic_load_n(&clock->end_time, __ATOMIC_RELAXED);
+		if (start <= end || now <= start || now - start <= b->budget || b->watched == start)
+			continue;
+
+		b->watched = start;
+		__atomic_add_fetch(&b->running, 1, __ATOMIC_RELAXED);
+		notify(clock, b, MEAS_BUDGET_RUNNING, now - start, now);
+	}
+}
+
+
+/**
+ * Watchdog thread
+ * @param arg The watchdog.
+ */
+static void *watchdog_worker(void *arg)
+{
+	meas_watchdog *wd = (meas_watchdog*)arg;
+	struct timespec next;
+
+	clock_gettime(CLOCK_REALTIME, &next);
+
+	pthread_mutex_lock(&wd->lock);
+	while (!wd->stop) {
+		next.tv_sec  += wd->period / 1000;
+		next.tv_nsec += (wd->period % 1000) * 1000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+
+		while (!wd->stop &&
+				pthread_cond_timedwait(&wd->cond, &wd->lock, &next) != ETIMEDOUT);
+
+		if (!wd->stop) {
+			pthread_mutex_unlock(&wd->lock);
+			scan_running(wd);
+			meas_budget_drain(&wd->mst);
+			pthread_mutex_lock(&wd->lock);
+		}
+	}
+	pthread_mutex_unlock(&wd->lock);
+
+	return(NULL);
+}
+
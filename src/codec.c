@@ -0,0 +1,421 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Trace compression: Gorilla-style blocks of (timestamp, name, value)
+ *
+ * Block: magic, varint payload length, varint number of events, varint
+ * timestamp of the first event, then for each event:
+ *   varint tag (name id * 2, + 1 when the name is defined here, followed
+ *          by its length and bytes: each block carries its dictionary),
+ *   zigzag varint delta-of-delta of the timestamp,
+ *   zigzag varint delta of the value from the previous one of that name.
+ * Periodic timestamps and steady values take one byte each. Blocks are
+ * self-contained: decoding can start at any block. Byte-aligned varints
+ * (instead of Gorilla bit packing) keep encoding at a few ns per event.
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Block magic
+ */
+#define CODEC_MAGIC0 0x4d
+#define CODEC_MAGIC1 0xb1
+
+/**
+ * Largest encoded event: tag, name definition and two 64-bit varints
+ */
+#define CODEC_MAX_EVENT (2 + 1 + MAX_NAME_SIZE + 10 + 10)
+
+/**
+ * Largest block header
+ */
+#define CODEC_MAX_HEADER (2 + 10 + 5 + 10)
+
+/**
+ * static functions
+ */
+static inline unsigned char *put_varint(unsigned char *p, unsigned long long v);
+static inline const unsigned char *get_varint(const unsigned char *p, const unsigned char *end,
+											  unsigned long long *v);
+static inline unsigned long long zigzag(long long v);
+static inline long long unzigzag(unsigned long long v);
+
+
+/**
+ * Initialize a trace encoder
+ * @param enc The encoder.
+ * @param block_events Events per block (0 for MEAS_CODEC_BLOCK_EVENTS).
+ * @param sink Function storing the blocks (e.g. meas_codec_file_sink).
+ * @param ctx Argument passed to sink.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_codec_init(meas_codec *enc, unsigned int block_events, meas_codec_sink sink, void *ctx)
+{
+	if (enc == NULL || sink == NULL)
+		return(FALSE);
+
+	memset(enc, 0, sizeof(meas_codec));
+	enc->block_events = (block_events > 0) ? block_events : MEAS_CODEC_BLOCK_EVENTS;
+	enc->sink = sink;
+	enc->ctx  = ctx;
+
+	/* Room for the header in front of the events */
+	if ((enc->block = (unsigned char*)malloc(CODEC_MAX_HEADER +
+							(unsigned long)enc->block_events * CODEC_MAX_EVENT)) == NULL)
+		return(FALSE);
+
+	return(TRUE);
+}
+
+
+/**
+ * Register a name in an encoder
+ * @param enc The encoder.
+ * @param name The name (e.g. of a timer).
+ * @return int Id to pass to meas_codec_put (-1 when the dictionary is full).
+ */
+int meas_codec_name(meas_codec *enc, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < enc->nnames; i++) {
+		if (strncmp(enc->names[i], name, MAX_NAME_SIZE - 1) == 0)
+			return((int)i);
+	}
+
+	if (enc->nnames == MEAS_CODEC_NAMES)
+		return(-1);
+
+	strncpy(enc->names[enc->nnames], name, MAX_NAME_SIZE - 1);
+	enc->names[enc->nnames][MAX_NAME_SIZE - 1] = '\0';
+	return((int)enc->nnames++);
+}
+
+
+/**
+ * Encode an event
+ * @param enc The encoder.
+ * @param id Name id (see meas_codec_name).
+ * @param ts Timestamp (e.g. meas_get_ticks).
+ * @param value Value (e.g. an interval).
+ * @return FALSE on error (or if a full block was refused by the sink), TRUE otherwise.
+ */
+int meas_codec_put(meas_codec *enc, int id, unsigned long long ts, long value)
+{
+	unsigned char *p;
+	long long delta;
+	size_t len;
+
+	if (id < 0 || (unsigned int)id >= enc->nnames)
+		return(FALSE);
+
+	if (enc->nevents == 0) {
+		enc->base       = ts;
+		enc->prev_ts    = ts;
+		enc->prev_delta = 0;
+		memset(enc->defined, 0, sizeof(enc->defined));
+		memset(enc->prev_value, 0, sizeof(enc->prev_value));
+	}
+
+	p = enc->block + CODEC_MAX_HEADER + enc->used;
+	if (enc->defined[id]) {
+		p = put_varint(p, (unsigned long long)id << 1);
+	} else {
+		p = put_varint(p, ((unsigned long long)id << 1) | 1);
+		len = strlen(enc->names[id]);
+		*p++ = (unsigned char)len;
+		memcpy(p, enc->names[id], len);
+		p += len;
+		enc->defined[id] = 1;
+	}
+
+	delta = (long long)(ts - enc->prev_ts);
+	p = put_varint(p, zigzag(delta - enc->prev_delta));
+	p = put_varint(p, zigzag((long long)((unsigned long)value - (unsigned long)enc->prev_value[id])));
+
+	enc->prev_ts        = ts;
+	enc->prev_delta     = delta;
+	enc->prev_value[id] = value;
+	enc->used = (unsigned long)(p - (enc->block + CODEC_MAX_HEADER));
+	enc->in_events++;
+
+	if (++enc->nevents == enc->block_events)
+		return(meas_codec_flush(enc));
+
+	return(TRUE);
+}
+
+
+/**
+ * Store the current block (if not empty)
+ * @param enc The encoder.
+ * @return FALSE if the sink refused the block, TRUE otherwise.
+ */
+int meas_codec_flush(meas_codec *enc)
+{
+	unsigned char header[CODEC_MAX_HEADER], *p, *start;
+	unsigned long hlen;
+	int ret;
+
+	if (enc->nevents == 0)
+		return(TRUE);
+
+	p = header;
+	*p++ = CODEC_MAGIC0;
+	*p++ = CODEC_MAGIC1;
+	p = put_varint(p, enc->used);
+	p = put_varint(p, enc->nevents);
+	p = put_varint(p, enc->base);
+	hlen = (unsigned long)(p - header);
+
+	/* Header right before the events: one call to the sink */
+	start = enc->block + CODEC_MAX_HEADER - hlen;
+	memcpy(start, header, hlen);
+
+	if ((ret = enc->sink(start, hlen + enc->used, enc->ctx)) == TRUE) {
+		enc->blocks++;
+		enc->out_bytes += hlen + enc->used;
+	} else {
+		enc->dropped++;
+	}
+
+	enc->nevents = 0;
+	enc->used    = 0;
+	return(ret);
+}
+
+
+/**
+ * Store the last block and release an encoder
+ * @param enc The encoder.
+ */
+void meas_codec_free(meas_codec *enc)
+{
+	if (enc != NULL && enc->block != NULL) {
+		meas_codec_flush(enc);
+		free(enc->block);
+		enc->block = NULL;
+	}
+}
+
+
+/**
+ * Decode blocks written by an encoder
+ * @param buf Encoded blocks.
+ * @param len Length of buf.
+ * @param fn Function called for each event (NULL to only check the data).
+ * @param ctx Argument passed to fn.
+ * @return long Number of events decoded (-1 if the data is corrupted).
+ */
+long meas_codec_decode(const void *buf, unsigned long len, meas_codec_fn fn, void *ctx)
+{
+	const unsigned char *p = (const unsigned char*)buf, *end = p + len, *bend;
+	char names[MEAS_CODEC_NAMES][MAX_NAME_SIZE];
+	unsigned char defined[MEAS_CODEC_NAMES];
+	long prev_value[MEAS_CODEC_NAMES];
+	unsigned long long blen, nevents, ts, v, id, i;
+	long long delta;
+	long n = 0;
+
+	while (p < end) {
+		if (end - p < 2 || p[0] != CODEC_MAGIC0 || p[1] != CODEC_MAGIC1)
+			return(-1);
+		p += 2;
+
+		if ((p = get_varint(p, end, &blen)) == NULL || (p = get_varint(p, end, &nevents)) == NULL ||
+				(p = get_varint(p, end, &ts)) == NULL || blen > (unsigned long long)(end - p))
+			return(-1);
+
+		bend  = p + blen;
+		delta = 0;
+		memset(defined, 0, sizeof(defined));
+		memset(prev_value, 0, sizeof(prev_value));
+
+		for (i = 0; i < nevents; i++) {
+			if ((p = get_varint(p, bend, &id)) == NULL)
+				return(-1);
+
+			if (id & 1) {
+				id >>= 1;
+				if (id >= MEAS_CODEC_NAMES || p >= bend || *p >= MAX_NAME_SIZE ||
+						*p > bend - p - 1)
+					return(-1);
+				memcpy(names[id], p + 1, *p);
+				names[id][*p] = '\0';
+				defined[id] = 1;
+				p += *p + 1;
+			} else {
+				id >>= 1;
+				if (id >= MEAS_CODEC_NAMES || !defined[id])
+					return(-1);
+			}
+
+			if ((p = get_varint(p, bend, &v)) == NULL)
+				return(-1);
+			delta += unzigzag(v);
+			ts    += (unsigned long long)delta;
+
+			if ((p = get_varint(p, bend, &v)) == NULL)
+				return(-1);
+			prev_value[id] = (long)((unsigned long)prev_value[id] + (unsigned long)unzigzag(v));
+
+			n++;
+			if (fn != NULL && fn(ts, names[id], prev_value[id], ctx) == FALSE)
+				return(n);
+		}
+
+		if (p != bend)
+			return(-1);
+	}
+
+	return(n);
+}
+
+
+/**
+ * Encoder sink appending blocks to a stream
+ * @param buf Block.
+ * @param len Length of the block.
+ * @param ctx The stream (FILE*).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_codec_file_sink(const void *buf, unsigned long len, void *ctx)
+{
+	return(fwrite(buf, 1, len, (FILE*)ctx) == len ? TRUE : FALSE);
+}
+
+
+/**
+ * Encoder sink appending blocks to a memory region (meas_codec_mem);
+ * blocks that do not fit are refused.
+ * @param buf Block.
+ * @param len Length of the block.
+ * @param ctx The region (meas_codec_mem*).
+ * @return FALSE if the block does not fit, TRUE otherwise.
+ */
+int meas_codec_mem_sink(const void *buf, unsigned long len, void *ctx)
+{
+	meas_codec_mem *mem = (meas_codec_mem*)ctx;
+
+	if (len > mem->size - mem->used)
+		return(FALSE);
+
+	memcpy(mem->base + mem->used, buf, len);
+	mem->used += len;
+	return(TRUE);
+}
+
+
+/**
+ * Encode the captured samples of a timer (see meas_clock_capture); the
+ * timestamp of each sample is its index.
+ * @param clock The timer.
+ * @param enc The encoder.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_samples_encode(meas_clock *clock, meas_codec *enc)
+{
+	unsigned long i;
+	int id, ret = TRUE;
+
+	if (clock == NULL || clock->samples == NULL || enc == NULL)
+		return(FALSE);
+
+	if ((id = meas_codec_name(enc, clock->name)) < 0)
+		return(FALSE);
+
+	for (i = 0; i < clock->samples->n; i++) {
+		if (meas_codec_put(enc, id, i, (long)clock->samples->values[i]) == FALSE)
+			ret = FALSE;
+	}
+
+	return(ret);
+}
+
+
+/**
+ * Write a varint (7 bits per byte, low bits first)
+ * @param p Output.
+ * @param v Value.
+ * @return End of the varint.
+ */
+static inline unsigned char *put_varint(unsigned char *p, unsigned long long v)
+{
+	while (v >= 0x80) {
+		*p++ = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (unsigned char)v;
+	return(p);
+}
+
+
+/**
+ * Read a varint
+ * @param p Input.
+ * @param end End of the input.
+ * @param v Returned value.
+ * @return End of the varint (NULL if truncated or too long).
+ */
+static inline const unsigned char *get_varint(const unsigned char *p, const unsigned char *end,
+											  unsigned long long *v)
+{
+	unsigned long long r = 0;
+	unsigned int shift = 0;
+
+	while (p < end && shift < 64) {
+		r |= (unsigned long long)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80)) {
+			*v = r;
+			return(p);
+		}
+		shift += 7;
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * Map signed to unsigned values (small magnitudes stay small)
+ * @param v Value.
+ * @return Zigzag value.
+ */
+static inline unsigned long long zigzag(long long v)
+{
+	return(((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63));
+}
+
+
+/**
+ * Inverse of zigzag
+ * @param v Zigzag value.
+ * @return Value.
+ */
+static inline long long unzigzag(unsigned long long v)
+{
+	return((long long)(v >> 1) ^ -(long long)(v & 1));
+}
+
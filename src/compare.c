@@ -0,0 +1,666 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Saved runs and baseline comparison
+ *
+ * A saved run is a text file:
+ *   libmeas-run 1
+ *   <kind> <name> <nsamples> <sample> <sample> ...
+ * where kind is "timer", "counter" or "bench". Whitespace inside names is
+ * written as '_'. Timers without captured samples are saved as
+ *   timersum <name> 4 <count> <total> <min> <max>
+ * (skipped by readers that do not know the kind).
+ */
+#include <meas.h>
+#include <util.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+extern void _libmeas_read_timer(meas_clock *clock, meas_interval *value);
+
+/**
+ * First word of a saved run
+ */
+#define RUN_MAGIC "libmeas-run"
+
+/**
+ * Saved run format version
+ */
+#define RUN_VERSION 1
+
+/**
+ * Default significance level
+ */
+#define CMP_DEF_ALPHA 0.01
+
+/**
+ * Default min. number of samples of each side
+ */
+#define CMP_DEF_MIN_SAMPLES 5
+
+/**
+ * Default number of bootstrap resamples
+ */
+#define CMP_DEF_NRESAMPLES 2000
+
+/**
+ * Ranked sample (Mann-Whitney U test)
+ */
+struct ranked {
+	double value;
+	int base;
+};
+
+/**
+ * static functions
+ */
+static void write_metric(FILE *fp, const char *kind, const char *name,
+						 unsigned int n, const double *samples);
+static void write_samples(FILE *fp, meas_clock *clock);
+static void write_header(FILE *fp, const char *kind, const char *name, unsigned int n);
+static int kind_from_name(const char *kind, int *summary);
+static meas_run_metric **sorted_metrics(meas_run *run, unsigned int *n);
+static int cmp_metric(const void *a, const void *b);
+static double *sorted_copy(const meas_run_metric *m);
+static double median(const double *sorted, unsigned int n);
+static double center(const meas_run_metric *m, const double *sorted, int mean, unsigned int *n);
+static double mann_whitney(const double *a, unsigned int na, const double *b, unsigned int nb);
+static double bootstrap(const double *a, unsigned int na, const double *b, unsigned int nb,
+						unsigned int nresamples);
+static int cmp_ranked(const void *a, const void *b);
+
+
+/**
+ * Save the measurements of a meas structure (timers, counters and
+ * benchmark samples) to be compared later (see meas_compare_runs).
+ * Timers with captured samples (see meas_clock_capture) save all of them;
+ * other timers save the count, total, min. and max. of their intervals,
+ * which are compared by mean but can not be tested for significance.
+ * @param mst The meas user structure.
+ * @param fp Output stream.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_save_run(meas_t *mst, FILE *fp)
+{
+	meas_clock *clock;
+	meas_counter *counter;
+	meas_bench *bench;
+	meas_interval acc;
+	llist *tmp;
+	double value, sum[4];
+
+	if (mst == NULL || fp == NULL)
+		return(FALSE);
+
+	fprintf(fp, "%s %d\n", RUN_MAGIC, RUN_VERSION);
+
+	foreach(mst->timers, tmp) {
+		clock = (meas_clock*)tmp->element;
+		if (clock->samples != NULL && clock->samples->n > 0) {
+			write_samples(fp, clock);
+			continue;
+		}
+
+		_libmeas_read_timer(clock, &acc);
+		if (acc.count > 0) {
+			sum[0] = (double)acc.count;
+			sum[1] = (double)(unsigned long)acc.value;
+			sum[2] = (double)acc.min;
+			sum[3] = (double)acc.max;
+			write_metric(fp, "timersum", clock->name, 4, sum);
+		} else {
+			value = (double)clock->interv;
+			write_metric(fp, "timer", clock->name, 1, &value);
+		}
+	}
+
+	foreach(mst->counters, tmp) {
+		counter = (meas_counter*)tmp->element;
+		value = (double)counter->value;
+		write_metric(fp, "counter", counter->name, 1, &value);
+	}
+
+	foreach(mst->benchmarks, tmp) {
+		bench = (meas_bench*)tmp->element;
+		write_metric(fp, "bench", bench->name, bench->nsamples, bench->samples);
+	}
+
+	return(ferror(fp) ? FALSE : TRUE);
+}
+
+
+/**
+ * Load a saved run
+ * @param fp Input stream.
+ * @return NULL on error or the run (free with meas_free_run).
+ */
+meas_run *meas_load_run(FILE *fp)
+{
+	meas_run *run;
+	meas_run_metric *metric;
+	char word[16], name[MAX_NAME_SIZE];
+	unsigned int n, i;
+	int version, kind, summary;
+	double skip;
+
+	if (fp == NULL)
+		return(NULL);
+
+	if (fscanf(fp, "%15s %d", word, &version) != 2 ||
+			strcmp(word, RUN_MAGIC) != 0 || version != RUN_VERSION)
+		return(NULL);
+
+	if ((run = (meas_run*)malloc(sizeof(meas_run))) == NULL)
+		return(NULL);
+
+	llist_create(&run->metrics);
+	run->metrics_tail = NULL;
+
+	while (fscanf(fp, "%15s %34s %u", word, name, &n) == 3) {
+		/* Unknown kinds (newer versions) are skipped */
+		if ((kind = kind_from_name(word, &summary)) == 0) {
+			for (i = 0; i < n; i++) {
+				if (fscanf(fp, "%lf", &skip) != 1)
+					break;
+			}
+			continue;
+		}
+
+		metric = (meas_run_metric*)malloc(sizeof(meas_run_metric) + (sizeof(double) * n));
+		if (metric == NULL)
+			break;
+
+		strcpy(metric->name, name);
+		metric->kind     = kind;
+		metric->summary  = summary;
+		metric->nsamples = n;
+		metric->samples  = (double*)(metric + 1);
+
+		for (i = 0; i < n; i++) {
+			if (fscanf(fp, "%lf", &metric->samples[i]) != 1)
+				break;
+		}
+		metric->nsamples = i;
+
+		/* Truncated summary: unusable */
+		if (summary && i < 4)
+			metric->nsamples = 0;
+
+		if (llist_add_tail(&run->metrics, &run->metrics_tail, metric) == FALSE) {
+			free(metric);
+			break;
+		}
+	}
+
+	return(run);
+}
+
+
+/**
+ * Free a saved run
+ * @param run The run.
+ */
+void meas_free_run(meas_run **run)
+{
+	if (run == NULL || *run == NULL)
+		return;
+
+	llist_destroy(&(*run)->metrics);
+	free(*run);
+	*run = NULL;
+}
+
+
+/**
+ * Fill comparison options with default values
+ * @param opts Options to fill.
+ */
+void meas_cmp_defaults(meas_cmp_opts *opts)
+{
+	if (opts == NULL)
+		return;
+
+	opts->method      = MEAS_CMP_MANN_WHITNEY;
+	opts->alpha       = CMP_DEF_ALPHA;
+	opts->min_samples = CMP_DEF_MIN_SAMPLES;
+	opts->nresamples  = CMP_DEF_NRESAMPLES;
+}
+
+
+/**
+ * Compare a run against a baseline.
+ * Metrics are matched by kind and name. For each pair the relative change
+ * of the median is computed and a Mann-Whitney U (or bootstrap) test
+ * decides if the change is significant: higher values are regressions,
+ * lower values are improvements. Timers saved without samples only have
+ * their means compared (the result is flagged summary and untested).
+ * @param base Baseline run.
+ * @param cur Current run.
+ * @param opts Options (NULL for defaults, see meas_cmp_defaults).
+ * @param results Returned vector of results (free with free()).
+ * @param nresults Returned number of results.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_compare_runs(meas_run *base, meas_run *cur, const meas_cmp_opts *opts,
+					  meas_cmp_result **results, unsigned int *nresults)
+{
+	meas_cmp_opts dopts;
+	meas_cmp_result *res;
+	meas_run_metric **bm, **cm;
+	double *bs, *cs;
+	unsigned int nb, nc, i, j, n;
+	int c;
+
+	if (base == NULL || cur == NULL || results == NULL || nresults == NULL)
+		return(FALSE);
+
+	if (opts == NULL) {
+		meas_cmp_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	bm = sorted_metrics(base, &nb);
+	cm = sorted_metrics(cur, &nc);
+	res = (meas_cmp_result*)malloc(sizeof(meas_cmp_result) * ((nb < nc ? nb : nc) + 1));
+
+	if (bm == NULL || cm == NULL || res == NULL) {
+		free(bm);
+		free(cm);
+		free(res);
+		return(FALSE);
+	}
+
+	/* Merge join by (kind, name) */
+	for (i = 0, j = 0, n = 0; i < nb && j < nc; ) {
+		c = cmp_metric(&bm[i], &cm[j]);
+		if (c < 0) {
+			i++;
+			continue;
+		} else if (c > 0) {
+			j++;
+			continue;
+		}
+
+		strcpy(res[n].name, bm[i]->name);
+		res[n].kind    = bm[i]->kind;
+		res[n].summary = (bm[i]->summary || cm[j]->summary);
+		res[n].p_value = 1.0;
+		res[n].verdict = MEAS_CMP_UNTESTED;
+		res[n].change  = 0;
+
+		bs = sorted_copy(bm[i]);
+		cs = sorted_copy(cm[j]);
+		res[n].base_median = center(bm[i], bs, res[n].summary, &res[n].nbase);
+		res[n].cur_median  = center(cm[j], cs, res[n].summary, &res[n].ncur);
+
+		if (res[n].base_median != 0) {
+			res[n].change = (res[n].cur_median - res[n].base_median) / res[n].base_median;
+		}
+
+		if (bs != NULL && cs != NULL && !res[n].summary &&
+				res[n].nbase >= opts->min_samples && res[n].ncur >= opts->min_samples &&
+				res[n].nbase > 0 && res[n].ncur > 0) {
+
+			if (opts->method == MEAS_CMP_BOOTSTRAP) {
+				res[n].p_value = bootstrap(bs, res[n].nbase, cs, res[n].ncur, opts->nresamples);
+			} else {
+				res[n].p_value = mann_whitney(bs, res[n].nbase, cs, res[n].ncur);
+			}
+
+			if (res[n].p_value >= opts->alpha || res[n].cur_median == res[n].base_median) {
+				res[n].verdict = MEAS_CMP_UNCHANGED;
+			} else if (res[n].cur_median > res[n].base_median) {
+				res[n].verdict = MEAS_CMP_REGRESSION;
+			} else {
+				res[n].verdict = MEAS_CMP_IMPROVEMENT;
+			}
+		}
+
+		free(bs);
+		free(cs);
+		n++;
+		i++;
+		j++;
+	}
+
+	free(bm);
+	free(cm);
+
+	*results  = res;
+	*nresults = n;
+	return(TRUE);
+}
+
+
+/**
+ * Write a metric line of a saved run
+ * @param fp Output stream.
+ * @param kind Metric kind.
+ * @param name Metric name.
+ * @param n Number of samples.
+ * @param samples Samples.
+ */
+static void write_metric(FILE *fp, const char *kind, const char *name,
+						 unsigned int n, const double *samples)
+{
+	unsigned int i;
+
+	write_header(fp, kind, name, n);
+	for (i = 0; i < n; i++) {
+		fprintf(fp, " %.17g", samples[i]);
+	}
+	fputc('\n', fp);
+}
+
+
+/**
+ * Write the captured samples of a timer as a metric line
+ * @param fp Output stream.
+ * @param clock The timer.
+ */
+static void write_samples(FILE *fp, meas_clock *clock)
+{
+	unsigned long i;
+
+	write_header(fp, "timer", clock->name, (unsigned int)clock->samples->n);
+	for (i = 0; i < clock->samples->n; i++) {
+		fprintf(fp, " %lu", clock->samples->values[i]);
+	}
+	fputc('\n', fp);
+}
+
+
+/**
+ * Write the start of a metric line: "<kind> <name> <n>"
+ * @param fp Output stream.
+ * @param kind Kind name.
+ * @param name Metric name (blanks replaced by '_').
+ * @param n Number of samples.
+ */
+static void write_header(FILE *fp, const char *kind, const char *name, unsigned int n)
+{
+	unsigned int i;
+
+	fprintf(fp, "%s ", kind);
+	if (name[0] == '\0') {
+		fputc('-', fp);
+	}
+	for (i = 0; name[i] != '\0'; i++) {
+		fputc(isspace((unsigned char)name[i]) ? '_' : name[i], fp);
+	}
+	fprintf(fp, " %u", n);
+}
+
+
+/**
+ * Metric kind from its name in a saved run
+ * @param kind Kind name.
+ * @param summary Returned TRUE for timer summaries.
+ * @return int The kind or 0 if unknown.
+ */
+static int kind_from_name(const char *kind, int *summary)
+{
+	*summary = FALSE;
+	if (strcmp(kind, "timer") == 0) {
+		return(MEAS_RUN_TIMER);
+	} else if (strcmp(kind, "timersum") == 0) {
+		*summary = TRUE;
+		return(MEAS_RUN_TIMER);
+	} else if (strcmp(kind, "counter") == 0) {
+		return(MEAS_RUN_COUNTER);
+	} else if (strcmp(kind, "bench") == 0) {
+		return(MEAS_RUN_BENCH);
+	} else {
+		return(0);
+	}
+}
+
+
+/**
+ * Metrics of a run sorted by kind and name
+ * @param run The run.
+ * @param n Returned number of metrics.
+ * @return meas_run_metric** Vector of metrics (NULL on error).
+ */
+static meas_run_metric **sorted_metrics(meas_run *run, unsigned int *n)
+{
+	meas_run_metric **v;
+	llist *tmp;
+	unsigned int i;
+
+	*n = llist_length(run->metrics);
+	if ((v = (meas_run_metric**)malloc(sizeof(meas_run_metric*) * (*n + 1))) == NULL)
+		return(NULL);
+
+	i = 0;
+	foreach(run->metrics, tmp) {
+		v[i++] = (meas_run_metric*)tmp->element;
+	}
+
+	qsort(v, *n, sizeof(meas_run_metric*), cmp_metric);
+	return(v);
+}
+
+
+/**
+ * Compare two metrics by kind and name (for qsort)
+ */
+static int cmp_metric(const void *a, const void *b)
+{
+	const meas_run_metric *ma = *(meas_run_metric* const*)a;
+	const meas_run_metric *mb = *(meas_run_metric* const*)b;
+
+	if (ma->kind != mb->kind)
+		return(ma->kind - mb->kind);
+
+	return(strcmp(ma->name, mb->name));
+}
+
+
+/**
+ * Sorted copy of the samples of a metric
+ * @param m The metric.
+ * @return double* Sorted samples (NULL on error).
+ */
+static double *sorted_copy(const meas_run_metric *m)
+{
+	double *v;
+
+	if ((v = (double*)malloc(sizeof(double) * (m->nsamples + 1))) == NULL)
+		return(NULL);
+
+	memcpy(v, m->samples, sizeof(double) * m->nsamples);
+	qsort(v, m->nsamples, sizeof(double), util_cmp_double);
+	return(v);
+}
+
+
+/**
+ * Median of a sorted vector
+ * @param sorted Sorted vector (may be NULL).
+ * @param n Number of elements.
+ * @return double The median (0 for empty vectors).
+ */
+static double median(const double *sorted, unsigned int n)
+{
+	if (sorted == NULL || n == 0)
+		return(0);
+
+	if (n % 2) {
+		return(sorted[n / 2]);
+	} else {
+		return((sorted[(n / 2) - 1] + sorted[n / 2]) / 2.0);
+	}
+}
+
+
+/**
+ * Central value of a metric and its number of intervals
+ * @param m The metric.
+ * @param sorted Sorted samples of the metric.
+ * @param mean TRUE for the mean, FALSE for the median.
+ * @param n Returned number of intervals.
+ * @return double The central value.
+ */
+static double center(const meas_run_metric *m, const double *sorted, int mean, unsigned int *n)
+{
+	double sum = 0;
+	unsigned int i;
+
+	if (m->summary) {
+		*n = (m->nsamples == 4) ? (unsigned int)m->samples[0] : 0;
+		return((*n > 0) ? m->samples[1] / m->samples[0] : 0);
+	}
+
+	*n = m->nsamples;
+	if (!mean)
+		return(median(sorted, m->nsamples));
+
+	for (i = 0; i < m->nsamples; i++) {
+		sum += m->samples[i];
+	}
+	return((m->nsamples > 0) ? sum / m->nsamples : 0);
+}
+
+
+/**
+ * Two-sided Mann-Whitney U test (normal approximation with tie and
+ * continuity corrections)
+ * @param a First sample.
+ * @param na Size of the first sample.
+ * @param b Second sample.
+ * @param nb Size of the second sample.
+ * @return double p-value.
+ */
+static double mann_whitney(const double *a, unsigned int na, const double *b, unsigned int nb)
+{
+	struct ranked *all;
+	unsigned int i, j, k, n = na + nb;
+	double ra, rank, ties, t, u, mu, sigma, z;
+
+	if ((all = (struct ranked*)malloc(sizeof(struct ranked) * n)) == NULL)
+		return(1.0);
+
+	for (i = 0; i < na; i++) {
+		all[i].value = a[i];
+		all[i].base  = 1;
+	}
+	for (i = 0; i < nb; i++) {
+		all[na + i].value = b[i];
+		all[na + i].base  = 0;
+	}
+	qsort(all, n, sizeof(struct ranked), cmp_ranked);
+
+	/* Rank sum of the first sample (ties get the average rank) */
+	ra   = 0;
+	ties = 0;
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && all[j].value == all[i].value; j++);
+
+		rank = ((double)(i + 1) + (double)j) / 2.0;
+		for (k = i; k < j; k++) {
+			if (all[k].base)
+				ra += rank;
+		}
+
+		t = (double)(j - i);
+		ties += (t * t * t) - t;
+	}
+	free(all);
+
+	u     = ra - (((double)na * (na + 1)) / 2.0);
+	mu    = ((double)na * nb) / 2.0;
+	sigma = (((double)na * nb) / 12.0) * ((n + 1) - (ties / ((double)n * (n - 1))));
+
+	if (sigma <= 0)
+		return(1.0);
+
+	z = (fabs(u - mu) - 0.5) / sqrt(sigma);
+	if (z < 0)
+		z = 0;
+
+	return(erfc(z / M_SQRT2));
+}
+
+
+/**
+ * Two-sided bootstrap test on the ratio of medians
+ * @param a First sample (sorted).
+ * @param na Size of the first sample.
+ * @param b Second sample (sorted).
+ * @param nb Size of the second sample.
+ * @param nresamples Number of resamples.
+ * @return double p-value.
+ */
+static double bootstrap(const double *a, unsigned int na, const double *b, unsigned int nb,
+						unsigned int nresamples)
+{
+	unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+	unsigned int r, i, below = 0, above = 0;
+	double *wa, *wb, ma, mb, p;
+
+	if (nresamples == 0)
+		return(1.0);
+
+	wa = (double*)malloc(sizeof(double) * na);
+	wb = (double*)malloc(sizeof(double) * nb);
+	if (wa == NULL || wb == NULL) {
+		free(wa);
+		free(wb);
+		return(1.0);
+	}
+
+	for (r = 0; r < nresamples; r++) {
+		for (i = 0; i < na; i++) {
+			wa[i] = a[util_xorshift(&seed) % na];
+		}
+		for (i = 0; i < nb; i++) {
+			wb[i] = b[util_xorshift(&seed) % nb];
+		}
+		qsort(wa, na, sizeof(double), util_cmp_double);
+		qsort(wb, nb, sizeof(double), util_cmp_double);
+		ma = median(wa, na);
+		mb = median(wb, nb);
+
+		if (mb <= ma)
+			below++;
+		if (mb >= ma)
+			above++;
+	}
+	free(wa);
+	free(wb);
+
+	p = (2.0 * (below < above ? below : above)) / nresamples;
+	return(p > 1.0 ? 1.0 : p);
+}
+
+
+/**
+ * Compare two ranked samples (for qsort)
+ */
+static int cmp_ranked(const void *a, const void *b)
+{
+	return(util_cmp_double(&((const struct ranked*)a)->value, &((const struct ranked*)b)->value));
+}
+
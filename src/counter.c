@@ -29,6 +29,10 @@
 #include <sys/syscall.h>
 #include <errno.h>
 
+extern void *_libmeas_alloc(meas_t *mst, int pool, size_t size);
+extern void _libmeas_free(meas_t *mst, void *ptr);
+extern int _libmeas_list_add(meas_t *mst, int pool, llist **list, llist **tail, void *element);
+
 /**
  * Create a counter
  * @param mst The meas user structure. 
@@ -36,16 +40,20 @@
  * @param name A name to the counter (useful for report visualization).
  * @return NULL on error or the created counter.
  */
-meas_counter *meas_create_counter(meas_t **mst, unsigned long ivalue, char *name)
+meas_counter *meas_create_counter(meas_t **mst, unsigned long ivalue, const char *name)
 {
-	meas_t *umst = *mst;
+	meas_t *umst;
 	meas_counter *ncounter;
 
 	if(mst != NULL) {
-		if((ncounter = (meas_counter*)malloc(sizeof(meas_counter))) == NULL)
+		umst = *mst;
+		if((ncounter = (meas_counter*)_libmeas_alloc(umst, MEAS_RT_COUNTERS, sizeof(meas_counter))) == NULL)
 			return(NULL);
 
-		llist_add(&umst->counters, ncounter);
+		if (_libmeas_list_add(umst, MEAS_RT_COUNTERS, &umst->counters, &umst->counters_tail, ncounter) == FALSE) {
+			_libmeas_free(umst, ncounter);
+			return(NULL);
+		}
 	} else {
 		return(NULL);
 	}
@@ -66,7 +74,7 @@ meas_counter *meas_create_counter(meas_t **mst, unsigned long ivalue, char *name
 unsigned long meas_set_counter(meas_counter *counter, unsigned long value)
 {
 	if(counter != NULL) {
-		counter->value = value;
+		__atomic_store_n(&counter->value, value, __ATOMIC_RELAXED);
 		return(value);
 	} else {
 		return(0);
@@ -93,9 +101,10 @@ unsigned long meas_get_counter(meas_counter counter)
 unsigned long meas_inc_counter(meas_counter *counter)
 {
 	if (counter != NULL) {
-		counter->value++;
+		/* Atomic: meas_snapshot_reset exchanges the value */
+		return(__atomic_add_fetch(&counter->value, 1, __ATOMIC_RELAXED));
 	}
-	return(counter->value);
+	return(0);
 }
 
 
@@ -107,8 +116,8 @@ unsigned long meas_inc_counter(meas_counter *counter)
 unsigned long meas_dec_counter(meas_counter *counter)
 {
 	if (counter != NULL) {
-		counter->value--;
+		return(__atomic_sub_fetch(&counter->value, 1, __ATOMIC_RELAXED));
 	}
-	return(counter->value);
+	return(0);
 }
 
@@ -0,0 +1,139 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * CPU placement of timers
+ *
+ * A tracked timer reads the current CPU (sched_getcpu, a vDSO or rseq
+ * read on recent systems) right before its start time and right after
+ * its end time, so the lookup is not part of the interval. Intervals that
+ * started and ended on the same CPU are accumulated on that CPU; the
+ * others count as migrations.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+
+void _libmeas_cpus_start(meas_cpu_stats *cpus);
+void _libmeas_cpus_stop(meas_cpu_stats *cpus, unsigned long interv);
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static void acc_add(meas_timer_acc *acc, unsigned long value);
+
+
+/**
+ * Track the CPU on which each interval of a timer runs (fed by
+ * meas_start_clock and meas_stop_clock)
+ * @param clock The timer (must not be running).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_clock_track_cpus(meas_clock *clock)
+{
+	meas_cpu_stats *cpus;
+	long ncpus;
+
+	if (clock == NULL || clock->cpus != NULL || clock->state == TIMER_ST_RUNNING)
+		return(FALSE);
+
+	_libmeas_rt_violation(clock->mst);
+
+	/* Configured CPUs: CPUs brought online later stay in range */
+	ncpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (ncpus < 1)
+		ncpus = 1;
+
+	if ((cpus = (meas_cpu_stats*)calloc(1, sizeof(meas_cpu_stats) +
+										(sizeof(meas_timer_acc) * ncpus))) == NULL)
+		return(FALSE);
+
+	cpus->ncpus     = ncpus;
+	cpus->start_cpu = -1;
+	cpus->cpu       = (meas_timer_acc*)(cpus + 1);
+
+	clock->cpus = cpus;
+	return(TRUE);
+}
+
+
+/**
+ * Stop tracking the CPU placement of a timer
+ * @param clock The timer.
+ */
+void meas_clock_release_cpus(meas_clock *clock)
+{
+	if (clock != NULL && clock->cpus != NULL) {
+		free(clock->cpus);
+		clock->cpus = NULL;
+	}
+}
+
+
+/**
+ * Record the CPU at the start of an interval
+ * @param cpus CPU placement of the timer.
+ */
+void _libmeas_cpus_start(meas_cpu_stats *cpus)
+{
+	cpus->start_cpu = sched_getcpu();
+}
+
+
+/**
+ * Account an interval to the CPU it ran on
+ * @param cpus CPU placement of the timer.
+ * @param interv The interval.
+ */
+void _libmeas_cpus_stop(meas_cpu_stats *cpus, unsigned long interv)
+{
+	int cpu = sched_getcpu();
+
+	if (cpu != cpus->start_cpu) {
+		cpus->migrations++;
+		acc_add(&cpus->migrated, interv);
+	} else if (cpu < 0 || (unsigned int)cpu >= cpus->ncpus) {
+		cpus->unknown++;
+	} else {
+		acc_add(&cpus->cpu[cpu], interv);
+	}
+}
+
+
+/**
+ * Add an interval to an accumulator
+ * @param acc The accumulator.
+ * @param value The interval.
+ */
+static void acc_add(meas_timer_acc *acc, unsigned long value)
+{
+	if (acc->count == 0 || value < acc->min)
+		acc->min = value;
+	if (value > acc->max)
+		acc->max = value;
+	acc->total += value;
+	acc->count++;
+}
+
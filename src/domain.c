@@ -0,0 +1,673 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Multi-process aggregation through a named shared memory domain
+ *
+ * Each attached process owns one slot of the domain and publishes a copy
+ * of its timers and counters there (meas_domain_publish) under the slot
+ * sequence lock; measuring never touches the shared memory. Slots are
+ * claimed with a compare-and-swap of the owner pid, so there is no
+ * cross-process lock at all. An aggregator reads every slot and merges
+ * the metrics by name. A process that died without detaching keeps its
+ * last published values and is reported as dead until its slot is reaped
+ * or claimed again.
+ */
+#include <meas.h>
+#include <seqlock.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Layout identification
+ */
+#define DOMAIN_MAGIC   0x6d656173
+#define DOMAIN_VERSION 1
+
+/**
+ * Slot states (the slot is free while its pid is 0)
+ */
+#define SLOT_LIVE   1
+#define SLOT_EXITED 2
+
+/**
+ * Reads of a slot retried while its owner publishes
+ */
+#define DOMAIN_RETRIES 100
+
+/**
+ * Waits (1 ms each) for the creator to initialize a new domain
+ */
+#define DOMAIN_INIT_WAITS 1000
+
+extern void _libmeas_read_timer(meas_clock *clock, meas_interval *value);
+
+/**
+ * Slot of one process
+ */
+struct domain_slot {
+	int pid;					/* Owner (0: free, -1: being reaped) */
+	int state;
+	unsigned int seq;			/* Sequence lock of the published metrics */
+	unsigned int nmetrics;
+	unsigned int truncated;		/* Metrics that did not fit */
+	char tag[MAX_NAME_SIZE];
+	unsigned long published;	/* CLOCK_MONOTONIC of the last publication (ns) */
+	unsigned long npublished;
+	meas_interval metrics[MEAS_DOMAIN_METRICS];
+};
+
+/**
+ * Shared memory layout
+ */
+struct _meas_domain_shm {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int nslots;
+	unsigned int nmetrics;
+	struct domain_slot slots[MEAS_DOMAIN_SLOTS];
+};
+
+/**
+ * static functions
+ */
+static struct _meas_domain_shm *map_domain(const char *name, int create, int writable);
+static int shm_name(const char *name, char *path, size_t size);
+static int claim_slot(struct _meas_domain_shm *shm, int pid);
+static int read_slot(const struct domain_slot *slot, struct domain_slot *copy);
+static int merge_metrics(meas_interval **values, unsigned int *nvalues, unsigned int *capacity,
+						 const struct domain_slot *slot);
+static int pid_alive(int pid);
+static unsigned long monotonic_ns(void);
+static void write_metrics(FILE *fp, const meas_interval *values, unsigned int n);
+
+
+/**
+ * Attach the process to a shared aggregation domain (created if needed)
+ * and publish its metrics once. meas_close detaches it.
+ * @param mst The meas user structure.
+ * @param name Name of the domain (shared by the cooperating processes).
+ * @param tag Tag of this process in the aggregated report.
+ * @return NULL on error (e.g. every slot in use) or the attachment.
+ */
+meas_domain *meas_domain_attach(meas_t **mst, const char *name, const char *tag)
+{
+	meas_t *umst;
+	meas_domain *domain;
+	struct _meas_domain_shm *shm;
+	struct domain_slot *slot;
+	int s;
+
+	if (mst == NULL || *mst == NULL || (*mst)->domain != NULL || tag == NULL)
+		return(NULL);
+
+	umst = *mst;
+	if ((shm = map_domain(name, TRUE, TRUE)) == NULL)
+		return(NULL);
+
+	if ((s = claim_slot(shm, (int)getpid())) < 0 ||
+			(domain = (meas_domain*)calloc(1, sizeof(meas_domain))) == NULL) {
+		if (s >= 0)
+			__atomic_store_n(&shm->slots[s].pid, 0, __ATOMIC_RELEASE);
+		munmap(shm, sizeof(struct _meas_domain_shm));
+		return(NULL);
+	}
+
+	/* A reclaimed slot is hidden until it is reset */
+	slot = &shm->slots[s];
+	__atomic_store_n(&slot->state, 0, __ATOMIC_RELEASE);
+	seq_write_begin(&slot->seq);
+	strncpy(slot->tag, tag, MAX_NAME_SIZE - 1);
+	slot->tag[MAX_NAME_SIZE - 1] = '\0';
+	slot->nmetrics   = 0;
+	slot->truncated  = 0;
+	slot->npublished = 0;
+	slot->published  = 0;
+	seq_write_end(&slot->seq);
+	__atomic_store_n(&slot->state, SLOT_LIVE, __ATOMIC_RELEASE);
+
+	strncpy(domain->name, name, MAX_NAME_SIZE - 1);
+	domain->shm  = shm;
+	domain->slot = (unsigned int)s;
+	domain->mst  = umst;
+	umst->domain = domain;
+
+	meas_domain_publish(domain);
+	return(domain);
+}
+
+
+/**
+ * Publish the current timers (accumulated intervals, see
+ * meas_snapshot_reset) and counters of the process to its slot.
+ * Call it periodically; only the publishing thread touches the domain.
+ * @param domain The attachment.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_domain_publish(meas_domain *domain)
+{
+	struct domain_slot *slot;
+	meas_interval *metric;
+	meas_counter *counter;
+	unsigned int n = 0, truncated = 0;
+	llist *tmp;
+
+	if (domain == NULL)
+		return(FALSE);
+
+	slot = &domain->shm->slots[domain->slot];
+	seq_write_begin(&slot->seq);
+
+	foreach(domain->mst->timers, tmp) {
+		if (n == MEAS_DOMAIN_METRICS) {
+			truncated++;
+			continue;
+		}
+
+		_libmeas_read_timer((meas_clock*)tmp->element, &slot->metrics[n++]);
+	}
+
+	foreach(domain->mst->counters, tmp) {
+		if (n == MEAS_DOMAIN_METRICS) {
+			truncated++;
+			continue;
+		}
+
+		counter = (meas_counter*)tmp->element;
+		metric  = &slot->metrics[n++];
+		memset(metric, 0, sizeof(meas_interval));
+		strcpy(metric->name, counter->name);
+		metric->kind  = MEAS_RUN_COUNTER;
+		metric->value = (long)__atomic_load_n(&counter->value, __ATOMIC_RELAXED);
+	}
+
+	slot->nmetrics  = n;
+	slot->truncated = truncated;
+	slot->published = monotonic_ns();
+	slot->npublished++;
+	seq_write_end(&slot->seq);
+
+	return(truncated == 0 ? TRUE : FALSE);
+}
+
+
+/**
+ * Publish the metrics a last time and detach the process from its domain
+ * (the slot keeps the values until it is reaped)
+ * @param domain The attachment.
+ */
+void meas_domain_detach(meas_domain **domain)
+{
+	meas_domain *d;
+
+	if (domain == NULL || *domain == NULL)
+		return;
+
+	d = *domain;
+	meas_domain_publish(d);
+	__atomic_store_n(&d->shm->slots[d->slot].state, SLOT_EXITED, __ATOMIC_RELEASE);
+	munmap(d->shm, sizeof(struct _meas_domain_shm));
+
+	d->mst->domain = NULL;
+	free(d);
+	*domain = NULL;
+}
+
+
+/**
+ * Merge the metrics of every process of a domain (by kind and name):
+ * timer totals, counts and counter values are added, min. and max. are
+ * kept.
+ * @param name Name of the domain.
+ * @param values Returned vector of merged metrics (free with free()).
+ * @param nvalues Returned number of metrics.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_domain_totals(const char *name, meas_interval **values, unsigned int *nvalues)
+{
+	struct _meas_domain_shm *shm;
+	struct domain_slot *copy;
+	unsigned int i, capacity = 0;
+	int ret = TRUE;
+
+	if (values == NULL || nvalues == NULL)
+		return(FALSE);
+
+	if ((shm = map_domain(name, FALSE, FALSE)) == NULL)
+		return(FALSE);
+
+	if ((copy = (struct domain_slot*)malloc(sizeof(struct domain_slot))) == NULL) {
+		munmap(shm, sizeof(struct _meas_domain_shm));
+		return(FALSE);
+	}
+
+	*values  = NULL;
+	*nvalues = 0;
+	for (i = 0; i < MEAS_DOMAIN_SLOTS && ret == TRUE; i++) {
+		if (read_slot(&shm->slots[i], copy) == TRUE)
+			ret = merge_metrics(values, nvalues, &capacity, copy);
+	}
+
+	free(copy);
+	munmap(shm, sizeof(struct _meas_domain_shm));
+
+	if (ret == FALSE) {
+		free(*values);
+		*values = NULL;
+		*nvalues = 0;
+	}
+	return(ret);
+}
+
+
+/**
+ * Write the aggregated report of a domain
+ * @param name Name of the domain.
+ * @param views MEAS_DOMAIN_PROCESSES and/or MEAS_DOMAIN_TOTAL.
+ * @param fp Output stream.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_domain_report(const char *name, int views, FILE *fp)
+{
+	struct _meas_domain_shm *shm;
+	struct domain_slot *copy;
+	meas_interval *totals = NULL;
+	unsigned int i, ntotals = 0, capacity = 0, nlive = 0, nexited = 0, ndead = 0;
+	unsigned long now;
+	const char *state;
+	int ret = TRUE;
+
+	if (fp == NULL)
+		return(FALSE);
+
+	if ((shm = map_domain(name, FALSE, FALSE)) == NULL)
+		return(FALSE);
+
+	if ((copy = (struct domain_slot*)malloc(sizeof(struct domain_slot))) == NULL) {
+		munmap(shm, sizeof(struct _meas_domain_shm));
+		return(FALSE);
+	}
+
+	fprintf(fp, "****************************************************************\n");
+	fprintf(fp, "* libmeas - A measurement system for critical embedded systems *\n");
+	fprintf(fp, "*                      AGGREGATED REPORT                       *\n");
+	fprintf(fp, "****************************************************************\n\n");
+
+	if ((views & MEAS_DOMAIN_PROCESSES))
+		fprintf(fp, "========================== PROCESSES ===========================\n");
+
+	now = monotonic_ns();
+	for (i = 0; i < MEAS_DOMAIN_SLOTS; i++) {
+		if (read_slot(&shm->slots[i], copy) == FALSE)
+			continue;
+
+		if (copy->state == SLOT_EXITED) {
+			state = "exited";
+			nexited++;
+		} else if (pid_alive(copy->pid)) {
+			state = "live";
+			nlive++;
+		} else {
+			state = "dead";
+			ndead++;
+		}
+
+		if ((views & MEAS_DOMAIN_PROCESSES)) {
+			fprintf(fp, " %-34s pid %d, %s, published %.1fs ago\n", copy->tag, copy->pid, state,
+					copy->npublished > 0 ? (double)(now - copy->published) / 1e9 : 0.0);
+			if (copy->truncated > 0)
+				fprintf(fp, "   (%u metrics not published)\n", copy->truncated);
+			write_metrics(fp, copy->metrics, copy->nmetrics);
+		}
+
+		if (ret == TRUE)
+			ret = merge_metrics(&totals, &ntotals, &capacity, copy);
+	}
+
+	if ((views & MEAS_DOMAIN_PROCESSES))
+		fprintf(fp, "----------------------------------------------------------------\n\n");
+
+	if ((views & MEAS_DOMAIN_TOTAL) && ret == TRUE) {
+		fprintf(fp, "============================ TOTAL =============================\n");
+		fprintf(fp, " %u processes (%u live, %u exited, %u dead)\n", nlive + nexited + ndead,
+				nlive, nexited, ndead);
+		write_metrics(fp, totals, ntotals);
+		fprintf(fp, "----------------------------------------------------------------\n\n");
+	}
+
+	free(totals);
+	free(copy);
+	munmap(shm, sizeof(struct _meas_domain_shm));
+	return(ferror(fp) ? FALSE : ret);
+}
+
+
+/**
+ * Free the slots of exited and dead processes of a domain
+ * @param name Name of the domain.
+ * @return int Number of slots freed (-1 on error).
+ */
+int meas_domain_reap(const char *name)
+{
+	struct _meas_domain_shm *shm;
+	struct domain_slot *slot;
+	unsigned int i;
+	int pid, n = 0;
+
+	if ((shm = map_domain(name, FALSE, TRUE)) == NULL)
+		return(-1);
+
+	for (i = 0; i < MEAS_DOMAIN_SLOTS; i++) {
+		slot = &shm->slots[i];
+		pid  = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+		if (pid <= 0 || (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SLOT_EXITED &&
+						 pid_alive(pid)))
+			continue;
+
+		/* Races with a process claiming the same slot */
+		if (!__atomic_compare_exchange_n(&slot->pid, &pid, -1, FALSE,
+										 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			continue;
+
+		slot->state    = 0;
+		slot->nmetrics = 0;
+		__atomic_store_n(&slot->pid, 0, __ATOMIC_RELEASE);
+		n++;
+	}
+
+	munmap(shm, sizeof(struct _meas_domain_shm));
+	return(n);
+}
+
+
+/**
+ * Remove a domain (attached processes keep their mapping)
+ * @param name Name of the domain.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_domain_unlink(const char *name)
+{
+	char path[MAX_NAME_SIZE + 16];
+
+	if (shm_name(name, path, sizeof(path)) == FALSE)
+		return(FALSE);
+
+	return(shm_unlink(path) == 0 ? TRUE : FALSE);
+}
+
+
+/**
+ * Map a domain
+ * @param name Name of the domain.
+ * @param create TRUE to create (and initialize) a missing domain.
+ * @param writable TRUE to map it for writing.
+ * @return Mapping or NULL on error.
+ */
+static struct _meas_domain_shm *map_domain(const char *name, int create, int writable)
+{
+	struct _meas_domain_shm *shm;
+	char path[MAX_NAME_SIZE + 16];
+	struct stat st;
+	int fd, creator = FALSE, waits;
+
+	if (shm_name(name, path, sizeof(path)) == FALSE)
+		return(NULL);
+
+	fd = -1;
+	if (create) {
+		if ((fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666)) >= 0) {
+			creator = TRUE;
+			if (ftruncate(fd, sizeof(struct _meas_domain_shm)) != 0) {
+				close(fd);
+				shm_unlink(path);
+				return(NULL);
+			}
+		} else if (errno != EEXIST) {
+			return(NULL);
+		}
+	}
+
+	if (fd < 0 && (fd = shm_open(path, writable ? O_RDWR : O_RDONLY, 0)) < 0)
+		return(NULL);
+
+	/* The creator may not have sized it yet */
+	for (waits = 0; ; waits++) {
+		if (fstat(fd, &st) != 0)
+			st.st_size = 0;
+		if (st.st_size >= (off_t)sizeof(struct _meas_domain_shm) || waits == DOMAIN_INIT_WAITS)
+			break;
+		usleep(1000);
+	}
+
+	if (st.st_size < (off_t)sizeof(struct _meas_domain_shm)) {
+		close(fd);
+		return(NULL);
+	}
+
+	shm = (struct _meas_domain_shm*)mmap(NULL, sizeof(struct _meas_domain_shm),
+										 writable ? PROT_READ | PROT_WRITE : PROT_READ,
+										 MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return(NULL);
+
+	if (creator) {
+		/* ftruncate zeroed it: every slot is free */
+		shm->version  = DOMAIN_VERSION;
+		shm->nslots   = MEAS_DOMAIN_SLOTS;
+		shm->nmetrics = MEAS_DOMAIN_METRICS;
+		__atomic_store_n(&shm->magic, DOMAIN_MAGIC, __ATOMIC_RELEASE);
+	}
+
+	for (waits = 0; __atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != DOMAIN_MAGIC &&
+			waits < DOMAIN_INIT_WAITS; waits++) {
+		usleep(1000);
+	}
+
+	if (shm->magic != DOMAIN_MAGIC || shm->version != DOMAIN_VERSION ||
+			shm->nslots != MEAS_DOMAIN_SLOTS || shm->nmetrics != MEAS_DOMAIN_METRICS) {
+		munmap(shm, sizeof(struct _meas_domain_shm));
+		return(NULL);
+	}
+
+	return(shm);
+}
+
+
+/**
+ * Shared memory object name of a domain
+ * @param name Name of the domain.
+ * @param path Returned object name.
+ * @param size Size of path.
+ * @return FALSE on error (invalid name), TRUE otherwise.
+ */
+static int shm_name(const char *name, char *path, size_t size)
+{
+	if (name == NULL || name[0] == '\0' || strchr(name, '/') != NULL ||
+			strlen(name) >= MAX_NAME_SIZE)
+		return(FALSE);
+
+	snprintf(path, size, "/libmeas.%s", name);
+	return(TRUE);
+}
+
+
+/**
+ * Claim a free slot, or else the slot of an exited or dead process
+ * @param shm The domain.
+ * @param pid Pid of the caller.
+ * @return int Slot index (-1 if every slot is in use).
+ */
+static int claim_slot(struct _meas_domain_shm *shm, int pid)
+{
+	struct domain_slot *slot;
+	unsigned int i;
+	int owner;
+
+	for (i = 0; i < MEAS_DOMAIN_SLOTS; i++) {
+		owner = 0;
+		if (__atomic_compare_exchange_n(&shm->slots[i].pid, &owner, pid, FALSE,
+										__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return((int)i);
+	}
+
+	for (i = 0; i < MEAS_DOMAIN_SLOTS; i++) {
+		slot  = &shm->slots[i];
+		owner = __atomic_load_n(&slot->pid, __ATOMIC_ACQUIRE);
+		if (owner <= 0 || (__atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) != SLOT_EXITED &&
+						   pid_alive(owner)))
+			continue;
+
+		if (__atomic_compare_exchange_n(&slot->pid, &owner, pid, FALSE,
+										__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return((int)i);
+	}
+
+	return(-1);
+}
+
+
+/**
+ * Copy an occupied slot
+ * @param slot The slot.
+ * @param copy Returned copy.
+ * @return FALSE if the slot is free (or being claimed), TRUE otherwise.
+ */
+static int read_slot(const struct domain_slot *slot, struct domain_slot *copy)
+{
+	unsigned int s, retries = 0;
+
+	do {
+		s = seq_read_begin(&slot->seq);
+		memcpy(copy, slot, sizeof(struct domain_slot));
+	} while (seq_read_retry(&slot->seq, s) && ++retries < DOMAIN_RETRIES);
+
+	/* A writer that died while publishing leaves an odd sequence */
+	if (copy->nmetrics > MEAS_DOMAIN_METRICS)
+		copy->nmetrics = MEAS_DOMAIN_METRICS;
+	copy->tag[MAX_NAME_SIZE - 1] = '\0';
+
+	return(copy->pid > 0 && copy->state != 0);
+}
+
+
+/**
+ * Merge the metrics of a slot into a vector
+ * @param values Vector of merged metrics (grown as needed).
+ * @param nvalues Number of merged metrics.
+ * @param capacity Capacity of the vector.
+ * @param slot The slot.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int merge_metrics(meas_interval **values, unsigned int *nvalues, unsigned int *capacity,
+						 const struct domain_slot *slot)
+{
+	const meas_interval *m;
+	meas_interval *v, *nv;
+	unsigned int i, j;
+
+	for (i = 0; i < slot->nmetrics; i++) {
+		m = &slot->metrics[i];
+		for (j = 0; j < *nvalues; j++) {
+			v = &(*values)[j];
+			if (v->kind == m->kind && strncmp(v->name, m->name, MAX_NAME_SIZE) == 0)
+				break;
+		}
+
+		if (j == *nvalues) {
+			if (*nvalues == *capacity) {
+				if ((nv = (meas_interval*)realloc(*values, sizeof(meas_interval) *
+												  (*capacity + MEAS_DOMAIN_METRICS))) == NULL)
+					return(FALSE);
+				*values    = nv;
+				*capacity += MEAS_DOMAIN_METRICS;
+			}
+			memcpy(&(*values)[j], m, sizeof(meas_interval));
+			(*values)[j].name[MAX_NAME_SIZE - 1] = '\0';
+			(*nvalues)++;
+			continue;
+		}
+
+		if (m->count > 0 && (v->count == 0 || m->min < v->min))
+			v->min = m->min;
+		if (m->max > v->max)
+			v->max = m->max;
+		v->value += m->value;
+		v->count += m->count;
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Check if a process is alive
+ * @param pid Process id.
+ * @return int TRUE if it is alive.
+ */
+static int pid_alive(int pid)
+{
+	return(kill(pid, 0) == 0 || errno == EPERM);
+}
+
+
+/**
+ * CLOCK_MONOTONIC in nanoseconds (comparable between processes)
+ * @return unsigned long Nanoseconds.
+ */
+static unsigned long monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(((unsigned long)ts.tv_sec * 1000000000UL) + ts.tv_nsec);
+}
+
+
+/**
+ * Write metrics as report lines
+ * @param fp Output stream.
+ * @param values The metrics.
+ * @param n Number of metrics.
+ */
+static void write_metrics(FILE *fp, const meas_interval *values, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (values[i].kind == MEAS_RUN_TIMER) {
+			fprintf(fp, "   T %-34s %lu x, %ld ticks (min. %lu, max. %lu)\n", values[i].name,
+					values[i].count, values[i].value, values[i].min, values[i].max);
+		} else {
+			fprintf(fp, "   C %-34s %ld\n", values[i].name, values[i].value);
+		}
+	}
+}
+
@@ -0,0 +1,187 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Fixed-size histograms
+ * Buckets are allocated once (meas_hist_init); adding a value never
+ * allocates.
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Initialize a histogram of nbuckets linear buckets starting at low
+ * @param hist The histogram.
+ * @param low Lower bound of the first bucket.
+ * @param width Width of each bucket (at least 1).
+ * @param nbuckets Number of buckets.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_hist_init(meas_histogram *hist, unsigned long low, unsigned long width,
+				   unsigned int nbuckets)
+{
+	if (hist == NULL || nbuckets == 0)
+		return(FALSE);
+
+	if ((hist->buckets = (unsigned long*)calloc(nbuckets, sizeof(unsigned long))) == NULL)
+		return(FALSE);
+
+	meas_hist_setup(hist, low, width, nbuckets, hist->buckets);
+	return(TRUE);
+}
+
+
+/**
+ * Initialize a histogram over caller-provided buckets (do not call
+ * meas_hist_free on it)
+ * @param hist The histogram.
+ * @param low Lower bound of the first bucket.
+ * @param width Width of each bucket (at least 1).
+ * @param nbuckets Number of buckets.
+ * @param buckets Array of nbuckets counters.
+ */
+void meas_hist_setup(meas_histogram *hist, unsigned long low, unsigned long width,
+					 unsigned int nbuckets, unsigned long *buckets)
+{
+	hist->buckets  = buckets;
+	hist->low      = low;
+	hist->width    = (width > 0) ? width : 1;
+	hist->nbuckets = nbuckets;
+	meas_hist_reset(hist);
+}
+
+
+/**
+ * Add a value to a histogram
+ * @param hist The histogram.
+ * @param value The value.
+ */
+void meas_hist_add(meas_histogram *hist, unsigned long value)
+{
+	unsigned long b;
+
+	if (value < hist->low) {
+		hist->underflow++;
+	} else {
+		b = (value - hist->low) / hist->width;
+		if (b < hist->nbuckets) {
+			hist->buckets[b]++;
+		} else {
+			hist->overflow++;
+		}
+	}
+
+	if (hist->count == 0 || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+
+	hist->count++;
+	hist->sum += value;
+}
+
+
+/**
+ * Estimate a percentile from a histogram (upper bound of the bucket
+ * holding it, clamped to the observed min. and max.)
+ * @param hist The histogram.
+ * @param p Percentile (0 to 100).
+ * @return unsigned long The percentile (0 for empty histograms).
+ */
+unsigned long meas_hist_percentile(meas_histogram *hist, double p)
+{
+	unsigned long long rank, seen;
+	unsigned long value;
+	unsigned int b;
+
+	if (hist->count == 0)
+		return(0);
+
+	rank = (unsigned long long)((p / 100.0) * hist->count);
+	if (rank < 1)
+		rank = 1;
+	if (rank > hist->count)
+		rank = hist->count;
+
+	seen = hist->underflow;
+	if (seen >= rank)
+		return(hist->min);
+
+	for (b = 0; b < hist->nbuckets; b++) {
+		seen += hist->buckets[b];
+		if (seen >= rank) {
+			value = hist->low + ((b + 1) * hist->width) - 1;
+			if (value > hist->max)
+				value = hist->max;
+			if (value < hist->min)
+				value = hist->min;
+			return(value);
+		}
+	}
+
+	return(hist->max);
+}
+
+
+/**
+ * Average of the values added to a histogram
+ * @param hist The histogram.
+ * @return double The average (0 for empty histograms).
+ */
+double meas_hist_mean(meas_histogram *hist)
+{
+	if (hist->count == 0)
+		return(0);
+
+	return((double)hist->sum / (double)hist->count);
+}
+
+
+/**
+ * Clear every bucket of a histogram
+ * @param hist The histogram.
+ */
+void meas_hist_reset(meas_histogram *hist)
+{
+	memset(hist->buckets, 0, sizeof(unsigned long) * hist->nbuckets);
+	hist->underflow = 0;
+	hist->overflow  = 0;
+	hist->count     = 0;
+	hist->sum       = 0;
+	hist->min       = 0;
+	hist->max       = 0;
+}
+
+
+/**
+ * Release the buckets of a histogram
+ * @param hist The histogram.
+ */
+void meas_hist_free(meas_histogram *hist)
+{
+	if (hist != NULL && hist->buckets != NULL) {
+		free(hist->buckets);
+		hist->buckets = NULL;
+	}
+}
+
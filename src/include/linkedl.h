@@ -41,7 +41,7 @@
 	struct _llist {
 		void *element;
 		struct _llist *next;
-	} __attribute__ ((packed));
+	};
 
 
 	typedef struct _llist llist;
@@ -53,6 +53,8 @@
 
 	int llist_add(llist **list, void *element);
 
+	int llist_add_tail(llist **list, llist **tail, void *element);
+
 	int llist_remove_nth(llist **list, unsigned int pos);
 
 	int llist_remove(llist **list, void *element);
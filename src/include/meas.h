@@ -28,6 +28,11 @@
 	#include <linkedl.h>
 	#include <sys/time.h>
 	#include <sys/resource.h>
+	#include <pthread.h>
+
+	#ifdef __cplusplus
+	extern "C" {
+	#endif
 
 	/**
 	 * syscall getjiffies number
@@ -39,11 +44,22 @@
 	 */
 	#define MAX_NAME_SIZE 35
 
+	/**
+	 * Cache line size (alignment of timers and counters)
+	 */
+	#define MEAS_CACHE_LINE 64
+
+	/**
+	 * Max. number of frames of a sampling profiler stack
+	 */
+	#define MEAS_SAMPLER_DEPTH 32
+
 	/**
 	 * Timer states
 	 */
 	#define TIMER_ST_RUNNING 1
 	#define TIMER_ST_STOPPED 0
+	#define TIMER_ST_PAUSED  2
 
 	/**
 	 * Counter states
@@ -66,10 +82,48 @@
 	 */
 	#define REPORT_USER_ITEMS 	0x04
 
+	/**
+	 * Show benchmarks in report
+	 */
+	#define REPORT_BENCHMARKS	0x08
+
+	/**
+	 * Show periodic real-time tasks in report
+	 */
+	#define REPORT_RT			0x10
+
+	/**
+	 * Show wakeup latency probes in report
+	 */
+	#define REPORT_LATENCY		0x20
+
+	/**
+	 * Show child processes in report
+	 */
+	#define REPORT_CHILDREN		0x40
+
+	/**
+	 * Show per-thread resources in report
+	 */
+	#define REPORT_THREADS		0x80
+
+	/**
+	 * Show lock contention in report
+	 */
+	#define REPORT_LOCKS		0x100
+
 	/**
 	 * Show all parameters in report
 	 */
-	#define REPORT_SHOW_ALL (REPORT_TIMERS | REPORT_COUNTERS | REPORT_USER_ITEMS)
+	#define REPORT_SHOW_ALL (REPORT_TIMERS | REPORT_COUNTERS | REPORT_USER_ITEMS | \
+							 REPORT_BENCHMARKS | REPORT_RT | REPORT_LATENCY | REPORT_CHILDREN | \
+							 REPORT_THREADS | REPORT_LOCKS)
+
+	/**
+	 * Periodic task states
+	 */
+	#define TASK_ST_RUNNING 1
+	#define TASK_ST_IDLE    0
 
 
 	/**
@@ -79,6 +133,8 @@
 		char *text;
 		unsigned long size;
 		unsigned long pos;
+		int fixed;					/* Preallocated: never grows */
+		int truncated;				/* Text did not fit a fixed buffer */
 	};
 
 	/**
@@ -95,32 +151,691 @@
 	 */
 	struct _meas_t {
 		llist *counters;
+		llist *counters_tail;
 		llist *timers;
+		llist *timers_tail;
 		struct rusage resources;
 		llist *report_items;
+		llist *benchmarks;
+		llist *tasks;
+		llist *tasks_tail;
+		llist *latencies;
+		llist *children;			/* Child process groups (see meas_spawn) */
+		struct _meas_threads *threads;	/* Per-thread resources (see meas_threads_create) */
+		llist *locks;				/* Profiled locks (see meas_create_mutex) */
 		struct _text_buffer report;
+		struct _meas_rt *rt;		/* Hard real-time mode (see meas_init_rt), NULL otherwise */
+		unsigned long last_reset;	/* Start of the current interval (see meas_snapshot_reset) */
+		struct _meas_domain *domain;	/* Shared aggregation domain (see meas_domain_attach) */
+		struct _meas_plog *plog;		/* Persistent log (see meas_plog_open) */
+		struct _meas_watchdog *watchdog;	/* Budget notifications (see meas_clock_budget) */
+	};
+
+	/**
+	 * Hard real-time mode capacities
+	 */
+	struct _meas_rt_opts {
+		unsigned int  max_timers;
+		unsigned int  max_counters;
+		unsigned int  max_tasks;		/* Periodic tasks (with their histograms) */
+		unsigned int  max_report_items;
+		unsigned long report_size;		/* Report text buffer (bytes) */
+		unsigned int  trace_threads;	/* Sampling profiler buffers */
+		unsigned long stack_size;		/* Stack prefaulted by the calling thread (bytes) */
+		int           lock_memory;		/* mlockall(MCL_CURRENT | MCL_FUTURE) */
+	};
+
+	/**
+	 * Hard real-time mode pools (one per kind of element)
+	 */
+	#define MEAS_RT_TIMERS       0
+	#define MEAS_RT_COUNTERS     1
+	#define MEAS_RT_TASKS        2
+	#define MEAS_RT_REPORT_ITEMS 3
+	#define MEAS_RT_NPOOLS       4
+
+	/**
+	 * Hard real-time mode storage: one prefaulted block holding every
+	 * element of a meas_t, split in fixed-capacity pools.
+	 */
+	struct _meas_rt {
+		char *base;
+		unsigned long size;
+		char *next[MEAS_RT_NPOOLS];	/* Next free byte of each pool */
+		char *end[MEAS_RT_NPOOLS];
+		int locked;					/* Memory locked with mlockall */
+		unsigned long violations;	/* Calls that needed to allocate */
+	};
+
+	/**
+	 * Accumulated intervals of a timer
+	 */
+	struct _meas_timer_acc {
+		unsigned long count;
+		unsigned long total;
+		unsigned long min;
+		unsigned long max;
+	};
+
+	/**
+	 * Captured intervals of a timer (see meas_clock_capture)
+	 */
+	struct _meas_samples {
+		unsigned long *values;
+		unsigned long n;
+		unsigned long capacity;
+		int grow;					/* Double the array when full (otherwise drop) */
+		unsigned long dropped;
+	};
+
+	/**
+	 * Exact statistics of captured intervals
+	 */
+	struct _meas_sample_stats {
+		unsigned long n;
+		unsigned long min;
+		unsigned long max;
+		double mean;
+		double stddev;
+	};
+
+	/**
+	 * Default number of bins of a quantile sketch
+	 */
+	#define MEAS_SKETCH_BINS 1024
+
+	/**
+	 * Mergeable quantile sketch (see meas_sketch_init)
+	 */
+	struct _meas_sketch {
+		double alpha;				/* Relative error guarantee */
+		double gamma;				/* (1 + alpha) / (1 - alpha) */
+		double inv_log_gamma;
+		int offset;					/* Key of bins[0] */
+		int lo, hi;					/* Lowest and highest keys in use */
+		unsigned int nbins;
+		unsigned long *bins;
+		unsigned long used;			/* Values counted in bins */
+		unsigned long zero;			/* Values equal to 0 */
+		unsigned long count;
+		unsigned long min;
+		unsigned long max;
+		double sum;
+		unsigned long collapsed;	/* Values moved to a higher bin (no error guarantee) */
+	};
+
+	/**
+	 * CPU placement of the intervals of a timer (see meas_clock_track_cpus)
+	 */
+	struct _meas_cpu_stats {
+		unsigned int ncpus;
+		int start_cpu;				/* CPU at meas_start_clock (-1: unknown) */
+		unsigned long migrations;	/* Intervals that ended on another CPU */
+		unsigned long unknown;		/* Intervals on a CPU out of range */
+		struct _meas_timer_acc migrated;	/* Intervals that migrated */
+		struct _meas_timer_acc *cpu;		/* Intervals that stayed on each CPU */
 	};
 
 	/**
 	 * Clock structure
+	 * Fields written by every start/stop come first: they fill the first
+	 * line (state and times) and the second line (accumulators) of the
+	 * timer. Timers never share a cache line.
 	 */
 	struct _meas_clock {
+		unsigned int seq;			/* Sequence lock of state, interv and acc */
+		unsigned int epoch;			/* Accumulator written by meas_stop_clock (acc[epoch & 1]) */
 		int state;
-		char name[MAX_NAME_SIZE];
-		unsigned long start_time;
+		unsigned int npauses;		/* Pauses of the current operation */
+		unsigned long start_time;	/* Start of the current operation or of its last resume */
 		unsigned long end_time;
-		unsigned long interv;
-	};
+		unsigned long interv;		/* Active time of the last operation */
+		struct _meas_clock *parent;	/* Enclosing running clock of this thread */
+		struct _meas_samples *samples;	/* Every interval (NULL unless captured) */
+		struct _meas_sketch *sketch;	/* Quantile sketch (NULL unless enabled) */
+		struct _meas_timer_acc acc[2] __attribute__ ((aligned (MEAS_CACHE_LINE)));
+		struct _meas_cpu_stats *cpus;	/* CPU placement (NULL unless tracked) */
+		struct _meas_budget *budget;	/* Time budget (NULL unless set) */
+		struct _meas_clock **chain;	/* Chain of running clocks it is linked in (NULL: none) */
+		unsigned long op_start;		/* Start of the current paused operation */
+		unsigned long active;		/* Active time of the current paused operation */
+		unsigned long wait;			/* Time spent paused by the last operation */
+		unsigned long waits;		/* Operations that paused */
+		unsigned long long active_total;	/* Of the operations that paused */
+		unsigned long long wait_total;
+		struct _meas_t *mst;		/* Owner (NULL unless created by meas_start_clock) */
+		char name[MAX_NAME_SIZE];
+	} __attribute__ ((aligned (MEAS_CACHE_LINE)));
 
 	/**
 	 * Counter structure
+	 * The value leads a cache line of its own: counters updated by
+	 * different threads do not share lines.
 	 */
 	struct _meas_counter {
+		unsigned long value;
 		int state;
 		char name[MAX_NAME_SIZE];
-		unsigned long value;
+	} __attribute__ ((aligned (MEAS_CACHE_LINE)));
+
+
+	/**
+	 * Overruns kept by a timer budget
+	 */
+	#define MEAS_BUDGET_HISTORY 8
+
+	/**
+	 * Budget notifications
+	 */
+	#define MEAS_BUDGET_OVERRUN 1		/* An interval ended over budget */
+	#define MEAS_BUDGET_RUNNING 2		/* A region still runs past its budget (watchdog) */
+
+	/**
+	 * Interval over budget
+	 */
+	struct _meas_overrun {
+		unsigned long interval;
+		unsigned long time;			/* End of the interval (ticks) */
+	};
+
+	/**
+	 * Time budget of a timer (see meas_clock_budget)
+	 * Times are in clock ticks (nanoseconds without the getjiffies patch).
+	 */
+	struct _meas_budget {
+		unsigned long budget;
+		unsigned long min_gap;		/* Min. time between two notifications */
+		unsigned long overruns;
+		unsigned long worst;
+		unsigned long running;		/* Activations caught running past the budget */
+		unsigned long suppressed;	/* Notifications skipped by the rate limit */
+		unsigned long last_notify;
+		unsigned long watched;		/* Start of the activation already caught running */
+		struct _meas_overrun history[MEAS_BUDGET_HISTORY];	/* Last overruns (by overruns % MEAS_BUDGET_HISTORY) */
+		void (*fn)(struct _meas_clock *clock, int kind, unsigned long interval, unsigned long time,
+				   void *ctx);
+		void *ctx;
+		struct _meas_watchdog *watchdog;
+		struct _meas_budget *next;	/* Retired budgets (see meas_clock_release_budget) */
+	};
+
+	/**
+	 * pWCET models
+	 */
+	#define MEAS_PWCET_GUMBEL 0			/* Gumbel fit of block maxima */
+	#define MEAS_PWCET_GEV    1			/* Generalized extreme value fit of block maxima */
+	#define MEAS_PWCET_POT    2			/* Generalized Pareto fit of peaks over a threshold */
+
+	/**
+	 * pWCET warnings
+	 */
+	#define MEAS_PWCET_FEW_SAMPLES 0x01	/* Fewer block maxima or peaks than min_fit */
+	#define MEAS_PWCET_POOR_FIT    0x02	/* Kolmogorov-Smirnov test rejects the model */
+	#define MEAS_PWCET_DEPENDENT   0x04	/* Samples are correlated (EVT assumes i.i.d.) */
+	#define MEAS_PWCET_HEAVY_TAIL  0x08	/* Positive shape: no upper bound, bounds grow fast */
+
+	/**
+	 * pWCET estimation options
+	 */
+	struct _meas_pwcet_opts {
+		int method;					/* MEAS_PWCET_GUMBEL, MEAS_PWCET_GEV or MEAS_PWCET_POT */
+		unsigned int block_size;	/* Samples per block (block maxima) */
+		double tail;				/* Fraction of samples over the threshold (POT) */
+		unsigned int min_fit;		/* Fewer fitted values raise MEAS_PWCET_FEW_SAMPLES */
+		double alpha;				/* Significance level of the goodness-of-fit test */
+	};
+
+	/**
+	 * Extreme value model of a timer (see meas_pwcet_fit)
+	 * Values are in clock ticks.
+	 */
+	struct _meas_pwcet {
+		int method;
+		unsigned long n;			/* Samples */
+		unsigned long nfit;			/* Block maxima or peaks fitted */
+		unsigned int block_size;
+		double location;			/* mu (block maxima) or threshold (POT) */
+		double scale;				/* sigma */
+		double shape;				/* xi (0 for Gumbel) */
+		double ks;					/* Kolmogorov-Smirnov distance of the fit */
+		double ks_p;				/* and its p-value */
+		double lag1;				/* Lag-1 autocorrelation of the samples */
+		unsigned long max;			/* Observed max. */
+		int warnings;
+	};
+
+	/**
+	 * Function timed by libmeas-autoprof (times in nanoseconds)
+	 */
+	struct _meas_autoprof_func {
+		void *fn;
+		unsigned long calls;
+		unsigned long long inclusive;
+		unsigned long long self;		/* Without the timed callees */
+		unsigned long long max;			/* Longest call (inclusive) */
+	};
+
+	/**
+	 * Operations traced by libmeas-iotrace
+	 */
+	#define MEAS_IOTRACE_READ	0	/* read, pread, recv */
+	#define MEAS_IOTRACE_WRITE	1	/* write, pwrite, send */
+	#define MEAS_IOTRACE_SYNC	2	/* fsync, fdatasync */
+	#define MEAS_IOTRACE_OPEN	3
+	#define MEAS_IOTRACE_CLOSE	4
+	#define MEAS_IOTRACE_OPS	5
+
+	/**
+	 * Max. size of the paths traced by libmeas-iotrace
+	 */
+	#define MEAS_IOTRACE_PATH	256
+
+	/**
+	 * Calls of one operation on a file (times in nanoseconds)
+	 */
+	struct _meas_iotrace_op {
+		unsigned long calls;
+		unsigned long errors;
+		unsigned long long bytes;		/* Read or written */
+		unsigned long long time;
+		unsigned long long max;
+	};
+
+	/**
+	 * File traced by libmeas-iotrace
+	 */
+	struct _meas_iotrace_file {
+		char path[MEAS_IOTRACE_PATH];
+		int fd;							/* Last descriptor of the file */
+		struct _meas_iotrace_op op[MEAS_IOTRACE_OPS];
+	};
+
+	/**
+	 * Benchmark options
+	 * Times are in clock ticks (nanoseconds without the getjiffies patch).
+	 */
+	struct _meas_bench_opts {
+		unsigned long warmup_time;	/* Time spent warming up */
+		unsigned long sample_time;	/* Target duration of each sample batch */
+		unsigned int  nsamples;		/* Number of sample batches */
+		unsigned int  nresamples;	/* Bootstrap resamples (0 disables the CI) */
+		double        confidence;	/* Confidence level of the interval */
+	};
+
+	/**
+	 * Benchmark result
+	 * Statistics are in clock ticks per iteration.
+	 */
+	struct _meas_bench {
+		char name[MAX_NAME_SIZE];
+		unsigned long iterations;	/* Iterations per sample batch */
+		unsigned int  nsamples;
+		double *samples;
+		double min;
+		double max;
+		double mean;
+		double median;
+		double mad;
+		double ci_low;
+		double ci_high;
+		double confidence;
+		unsigned int outliers_low;
+		unsigned int outliers_high;
+	};
+
+	/**
+	 * Function under benchmark
+	 */
+	typedef void (*meas_bench_fn)(void *ctx);
+
+	/**
+	 * Kinds of metrics in a saved run
+	 */
+	#define MEAS_RUN_TIMER   1
+	#define MEAS_RUN_COUNTER 2
+	#define MEAS_RUN_BENCH   3
+
+	/**
+	 * Metric of a saved run
+	 */
+	struct _meas_run_metric {
+		char name[MAX_NAME_SIZE];
+		int kind;
+		int summary;				/* Timer saved without samples: count, total, min, max */
+		unsigned int nsamples;
+		double *samples;
+	};
+
+	/**
+	 * Saved run (see meas_save_run and meas_load_run)
+	 */
+	struct _meas_run {
+		llist *metrics;
+		llist *metrics_tail;
+	};
+
+	/**
+	 * Comparison methods
+	 */
+	#define MEAS_CMP_MANN_WHITNEY 0
+	#define MEAS_CMP_BOOTSTRAP    1
+
+	/**
+	 * Comparison verdicts
+	 */
+	#define MEAS_CMP_UNCHANGED   0
+	#define MEAS_CMP_REGRESSION  1
+	#define MEAS_CMP_IMPROVEMENT 2
+	#define MEAS_CMP_UNTESTED    3
+
+	/**
+	 * Comparison options
+	 */
+	struct _meas_cmp_opts {
+		int method;					/* MEAS_CMP_MANN_WHITNEY or MEAS_CMP_BOOTSTRAP */
+		double alpha;				/* Significance level */
+		unsigned int min_samples;	/* Fewer samples leave a metric untested */
+		unsigned int nresamples;	/* Bootstrap resamples */
+	};
+
+	/**
+	 * Comparison of one metric present in both runs
+	 */
+	struct _meas_cmp_result {
+		char name[MAX_NAME_SIZE];
+		int kind;
+		unsigned int nbase;
+		unsigned int ncur;
+		double base_median;			/* Mean when summary is set */
+		double cur_median;
+		double change;				/* Relative change of the median */
+		int summary;				/* A side has no samples: means compared, untested */
+		double p_value;
+		int verdict;
+	};
+
+	/**
+	 * Fixed-size histogram of linear buckets
+	 * Bucket i holds values in [low + i * width, low + (i + 1) * width).
+	 */
+	struct _meas_histogram {
+		unsigned long low;
+		unsigned long width;
+		unsigned int  nbuckets;
+		unsigned long *buckets;
+		unsigned long underflow;	/* Values below low */
+		unsigned long overflow;		/* Values above the last bucket */
+		unsigned long count;
+		unsigned long long sum;
+		unsigned long min;
+		unsigned long max;
+	};
+
+	/**
+	 * Periodic real-time task
+	 * Times are in clock ticks (nanoseconds without the getjiffies patch).
+	 */
+	struct _meas_task {
+		unsigned int seq;			/* Sequence lock of the statistics */
+		int state;
+		char name[MAX_NAME_SIZE];
+		unsigned long period;
+		unsigned long deadline;		/* Relative to the release */
+		unsigned long origin;		/* Release of the first job */
+		unsigned long release;		/* Release of the current job */
+		unsigned long start;		/* Start of the current job */
+		unsigned long job;			/* Index of the current job */
+		unsigned long jobs;			/* Completed jobs */
+		unsigned long skipped;		/* Releases without an activation */
+		unsigned long misses;
+		unsigned long miss_run;		/* Current run of consecutive misses */
+		unsigned long max_miss_run;
+		struct _meas_histogram jitter;		/* Release jitter */
+		struct _meas_histogram response;	/* Response time */
+		struct _meas_histogram miss_runs;	/* Lengths of runs of consecutive misses */
+		void (*on_miss)(struct _meas_task *task, unsigned long response, void *ctx);
+		void *miss_ctx;
+	};
+
+	/**
+	 * Wakeup latency probe options
+	 * Times are in nanoseconds (CLOCK_MONOTONIC).
+	 */
+	struct _meas_latency_opts {
+		unsigned int  nthreads;		/* Measurement threads (0: one per online CPU) */
+		unsigned long interval;		/* Sleep interval of each thread */
+		unsigned long loops;		/* Wakeups per thread */
+		int           priority;		/* SCHED_FIFO priority (0: SCHED_OTHER) */
+		unsigned long resolution;	/* Histogram bucket width */
+		unsigned long max_latency;	/* Histogram range (larger values overflow) */
+	};
+
+	/**
+	 * Wakeup latency of one measurement thread
+	 */
+	struct _meas_latency_thread {
+		int cpu;					/* CPU the thread is pinned to (-1: not pinned) */
+		int fifo;					/* Thread ran under SCHED_FIFO */
+		struct _meas_histogram hist;
+	};
+
+	/**
+	 * Wakeup latency probe result
+	 */
+	struct _meas_latency {
+		char name[MAX_NAME_SIZE];
+		unsigned long interval;
+		unsigned int nthreads;
+		unsigned int unpinned;		/* Threads whose pinning failed */
+		struct _meas_latency_thread *threads;
+	};
+
+	/**
+	 * Interval value of a timer or counter (see meas_snapshot_reset)
+	 */
+	struct _meas_interval {
+		char name[MAX_NAME_SIZE];
+		int kind;					/* MEAS_RUN_TIMER or MEAS_RUN_COUNTER */
+		long value;					/* Counter change or total timer ticks */
+		unsigned long count;		/* Timer intervals */
+		unsigned long min;
+		unsigned long max;
+	};
+
+	/**
+	 * Resources of the children spawned under one name (see meas_spawn)
+	 */
+	struct _meas_child_stats {
+		char name[MAX_NAME_SIZE];
+		unsigned long nchildren;	/* Children waited for */
+		unsigned long nfailed;		/* Non-zero exit status or killed by a signal */
+		unsigned long wall_min;		/* Wall time (ticks) */
+		unsigned long wall_max;
+		unsigned long wall_total;
+		struct timeval utime;		/* Totals */
+		struct timeval stime;
+		long maxrss;				/* Largest child (KB) */
+		long minflt;				/* Totals */
+		long majflt;
+		long nvcsw;
+		long nivcsw;
+		long inblock;
+		long oublock;
+	};
+
+	/**
+	 * Child process started by meas_spawn (results set by meas_wait)
+	 */
+	struct _meas_child {
+		int pid;
+		unsigned long start;		/* meas_get_ticks before the spawn */
+		unsigned long wall;			/* Until the child was reaped (ticks) */
+		int status;					/* As returned by wait4 */
+		struct rusage usage;
+		struct _meas_child_stats *stats;
+	};
+
+	/**
+	 * Size of a thread name (with the terminator)
+	 */
+	#define MEAS_THREAD_NAME 16
+
+	/**
+	 * Resources of a thread (from /proc/self/task/<tid>)
+	 */
+	struct _meas_thread_info {
+		int tid;
+		char name[MEAS_THREAD_NAME];
+		int cpu;					/* Last CPU */
+		unsigned long long utime;	/* ns (clock tick resolution) */
+		unsigned long long stime;
+		unsigned long long run;		/* Time on a CPU (ns, schedstat) */
+		unsigned long long wait;	/* Time waiting on a run queue (ns, schedstat) */
+		unsigned long nvcsw;		/* Voluntary context switches */
+		unsigned long nivcsw;		/* Involuntary context switches */
+		int fd_stat;				/* Cached file descriptors */
+		int fd_schedstat;
+		int fd_status;
+	};
+
+	/**
+	 * Kinds of profiled locks
+	 */
+	#define MEAS_LOCK_MUTEX  0
+	#define MEAS_LOCK_RWLOCK 1
+
+	/**
+	 * Acquisitions of a lock in one mode (times in clock ticks)
+	 */
+	struct _meas_lock_stats {
+		unsigned long acquisitions;
+		unsigned long contended;		/* Acquisitions that had to wait */
+		unsigned long long wait;		/* Time waiting to acquire */
+		unsigned long wait_max;
+		unsigned long long hold;		/* Time between acquire and release */
+		unsigned long hold_max;
+	};
+
+	/**
+	 * Profiled lock (a mutex or a read-write lock)
+	 * Statistics are kept per thread and merged when read.
+	 */
+	struct _meas_mutex {
+		union {
+			pthread_mutex_t mutex;
+			pthread_rwlock_t rwlock;
+		} u;
+		int type;					/* MEAS_LOCK_MUTEX or MEAS_LOCK_RWLOCK */
+		unsigned long id;			/* Key of the per-thread statistics (never reused) */
+		char name[MAX_NAME_SIZE];
 	};
 
+	/**
+	 * Per-thread resource probe: the last two snapshots of every thread
+	 */
+	struct _meas_threads {
+		struct _meas_t *mst;
+		int dirfd;					/* /proc/self/task */
+		void *dir;
+		unsigned int capacity;
+		unsigned int n;				/* Threads of the last snapshot (sorted by tid) */
+		unsigned int nprev;
+		struct _meas_thread_info *threads;
+		struct _meas_thread_info *prev;
+		unsigned char *seen;		/* Scratch of meas_threads_update */
+		unsigned long long time;	/* CLOCK_MONOTONIC of the last snapshot (ns) */
+		unsigned long long prev_time;
+		unsigned long dropped;		/* Threads beyond the capacity (last snapshot) */
+	};
+
+	/**
+	 * Shared aggregation domain capacities
+	 */
+	#define MEAS_DOMAIN_SLOTS   32		/* Processes attached at the same time */
+	#define MEAS_DOMAIN_METRICS 128		/* Metrics published by each process */
+
+	/**
+	 * Views of an aggregated report
+	 */
+	#define MEAS_DOMAIN_PROCESSES 0x01
+	#define MEAS_DOMAIN_TOTAL     0x02
+
+	/**
+	 * Attachment of a process to a shared aggregation domain
+	 */
+	struct _meas_domain {
+		char name[MAX_NAME_SIZE];
+		struct _meas_domain_shm *shm;
+		unsigned int slot;			/* Slot owned by this process */
+		struct _meas_t *mst;
+	};
+
+	/**
+	 * Persistent log records
+	 */
+	#define MEAS_PLOG_SESSION  1		/* A process opened the log */
+	#define MEAS_PLOG_SNAPSHOT 2		/* Timers and counters */
+	#define MEAS_PLOG_EVENT    3		/* Trace event */
+
+	/**
+	 * Record recovered from a persistent log (see meas_plog_read)
+	 */
+	struct _meas_plog_rec {
+		int type;
+		unsigned long long seq;		/* Position in the log (increasing) */
+		unsigned long long time;	/* CLOCK_REALTIME (ns) */
+		unsigned int session;		/* Number of the session that wrote it */
+		int pid;					/* Process of the session */
+		unsigned int nmetrics;		/* MEAS_PLOG_SNAPSHOT */
+		const struct _meas_interval *metrics;
+		const char *name;			/* MEAS_PLOG_EVENT */
+		long value;
+	};
+
+	/**
+	 * Trace compression capacities
+	 */
+	#define MEAS_CODEC_NAMES        256		/* Names of an encoder */
+	#define MEAS_CODEC_BLOCK_EVENTS 4096	/* Default events per block */
+
+	/**
+	 * Trace compression sink (return FALSE if the block was not stored)
+	 */
+	typedef int (*meas_codec_sink)(const void *buf, unsigned long len, void *ctx);
+
+	/**
+	 * Trace encoder: events (timestamp, name, value) in self-contained
+	 * blocks (delta-of-delta timestamps, zigzag varint value deltas and
+	 * names defined once per block)
+	 */
+	struct _meas_codec {
+		meas_codec_sink sink;
+		void *ctx;
+		unsigned char *block;		/* Events of the current block */
+		unsigned long used;
+		unsigned int block_events;
+		unsigned int nevents;		/* Events in the current block */
+		unsigned long long base;	/* Timestamp of the first event of the block */
+		unsigned long long prev_ts;
+		long long prev_delta;
+		unsigned int nnames;
+		char names[MEAS_CODEC_NAMES][MAX_NAME_SIZE];
+		unsigned char defined[MEAS_CODEC_NAMES];	/* Name defined in the current block */
+		long prev_value[MEAS_CODEC_NAMES];
+		unsigned long blocks;		/* Blocks stored */
+		unsigned long dropped;		/* Blocks refused by the sink */
+		unsigned long long in_events;
+		unsigned long long out_bytes;
+	};
+
+	/**
+	 * Memory sink of an encoder (e.g. a shared memory region)
+	 */
+	struct _meas_codec_mem {
+		char *base;
+		unsigned long size;
+		unsigned long used;
+	};
 
 	/**
 	 * Typedefs
@@ -129,6 +844,68 @@
 	typedef struct _meas_clock   	 meas_clock;
 	typedef struct _meas_counter 	 meas_counter;
 	typedef struct _meas_report_item meas_report_item;
+	typedef struct _meas_bench_opts  meas_bench_opts;
+	typedef struct _meas_bench       meas_bench;
+	typedef struct _meas_run_metric  meas_run_metric;
+	typedef struct _meas_run         meas_run;
+	typedef struct _meas_cmp_opts    meas_cmp_opts;
+	typedef struct _meas_cmp_result  meas_cmp_result;
+	typedef struct _meas_symtab      meas_symtab;
+	typedef struct _meas_histogram   meas_histogram;
+	typedef struct _meas_task        meas_task;
+	typedef struct _meas_latency_opts   meas_latency_opts;
+	typedef struct _meas_latency_thread meas_latency_thread;
+	typedef struct _meas_latency        meas_latency;
+	typedef struct _meas_rt_opts        meas_rt_opts;
+	typedef struct _meas_rt             meas_rt;
+	typedef struct _meas_reporter       meas_reporter;
+	typedef struct _meas_timer_acc      meas_timer_acc;
+	typedef struct _meas_interval       meas_interval;
+	typedef struct _meas_samples        meas_samples;
+	typedef struct _meas_sample_stats   meas_sample_stats;
+	typedef struct _meas_sketch         meas_sketch;
+	typedef struct _meas_cpu_stats      meas_cpu_stats;
+	typedef struct _meas_overrun        meas_overrun;
+	typedef struct _meas_budget         meas_budget;
+	typedef struct _meas_watchdog       meas_watchdog;
+	typedef struct _meas_pwcet_opts     meas_pwcet_opts;
+	typedef struct _meas_pwcet          meas_pwcet;
+	typedef struct _meas_autoprof_func  meas_autoprof_func;
+	typedef struct _meas_iotrace_op     meas_iotrace_op;
+	typedef struct _meas_iotrace_file   meas_iotrace_file;
+	typedef struct _meas_domain         meas_domain;
+	typedef struct _meas_plog           meas_plog;
+	typedef struct _meas_plog_rec       meas_plog_rec;
+	typedef struct _meas_codec          meas_codec;
+	typedef struct _meas_codec_mem      meas_codec_mem;
+	typedef struct _meas_child_stats    meas_child_stats;
+	typedef struct _meas_child          meas_child;
+	typedef struct _meas_thread_info    meas_thread_info;
+	typedef struct _meas_threads        meas_threads;
+	typedef struct _meas_lock_stats     meas_lock_stats;
+	typedef struct _meas_mutex          meas_mutex;
+
+	/**
+	 * Deadline miss callback (runs in the task thread, must not block)
+	 */
+	typedef void (*meas_task_miss_fn)(meas_task *task, unsigned long response, void *ctx);
+
+	/**
+	 * Budget notification callback (runs in the thread draining the
+	 * notifications, see meas_budget_drain)
+	 */
+	typedef void (*meas_budget_fn)(meas_clock *clock, int kind, unsigned long interval,
+								   unsigned long time, void *ctx);
+
+	/**
+	 * Persistent log reader callback (return FALSE to stop reading)
+	 */
+	typedef int (*meas_plog_fn)(const meas_plog_rec *rec, void *ctx);
+
+	/**
+	 * Trace decoder callback (return FALSE to stop decoding)
+	 */
+	typedef int (*meas_codec_fn)(unsigned long long ts, const char *name, long value, void *ctx);
 
 
 	/**
@@ -136,22 +913,172 @@
 	 */
 	int  meas_init(meas_t **mst);
 	void meas_close(meas_t **mst);
+
+	/**
+	 * Hard real-time mode
+	 */
+	void meas_rt_defaults(meas_rt_opts *opts);
+	int  meas_init_rt(meas_t **mst, const meas_rt_opts *opts);
+	unsigned long meas_rt_violations(meas_t *mst);
 	
 	/**
  	 * Timer functions
 	 */
-	meas_clock *meas_start_clock(meas_t **mst, meas_clock *clock, char *name);
+	meas_clock *meas_start_clock(meas_t **mst, meas_clock *clock, const char *name);
 	int meas_stop_clock(meas_clock *clock);
+	int meas_pause_clock(meas_clock *clock);
+	int meas_resume_clock(meas_clock *clock);
+	unsigned long meas_calibrate(unsigned int npairs);
+	void meas_compensate_overhead(int enable);
+	unsigned long meas_get_overhead(void);
+	meas_clock *meas_active_clock(void);
+	unsigned long meas_get_ticks(void);
+
+	/**
+	 * Raw sample capture
+	 */
+	int meas_clock_capture(meas_clock *clock, unsigned long capacity, int grow);
+	void meas_clock_release_samples(meas_clock *clock);
+	int meas_samples_stats(meas_clock *clock, meas_sample_stats *stats, const double *p,
+						   unsigned int np, unsigned long *values);
+	int meas_samples_write(meas_clock *clock, FILE *fp);
+
+	/**
+	 * Quantile sketches
+	 */
+	int  meas_sketch_init(meas_sketch *sk, double alpha, unsigned int nbins);
+	void meas_sketch_free(meas_sketch *sk);
+	void meas_sketch_add(meas_sketch *sk, unsigned long value);
+	int  meas_sketch_merge(meas_sketch *dst, const meas_sketch *src);
+	unsigned long meas_sketch_percentile(const meas_sketch *sk, double p);
+	int  meas_sketch_write(const meas_sketch *sk, const char *name, FILE *fp);
+	int  meas_sketch_read(meas_sketch *sk, char *name, FILE *fp);
+	int  meas_clock_sketch(meas_clock *clock, double alpha, unsigned int nbins);
+	void meas_clock_release_sketch(meas_clock *clock);
+
+	/**
+	 * CPU placement of timers
+	 */
+	int  meas_clock_track_cpus(meas_clock *clock);
+	void meas_clock_release_cpus(meas_clock *clock);
+
+	/**
+	 * Time budgets and watchdog
+	 */
+	int  meas_clock_budget(meas_t **mst, meas_clock *clock, unsigned long budget,
+						   unsigned long min_gap, meas_budget_fn fn, void *ctx);
+	void meas_clock_release_budget(meas_clock *clock);
+	int  meas_budget_drain(meas_t **mst);
+	unsigned long meas_budget_dropped(meas_t **mst);
+	int  meas_watchdog_start(meas_t **mst, unsigned long period);
+	void meas_watchdog_stop(meas_t **mst);
+
+	/**
+	 * Probabilistic WCET
+	 */
+	void meas_pwcet_defaults(meas_pwcet_opts *opts);
+	int  meas_pwcet_fit(const unsigned long *values, unsigned long n, const meas_pwcet_opts *opts,
+						meas_pwcet *fit);
+	int  meas_pwcet_clock(meas_clock *clock, const meas_pwcet_opts *opts, meas_pwcet *fit);
+	int  meas_pwcet_hist(meas_histogram *hist, const meas_pwcet_opts *opts, meas_pwcet *fit);
+	double meas_pwcet_bound(const meas_pwcet *fit, double p);
+	int  meas_pwcet_write(const meas_pwcet *fit, const char *name, FILE *fp);
+
+	/**
+	 * Automatic function instrumentation (libmeas-autoprof, code built
+	 * with -finstrument-functions)
+	 */
+	int  meas_autoprof_filter(const char *pattern, int include);
+	void meas_autoprof_enable(int enable);
+	int  meas_autoprof_get(void *fn, meas_autoprof_func *stats);
+	int  meas_autoprof_write(FILE *fp);
+
+	/**
+	 * Blocking I/O tracing (libmeas-iotrace, LD_PRELOAD or linked)
+	 */
+	void meas_iotrace_enable(int enable);
+	int  meas_iotrace_path(const char *path, meas_iotrace_file *stats);
+	int  meas_iotrace_fd(int fd, meas_iotrace_file *stats);
+	int  meas_iotrace_write(FILE *fp);
+
+	/**
+	 * Child processes
+	 */
+	int meas_spawn(meas_t **mst, meas_child *child, const char *name, char *const argv[],
+				   char *const envp[]);
+	int meas_wait(meas_child *child);
+	meas_child_stats *meas_get_child_stats(meas_t **mst, const char *name);
+
+	/**
+	 * Per-thread resources
+	 */
+	meas_threads *meas_threads_create(meas_t **mst, unsigned int capacity);
+	int  meas_threads_update(meas_threads *thr);
+	int  meas_threads_delta(meas_threads *thr, unsigned int i, meas_thread_info *delta);
+	void meas_threads_free(meas_threads **thr);
+
+	/**
+	 * Lock contention profiling
+	 */
+	meas_mutex *meas_create_mutex(meas_t **mst, const char *name);
+	meas_mutex *meas_create_rwlock(meas_t **mst, const char *name);
+	int  meas_mutex_lock(meas_mutex *m);
+	int  meas_mutex_rdlock(meas_mutex *m);
+	int  meas_mutex_unlock(meas_mutex *m);
+	int  meas_mutex_cond_wait(meas_mutex *m, pthread_cond_t *cond, const struct timespec *abstime);
+	int  meas_mutex_stats(meas_mutex *m, int shared, meas_lock_stats *stats);
 
 	/**
 	 * Counter functions
 	 */
-	meas_counter *meas_create_counter(meas_t **mst, unsigned long ivalue, char *name);
+	meas_counter *meas_create_counter(meas_t **mst, unsigned long ivalue, const char *name);
 	unsigned long meas_set_counter(meas_counter *counter, unsigned long value);
 	unsigned long meas_get_counter(meas_counter counter);
 	unsigned long meas_inc_counter(meas_counter *counter);
 	unsigned long meas_dec_counter(meas_counter *counter);
 
+	/**
+	 * Interval harvesting
+	 */
+	int meas_snapshot_reset(meas_t **mst, meas_interval **values, unsigned int *nvalues,
+							unsigned long *elapsed);
+
+	/**
+	 * Multi-process aggregation
+	 */
+	meas_domain *meas_domain_attach(meas_t **mst, const char *name, const char *tag);
+	int  meas_domain_publish(meas_domain *domain);
+	void meas_domain_detach(meas_domain **domain);
+	int  meas_domain_totals(const char *name, meas_interval **values, unsigned int *nvalues);
+	int  meas_domain_report(const char *name, int views, FILE *fp);
+	int  meas_domain_reap(const char *name);
+	int  meas_domain_unlink(const char *name);
+
+	/**
+	 * Persistent log
+	 */
+	meas_plog *meas_plog_open(meas_t **mst, const char *path, unsigned long size,
+							  unsigned long period);
+	int  meas_plog_snapshot(meas_plog *plog);
+	int  meas_plog_event(meas_plog *plog, const char *name, long value);
+	int  meas_plog_sync(meas_plog *plog, int wait);
+	unsigned long meas_plog_dropped(meas_plog *plog);
+	void meas_plog_close(meas_plog **plog);
+	int  meas_plog_read(const char *path, meas_plog_fn fn, void *ctx);
+
+	/**
+	 * Trace compression
+	 */
+	int  meas_codec_init(meas_codec *enc, unsigned int block_events, meas_codec_sink sink, void *ctx);
+	int  meas_codec_name(meas_codec *enc, const char *name);
+	int  meas_codec_put(meas_codec *enc, int id, unsigned long long ts, long value);
+	int  meas_codec_flush(meas_codec *enc);
+	void meas_codec_free(meas_codec *enc);
+	long meas_codec_decode(const void *buf, unsigned long len, meas_codec_fn fn, void *ctx);
+	int  meas_codec_file_sink(const void *buf, unsigned long len, void *ctx);
+	int  meas_codec_mem_sink(const void *buf, unsigned long len, void *ctx);
+	int  meas_samples_encode(meas_clock *clock, meas_codec *enc);
+
 	/**
 	 * Resources functions
 	 */
@@ -166,12 +1093,87 @@
 	long meas_get_blkoutput(meas_t **mst, int who);
 	long meas_get_cswitches(meas_t **mst, int who);
 
+	/**
+	 * Benchmark functions
+	 */
+	void meas_bench_defaults(meas_bench_opts *opts);
+	meas_bench *meas_bench_run(meas_t **mst, const char *name, meas_bench_fn fn,
+							   void *ctx, const meas_bench_opts *opts);
+
+	/**
+	 * Saved runs and baseline comparison
+	 */
+	int meas_save_run(meas_t *mst, FILE *fp);
+	meas_run *meas_load_run(FILE *fp);
+	void meas_free_run(meas_run **run);
+	void meas_cmp_defaults(meas_cmp_opts *opts);
+	int meas_compare_runs(meas_run *base, meas_run *cur, const meas_cmp_opts *opts,
+						  meas_cmp_result **results, unsigned int *nresults);
+
+	/**
+	 * Sampling profiler
+	 */
+	int meas_sampler_start(unsigned int frequency);
+	int meas_sampler_attach(void);
+	void meas_sampler_detach(void);
+	void meas_sampler_stop(void);
+	int meas_sampler_reserve(unsigned int nthreads);
+	void meas_sampler_clear(void);
+	int meas_sampler_write(FILE *fp);
+
+	/**
+	 * ELF symbol tables
+	 */
+	meas_symtab *meas_symtab_load(const char *path);
+	const char *meas_symtab_lookup(meas_symtab *tab, unsigned long offset, unsigned long *symoff);
+	void meas_symtab_free(meas_symtab **tab);
+
+	/**
+	 * Histograms
+	 */
+	int meas_hist_init(meas_histogram *hist, unsigned long low, unsigned long width,
+					   unsigned int nbuckets);
+	void meas_hist_setup(meas_histogram *hist, unsigned long low, unsigned long width,
+						 unsigned int nbuckets, unsigned long *buckets);
+	void meas_hist_add(meas_histogram *hist, unsigned long value);
+	unsigned long meas_hist_percentile(meas_histogram *hist, double p);
+	double meas_hist_mean(meas_histogram *hist);
+	void meas_hist_reset(meas_histogram *hist);
+	void meas_hist_free(meas_histogram *hist);
+
+	/**
+	 * Periodic real-time tasks
+	 */
+	meas_task *meas_create_task(meas_t **mst, const char *name, unsigned long period,
+								unsigned long deadline);
+	void meas_task_on_miss(meas_task *task, meas_task_miss_fn fn, void *ctx);
+	int meas_task_begin(meas_task *task);
+	int meas_task_end(meas_task *task);
+
+	/**
+	 * Wakeup latency probe
+	 */
+	void meas_latency_defaults(meas_latency_opts *opts);
+	meas_latency *meas_latency_run(meas_t **mst, const char *name, const meas_latency_opts *opts);
+
 	/**
 	 * Report functions
 	 */
 	int meas_generate_report(meas_t **mst, int parameters);
 	void meas_write_report(meas_t *mst, FILE *fp);
-	int meas_add_report_item(meas_t **mst, char *name, char *fmt, long value);
+	int meas_add_report_item(meas_t **mst, const char *name, const char *fmt, long value);
+
+	/**
+	 * Asynchronous reports
+	 */
+	meas_reporter *meas_reporter_start(meas_t **mst, FILE *fp, int parameters);
+	int meas_reporter_snapshot(meas_reporter *rep);
+	unsigned long meas_reporter_dropped(meas_reporter *rep);
+	void meas_reporter_stop(meas_reporter **rep);
+
+	#ifdef __cplusplus
+	}
+	#endif
 
 #endif
 
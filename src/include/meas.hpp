@@ -0,0 +1,449 @@
+ /**
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * C++17 header-only layer over meas.h
+ *
+ * Usage:
+ *
+ *   static constexpr char rx_name[] = "RX_PACKETS";
+ *   meas::Counter<rx_name>::inc();
+ *
+ *   meas::Timer t(meas::Session::global(), "T_LOOP");
+ *   {
+ *       meas::ScopedTimer guard(t);
+ *       ...                              // stopped on every exit path
+ *   }
+ *
+ * Define MEAS_DISABLE before including this file to compile every
+ * operation away (meas::enabled becomes a constexpr false).
+ */
+
+#ifndef MEAS_HPP
+
+	#define MEAS_HPP
+
+	#include <meas.h>
+	#include <cstdint>
+	#include <cstring>
+	#include <cstdio>
+	#include <mutex>
+	#include <unordered_map>
+	#include <utility>
+
+namespace meas {
+
+	/**
+	 * Compile-time switch for every wrapper operation
+	 */
+#ifdef MEAS_DISABLE
+	inline constexpr bool enabled = false;
+#else
+	inline constexpr bool enabled = true;
+#endif
+
+	namespace detail {
+
+		/**
+		 * FNV-1a hash of a metric name, evaluated at compile time
+		 */
+		constexpr std::uint64_t hash(const char *s)
+		{
+			std::uint64_t h = 14695981039346656037ull;
+
+			while (*s != '\0') {
+				h ^= static_cast<unsigned char>(*s++);
+				h *= 1099511628211ull;
+			}
+			return(h);
+		}
+
+		/**
+		 * Length of a metric name, evaluated at compile time
+		 */
+		constexpr std::size_t length(const char *s)
+		{
+			std::size_t n = 0;
+
+			while (s[n] != '\0')
+				n++;
+			return(n);
+		}
+
+		/**
+		 * Name provider for a pointer to a constexpr character array
+		 */
+		template <const char *Name>
+		struct name_ptr {
+			static constexpr const char *value = Name;
+		};
+
+#if __cplusplus >= 202002L
+		/**
+		 * String literal usable as a template argument (C++20)
+		 */
+		template <std::size_t N>
+		struct fixed_string {
+			char value[N];
+
+			constexpr fixed_string(const char (&s)[N])
+			{
+				for (std::size_t i = 0; i < N; i++)
+					value[i] = s[i];
+			}
+		};
+
+		/**
+		 * Name provider for a fixed_string template argument
+		 */
+		template <fixed_string S>
+		struct name_lit {
+			static constexpr const char *value = S.value;
+		};
+#endif
+	}
+
+
+	/**
+	 * Owner of a meas_t structure (move-only)
+	 */
+	class Session {
+		public:
+			Session()
+			{
+				if constexpr (enabled) {
+					if (meas_init(&mst_) == FALSE)
+						mst_ = nullptr;
+				}
+			}
+
+			~Session()
+			{
+				if (mst_ != nullptr)
+					meas_close(&mst_);
+			}
+
+			Session(const Session &) = delete;
+			Session &operator=(const Session &) = delete;
+
+			Session(Session &&other) noexcept : mst_(other.mst_)
+			{
+				other.mst_ = nullptr;
+			}
+
+			Session &operator=(Session &&other) noexcept
+			{
+				if (this != &other) {
+					if (mst_ != nullptr)
+						meas_close(&mst_);
+					mst_ = other.mst_;
+					other.mst_ = nullptr;
+				}
+				return(*this);
+			}
+
+			/**
+			 * Process wide session used by named metrics. Never destroyed:
+			 * counters cached by BasicCounter stay valid through static
+			 * destruction, so metrics updated at exit are still counted.
+			 */
+			static Session &global()
+			{
+				static Session *session = new Session();
+				return(*session);
+			}
+
+			meas_t *get() const
+			{
+				return(mst_);
+			}
+
+			meas_t **ptr()
+			{
+				return(&mst_);
+			}
+
+			/**
+			 * Generate the report and write it to fp
+			 * @param fp Output stream.
+			 * @param parameters Report parameters (REPORT_SHOW_ALL by default).
+			 */
+			void write_report(FILE *fp, int parameters = REPORT_SHOW_ALL)
+			{
+				if constexpr (enabled) {
+					if (mst_ != nullptr) {
+						meas_generate_report(&mst_, parameters);
+						meas_write_report(mst_, fp);
+					}
+				}
+			}
+
+		private:
+			meas_t *mst_ = nullptr;
+	};
+
+
+	/**
+	 * Handle to a meas_clock (move-only). A running timer is stopped
+	 * when its handle is destroyed.
+	 */
+	class Timer {
+		public:
+			Timer(Session &session, const char *name) :
+				session_(&session), name_(name) { }
+
+			~Timer()
+			{
+				stop();
+			}
+
+			Timer(const Timer &) = delete;
+			Timer &operator=(const Timer &) = delete;
+
+			Timer(Timer &&other) noexcept :
+				session_(other.session_), name_(other.name_), clock_(other.clock_)
+			{
+				other.clock_ = nullptr;
+			}
+
+			Timer &operator=(Timer &&other) noexcept
+			{
+				if (this != &other) {
+					stop();
+					session_ = other.session_;
+					name_    = other.name_;
+					clock_   = other.clock_;
+					other.clock_ = nullptr;
+				}
+				return(*this);
+			}
+
+			/**
+			 * Start the timer (the clock is created on first start)
+			 */
+			void start()
+			{
+				if constexpr (enabled) {
+					if (clock_ == nullptr) {
+						if (session_->get() != nullptr)
+							clock_ = meas_start_clock(session_->ptr(), nullptr, name_);
+					} else {
+						meas_start_clock(nullptr, clock_, name_);
+					}
+				}
+			}
+
+			/**
+			 * Stop the timer if it is running or paused
+			 */
+			void stop()
+			{
+				if constexpr (enabled) {
+					if (clock_ != nullptr && clock_->state != TIMER_ST_STOPPED)
+						meas_stop_clock(clock_);
+				}
+			}
+
+			/**
+			 * Pause the timer if it is running (see meas_pause_clock)
+			 */
+			void pause()
+			{
+				if constexpr (enabled) {
+					if (clock_ != nullptr)
+						meas_pause_clock(clock_);
+				}
+			}
+
+			/**
+			 * Resume the timer in the calling thread if it is paused
+			 */
+			void resume()
+			{
+				if constexpr (enabled) {
+					if (clock_ != nullptr)
+						meas_resume_clock(clock_);
+				}
+			}
+
+			/**
+			 * Last measured interval (0 if never stopped)
+			 */
+			unsigned long interval() const
+			{
+				return(clock_ != nullptr ? clock_->interv : 0);
+			}
+
+			meas_clock *get() const
+			{
+				return(clock_);
+			}
+
+		private:
+			Session *session_;
+			const char *name_;
+			meas_clock *clock_ = nullptr;
+	};
+
+
+	/**
+	 * RAII guard: starts a timer on construction and stops it on scope exit
+	 */
+	class ScopedTimer {
+		public:
+			explicit ScopedTimer(Timer &timer) : timer_(&timer)
+			{
+				timer_->start();
+			}
+
+			~ScopedTimer()
+			{
+				if (timer_ != nullptr)
+					timer_->stop();
+			}
+
+			ScopedTimer(const ScopedTimer &) = delete;
+			ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+			ScopedTimer(ScopedTimer &&other) noexcept : timer_(other.timer_)
+			{
+				other.timer_ = nullptr;
+			}
+
+			ScopedTimer &operator=(ScopedTimer &&) = delete;
+
+		private:
+			Timer *timer_;
+	};
+
+
+	/**
+	 * Registry of named metrics inside the global session.
+	 * Lookups happen once per metric type, never on the hot path.
+	 */
+	class Registry {
+		public:
+			static meas_counter *counter(const char *name, std::uint64_t hash)
+			{
+				Session &session = Session::global();
+				static std::mutex *lock = new std::mutex();
+				static auto *slots = new std::unordered_map<std::uint64_t, meas_counter *>();
+				std::lock_guard<std::mutex> guard(*lock);
+
+				/* Probe past hash collisions between different names */
+				for (;;) {
+					auto it = slots->find(hash);
+					if (it == slots->end())
+						break;
+					if (std::strcmp(it->second->name, name) == 0)
+						return(it->second);
+					hash++;
+				}
+
+				if (session.get() == nullptr)
+					return(nullptr);
+
+				meas_counter *c = meas_create_counter(session.ptr(), 0, name);
+				if (c != nullptr)
+					slots->emplace(hash, c);
+				return(c);
+			}
+	};
+
+
+	/**
+	 * Counter keyed by a compile-time name. The registry slot is resolved
+	 * on first use; afterwards inc() is a relaxed atomic increment, as
+	 * meas_inc_counter.
+	 */
+	template <typename NameT>
+	class BasicCounter {
+		public:
+			static constexpr const char *name = NameT::value;
+			static constexpr std::uint64_t hash = detail::hash(NameT::value);
+
+			static_assert(detail::length(NameT::value) < MAX_NAME_SIZE,
+				"meas: counter name longer than MAX_NAME_SIZE");
+
+			static void inc()
+			{
+				if constexpr (enabled) {
+					meas_counter *c = slot();
+					if (c != nullptr)
+						__atomic_add_fetch(&c->value, 1, __ATOMIC_RELAXED);
+				}
+			}
+
+			static void dec()
+			{
+				if constexpr (enabled) {
+					meas_counter *c = slot();
+					if (c != nullptr)
+						__atomic_sub_fetch(&c->value, 1, __ATOMIC_RELAXED);
+				}
+			}
+
+			static void add(unsigned long n)
+			{
+				if constexpr (enabled) {
+					meas_counter *c = slot();
+					if (c != nullptr)
+						__atomic_add_fetch(&c->value, n, __ATOMIC_RELAXED);
+				}
+			}
+
+			static unsigned long get()
+			{
+				if constexpr (enabled) {
+					meas_counter *c = slot();
+					return(c != nullptr ? __atomic_load_n(&c->value, __ATOMIC_RELAXED) : 0);
+				} else {
+					return(0);
+				}
+			}
+
+			static meas_counter *slot()
+			{
+				static meas_counter *const c = Registry::counter(name, hash);
+				return(c);
+			}
+	};
+
+	/**
+	 * Counter named by a constexpr character array (C++17):
+	 *   static constexpr char n[] = "NAME"; meas::Counter<n>::inc();
+	 */
+	template <const char *Name>
+	using Counter = BasicCounter<detail::name_ptr<Name>>;
+
+#if __cplusplus >= 202002L
+	/**
+	 * Counter named directly by a string literal (C++20):
+	 *   meas::NamedCounter<"NAME">::inc();
+	 */
+	template <detail::fixed_string S>
+	using NamedCounter = BasicCounter<detail::name_lit<S>>;
+#endif
+
+}
+
+#endif /* MEAS_HPP */
+
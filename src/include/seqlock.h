@@ -0,0 +1,75 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Sequence locks: a single writer updates a structure without blocking,
+ * readers copy it and retry if the copy overlapped an update.
+ */
+
+#ifndef SEQLOCK_H
+
+	#define SEQLOCK_H
+
+	/**
+	 * Start an update (the sequence becomes odd)
+	 * @param seq Sequence of the structure.
+	 */
+	static inline void seq_write_begin(unsigned int *seq)
+	{
+		__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+
+	/**
+	 * End an update (the sequence becomes even)
+	 * @param seq Sequence of the structure.
+	 */
+	static inline void seq_write_end(unsigned int *seq)
+	{
+		__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * Start a read
+	 * @param seq Sequence of the structure.
+	 * @return unsigned int Sequence to pass to seq_read_retry.
+	 */
+	static inline unsigned int seq_read_begin(const unsigned int *seq)
+	{
+		return(__atomic_load_n(seq, __ATOMIC_ACQUIRE));
+	}
+
+	/**
+	 * Check if a read overlapped an update (readers do not spin on a
+	 * preempted writer: they decide how many times to retry)
+	 * @param seq Sequence of the structure.
+	 * @param start Value returned by seq_read_begin.
+	 * @return int TRUE if the read must be retried.
+	 */
+	static inline int seq_read_retry(const unsigned int *seq, unsigned int start)
+	{
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return((start & 1) || __atomic_load_n(seq, __ATOMIC_RELAXED) != start);
+	}
+
+#endif
+
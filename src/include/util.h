@@ -0,0 +1,136 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Helpers shared by the library, the preloaded libraries and the tools
+ * (inline: libmeas-iotrace does not link libmeas)
+ */
+
+#ifndef UTIL_H
+
+	#define UTIL_H
+
+	#include <time.h>
+	#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#endif
+
+	/**
+	 * Compare two doubles (for qsort)
+	 */
+	static inline int util_cmp_double(const void *a, const void *b)
+	{
+		double x = *(const double*)a;
+		double y = *(const double*)b;
+
+		return((x > y) - (x < y));
+	}
+
+	/**
+	 * xorshift64* pseudo random generator
+	 * @param state Generator state (non zero).
+	 * @return unsigned long long Next random number.
+	 */
+	static inline unsigned long long util_xorshift(unsigned long long *state)
+	{
+		unsigned long long x = *state;
+
+		x ^= x >> 12;
+		x ^= x << 25;
+		x ^= x >> 27;
+		*state = x;
+
+		return(x * 0x2545F4914F6CDD1DULL);
+	}
+
+	/**
+	 * Home slot of a key in a table of 2^bits slots (Fibonacci hashing)
+	 * @param key The key (pointer or id).
+	 * @param bits Log2 of the number of slots.
+	 * @return unsigned long The slot.
+	 */
+	static inline unsigned long util_hash(unsigned long long key, unsigned int bits)
+	{
+		return((unsigned long)((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits)));
+	}
+
+	/**
+	 * Read CLOCK_MONOTONIC
+	 * @return unsigned long long Nanoseconds.
+	 */
+	static inline unsigned long long util_monotonic_ns(void)
+	{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return(((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec);
+	}
+
+	/**
+	 * Read the time source of the hooks and wrappers
+	 * @return unsigned long long Ticks (TSC cycles or nanoseconds).
+	 */
+	static inline unsigned long long util_ticks(void)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return(__rdtsc());
+#else
+		return(util_monotonic_ns());
+#endif
+	}
+
+	/**
+	 * Nearest rank percentile of a log2 histogram (upper bound of the
+	 * bucket holding it, clamped to the max.): the p99 of a few values is
+	 * their max.
+	 * @param hist Values per bucket (bucket b holds [2^(b-1), 2^b)).
+	 * @param nbuckets Number of buckets.
+	 * @param n Number of values.
+	 * @param max Largest value.
+	 * @param p Percentile (0 to 100).
+	 * @return unsigned long long The percentile.
+	 */
+	static inline unsigned long long util_hist_percentile(const unsigned int *hist, unsigned int nbuckets,
+														  unsigned long n, unsigned long long max, double p)
+	{
+		unsigned long long rank, seen = 0, bound;
+		unsigned int b;
+
+		rank = (unsigned long long)((p / 100.0) * n);
+		if (rank < (p / 100.0) * n)
+			rank++;
+		if (rank < 1)
+			rank = 1;
+
+		for (b = 0; b < nbuckets; b++) {
+			seen += hist[b];
+			if (seen >= rank) {
+				bound = (b > 0) ? (1ULL << b) - 1 : 0;
+				return((bound < max) ? bound : max);
+			}
+		}
+
+		return(max);
+	}
+
+#endif
+
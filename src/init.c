@@ -32,14 +32,17 @@
 
 char _libmeas_use_syscall = 0;
 
+extern void _libmeas_list_destroy(meas_t *mst, llist **list);
+extern void _libmeas_rt_release(meas_t *mst);
+extern void _libmeas_watchdog_free(meas_t *mst);
+
 /**
  * Global constructor for libmeas internal allocation
  */
 __attribute__((constructor)) void init(void)
 {
 	/*  Check if libmeas syscall is available */
-	syscall(SYS_getjiffies);
-	if(errno == 0) {
+	if(syscall(SYS_getjiffies) != -1) {
 		/* It is, use it! */
 		_libmeas_use_syscall = 1;
 	} else {
@@ -74,10 +77,26 @@ int meas_init(meas_t **mst)
 
 	llist_create(&umst->counters);
 	llist_create(&umst->timers);
+	umst->counters_tail = NULL;
+	umst->timers_tail   = NULL;
 	llist_create(&umst->report_items);
+	llist_create(&umst->benchmarks);
+	llist_create(&umst->tasks);
+	umst->tasks_tail = NULL;
+	llist_create(&umst->latencies);
+	llist_create(&umst->children);
+	umst->threads = NULL;
+	llist_create(&umst->locks);
 	umst->report.text = NULL;
 	umst->report.size = 0;
 	umst->report.pos  = 0;
+	umst->report.fixed     = FALSE;
+	umst->report.truncated = FALSE;
+	umst->rt = NULL;
+	umst->domain = NULL;
+	umst->plog   = NULL;
+	umst->watchdog = NULL;
+	umst->last_reset = meas_get_ticks();
 
 	*mst = umst;
 	return(TRUE);
@@ -92,13 +111,53 @@ int meas_init(meas_t **mst)
 void meas_close(meas_t **mst)
 {
 	meas_t *umst = *mst;
+	meas_latency *lat;
+	meas_mutex *m;
+	unsigned int i;
+	llist *tmp;
+
+	if (umst->domain != NULL)
+		meas_domain_detach(&umst->domain);
+	if (umst->plog != NULL)
+		meas_plog_close(&umst->plog);
+	if (umst->threads != NULL)
+		meas_threads_free(&umst->threads);
+	if (umst->watchdog != NULL)
+		_libmeas_watchdog_free(umst);
+
+	foreach(umst->timers, tmp) {
+		meas_clock_release_samples((meas_clock*)tmp->element);
+		meas_clock_release_sketch((meas_clock*)tmp->element);
+		meas_clock_release_cpus((meas_clock*)tmp->element);
+	}
+
+	foreach(umst->latencies, tmp) {
+		lat = (meas_latency*)tmp->element;
+		for (i = 0; i < lat->nthreads; i++) {
+			meas_hist_free(&lat->threads[i].hist);
+		}
+	}
+
+	foreach(umst->locks, tmp) {
+		m = (meas_mutex*)tmp->element;
+		if (m->type == MEAS_LOCK_RWLOCK)
+			pthread_rwlock_destroy(&m->u.rwlock);
+		else
+			pthread_mutex_destroy(&m->u.mutex);
+	}
 
-	llist_destroy(&umst->counters);
-	llist_destroy(&umst->timers);
-	llist_destroy(&umst->report_items);
-	if (umst->report.text != NULL) {
+	_libmeas_list_destroy(umst, &umst->counters);
+	_libmeas_list_destroy(umst, &umst->timers);
+	_libmeas_list_destroy(umst, &umst->report_items);
+	_libmeas_list_destroy(umst, &umst->benchmarks);
+	_libmeas_list_destroy(umst, &umst->tasks);
+	_libmeas_list_destroy(umst, &umst->latencies);
+	_libmeas_list_destroy(umst, &umst->children);
+	_libmeas_list_destroy(umst, &umst->locks);
+	if (umst->report.text != NULL && !umst->report.fixed) {
 		free(umst->report.text);
 	}
+	_libmeas_rt_release(umst);
 
 	free(umst);
 	return;
@@ -0,0 +1,183 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Interval harvesting: values accumulated since the previous harvest
+ *
+ * Counters are exchanged with 0. Timers accumulate into one of two
+ * buffers selected by their epoch: the collector flips the epoch, waits
+ * for a stop in progress on the old buffer (odd sequence) and then owns
+ * that buffer. Writers never wait. Only one collector may run at a time.
+ */
+#include <meas.h>
+#include <seqlock.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+/**
+ * Spins before yielding while a stop is in progress
+ */
+#define RESET_SPINS 100
+
+/**
+ * Reads of a timer retried while it is being stopped
+ */
+#define READ_RETRIES 100
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static void harvest_timer(meas_clock *clock, meas_interval *value);
+
+void _libmeas_read_timer(meas_clock *clock, meas_interval *value);
+
+
+/**
+ * Harvest and reset the counters and timer accumulators.
+ * Events are never lost or counted twice: each one belongs to exactly one
+ * harvested interval.
+ * @param mst The meas user structure.
+ * @param values Returned vector of values (free with free()).
+ * @param nvalues Returned number of values.
+ * @param elapsed Returned duration of the interval in ticks (may be NULL).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_snapshot_reset(meas_t **mst, meas_interval **values, unsigned int *nvalues,
+						unsigned long *elapsed)
+{
+	meas_t *umst;
+	meas_interval *val;
+	meas_counter *counter;
+	unsigned long now;
+	unsigned int n = 0;
+	llist *tmp;
+
+	if (mst == NULL || *mst == NULL || values == NULL || nvalues == NULL)
+		return(FALSE);
+
+	umst = *mst;
+	foreach(umst->timers, tmp) {
+		n++;
+	}
+	foreach(umst->counters, tmp) {
+		n++;
+	}
+
+	_libmeas_rt_violation(umst);
+
+	if ((val = (meas_interval*)calloc(n + 1, sizeof(meas_interval))) == NULL)
+		return(FALSE);
+
+	n = 0;
+	foreach(umst->timers, tmp) {
+		harvest_timer((meas_clock*)tmp->element, &val[n++]);
+	}
+
+	foreach(umst->counters, tmp) {
+		counter = (meas_counter*)tmp->element;
+		strcpy(val[n].name, counter->name);
+		val[n].kind  = MEAS_RUN_COUNTER;
+		val[n].value = (long)__atomic_exchange_n(&counter->value, 0, __ATOMIC_RELAXED);
+		n++;
+	}
+
+	now = meas_get_ticks();
+	if (elapsed != NULL)
+		*elapsed = now - umst->last_reset;
+	umst->last_reset = now;
+
+	*values  = val;
+	*nvalues = n;
+	return(TRUE);
+}
+
+
+/**
+ * Flip the accumulator of a timer and harvest the old one
+ * @param clock The timer.
+ * @param value Returned interval value.
+ */
+static void harvest_timer(meas_clock *clock, meas_interval *value)
+{
+	meas_timer_acc *acc;
+	unsigned int epoch, s, spins = 0;
+
+	epoch = clock->epoch;
+	acc   = &clock->acc[epoch & 1];
+	__atomic_store_n(&clock->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	/* A stop in progress may have read the old epoch: wait for its end */
+	s = __atomic_load_n(&clock->seq, __ATOMIC_ACQUIRE);
+	if (s & 1) {
+		while (__atomic_load_n(&clock->seq, __ATOMIC_ACQUIRE) == s) {
+			if (++spins > RESET_SPINS)
+				sched_yield();
+		}
+	}
+
+	strcpy(value->name, clock->name);
+	value->kind  = MEAS_RUN_TIMER;
+	value->value = (long)acc->total;
+	value->count = acc->count;
+	value->min   = acc->min;
+	value->max   = acc->max;
+
+	/* Clean before the next flip makes it current again */
+	memset(acc, 0, sizeof(meas_timer_acc));
+}
+
+
+/**
+ * Read the accumulated intervals of a timer (both accumulators, without
+ * resetting them)
+ * @param clock The timer.
+ * @param value Returned value.
+ */
+void _libmeas_read_timer(meas_clock *clock, meas_interval *value)
+{
+	meas_timer_acc acc[2];
+	unsigned int s, i, retries = 0;
+
+	do {
+		s = seq_read_begin(&clock->seq);
+		memcpy(acc, clock->acc, sizeof(acc));
+	} while (seq_read_retry(&clock->seq, s) && ++retries < READ_RETRIES);
+
+	memset(value, 0, sizeof(meas_interval));
+	strcpy(value->name, clock->name);
+	value->kind = MEAS_RUN_TIMER;
+	for (i = 0; i < 2; i++) {
+		if (acc[i].count == 0)
+			continue;
+		if (value->count == 0 || acc[i].min < value->min)
+			value->min = acc[i].min;
+		if (acc[i].max > value->max)
+			value->max = acc[i].max;
+		value->value += (long)acc[i].total;
+		value->count += acc[i].count;
+	}
+}
+
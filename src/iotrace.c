@@ -0,0 +1,1030 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * libmeas-iotrace: blocking I/O latency and volume per file, for programs
+ * run with LD_PRELOAD=libmeas-iotrace.so (or linked with the library)
+ *
+ * read, write, pread, pwrite, fsync, fdatasync, open, close, send and recv
+ * are wrapped and timed. Files are identified by the path given to open;
+ * descriptors the wrappers did not see opened (inherited, pipes, sockets)
+ * are named after /proc/self/fd on their first use. Each thread aggregates
+ * into its own table, so the wrappers take no lock once a file is known.
+ * The table of an exiting thread is folded into a retired table (one slot
+ * per file) and reused. Calls made while the thread is already inside the
+ * tracer (a signal handler interrupting it, or the output of
+ * meas_iotrace_write) are not traced, so the tracer never reenters its
+ * lock or the allocator.
+ * Time is read from the TSC where available and converted to nanoseconds
+ * when written.
+ *
+ * Environment: MEAS_IOTRACE_OUTPUT is a file written at exit.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <util.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/**
+ * Files (distinct paths) and descriptors tracked
+ * Files past the limit, and descriptors above it, count as "(other)".
+ */
+#define IOTRACE_FILES_BITS 10
+#define IOTRACE_FILES      (1 << IOTRACE_FILES_BITS)
+#define IOTRACE_FDS        4096
+
+/**
+ * Files of a thread table (3/4 used at most)
+ */
+#define IOTRACE_SLOTS_BITS 8
+#define IOTRACE_SLOTS      (1 << IOTRACE_SLOTS_BITS)
+
+/**
+ * Log2 buckets of the latency histograms (in ticks)
+ */
+#define IOTRACE_BUCKETS 40
+
+/**
+ * File (one per distinct path)
+ */
+struct iotrace_file {
+	char path[MEAS_IOTRACE_PATH];
+	int fd;							/* Last descriptor of the file */
+};
+
+/**
+ * Operations on a file
+ */
+struct iotrace_op {
+	unsigned long calls;
+	unsigned long errors;
+	unsigned long long bytes;
+	unsigned long long time;		/* Ticks */
+	unsigned long long max;
+	unsigned int hist[IOTRACE_BUCKETS];
+};
+
+/**
+ * File of a thread table
+ */
+struct iotrace_slot {
+	struct iotrace_file *file;
+	struct iotrace_op op[MEAS_IOTRACE_OPS];
+};
+
+/**
+ * Thread state
+ */
+struct iotrace_thread {
+	unsigned int nslots;
+	unsigned long lost;				/* Calls on files not fitting the table */
+	struct iotrace_slot slots[IOTRACE_SLOTS];
+	struct iotrace_thread *next;
+};
+
+/**
+ * Wrapped functions
+ */
+struct iotrace_real {
+	ssize_t (*read)(int, void*, size_t);
+	ssize_t (*write)(int, const void*, size_t);
+	ssize_t (*pread)(int, void*, size_t, off_t);
+	ssize_t (*pwrite)(int, const void*, size_t, off_t);
+	ssize_t (*pread64)(int, void*, size_t, off64_t);
+	ssize_t (*pwrite64)(int, const void*, size_t, off64_t);
+	int (*fsync)(int);
+	int (*fdatasync)(int);
+	int (*open)(const char*, int, ...);
+	int (*open64)(const char*, int, ...);
+	int (*openat)(int, const char*, int, ...);
+	int (*close)(int);
+	ssize_t (*send)(int, const void*, size_t, int);
+	ssize_t (*recv)(int, void*, size_t, int);
+};
+
+/**
+ * Files and descriptors (only added), tables of the live threads, tables
+ * free for reuse and statistics of the exited threads (by file index,
+ * "(other)" last)
+ */
+static struct iotrace_file files[IOTRACE_FILES];
+static struct iotrace_file other = { "(other)", -1 };
+static struct iotrace_file *fds[IOTRACE_FDS];
+static unsigned int nfiles = 0;
+static struct iotrace_thread *threads = NULL;
+static struct iotrace_thread *free_threads = NULL;
+static struct iotrace_slot retired[IOTRACE_FILES + 1];
+static unsigned long retired_lost = 0;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static int enabled = TRUE;
+static struct iotrace_real real;
+static unsigned long long tsc0, ns0;
+
+static __thread struct iotrace_thread *thread_state __attribute__ ((tls_model ("initial-exec"))) = NULL;
+static __thread int thread_exited __attribute__ ((tls_model ("initial-exec"))) = FALSE;
+static __thread int thread_busy __attribute__ ((tls_model ("initial-exec"))) = FALSE;	/* Inside the tracer */
+
+static const char *op_names[MEAS_IOTRACE_OPS] = { "read", "write", "sync", "open", "close" };
+
+/**
+ * static functions
+ */
+static void resolve(void);
+static int open_mode(int flags, va_list ap);
+static void opened(const char *path, int fd, unsigned long long t0);
+static void account(int fd, int op, unsigned long long t0, ssize_t ret);
+static void account_file(struct iotrace_file *file, int op, unsigned long long t0, ssize_t ret);
+static struct iotrace_thread *thread_init(void);
+static void thread_exit(void *arg);
+static void key_init(void);
+static void set_busy(int busy);
+static unsigned int add_merged(struct iotrace_slot *all, unsigned int n, const struct iotrace_slot *s);
+static struct iotrace_slot *retired_slot(const struct iotrace_file *file);
+static struct iotrace_slot *lookup(struct iotrace_thread *t, struct iotrace_file *file);
+static struct iotrace_file *file_of(int fd);
+static struct iotrace_file *intern(const char *path);
+static int merge(struct iotrace_file *file, struct iotrace_slot *out);
+static void add_slot(struct iotrace_slot *dst, const struct iotrace_slot *src);
+static unsigned long long slot_time(const struct iotrace_slot *s);
+static int cmp_time(const void *a, const void *b);
+static void iotrace_init(void) __attribute__ ((constructor));
+static void iotrace_fini(void) __attribute__ ((destructor));
+
+
+/**
+ * Wrappers
+ */
+ssize_t read(int fd, void *buf, size_t count)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.read == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.read(fd, buf, count);
+	account(fd, MEAS_IOTRACE_READ, t0, ret);
+	return(ret);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.write == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.write(fd, buf, count);
+	account(fd, MEAS_IOTRACE_WRITE, t0, ret);
+	return(ret);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.pread == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.pread(fd, buf, count, offset);
+	account(fd, MEAS_IOTRACE_READ, t0, ret);
+	return(ret);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.pwrite == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.pwrite(fd, buf, count, offset);
+	account(fd, MEAS_IOTRACE_WRITE, t0, ret);
+	return(ret);
+}
+
+ssize_t pread64(int fd, void *buf, size_t count, off64_t offset)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.pread64 == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.pread64(fd, buf, count, offset);
+	account(fd, MEAS_IOTRACE_READ, t0, ret);
+	return(ret);
+}
+
+ssize_t pwrite64(int fd, const void *buf, size_t count, off64_t offset)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.pwrite64 == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.pwrite64(fd, buf, count, offset);
+	account(fd, MEAS_IOTRACE_WRITE, t0, ret);
+	return(ret);
+}
+
+int fsync(int fd)
+{
+	unsigned long long t0;
+	int ret;
+
+	if (real.fsync == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.fsync(fd);
+	account(fd, MEAS_IOTRACE_SYNC, t0, ret);
+	return(ret);
+}
+
+int fdatasync(int fd)
+{
+	unsigned long long t0;
+	int ret;
+
+	if (real.fdatasync == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.fdatasync(fd);
+	account(fd, MEAS_IOTRACE_SYNC, t0, ret);
+	return(ret);
+}
+
+int open(const char *path, int flags, ...)
+{
+	unsigned long long t0;
+	va_list ap;
+	int mode, ret;
+
+	if (real.open == NULL)
+		resolve();
+	va_start(ap, flags);
+	mode = open_mode(flags, ap);
+	va_end(ap);
+
+	t0  = util_ticks();
+	ret = real.open(path, flags, mode);
+	opened(path, ret, t0);
+	return(ret);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	unsigned long long t0;
+	va_list ap;
+	int mode, ret;
+
+	if (real.open64 == NULL)
+		resolve();
+	va_start(ap, flags);
+	mode = open_mode(flags, ap);
+	va_end(ap);
+
+	t0  = util_ticks();
+	ret = real.open64(path, flags, mode);
+	opened(path, ret, t0);
+	return(ret);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	unsigned long long t0;
+	va_list ap;
+	int mode, ret;
+
+	if (real.openat == NULL)
+		resolve();
+	va_start(ap, flags);
+	mode = open_mode(flags, ap);
+	va_end(ap);
+
+	t0  = util_ticks();
+	ret = real.openat(dirfd, path, flags, mode);
+	opened(path, ret, t0);
+	return(ret);
+}
+
+int close(int fd)
+{
+	struct iotrace_file *file, *bound = NULL;
+	unsigned long long t0;
+	int ret, err;
+
+	if (real.close == NULL)
+		resolve();
+	file = file_of(fd);		/* Before the descriptor may be reused */
+	if (fd >= 0 && fd < IOTRACE_FDS)
+		bound = __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE);
+
+	t0  = util_ticks();
+	ret = real.close(fd);
+	err = errno;
+
+	account_file(file, MEAS_IOTRACE_CLOSE, t0, ret);
+
+	/* Forget the descriptor (even while disabled) unless another thread already reused it */
+	if (ret == 0 && bound != NULL)
+		__atomic_compare_exchange_n(&fds[fd], &bound, NULL, FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+
+	errno = err;
+	return(ret);
+}
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.send == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.send(fd, buf, len, flags);
+	account(fd, MEAS_IOTRACE_WRITE, t0, ret);
+	return(ret);
+}
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+	unsigned long long t0;
+	ssize_t ret;
+
+	if (real.recv == NULL)
+		resolve();
+	t0  = util_ticks();
+	ret = real.recv(fd, buf, len, flags);
+	account(fd, MEAS_IOTRACE_READ, t0, ret);
+	return(ret);
+}
+
+
+/**
+ * Enable or disable tracing (calls made while disabled are not counted)
+ * @param enable TRUE to enable, FALSE to disable.
+ */
+void meas_iotrace_enable(int enable)
+{
+	__atomic_store_n(&enabled, enable ? TRUE : FALSE, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Statistics of a file, merged over every thread (live or exited)
+ * Threads still running may be slightly behind.
+ * @param path Path of the file (as given to open).
+ * @param stats Statistics (times in nanoseconds).
+ * @return FALSE if the file was not used, TRUE otherwise.
+ */
+int meas_iotrace_path(const char *path, meas_iotrace_file *stats)
+{
+	struct iotrace_slot s;
+	unsigned int i;
+	double scale;
+	int op;
+
+	if (path == NULL || stats == NULL)
+		return(FALSE);
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < IOTRACE_FILES && strcmp(files[i].path, path) != 0; i++);
+	pthread_mutex_unlock(&lock);
+
+	if (i == IOTRACE_FILES || merge(&files[i], &s) == FALSE)
+		return(FALSE);
+
+	scale = (double)(util_monotonic_ns() - ns0) / (double)(util_ticks() - tsc0);
+
+	memset(stats, 0, sizeof(meas_iotrace_file));
+	strcpy(stats->path, files[i].path);
+	stats->fd = files[i].fd;
+	for (op = 0; op < MEAS_IOTRACE_OPS; op++) {
+		stats->op[op].calls  = s.op[op].calls;
+		stats->op[op].errors = s.op[op].errors;
+		stats->op[op].bytes  = s.op[op].bytes;
+		stats->op[op].time   = (unsigned long long)(s.op[op].time * scale);
+		stats->op[op].max    = (unsigned long long)(s.op[op].max * scale);
+	}
+	return(TRUE);
+}
+
+
+/**
+ * Statistics of the file currently open on a descriptor
+ * @param fd The descriptor.
+ * @param stats Statistics (times in nanoseconds).
+ * @return FALSE if the descriptor is not known or the file was not used, TRUE otherwise.
+ */
+int meas_iotrace_fd(int fd, meas_iotrace_file *stats)
+{
+	struct iotrace_file *file;
+
+	if (fd < 0 || fd >= IOTRACE_FDS)
+		return(FALSE);
+
+	if ((file = __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE)) == NULL || file == &other)
+		return(FALSE);
+
+	return(meas_iotrace_path(file->path, stats));
+}
+
+
+/**
+ * Write the files used by every thread (live or exited), by decreasing
+ * I/O time (times in nanoseconds)
+ * @param fp Output file.
+ * @return int Number of files written or -1 on error.
+ */
+int meas_iotrace_write(FILE *fp)
+{
+	struct iotrace_thread *t;
+	struct iotrace_slot *all, *s;
+	struct iotrace_op *op;
+	unsigned long lost = 0;
+	unsigned int n = 0, i;
+	char label[32];
+	double scale;
+	int k, busy;
+
+	if (fp == NULL)
+		return(-1);
+
+	scale = (double)(util_monotonic_ns() - ns0) / (double)(util_ticks() - tsc0);
+
+	if ((all = (struct iotrace_slot*)calloc(IOTRACE_FILES + 1, sizeof(struct iotrace_slot))) == NULL)
+		return(-1);
+
+	/* The output is not traced: its writes would take the lock again */
+	busy = thread_busy;
+	set_busy(TRUE);
+
+	/* Merge the tables */
+	pthread_mutex_lock(&lock);
+	for (t = threads; t != NULL; t = t->next) {
+		lost += t->lost;
+		for (i = 0; i < IOTRACE_SLOTS; i++) {
+			if (t->slots[i].file != NULL)
+				n = add_merged(all, n, &t->slots[i]);
+		}
+	}
+	lost += retired_lost;
+	for (i = 0; i <= IOTRACE_FILES; i++) {
+		if (retired[i].file != NULL)
+			n = add_merged(all, n, &retired[i]);
+	}
+
+	qsort(all, n, sizeof(struct iotrace_slot), cmp_time);
+
+	fprintf(fp, "============================= I/O ==============================\n");
+	fprintf(fp, " PATH                                 FD                        \n");
+	fprintf(fp, "================================================================\n");
+	for (i = 0; i < n; i++) {
+		s = &all[i];
+		fprintf(fp, " %-*.*s   %d\n", MAX_NAME_SIZE, MAX_NAME_SIZE, s->file->path, s->file->fd);
+		if (strlen(s->file->path) > MAX_NAME_SIZE)
+			fprintf(fp, "   %s\n", s->file->path);
+
+		for (k = 0; k < MEAS_IOTRACE_OPS; k++) {
+			op = &s->op[k];
+			if (op->calls == 0)
+				continue;
+
+			if (k == MEAS_IOTRACE_READ || k == MEAS_IOTRACE_WRITE)
+				fprintf(fp, "   %-21s: %lu calls, %llu bytes, %lu errors\n", op_names[k],
+						op->calls, op->bytes, op->errors);
+			else
+				fprintf(fp, "   %-21s: %lu calls, %lu errors\n", op_names[k], op->calls, op->errors);
+			snprintf(label, sizeof(label), "%s (mean/p99/max)", op_names[k]);
+			fprintf(fp, "   %-21s: %.0f / %.0f / %.0f\n", label,
+					(op->time * scale) / op->calls,
+					util_hist_percentile(op->hist, IOTRACE_BUCKETS, op->calls, op->max, 99) * scale,
+					op->max * scale);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (lost > 0)
+		fprintf(fp, " %lu calls lost (file tables full)\n", lost);
+	fprintf(fp, "----------------------------------------------------------------\n");
+	set_busy(busy);
+
+	free(all);
+	return(ferror(fp) ? -1 : (int)n);
+}
+
+
+/**
+ * Resolve the wrapped functions
+ */
+static void resolve(void)
+{
+	real.read      = dlsym(RTLD_NEXT, "read");
+	real.write     = dlsym(RTLD_NEXT, "write");
+	real.pread     = dlsym(RTLD_NEXT, "pread");
+	real.pwrite    = dlsym(RTLD_NEXT, "pwrite");
+	real.pread64   = dlsym(RTLD_NEXT, "pread64");
+	real.pwrite64  = dlsym(RTLD_NEXT, "pwrite64");
+	real.fsync     = dlsym(RTLD_NEXT, "fsync");
+	real.fdatasync = dlsym(RTLD_NEXT, "fdatasync");
+	real.open      = dlsym(RTLD_NEXT, "open");
+	real.open64    = dlsym(RTLD_NEXT, "open64");
+	real.openat    = dlsym(RTLD_NEXT, "openat");
+	real.close     = dlsym(RTLD_NEXT, "close");
+	real.send      = dlsym(RTLD_NEXT, "send");
+	real.recv      = dlsym(RTLD_NEXT, "recv");
+}
+
+
+/**
+ * Mode argument of open (only passed when a file may be created)
+ * @param flags Flags of open.
+ * @param ap Variable arguments of open.
+ * @return int The mode (0 when not passed).
+ */
+static int open_mode(int flags, va_list ap)
+{
+#ifdef O_TMPFILE
+	if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE)
+#else
+	if (flags & O_CREAT)
+#endif
+		return(va_arg(ap, int));
+
+	return(0);
+}
+
+
+/**
+ * Account an open and bind its descriptor to the file
+ * @param path Path of the file.
+ * @param fd Return value of open.
+ * @param t0 Ticks before the call.
+ */
+static void opened(const char *path, int fd, unsigned long long t0)
+{
+	struct iotrace_file *file;
+	int err = errno;
+
+	if (__atomic_load_n(&enabled, __ATOMIC_RELAXED) == FALSE || thread_busy)
+		return;
+
+	set_busy(TRUE);
+	file = intern(path);
+	set_busy(FALSE);
+	if (fd >= 0 && fd < IOTRACE_FDS) {
+		file->fd = fd;
+		__atomic_store_n(&fds[fd], file, __ATOMIC_RELEASE);
+	}
+
+	account_file(file, MEAS_IOTRACE_OPEN, t0, fd);
+	errno = err;
+}
+
+
+/**
+ * Account a call on a descriptor
+ * @param fd The descriptor.
+ * @param op Operation (MEAS_IOTRACE_READ, ...).
+ * @param t0 Ticks before the call.
+ * @param ret Return value of the call (bytes or -1).
+ */
+static void account(int fd, int op, unsigned long long t0, ssize_t ret)
+{
+	int err = errno;
+
+	account_file(file_of(fd), op, t0, ret);
+	errno = err;
+}
+
+
+/**
+ * Account a call on a file in the table of the calling thread
+ * @param file The file (NULL: not traced).
+ * @param op Operation (MEAS_IOTRACE_READ, ...).
+ * @param t0 Ticks before the call.
+ * @param ret Return value of the call (bytes or -1).
+ */
+static void account_file(struct iotrace_file *file, int op, unsigned long long t0, ssize_t ret)
+{
+	unsigned long long elapsed = util_ticks() - t0;
+	struct iotrace_thread *t = thread_state;
+	struct iotrace_slot *s;
+	struct iotrace_op *o;
+	unsigned int b;
+
+	if (file == NULL || thread_busy)
+		return;
+
+	set_busy(TRUE);
+	if (t == NULL)
+		t = thread_init();
+
+	if (t == NULL || (s = lookup(t, file)) == NULL) {
+		set_busy(FALSE);
+		return;
+	}
+
+	o = &s->op[op];
+	o->calls++;
+	o->time += elapsed;
+	if (elapsed > o->max)
+		o->max = elapsed;
+
+	if (ret < 0)
+		o->errors++;
+	else if (op == MEAS_IOTRACE_READ || op == MEAS_IOTRACE_WRITE)
+		o->bytes += ret;
+
+	b = (elapsed > 0) ? 64 - __builtin_clzll(elapsed) : 0;
+	o->hist[(b < IOTRACE_BUCKETS) ? b : IOTRACE_BUCKETS - 1]++;
+	set_busy(FALSE);
+}
+
+
+/**
+ * Thread state of the calling thread (taken from the free tables or
+ * allocated on its first call; none once the thread is exiting)
+ * @return struct iotrace_thread* NULL on error or the state.
+ */
+static struct iotrace_thread *thread_init(void)
+{
+	struct iotrace_thread *t;
+
+	if (thread_exited)
+		return(NULL);
+
+	pthread_once(&key_once, key_init);
+
+	pthread_mutex_lock(&lock);
+	if ((t = free_threads) != NULL)
+		free_threads = t->next;
+	pthread_mutex_unlock(&lock);
+
+	if (t == NULL && (t = (struct iotrace_thread*)calloc(1, sizeof(struct iotrace_thread))) == NULL)
+		return(NULL);
+
+	pthread_mutex_lock(&lock);
+	t->next = threads;
+	threads = t;
+	pthread_mutex_unlock(&lock);
+
+	pthread_setspecific(key, t);
+	thread_state = t;
+	return(t);
+}
+
+
+/**
+ * Fold the table of an exiting thread into the retired table and keep
+ * it for reuse (calls made by the thread after this are not traced)
+ * @param arg The table.
+ */
+static void thread_exit(void *arg)
+{
+	struct iotrace_thread *t = (struct iotrace_thread*)arg, **p;
+	struct iotrace_slot *r;
+	unsigned int i;
+
+	thread_state  = NULL;
+	thread_exited = TRUE;
+
+	pthread_mutex_lock(&lock);
+	for (p = &threads; *p != NULL && *p != t; p = &(*p)->next);
+	if (*p != NULL)
+		*p = t->next;
+
+	retired_lost += t->lost;
+	for (i = 0; i < IOTRACE_SLOTS; i++) {
+		if (t->slots[i].file == NULL)
+			continue;
+
+		r = retired_slot(t->slots[i].file);
+		r->file = t->slots[i].file;
+		add_slot(r, &t->slots[i]);
+	}
+
+	memset(t, 0, sizeof(struct iotrace_thread));
+	t->next = free_threads;
+	free_threads = t;
+	pthread_mutex_unlock(&lock);
+}
+
+
+/**
+ * Create the key running thread_exit at thread exit
+ */
+static void key_init(void)
+{
+	pthread_key_create(&key, thread_exit);
+}
+
+
+/**
+ * Mark the calling thread inside the tracer (or out of it)
+ * A signal handler runs between two instructions of the thread: the flag
+ * only has to be ordered against the code of the thread.
+ * @param busy TRUE inside the tracer.
+ */
+static void set_busy(int busy)
+{
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	thread_busy = busy;
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+
+/**
+ * Find (or add) a file in the table of a thread
+ * @param t The thread.
+ * @param file The file.
+ * @return struct iotrace_slot* NULL if the table is full.
+ */
+static struct iotrace_slot *lookup(struct iotrace_thread *t, struct iotrace_file *file)
+{
+	struct iotrace_slot *s;
+	unsigned long i;
+
+	i = util_hash((unsigned long long)file, IOTRACE_SLOTS_BITS);
+	for (;;) {
+		s = &t->slots[i & (IOTRACE_SLOTS - 1)];
+		if (s->file == file)
+			return(s);
+		if (s->file == NULL)
+			break;
+		i++;
+	}
+
+	if (t->nslots >= (IOTRACE_SLOTS / 4) * 3) {
+		t->lost++;
+		return(NULL);
+	}
+
+	__atomic_store_n(&s->file, file, __ATOMIC_RELEASE);
+	t->nslots++;
+	return(s);
+}
+
+
+/**
+ * File of a descriptor (named after /proc/self/fd on its first use)
+ * @param fd The descriptor.
+ * @return struct iotrace_file* NULL while tracing is disabled or the file
+ *         can not be named now, the file otherwise.
+ */
+static struct iotrace_file *file_of(int fd)
+{
+	struct iotrace_file *file;
+	char link[32], path[MEAS_IOTRACE_PATH];
+	ssize_t len;
+
+	if (__atomic_load_n(&enabled, __ATOMIC_RELAXED) == FALSE)
+		return(NULL);
+
+	if (fd < 0 || fd >= IOTRACE_FDS)
+		return(&other);
+
+	if ((file = __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE)) != NULL)
+		return(file);
+
+	/* Named on a later call: a signal handler may have interrupted the tracer */
+	if (thread_busy)
+		return(NULL);
+
+	set_busy(TRUE);
+	snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+	if ((len = readlink(link, path, sizeof(path) - 1)) > 0)
+		path[len] = '\0';
+	else
+		snprintf(path, sizeof(path), "fd %d", fd);
+
+	file = intern(path);
+	file->fd = fd;
+	__atomic_store_n(&fds[fd], file, __ATOMIC_RELEASE);
+	set_busy(FALSE);
+	return(file);
+}
+
+
+/**
+ * Find (or add) the file of a path
+ * @param path The path.
+ * @return struct iotrace_file* The file ("(other)" when the table is full).
+ */
+static struct iotrace_file *intern(const char *path)
+{
+	struct iotrace_file *file = &other;
+	unsigned long h = 5381;
+	const char *c;
+	unsigned int i, n;
+
+	for (c = path; *c != '\0'; c++) {
+		h = (h * 33) ^ (unsigned char)*c;
+	}
+
+	pthread_mutex_lock(&lock);
+	for (n = 0, i = h & (IOTRACE_FILES - 1); n < IOTRACE_FILES; n++, i = (i + 1) & (IOTRACE_FILES - 1)) {
+		if (files[i].path[0] == '\0') {
+			/* New file (keep the last entries free to end the probes) */
+			if (nfiles < (IOTRACE_FILES / 4) * 3) {
+				snprintf(files[i].path, MEAS_IOTRACE_PATH, "%s", path);
+				files[i].fd = -1;
+				nfiles++;
+				file = &files[i];
+			}
+			break;
+		}
+		if (strncmp(files[i].path, path, MEAS_IOTRACE_PATH - 1) == 0) {
+			file = &files[i];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&lock);
+
+	return(file);
+}
+
+
+/**
+ * Merge the statistics of a file over every thread (live or exited)
+ * @param file The file.
+ * @param out Merged statistics.
+ * @return FALSE if no thread used the file, TRUE otherwise.
+ */
+static int merge(struct iotrace_file *file, struct iotrace_slot *out)
+{
+	struct iotrace_thread *t;
+	unsigned int i;
+	int op;
+
+	memset(out, 0, sizeof(struct iotrace_slot));
+	pthread_mutex_lock(&lock);
+	for (t = threads; t != NULL; t = t->next) {
+		for (i = 0; i < IOTRACE_SLOTS; i++) {
+			if (t->slots[i].file == file) {
+				add_slot(out, &t->slots[i]);
+				break;
+			}
+		}
+	}
+	add_slot(out, retired_slot(file));
+	pthread_mutex_unlock(&lock);
+
+	out->file = file;
+	for (op = 0; op < MEAS_IOTRACE_OPS && out->op[op].calls == 0; op++);
+	return(op < MEAS_IOTRACE_OPS);
+}
+
+
+/**
+ * Add the statistics of a file to another
+ * @param dst Statistics updated.
+ * @param src Statistics added.
+ */
+static void add_slot(struct iotrace_slot *dst, const struct iotrace_slot *src)
+{
+	unsigned int b;
+	int op;
+
+	for (op = 0; op < MEAS_IOTRACE_OPS; op++) {
+		dst->op[op].calls  += src->op[op].calls;
+		dst->op[op].errors += src->op[op].errors;
+		dst->op[op].bytes  += src->op[op].bytes;
+		dst->op[op].time   += src->op[op].time;
+		if (src->op[op].max > dst->op[op].max)
+			dst->op[op].max = src->op[op].max;
+		for (b = 0; b < IOTRACE_BUCKETS; b++) {
+			dst->op[op].hist[b] += src->op[op].hist[b];
+		}
+	}
+}
+
+
+/**
+ * Add a file of a thread table to the merged files
+ * @param all Merged files.
+ * @param n Number of merged files.
+ * @param s The file statistics.
+ * @return unsigned int New number of merged files.
+ */
+static unsigned int add_merged(struct iotrace_slot *all, unsigned int n, const struct iotrace_slot *s)
+{
+	unsigned int j;
+
+	for (j = 0; j < n && all[j].file != s->file; j++);
+	if (j == n)
+		all[n++].file = s->file;
+
+	add_slot(&all[j], s);
+	return(n);
+}
+
+
+/**
+ * Retired statistics of a file
+ * The caller holds the lock.
+ * @param file The file.
+ * @return struct iotrace_slot* The slot of the file.
+ */
+static struct iotrace_slot *retired_slot(const struct iotrace_file *file)
+{
+	return(&retired[(file == &other) ? IOTRACE_FILES : (unsigned int)(file - files)]);
+}
+
+
+/**
+ * Total time of the operations on a file
+ * @param s The file statistics.
+ * @return unsigned long long Ticks.
+ */
+static unsigned long long slot_time(const struct iotrace_slot *s)
+{
+	unsigned long long total = 0;
+	int op;
+
+	for (op = 0; op < MEAS_IOTRACE_OPS; op++) {
+		total += s->op[op].time;
+	}
+	return(total);
+}
+
+
+/**
+ * Compare two files by decreasing I/O time (for qsort)
+ */
+static int cmp_time(const void *a, const void *b)
+{
+	unsigned long long x = slot_time((const struct iotrace_slot*)a);
+	unsigned long long y = slot_time((const struct iotrace_slot*)b);
+
+	return((x < y) - (x > y));
+}
+
+
+/**
+ * Resolve the wrapped functions and take the reference of the tick to
+ * nanosecond conversion
+ */
+static void iotrace_init(void)
+{
+	ns0  = util_monotonic_ns();
+	tsc0 = util_ticks();
+
+	if (real.read == NULL)
+		resolve();
+}
+
+
+/**
+ * Write MEAS_IOTRACE_OUTPUT (if set) at exit
+ */
+static void iotrace_fini(void)
+{
+	const char *path = getenv("MEAS_IOTRACE_OUTPUT");
+	FILE *fp;
+
+	if (path == NULL)
+		return;
+
+	meas_iotrace_enable(FALSE);
+	if ((fp = fopen(path, "w")) != NULL) {
+		meas_iotrace_write(fp);
+		fclose(fp);
+	}
+}
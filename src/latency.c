@@ -0,0 +1,296 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Wakeup latency probe (cyclictest-style)
+ *
+ * Each measurement thread is pinned to a CPU of the affinity mask of the
+ * process (round robin), optionally runs under
+ * SCHED_FIFO, sleeps to absolute clock_nanosleep deadlines and records
+ * how late it woke up.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+
+#define NSEC_PER_SEC 1000000000L
+
+/**
+ * Start signal of the measurement threads (go: 0 wait, 1 run, -1 abort)
+ */
+struct latency_start {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int go;
+};
+
+/**
+ * Measurement thread argument
+ */
+struct latency_arg {
+	meas_latency_thread *thread;
+	const meas_latency_opts *opts;
+	struct latency_start *start;
+};
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static void *latency_thread(void *arg);
+static unsigned int allowed_cpus(int *cpus);
+static void timespec_add(struct timespec *ts, unsigned long ns);
+
+
+/**
+ * Fill latency probe options with default values
+ * (one thread per CPU, 1 ms interval, 1000 loops, no SCHED_FIFO,
+ *  1 us resolution up to 10 ms).
+ * @param opts Options.
+ */
+void meas_latency_defaults(meas_latency_opts *opts)
+{
+	opts->nthreads    = 0;
+	opts->interval    = 1000000;
+	opts->loops       = 1000;
+	opts->priority    = 0;
+	opts->resolution  = 1000;
+	opts->max_latency = 10000000;
+}
+
+
+/**
+ * Run the wakeup latency probe (blocks until every thread is done)
+ * Threads that can not get SCHED_FIFO (e.g. without CAP_SYS_NICE) run
+ * under SCHED_OTHER; check the fifo field of each thread. Threads that
+ * can not be pinned run on any CPU (cpu -1) and are counted in unpinned.
+ * @param mst The meas user structure.
+ * @param name A name to the probe (useful for report visualization).
+ * @param opts Options (NULL for defaults).
+ * @return NULL on error or the probe result.
+ */
+meas_latency *meas_latency_run(meas_t **mst, const char *name, const meas_latency_opts *opts)
+{
+	meas_t *umst;
+	meas_latency *lat;
+	meas_latency_opts dopts;
+	struct latency_arg *args;
+	pthread_t *tids;
+	struct latency_start start;
+	unsigned int i, nbuckets, started, ncpus;
+	int cpus[CPU_SETSIZE];
+
+	if (mst == NULL || *mst == NULL)
+		return(NULL);
+
+	umst = *mst;
+	if (opts == NULL) {
+		meas_latency_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	if (opts->interval == 0 || opts->resolution == 0)
+		return(NULL);
+
+	_libmeas_rt_violation(umst);
+
+	ncpus = allowed_cpus(cpus);
+
+	if ((lat = (meas_latency*)calloc(1, sizeof(meas_latency) +
+					sizeof(meas_latency_thread) * (opts->nthreads ? opts->nthreads : ncpus))) == NULL)
+		return(NULL);
+
+	strncpy(lat->name, name, MAX_NAME_SIZE - 1);
+	lat->interval = opts->interval;
+	lat->nthreads = opts->nthreads ? opts->nthreads : ncpus;
+	lat->threads  = (meas_latency_thread*)(lat + 1);
+
+	/* Histograms are allocated before the threads start */
+	nbuckets = (opts->max_latency / opts->resolution) + 1;
+	for (i = 0; i < lat->nthreads; i++) {
+		lat->threads[i].cpu = cpus[i % ncpus];
+		if (meas_hist_init(&lat->threads[i].hist, 0, opts->resolution, nbuckets) == FALSE)
+			break;
+	}
+
+	tids = (pthread_t*)malloc(sizeof(pthread_t) * lat->nthreads);
+	args = (struct latency_arg*)malloc(sizeof(struct latency_arg) * lat->nthreads);
+
+	if (i < lat->nthreads || tids == NULL || args == NULL) {
+		while (i-- > 0) {
+			meas_hist_free(&lat->threads[i].hist);
+		}
+		free(tids);
+		free(args);
+		free(lat);
+		return(NULL);
+	}
+
+	pthread_mutex_init(&start.lock, NULL);
+	pthread_cond_init(&start.cond, NULL);
+	start.go = 0;
+
+	for (started = 0; started < lat->nthreads; started++) {
+		args[started].thread  = &lat->threads[started];
+		args[started].opts    = opts;
+		args[started].start   = &start;
+		if (pthread_create(&tids[started], NULL, latency_thread, &args[started]) != 0)
+			break;
+	}
+
+	/* Start every thread together (or abort the ones already created) */
+	pthread_mutex_lock(&start.lock);
+	start.go = (started < lat->nthreads) ? -1 : 1;
+	pthread_cond_broadcast(&start.cond);
+	pthread_mutex_unlock(&start.lock);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(tids[i], NULL);
+		if (lat->threads[i].cpu < 0)
+			lat->unpinned++;
+	}
+
+	pthread_cond_destroy(&start.cond);
+	pthread_mutex_destroy(&start.lock);
+	free(tids);
+	free(args);
+
+	if (started < lat->nthreads || llist_add(&umst->latencies, lat) == FALSE) {
+		for (i = 0; i < lat->nthreads; i++) {
+			meas_hist_free(&lat->threads[i].hist);
+		}
+		free(lat);
+		return(NULL);
+	}
+
+	return(lat);
+}
+
+
+/**
+ * Measurement thread
+ * @param arg Thread argument (struct latency_arg).
+ */
+static void *latency_thread(void *arg)
+{
+	struct latency_arg *larg = (struct latency_arg*)arg;
+	meas_latency_thread *thread = larg->thread;
+	const meas_latency_opts *opts = larg->opts;
+	struct sched_param param;
+	struct timespec next, now;
+	cpu_set_t set;
+	unsigned long i;
+	long diff;
+
+	CPU_ZERO(&set);
+	CPU_SET(thread->cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		thread->cpu = -1;
+
+	if (opts->priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = opts->priority;
+		thread->fifo = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0);
+	}
+
+	pthread_mutex_lock(&larg->start->lock);
+	while (larg->start->go == 0) {
+		pthread_cond_wait(&larg->start->cond, &larg->start->lock);
+	}
+	pthread_mutex_unlock(&larg->start->lock);
+
+	if (larg->start->go < 0)
+		return(NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	timespec_add(&next, opts->interval);
+
+	for (i = 0; i < opts->loops; i++) {
+		/* A signal (e.g. SIGPROF of the sampler) must not end the sleep early */
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		diff = ((long)(now.tv_sec - next.tv_sec) * NSEC_PER_SEC) + (now.tv_nsec - next.tv_nsec);
+		meas_hist_add(&thread->hist, (diff > 0) ? (unsigned long)diff : 0);
+
+		timespec_add(&next, opts->interval);
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * CPUs the process may run on
+ * @param cpus Output, CPU numbers (CPU_SETSIZE entries).
+ * @return unsigned int Number of CPUs (at least one).
+ */
+static unsigned int allowed_cpus(int *cpus)
+{
+	cpu_set_t set;
+	long online;
+	unsigned int n = 0;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &set))
+				cpus[n++] = cpu;
+		}
+	}
+
+	/* No mask: assume every online CPU */
+	if (n == 0) {
+		online = sysconf(_SC_NPROCESSORS_ONLN);
+		for (cpu = 0; cpu < online && cpu < CPU_SETSIZE; cpu++) {
+			cpus[n++] = cpu;
+		}
+		if (n == 0)
+			cpus[n++] = 0;
+	}
+
+	return(n);
+}
+
+
+/**
+ * Add nanoseconds to a timespec
+ * @param ts The timespec.
+ * @param ns Nanoseconds.
+ */
+static void timespec_add(struct timespec *ts, unsigned long ns)
+{
+	ts->tv_sec  += ns / NSEC_PER_SEC;
+	ts->tv_nsec += ns % NSEC_PER_SEC;
+	if (ts->tv_nsec >= NSEC_PER_SEC) {
+		ts->tv_sec++;
+		ts->tv_nsec -= NSEC_PER_SEC;
+	}
+}
+
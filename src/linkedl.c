@@ -98,6 +98,42 @@ int llist_add(llist **list, void *element)
 }
 
 
+/**
+ * Add item to the end of the list in constant time
+ * @param list Pointer to the list
+ * @param tail Pointer to the last node of the list (updated). If it is NULL,
+ *             the list is walked to find the last node.
+ * @param element Any element (void pointer)
+ * @return FALSE on error. TRUE otherwise
+ */
+int llist_add_tail(llist **list, llist **tail, void *element)
+{
+	llist *new_node, *last = *tail;
+
+	new_node = (llist*)malloc(sizeof(llist));
+	if(new_node == NULL) {
+		return(FALSE);
+	} else {
+		new_node->element = element;
+		new_node->next    = NULL;
+	}
+
+	if(last == NULL) {
+		for(last = *list; last != NULL && last->next != NULL; last = last->next);
+	}
+
+	if(last == NULL) {
+		/* First element */
+		*list = new_node;
+	} else {
+		last->next = new_node;
+	}
+
+	*tail = new_node;
+	return(TRUE);
+}
+
+
 /**
  * Remove the nth item of the list
  * @param list Pointer to the list
@@ -0,0 +1,544 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Lock contention profiling
+ *
+ * A profiled lock wraps a pthread mutex or read-write lock. Acquisitions
+ * first try the lock: only when it is busy the clock is read and the
+ * blocking call is timed as wait time. Hold time runs from the
+ * acquisition to the release. Statistics go to a table owned by the
+ * calling thread (keyed by the lock id), so profiling adds no shared
+ * write to the lock itself; the tables are merged when read. The table of
+ * an exiting thread is folded into a retired table (one slot per lock
+ * created, ids are dense) and reused.
+ */
+#include <meas.h>
+#include <util.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+/**
+ * Locks of a thread table (3/4 used at most)
+ */
+#define LOCK_SLOTS_BITS 7
+#define LOCK_SLOTS      (1 << LOCK_SLOTS_BITS)
+
+/**
+ * Modes (index of the statistics of a slot)
+ */
+#define MODE_EXCLUSIVE 0
+#define MODE_SHARED    1
+
+/**
+ * Statistics of a lock in a thread table
+ */
+struct lock_slot {
+	unsigned long id;				/* 0: free */
+	unsigned int held[2];			/* Nesting of shared acquisitions */
+	unsigned long since[2];			/* Start of the current hold */
+	meas_lock_stats stats[2];
+};
+
+/**
+ * Thread table
+ */
+struct lock_table {
+	unsigned int nslots;
+	unsigned long lost;				/* Acquisitions of locks not fitting the table */
+	struct lock_slot slots[LOCK_SLOTS];
+	struct lock_table *next;
+};
+
+/**
+ * Tables of the live threads, tables free for reuse and statistics of
+ * the exited threads (slot of lock id at id - 1)
+ */
+static struct lock_table *tables = NULL;
+static struct lock_table *free_tables = NULL;
+static struct lock_slot *retired = NULL;
+static unsigned long nretired = 0;
+static unsigned long retired_lost = 0;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static unsigned long next_id = 0;
+
+static __thread struct lock_table *thread_table = NULL;
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static meas_mutex *create_lock(meas_t **mst, const char *name, int type);
+static void acquired(meas_mutex *m, int mode, unsigned long t0, int contended);
+static struct lock_table *table_init(void);
+static void table_exit(void *arg);
+static void key_init(void);
+static struct lock_slot *lookup(struct lock_table *t, unsigned long id, int add);
+static void add_stats(meas_lock_stats *dst, const meas_lock_stats *src);
+
+
+/**
+ * Create a profiled mutex
+ * @param mst The meas user structure.
+ * @param name A name to the lock (NULL to name it after its address).
+ * @return NULL on error or the created lock.
+ */
+meas_mutex *meas_create_mutex(meas_t **mst, const char *name)
+{
+	return(create_lock(mst, name, MEAS_LOCK_MUTEX));
+}
+
+
+/**
+ * Create a profiled read-write lock
+ * @param mst The meas user structure.
+ * @param name A name to the lock (NULL to name it after its address).
+ * @return NULL on error or the created lock.
+ */
+meas_mutex *meas_create_rwlock(meas_t **mst, const char *name)
+{
+	return(create_lock(mst, name, MEAS_LOCK_RWLOCK));
+}
+
+
+/**
+ * Acquire a lock (a read-write lock for writing)
+ * @param m The lock.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_mutex_lock(meas_mutex *m)
+{
+	unsigned long t0 = 0;
+	int ret, contended = FALSE;
+
+	if (m == NULL)
+		return(FALSE);
+
+	if (m->type == MEAS_LOCK_RWLOCK)
+		ret = pthread_rwlock_trywrlock(&m->u.rwlock);
+	else
+		ret = pthread_mutex_trylock(&m->u.mutex);
+
+	if (ret == EBUSY) {
+		contended = TRUE;
+		t0 = meas_get_ticks();
+		if (m->type == MEAS_LOCK_RWLOCK)
+			ret = pthread_rwlock_wrlock(&m->u.rwlock);
+		else
+			ret = pthread_mutex_lock(&m->u.mutex);
+	}
+
+	if (ret != 0)
+		return(FALSE);
+
+	acquired(m, MODE_EXCLUSIVE, t0, contended);
+	return(TRUE);
+}
+
+
+/**
+ * Acquire a read-write lock for reading
+ * @param m The lock (created with meas_create_rwlock).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_mutex_rdlock(meas_mutex *m)
+{
+	unsigned long t0 = 0;
+	int ret, contended = FALSE;
+
+	if (m == NULL || m->type != MEAS_LOCK_RWLOCK)
+		return(FALSE);
+
+	if ((ret = pthread_rwlock_tryrdlock(&m->u.rwlock)) == EBUSY) {
+		contended = TRUE;
+		t0 = meas_get_ticks();
+		ret = pthread_rwlock_rdlock(&m->u.rwlock);
+	}
+
+	if (ret != 0)
+		return(FALSE);
+
+	acquired(m, MODE_SHARED, t0, contended);
+	return(TRUE);
+}
+
+
+/**
+ * Release a lock
+ * @param m The lock.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_mutex_unlock(meas_mutex *m)
+{
+	unsigned long now = meas_get_ticks();
+	unsigned long hold;
+	struct lock_slot *s;
+	int mode;
+
+	if (m == NULL)
+		return(FALSE);
+
+	/* Account the hold before the lock can be taken again */
+	if (thread_table != NULL && (s = lookup(thread_table, m->id, FALSE)) != NULL) {
+		mode = (s->held[MODE_EXCLUSIVE] > 0) ? MODE_EXCLUSIVE : MODE_SHARED;
+		if (s->held[mode] > 0 && --s->held[mode] == 0) {
+			hold = now - s->since[mode];
+			s->stats[mode].hold += hold;
+			if (hold > s->stats[mode].hold_max)
+				s->stats[mode].hold_max = hold;
+		}
+	}
+
+	if (m->type == MEAS_LOCK_RWLOCK)
+		return(pthread_rwlock_unlock(&m->u.rwlock) == 0);
+
+	return(pthread_mutex_unlock(&m->u.mutex) == 0);
+}
+
+
+/**
+ * Wait on a condition variable with a profiled mutex held
+ * The time blocked on the condition is neither wait nor hold time: the
+ * hold ends when the wait starts and a new one starts when it returns.
+ * @param m The mutex (held by the calling thread).
+ * @param cond The condition variable.
+ * @param abstime Timeout (CLOCK_REALTIME unless set otherwise on cond), NULL to wait forever.
+ * @return int 0, ETIMEDOUT or an error number of pthread_cond_wait.
+ */
+int meas_mutex_cond_wait(meas_mutex *m, pthread_cond_t *cond, const struct timespec *abstime)
+{
+	struct lock_slot *s = NULL;
+	unsigned long hold;
+	int ret;
+
+	if (m == NULL || cond == NULL || m->type != MEAS_LOCK_MUTEX)
+		return(EINVAL);
+
+	if (thread_table != NULL && (s = lookup(thread_table, m->id, FALSE)) != NULL &&
+			s->held[MODE_EXCLUSIVE] > 0) {
+		hold = meas_get_ticks() - s->since[MODE_EXCLUSIVE];
+		s->stats[MODE_EXCLUSIVE].hold += hold;
+		if (hold > s->stats[MODE_EXCLUSIVE].hold_max)
+			s->stats[MODE_EXCLUSIVE].hold_max = hold;
+	}
+
+	if (abstime != NULL)
+		ret = pthread_cond_timedwait(cond, &m->u.mutex, abstime);
+	else
+		ret = pthread_cond_wait(cond, &m->u.mutex);
+
+	if (s != NULL && s->held[MODE_EXCLUSIVE] > 0)
+		s->since[MODE_EXCLUSIVE] = meas_get_ticks();
+
+	return(ret);
+}
+
+
+/**
+ * Statistics of a lock, merged over every thread (live or exited)
+ * Threads still running may be slightly behind.
+ * @param m The lock.
+ * @param shared TRUE for the read acquisitions of a read-write lock,
+ *               FALSE for the exclusive ones.
+ * @param stats Statistics.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_mutex_stats(meas_mutex *m, int shared, meas_lock_stats *stats)
+{
+	struct lock_table *t;
+	struct lock_slot *s;
+	int mode = shared ? MODE_SHARED : MODE_EXCLUSIVE;
+
+	if (m == NULL || stats == NULL)
+		return(FALSE);
+
+	memset(stats, 0, sizeof(meas_lock_stats));
+
+	pthread_mutex_lock(&tables_lock);
+	for (t = tables; t != NULL; t = t->next) {
+		if ((s = lookup(t, m->id, FALSE)) != NULL)
+			add_stats(stats, &s->stats[mode]);
+	}
+	if (m->id <= nretired)
+		add_stats(stats, &retired[m->id - 1].stats[mode]);
+	pthread_mutex_unlock(&tables_lock);
+
+	return(TRUE);
+}
+
+
+/**
+ * Acquisitions not accounted because a lock did not fit a thread table
+ * (live or exited)
+ * @return unsigned long Number of acquisitions.
+ */
+unsigned long _libmeas_locks_lost(void)
+{
+	struct lock_table *t;
+	unsigned long lost;
+
+	pthread_mutex_lock(&tables_lock);
+	lost = retired_lost;
+	for (t = tables; t != NULL; t = t->next) {
+		lost += t->lost;
+	}
+	pthread_mutex_unlock(&tables_lock);
+
+	return(lost);
+}
+
+
+/**
+ * Create a profiled lock
+ * @param mst The meas user structure.
+ * @param name A name to the lock (NULL to name it after its address).
+ * @param type MEAS_LOCK_MUTEX or MEAS_LOCK_RWLOCK.
+ * @return NULL on error or the created lock.
+ */
+static meas_mutex *create_lock(meas_t **mst, const char *name, int type)
+{
+	meas_t *umst;
+	meas_mutex *m;
+	int ret;
+
+	if (mst == NULL || *mst == NULL)
+		return(NULL);
+
+	umst = *mst;
+	_libmeas_rt_violation(umst);
+
+	if ((m = (meas_mutex*)calloc(1, sizeof(meas_mutex))) == NULL)
+		return(NULL);
+
+	if (type == MEAS_LOCK_RWLOCK)
+		ret = pthread_rwlock_init(&m->u.rwlock, NULL);
+	else
+		ret = pthread_mutex_init(&m->u.mutex, NULL);
+
+	if (ret != 0) {
+		free(m);
+		return(NULL);
+	}
+
+	m->type = type;
+	m->id   = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+	if (name != NULL)
+		strncpy(m->name, name, MAX_NAME_SIZE - 1);
+	else
+		snprintf(m->name, MAX_NAME_SIZE, "%p", (void*)m);
+
+	if (llist_add(&umst->locks, m) == FALSE) {
+		if (type == MEAS_LOCK_RWLOCK)
+			pthread_rwlock_destroy(&m->u.rwlock);
+		else
+			pthread_mutex_destroy(&m->u.mutex);
+		free(m);
+		return(NULL);
+	}
+
+	return(m);
+}
+
+
+/**
+ * Account an acquisition in the table of the calling thread
+ * @param m The lock.
+ * @param mode MODE_EXCLUSIVE or MODE_SHARED.
+ * @param t0 Ticks before the blocking call (when contended).
+ * @param contended TRUE if the lock was busy.
+ */
+static void acquired(meas_mutex *m, int mode, unsigned long t0, int contended)
+{
+	unsigned long now = meas_get_ticks();
+	unsigned long wait;
+	struct lock_table *t = thread_table;
+	struct lock_slot *s;
+
+	if (t == NULL && (t = table_init()) == NULL)
+		return;
+
+	if ((s = lookup(t, m->id, TRUE)) == NULL)
+		return;
+
+	s->stats[mode].acquisitions++;
+	if (contended) {
+		wait = now - t0;
+		s->stats[mode].contended++;
+		s->stats[mode].wait += wait;
+		if (wait > s->stats[mode].wait_max)
+			s->stats[mode].wait_max = wait;
+	}
+
+	if (s->held[mode]++ == 0)
+		s->since[mode] = now;
+}
+
+
+/**
+ * Table of the calling thread (taken from the free tables or allocated
+ * on its first acquisition)
+ * @return struct lock_table* NULL on error or the table.
+ */
+static struct lock_table *table_init(void)
+{
+	struct lock_table *t;
+
+	pthread_once(&key_once, key_init);
+
+	pthread_mutex_lock(&tables_lock);
+	if ((t = free_tables) != NULL)
+		free_tables = t->next;
+	pthread_mutex_unlock(&tables_lock);
+
+	if (t == NULL && (t = (struct lock_table*)calloc(1, sizeof(struct lock_table))) == NULL)
+		return(NULL);
+
+	pthread_mutex_lock(&tables_lock);
+	t->next = tables;
+	tables  = t;
+	pthread_mutex_unlock(&tables_lock);
+
+	pthread_setspecific(key, t);
+	thread_table = t;
+	return(t);
+}
+
+
+/**
+ * Fold the table of an exiting thread into the retired table and keep
+ * it for reuse
+ * @param arg The table.
+ */
+static void table_exit(void *arg)
+{
+	struct lock_table *t = (struct lock_table*)arg, **p;
+	struct lock_slot *s, *r;
+	unsigned long n;
+	unsigned int i;
+
+	pthread_mutex_lock(&tables_lock);
+	for (p = &tables; *p != NULL && *p != t; p = &(*p)->next);
+	if (*p != NULL)
+		*p = t->next;
+
+	/* One retired slot per lock created so far */
+	n = __atomic_load_n(&next_id, __ATOMIC_RELAXED);
+	if (n > nretired && (r = (struct lock_slot*)realloc(retired, n * sizeof(struct lock_slot))) != NULL) {
+		memset(&r[nretired], 0, (n - nretired) * sizeof(struct lock_slot));
+		retired  = r;
+		nretired = n;
+	}
+
+	retired_lost += t->lost;
+	for (i = 0; i < LOCK_SLOTS; i++) {
+		s = &t->slots[i];
+		if (s->id == 0)
+			continue;
+
+		/* No memory for the slot: its acquisitions are lost */
+		if (s->id > nretired) {
+			retired_lost += s->stats[MODE_EXCLUSIVE].acquisitions + s->stats[MODE_SHARED].acquisitions;
+			continue;
+		}
+
+		r = &retired[s->id - 1];
+		r->id = s->id;
+		add_stats(&r->stats[MODE_EXCLUSIVE], &s->stats[MODE_EXCLUSIVE]);
+		add_stats(&r->stats[MODE_SHARED], &s->stats[MODE_SHARED]);
+	}
+
+	memset(t, 0, sizeof(struct lock_table));
+	t->next = free_tables;
+	free_tables = t;
+	pthread_mutex_unlock(&tables_lock);
+
+	thread_table = NULL;
+}
+
+
+/**
+ * Create the key running table_exit at thread exit
+ */
+static void key_init(void)
+{
+	pthread_key_create(&key, table_exit);
+}
+
+
+/**
+ * Find (or add) a lock in a thread table
+ * @param t The table.
+ * @param id Id of the lock.
+ * @param add TRUE to add the lock when not found.
+ * @return struct lock_slot* NULL if not found or the table is full.
+ */
+static struct lock_slot *lookup(struct lock_table *t, unsigned long id, int add)
+{
+	struct lock_slot *s;
+	unsigned long i;
+
+	i = util_hash(id, LOCK_SLOTS_BITS);
+	for (;;) {
+		s = &t->slots[i & (LOCK_SLOTS - 1)];
+		if (s->id == id)
+			return(s);
+		if (s->id == 0)
+			break;
+		i++;
+	}
+
+	if (!add)
+		return(NULL);
+
+	if (t->nslots >= (LOCK_SLOTS / 4) * 3) {
+		t->lost++;
+		return(NULL);
+	}
+
+	__atomic_store_n(&s->id, id, __ATOMIC_RELEASE);
+	t->nslots++;
+	return(s);
+}
+
+
+/**
+ * Add the statistics of a lock to another
+ * @param dst Statistics updated.
+ * @param src Statistics added.
+ */
+static void add_stats(meas_lock_stats *dst, const meas_lock_stats *src)
+{
+	dst->acquisitions += src->acquisitions;
+	dst->contended    += src->contended;
+	dst->wait         += src->wait;
+	dst->hold         += src->hold;
+	if (src->wait_max > dst->wait_max)
+		dst->wait_max = src->wait_max;
+	if (src->hold_max > dst->hold_max)
+		dst->hold_max = src->hold_max;
+}
+
@@ -0,0 +1,719 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Crash-safe persistent log
+ *
+ * A file mapped in memory holds a ring of records. Each record carries
+ * its position in the log (a byte offset that only grows, so old records
+ * are told apart from the ones that overwrote them) and a CRC32; a record
+ * torn by a crash or a reset fails its CRC and is skipped. Appending only
+ * reserves space with a compare-and-swap and writes to memory: no system
+ * call per record. The page cache keeps the records when the process
+ * dies; meas_plog_sync flushes them for power losses.
+ *
+ * The reader scans the whole ring at 8-byte steps, so it resynchronizes
+ * after any damaged area, and returns the records in log order.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * File and record identification
+ */
+#define PLOG_MAGIC   0x474f4c50
+#define PLOG_VERSION 1
+#define REC_MAGIC    0x43455250
+
+/**
+ * Records start at this file offset (after the header)
+ */
+#define PLOG_DATA_OFFSET 4096
+
+/**
+ * Smallest ring accepted
+ */
+#define PLOG_MIN_SIZE 4096
+
+/**
+ * Records are aligned to 8 bytes
+ */
+#define ALIGN8(x) (((x) + 7) & ~7UL)
+
+/**
+ * File header
+ */
+struct plog_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned long long size;	/* Size of the ring */
+	unsigned long long head;	/* Position of the next record */
+	unsigned int sessions;
+	unsigned int reserved;
+};
+
+/**
+ * Record header (followed by the payload)
+ */
+struct plog_record {
+	unsigned int magic;			/* Written last */
+	unsigned int crc;			/* CRC32 of the record after this field */
+	unsigned int type;
+	unsigned int length;		/* Payload bytes */
+	unsigned long long pos;		/* Position in the log */
+	unsigned long long time;
+	unsigned int session;
+	int pid;
+};
+
+/**
+ * Payload of MEAS_PLOG_SNAPSHOT (followed by nmetrics meas_interval)
+ */
+struct plog_snapshot {
+	unsigned int nmetrics;
+	unsigned int reserved;
+};
+
+/**
+ * Payload of MEAS_PLOG_EVENT
+ */
+struct plog_event {
+	long value;
+	char name[MAX_NAME_SIZE];
+};
+
+/**
+ * Persistent log
+ */
+struct _meas_plog {
+	meas_t *mst;
+	char *map;
+	unsigned long map_size;
+	struct plog_header *hdr;
+	char *data;
+	unsigned long long size;
+	unsigned int session;
+	int pid;
+	unsigned long dropped;		/* Records larger than the ring */
+	unsigned long period;		/* Snapshot period (ms), 0 without worker */
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t worker;
+};
+
+/**
+ * Valid record found by a scan
+ */
+struct plog_found {
+	unsigned long long pos;
+	unsigned long long off;
+};
+
+extern void _libmeas_read_timer(meas_clock *clock, meas_interval *value);
+
+static unsigned int crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * static functions
+ */
+static struct plog_record *begin_record(meas_plog *plog, unsigned int type, unsigned long length);
+static void commit_record(struct plog_record *rec);
+static int scan(const char *data, unsigned long long size, struct plog_found **found,
+				unsigned long *nfound);
+static int cmp_found(const void *a, const void *b);
+static void *plog_worker(void *arg);
+static void crc_init(void);
+static unsigned int crc32(const void *buf, unsigned long len);
+static unsigned long long realtime_ns(void);
+
+
+/**
+ * Open (or create) a persistent log and start a new session in it.
+ * An existing log keeps its records and its size. An existing file that
+ * is not empty and not a log of this version is left untouched (error).
+ * meas_close closes it.
+ * @param mst The meas user structure.
+ * @param path Log file.
+ * @param size Size of the ring of records (bytes) of a new log.
+ * @param period Snapshot period in milliseconds (0: only meas_plog_snapshot).
+ * @return NULL on error or the log.
+ */
+meas_plog *meas_plog_open(meas_t **mst, const char *path, unsigned long size,
+						  unsigned long period)
+{
+	meas_plog *plog;
+	struct plog_header hdr;
+	struct plog_found *found;
+	struct plog_record *rec;
+	unsigned long nfound, i;
+	unsigned long long end;
+	struct stat st;
+	int fd, valid = FALSE;
+
+	if (mst == NULL || *mst == NULL || (*mst)->plog != NULL || path == NULL)
+		return(NULL);
+
+	pthread_once(&crc_once, crc_init);
+
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return(NULL);
+
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return(NULL);
+	}
+
+	if (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+			hdr.magic == PLOG_MAGIC && hdr.version == PLOG_VERSION &&
+			hdr.size >= PLOG_MIN_SIZE && (hdr.size % 8) == 0 &&
+			st.st_size >= (off_t)(PLOG_DATA_OFFSET + hdr.size))
+		valid = TRUE;
+
+	/* Only an empty file becomes a new log: anything else is not ours to overwrite */
+	if (!valid) {
+		size &= ~7UL;
+		if (st.st_size != 0 || size < PLOG_MIN_SIZE ||
+				ftruncate(fd, PLOG_DATA_OFFSET + size) != 0) {
+			close(fd);
+			return(NULL);
+		}
+		hdr.size = size;
+	}
+
+	if ((plog = (meas_plog*)calloc(1, sizeof(meas_plog))) == NULL) {
+		close(fd);
+		return(NULL);
+	}
+
+	/* Every page is faulted in now, not when a record is appended */
+	plog->map_size = PLOG_DATA_OFFSET + hdr.size;
+	plog->map = (char*)mmap(NULL, plog->map_size, PROT_READ | PROT_WRITE,
+							MAP_SHARED | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (plog->map == MAP_FAILED) {
+		free(plog);
+		return(NULL);
+	}
+
+	plog->hdr  = (struct plog_header*)plog->map;
+	plog->data = plog->map + PLOG_DATA_OFFSET;
+	plog->size = hdr.size;
+	plog->mst  = *mst;
+	plog->pid  = (int)getpid();
+
+	if (!valid) {
+		plog->hdr->version = PLOG_VERSION;
+		plog->hdr->size    = hdr.size;
+		plog->hdr->magic   = PLOG_MAGIC;
+	} else if (scan(plog->data, plog->size, &found, &nfound) == TRUE) {
+		/* Continue after the last record (the header may lag behind) */
+		for (i = 0; i < nfound; i++) {
+			rec = (struct plog_record*)(plog->data + found[i].off);
+			end = rec->pos + ALIGN8(sizeof(struct plog_record) + rec->length);
+			if (end > plog->hdr->head)
+				plog->hdr->head = end;
+		}
+		free(found);
+	}
+
+	plog->session = ++plog->hdr->sessions;
+	if ((rec = begin_record(plog, MEAS_PLOG_SESSION, 0)) != NULL)
+		commit_record(rec);
+
+	plog->period = period;
+	if (period > 0) {
+		pthread_mutex_init(&plog->lock, NULL);
+		pthread_cond_init(&plog->cond, NULL);
+		if (pthread_create(&plog->worker, NULL, plog_worker, plog) != 0) {
+			pthread_cond_destroy(&plog->cond);
+			pthread_mutex_destroy(&plog->lock);
+			munmap(plog->map, plog->map_size);
+			free(plog);
+			return(NULL);
+		}
+	}
+
+	(*mst)->plog = plog;
+	return(plog);
+}
+
+
+/**
+ * Append a snapshot of the timers (accumulated intervals, see
+ * meas_snapshot_reset) and counters to a persistent log
+ * @param plog The log.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_plog_snapshot(meas_plog *plog)
+{
+	struct plog_record *rec;
+	struct plog_snapshot *snap;
+	meas_interval *metrics;
+	meas_counter *counter;
+	unsigned int n = 0, i = 0;
+	llist *tmp;
+
+	if (plog == NULL)
+		return(FALSE);
+
+	foreach(plog->mst->timers, tmp) {
+		n++;
+	}
+	foreach(plog->mst->counters, tmp) {
+		n++;
+	}
+
+	if ((rec = begin_record(plog, MEAS_PLOG_SNAPSHOT,
+							sizeof(struct plog_snapshot) + (n * sizeof(meas_interval)))) == NULL)
+		return(FALSE);
+
+	snap    = (struct plog_snapshot*)(rec + 1);
+	metrics = (meas_interval*)(snap + 1);
+
+	/* Elements created meanwhile wait for the next snapshot */
+	foreach(plog->mst->timers, tmp) {
+		if (i == n)
+			break;
+		_libmeas_read_timer((meas_clock*)tmp->element, &metrics[i++]);
+	}
+
+	foreach(plog->mst->counters, tmp) {
+		if (i == n)
+			break;
+		counter = (meas_counter*)tmp->element;
+		memset(&metrics[i], 0, sizeof(meas_interval));
+		strcpy(metrics[i].name, counter->name);
+		metrics[i].kind  = MEAS_RUN_COUNTER;
+		metrics[i].value = (long)__atomic_load_n(&counter->value, __ATOMIC_RELAXED);
+		i++;
+	}
+
+	/* Unused entries (removed meanwhile) stay empty */
+	memset(&metrics[i], 0, (n - i) * sizeof(meas_interval));
+	snap->nmetrics = i;
+	snap->reserved = 0;
+
+	commit_record(rec);
+	return(TRUE);
+}
+
+
+/**
+ * Append a trace event to a persistent log (safe from any thread)
+ * @param plog The log.
+ * @param name Name of the event.
+ * @param value Value of the event.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_plog_event(meas_plog *plog, const char *name, long value)
+{
+	struct plog_record *rec;
+	struct plog_event *ev;
+
+	if (plog == NULL || name == NULL)
+		return(FALSE);
+
+	if ((rec = begin_record(plog, MEAS_PLOG_EVENT, sizeof(struct plog_event))) == NULL)
+		return(FALSE);
+
+	ev = (struct plog_event*)(rec + 1);
+	memset(ev, 0, sizeof(struct plog_event));
+	ev->value = value;
+	strncpy(ev->name, name, MAX_NAME_SIZE - 1);
+
+	commit_record(rec);
+	return(TRUE);
+}
+
+
+/**
+ * Flush a persistent log to its file (only needed to survive power
+ * losses: records of a crashed process stay in the page cache)
+ * @param plog The log.
+ * @param wait TRUE to wait for the write, FALSE to only schedule it.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_plog_sync(meas_plog *plog, int wait)
+{
+	if (plog == NULL)
+		return(FALSE);
+
+	return(msync(plog->map, plog->map_size, wait ? MS_SYNC : MS_ASYNC) == 0 ? TRUE : FALSE);
+}
+
+
+/**
+ * Number of records that did not fit in the ring
+ * @param plog The log.
+ * @return unsigned long Number of records.
+ */
+unsigned long meas_plog_dropped(meas_plog *plog)
+{
+	return(plog != NULL ? __atomic_load_n(&plog->dropped, __ATOMIC_RELAXED) : 0);
+}
+
+
+/**
+ * Write a last snapshot, flush and close a persistent log
+ * @param plog The log.
+ */
+void meas_plog_close(meas_plog **plog)
+{
+	meas_plog *p;
+
+	if (plog == NULL || *plog == NULL)
+		return;
+
+	p = *plog;
+	if (p->period > 0) {
+		pthread_mutex_lock(&p->lock);
+		p->stop = TRUE;
+		pthread_cond_signal(&p->cond);
+		pthread_mutex_unlock(&p->lock);
+		pthread_join(p->worker, NULL);
+		pthread_cond_destroy(&p->cond);
+		pthread_mutex_destroy(&p->lock);
+	}
+
+	meas_plog_snapshot(p);
+	meas_plog_sync(p, TRUE);
+	munmap(p->map, p->map_size);
+
+	if (p->mst->plog == p)
+		p->mst->plog = NULL;
+	free(p);
+	*plog = NULL;
+}
+
+
+/**
+ * Read the valid records of a persistent log in log order (e.g. after an
+ * abrupt termination); the last MEAS_PLOG_SNAPSHOT is the last consistent
+ * state of the metrics.
+ * @param path Log file.
+ * @param fn Function called for each record.
+ * @param ctx Argument passed to fn.
+ * @return int Number of records read (-1 on error).
+ */
+int meas_plog_read(const char *path, meas_plog_fn fn, void *ctx)
+{
+	const struct plog_header *hdr;
+	const struct plog_record *r;
+	const struct plog_snapshot *snap;
+	const struct plog_event *ev;
+	struct plog_found *found;
+	meas_plog_rec rec;
+	unsigned long nfound, i, map_size;
+	unsigned long long end = 0;
+	char *map, *data, name[MAX_NAME_SIZE];
+	struct plog_header h;
+	struct stat st;
+	int fd, n = 0;
+
+	if (path == NULL || fn == NULL)
+		return(-1);
+
+	pthread_once(&crc_once, crc_init);
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return(-1);
+
+	if (fstat(fd, &st) != 0 || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+			h.magic != PLOG_MAGIC || h.version != PLOG_VERSION || h.size < PLOG_MIN_SIZE ||
+			(h.size % 8) != 0 || st.st_size < (off_t)(PLOG_DATA_OFFSET + h.size)) {
+		close(fd);
+		return(-1);
+	}
+
+	map_size = PLOG_DATA_OFFSET + h.size;
+	map = (char*)mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return(-1);
+
+	hdr  = (const struct plog_header*)map;
+	data = map + PLOG_DATA_OFFSET;
+
+	if (scan(data, hdr->size, &found, &nfound) == FALSE) {
+		munmap(map, map_size);
+		return(-1);
+	}
+
+	/* Records older than one ring were overwritten by reserved, unwritten space */
+	for (i = 0; i < nfound; i++) {
+		r = (const struct plog_record*)(data + found[i].off);
+		if (r->pos + ALIGN8(sizeof(struct plog_record) + r->length) > end)
+			end = r->pos + ALIGN8(sizeof(struct plog_record) + r->length);
+	}
+
+	qsort(found, nfound, sizeof(struct plog_found), cmp_found);
+
+	for (i = 0; i < nfound; i++) {
+		r = (const struct plog_record*)(data + found[i].off);
+		if (end > hdr->size && r->pos < end - hdr->size)
+			continue;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.type    = (int)r->type;
+		rec.seq     = r->pos;
+		rec.time    = r->time;
+		rec.session = r->session;
+		rec.pid     = r->pid;
+
+		if (r->type == MEAS_PLOG_SNAPSHOT) {
+			snap = (const struct plog_snapshot*)(r + 1);
+			if (r->length < sizeof(struct plog_snapshot) ||
+					snap->nmetrics > (r->length - sizeof(struct plog_snapshot)) / sizeof(meas_interval))
+				continue;
+			rec.nmetrics = snap->nmetrics;
+			rec.metrics  = (const meas_interval*)(snap + 1);
+		} else if (r->type == MEAS_PLOG_EVENT) {
+			if (r->length < sizeof(struct plog_event))
+				continue;
+			ev = (const struct plog_event*)(r + 1);
+			memcpy(name, ev->name, MAX_NAME_SIZE);
+			name[MAX_NAME_SIZE - 1] = '\0';
+			rec.name  = name;
+			rec.value = ev->value;
+		}
+
+		n++;
+		if (fn(&rec, ctx) == FALSE)
+			break;
+	}
+
+	free(found);
+	munmap(map, map_size);
+	return(n);
+}
+
+
+/**
+ * Reserve a record in the ring (its magic is cleared until commit_record)
+ * @param plog The log.
+ * @param type Record type.
+ * @param length Payload bytes.
+ * @return Record or NULL if it does not fit in the ring.
+ */
+static struct plog_record *begin_record(meas_plog *plog, unsigned int type, unsigned long length)
+{
+	struct plog_record *rec;
+	unsigned long long pos, start, next, off, len;
+
+	len = ALIGN8(sizeof(struct plog_record) + length);
+	if (len > plog->size) {
+		__atomic_add_fetch(&plog->dropped, 1, __ATOMIC_RELAXED);
+		return(NULL);
+	}
+
+	pos = __atomic_load_n(&plog->hdr->head, __ATOMIC_RELAXED);
+	do {
+		/* A record never wraps: skip the end of the ring */
+		off   = pos % plog->size;
+		start = (off + len <= plog->size) ? pos : pos + (plog->size - off);
+		next  = start + len;
+	} while (!__atomic_compare_exchange_n(&plog->hdr->head, &pos, next, FALSE,
+										  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+	rec = (struct plog_record*)(plog->data + (start % plog->size));
+	__atomic_store_n(&rec->magic, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec->type    = type;
+	rec->length  = (unsigned int)length;
+	rec->pos     = start;
+	rec->time    = realtime_ns();
+	rec->session = plog->session;
+	rec->pid     = plog->pid;
+	return(rec);
+}
+
+
+/**
+ * Seal a record written after begin_record
+ * @param rec The record.
+ */
+static void commit_record(struct plog_record *rec)
+{
+	rec->crc = crc32(&rec->type, sizeof(struct plog_record) - (2 * sizeof(unsigned int)) +
+					 rec->length);
+	__atomic_store_n(&rec->magic, REC_MAGIC, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Find the valid records of a ring
+ * @param data The ring.
+ * @param size Size of the ring.
+ * @param found Returned vector of records (free with free()).
+ * @param nfound Returned number of records.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int scan(const char *data, unsigned long long size, struct plog_found **found,
+				unsigned long *nfound)
+{
+	const struct plog_record *r;
+	struct plog_found *f, *nf;
+	unsigned long n = 0, capacity = 64;
+	unsigned long long off = 0, len;
+
+	if ((f = (struct plog_found*)malloc(sizeof(struct plog_found) * capacity)) == NULL)
+		return(FALSE);
+
+	while (off + sizeof(struct plog_record) <= size) {
+		r = (const struct plog_record*)(data + off);
+		len = ALIGN8(sizeof(struct plog_record) + (unsigned long long)r->length);
+
+		if (r->magic != REC_MAGIC || off + len > size || (r->pos % size) != off ||
+				r->crc != crc32(&r->type, sizeof(struct plog_record) -
+								(2 * sizeof(unsigned int)) + r->length)) {
+			off += 8;
+			continue;
+		}
+
+		if (n == capacity) {
+			if ((nf = (struct plog_found*)realloc(f, sizeof(struct plog_found) * capacity * 2)) == NULL) {
+				free(f);
+				return(FALSE);
+			}
+			f = nf;
+			capacity *= 2;
+		}
+
+		f[n].pos = r->pos;
+		f[n].off = off;
+		n++;
+		off += len;
+	}
+
+	*found  = f;
+	*nfound = n;
+	return(TRUE);
+}
+
+
+/**
+ * Compare two records by position (for qsort)
+ */
+static int cmp_found(const void *a, const void *b)
+{
+	unsigned long long x = ((const struct plog_found*)a)->pos;
+	unsigned long long y = ((const struct plog_found*)b)->pos;
+
+	return((x > y) - (x < y));
+}
+
+
+/**
+ * Periodic snapshot worker
+ * @param arg The log.
+ */
+static void *plog_worker(void *arg)
+{
+	meas_plog *plog = (meas_plog*)arg;
+	struct timespec next;
+
+	clock_gettime(CLOCK_REALTIME, &next);
+
+	pthread_mutex_lock(&plog->lock);
+	while (!plog->stop) {
+		next.tv_sec  += plog->period / 1000;
+		next.tv_nsec += (plog->period % 1000) * 1000000L;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+
+		while (!plog->stop &&
+				pthread_cond_timedwait(&plog->cond, &plog->lock, &next) != ETIMEDOUT);
+
+		if (!plog->stop) {
+			pthread_mutex_unlock(&plog->lock);
+			meas_plog_snapshot(plog);
+			pthread_mutex_lock(&plog->lock);
+		}
+	}
+	pthread_mutex_unlock(&plog->lock);
+
+	return(NULL);
+}
+
+
+/**
+ * Build the CRC32 (IEEE 802.3) table
+ */
+static void crc_init(void)
+{
+	unsigned int i, j, c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++) {
+			c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : (c >> 1);
+		}
+		crc_table[i] = c;
+	}
+}
+
+
+/**
+ * CRC32 of a buffer
+ * @param buf The buffer.
+ * @param len Length in bytes.
+ * @return unsigned int The CRC.
+ */
+static unsigned int crc32(const void *buf, unsigned long len)
+{
+	const unsigned char *p = (const unsigned char*)buf;
+	unsigned int c = 0xFFFFFFFFU;
+
+	while (len-- > 0) {
+		c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+	}
+
+	return(c ^ 0xFFFFFFFFU);
+}
+
+
+/**
+ * CLOCK_REALTIME in nanoseconds (meaningful after a reset)
+ * @return unsigned long long Nanoseconds.
+ */
+static unsigned long long realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return(((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec);
+}
+
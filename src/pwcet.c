@@ -0,0 +1,576 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Probabilistic WCET: extreme value models of timer samples
+ *
+ * Block maxima are fitted by a Gumbel or a generalized extreme value
+ * (GEV) distribution, peaks over a threshold by a generalized Pareto
+ * distribution (GPD). Parameters are estimated by probability weighted
+ * moments (Hosking), which stay stable with the few hundred maxima a
+ * timer usually provides. The fit is checked by a Kolmogorov-Smirnov
+ * test; with parameters estimated from the same data its p-value is
+ * optimistic, so a rejection is a strong signal, an acceptance a weak one.
+ *
+ * A bound is the value exceeded by one activation with probability p.
+ */
+#include <meas.h>
+#include <util.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Defaults (see meas_pwcet_defaults)
+ */
+#define PWCET_BLOCK_SIZE 50
+#define PWCET_TAIL       0.05
+#define PWCET_MIN_FIT    50
+#define PWCET_ALPHA      0.05
+
+/**
+ * Lag-1 autocorrelation above which samples are reported as dependent
+ */
+#define PWCET_MAX_LAG1 0.1
+
+/**
+ * Shapes closer to 0 are treated as 0 (Gumbel or exponential tail)
+ */
+#define PWCET_ZERO_SHAPE 1e-6
+
+#define EULER_GAMMA 0.57721566490153286
+
+/**
+ * static functions
+ */
+static int fit_block_maxima(meas_pwcet *fit, double *maxima, unsigned long m);
+static int fit_peaks(meas_pwcet *fit, double *peaks, unsigned long m, double threshold);
+static double cdf(const meas_pwcet *fit, double x);
+static void goodness_of_fit(meas_pwcet *fit, const double *v, unsigned long m, double alpha);
+static double ks_pvalue(double d, unsigned long m);
+static double lag1(const unsigned long *values, unsigned long n);
+static int cmp_ulong(const void *a, const void *b);
+
+
+/**
+ * Fill pWCET options with default values
+ * (Gumbel fit of maxima of blocks of 50 samples, POT tail of 5%,
+ *  50 fitted values at least, goodness-of-fit tested at 5%).
+ * @param opts Options.
+ */
+void meas_pwcet_defaults(meas_pwcet_opts *opts)
+{
+	opts->method     = MEAS_PWCET_GUMBEL;
+	opts->block_size = PWCET_BLOCK_SIZE;
+	opts->tail       = PWCET_TAIL;
+	opts->min_fit    = PWCET_MIN_FIT;
+	opts->alpha      = PWCET_ALPHA;
+}
+
+
+/**
+ * Fit an extreme value model to samples (in the order they were measured)
+ * @param values The samples.
+ * @param n Number of samples.
+ * @param opts Options (NULL for defaults).
+ * @param fit The model.
+ * @return FALSE on error (including too few samples to fit anything), TRUE otherwise.
+ */
+int meas_pwcet_fit(const unsigned long *values, unsigned long n, const meas_pwcet_opts *opts,
+				   meas_pwcet *fit)
+{
+	meas_pwcet_opts dopts;
+	unsigned long *sorted, i, j, m, first;
+	double *v;
+	int ret;
+
+	if (values == NULL || fit == NULL || n == 0)
+		return(FALSE);
+
+	if (opts == NULL) {
+		meas_pwcet_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	if (opts->block_size == 0 || opts->tail <= 0 || opts->tail >= 1)
+		return(FALSE);
+
+	memset(fit, 0, sizeof(meas_pwcet));
+	fit->method = opts->method;
+	fit->n      = n;
+	fit->lag1   = lag1(values, n);
+	for (i = 0; i < n; i++) {
+		if (values[i] > fit->max)
+			fit->max = values[i];
+	}
+
+	if (opts->method == MEAS_PWCET_POT) {
+		if ((sorted = (unsigned long*)malloc(sizeof(unsigned long) * n)) == NULL)
+			return(FALSE);
+		memcpy(sorted, values, sizeof(unsigned long) * n);
+		qsort(sorted, n, sizeof(unsigned long), cmp_ulong);
+
+		/* Peaks: values strictly over the threshold (ties stay below) */
+		first = (unsigned long)((1 - opts->tail) * n);
+		if (first >= n)
+			first = n - 1;
+		for (j = first; j < n && sorted[j] == sorted[first]; j++);
+
+		m = n - j;
+		if ((v = (double*)malloc(sizeof(double) * (m + 1))) == NULL) {
+			free(sorted);
+			return(FALSE);
+		}
+		for (i = 0; i < m; i++) {
+			v[i] = (double)(sorted[j + i] - sorted[first]);
+		}
+
+		ret = fit_peaks(fit, v, m, (double)sorted[first]);
+		free(sorted);
+	} else {
+		fit->block_size = opts->block_size;
+		m = n / opts->block_size;
+		if ((v = (double*)malloc(sizeof(double) * (m + 1))) == NULL)
+			return(FALSE);
+
+		for (i = 0; i < m; i++) {
+			v[i] = 0;
+			for (j = i * opts->block_size; j < (i + 1) * opts->block_size; j++) {
+				if (values[j] > v[i])
+					v[i] = values[j];
+			}
+		}
+
+		qsort(v, m, sizeof(double), util_cmp_double);
+		ret = fit_block_maxima(fit, v, m);
+	}
+
+	if (ret == TRUE)
+		goodness_of_fit(fit, v, m, opts->alpha);
+
+	if (m < opts->min_fit)
+		fit->warnings |= MEAS_PWCET_FEW_SAMPLES;
+	if (fabs(fit->lag1) > PWCET_MAX_LAG1)
+		fit->warnings |= MEAS_PWCET_DEPENDENT;
+	if (fit->shape > PWCET_ZERO_SHAPE)
+		fit->warnings |= MEAS_PWCET_HEAVY_TAIL;
+
+	free(v);
+	return(ret);
+}
+
+
+/**
+ * Fit an extreme value model to the captured samples of a timer (see
+ * meas_clock_capture)
+ * @param clock The timer.
+ * @param opts Options (NULL for defaults).
+ * @param fit The model.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_pwcet_clock(meas_clock *clock, const meas_pwcet_opts *opts, meas_pwcet *fit)
+{
+	if (clock == NULL || clock->samples == NULL)
+		return(FALSE);
+
+	return(meas_pwcet_fit(clock->samples->values, clock->samples->n, opts, fit));
+}
+
+
+/**
+ * Fit a generalized Pareto model to the peaks of a histogram
+ * (peaks over threshold only: a histogram does not keep the order needed
+ * by block maxima). Each value is the middle of its bucket, values in the
+ * overflow take the observed max.; the fit is tested at the bucket
+ * bounds. The lag-1 autocorrelation is not known (0).
+ * @param hist The histogram.
+ * @param opts Options (NULL for defaults, the method is ignored).
+ * @param fit The model.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_pwcet_hist(meas_histogram *hist, const meas_pwcet_opts *opts, meas_pwcet *fit)
+{
+	meas_pwcet_opts dopts;
+	unsigned long threshold, value, m, k, c;
+	unsigned int b;
+	double *v, middle, d;
+	int ret;
+
+	if (hist == NULL || fit == NULL || hist->count == 0)
+		return(FALSE);
+
+	if (opts == NULL) {
+		meas_pwcet_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	if (opts->tail <= 0 || opts->tail >= 1)
+		return(FALSE);
+
+	memset(fit, 0, sizeof(meas_pwcet));
+	fit->method = MEAS_PWCET_POT;
+	fit->n      = hist->count;
+	fit->max    = hist->max;
+
+	threshold = meas_hist_percentile(hist, 100.0 * (1 - opts->tail));
+
+	/* Peaks in increasing order */
+	m = hist->overflow;
+	for (b = 0; b < hist->nbuckets; b++) {
+		if (hist->low + ((b + 1) * hist->width) - 1 > threshold)
+			m += hist->buckets[b];
+	}
+
+	if ((v = (double*)malloc(sizeof(double) * (m + 1))) == NULL)
+		return(FALSE);
+
+	k = 0;
+	for (b = 0; b < hist->nbuckets; b++) {
+		value = hist->low + ((b + 1) * hist->width) - 1;
+		if (value <= threshold)
+			continue;
+		middle = hist->low + (b * hist->width) + (hist->width - 1) / 2.0;
+		for (c = 0; c < hist->buckets[b]; c++) {
+			v[k++] = middle - threshold;
+		}
+	}
+	for (c = 0; c < hist->overflow; c++) {
+		v[k++] = (double)(hist->max - threshold);
+	}
+
+	ret = fit_peaks(fit, v, k, (double)threshold);
+
+	/* Kolmogorov-Smirnov distance at the upper bound of each bucket */
+	if (ret == TRUE) {
+		c = 0;
+		for (b = 0; b < hist->nbuckets; b++) {
+			value = hist->low + ((b + 1) * hist->width) - 1;
+			if (value <= threshold)
+				continue;
+			c += hist->buckets[b];
+			d = fabs((double)c / k - cdf(fit, (double)(value - threshold)));
+			if (d > fit->ks)
+				fit->ks = d;
+		}
+		fit->ks_p = ks_pvalue(fit->ks, k);
+		if (fit->ks_p < opts->alpha)
+			fit->warnings |= MEAS_PWCET_POOR_FIT;
+	}
+
+	if (k < opts->min_fit)
+		fit->warnings |= MEAS_PWCET_FEW_SAMPLES;
+	if (fit->shape > PWCET_ZERO_SHAPE)
+		fit->warnings |= MEAS_PWCET_HEAVY_TAIL;
+
+	free(v);
+	return(ret);
+}
+
+
+/**
+ * pWCET bound: value exceeded by one activation with probability p
+ * @param fit The model.
+ * @param p Exceedance probability (e.g. 1e-9).
+ * @return double The bound (in ticks), the observed max. when the model can not
+ * reach p (POT with p above the tail), 0 on error.
+ */
+double meas_pwcet_bound(const meas_pwcet *fit, double p)
+{
+	double y, q;
+
+	if (fit == NULL || fit->scale <= 0 || p <= 0 || p >= 1)
+		return(0);
+
+	if (fit->method == MEAS_PWCET_POT) {
+		q = p / ((double)fit->nfit / fit->n);
+		if (q >= 1)
+			return((double)fit->max);
+		if (fabs(fit->shape) < PWCET_ZERO_SHAPE)
+			return(fit->location - fit->scale * log(q));
+		return(fit->location + (fit->scale / fit->shape) * (pow(q, -fit->shape) - 1));
+	}
+
+	/* A block exceeds the bound with probability 1 - (1 - p)^block_size: -log of its complement */
+	y = -(double)fit->block_size * log1p(-p);
+	if (fabs(fit->shape) < PWCET_ZERO_SHAPE)
+		return(fit->location - fit->scale * log(y));
+	return(fit->location + (fit->scale / fit->shape) * (pow(y, -fit->shape) - 1));
+}
+
+
+/**
+ * Write a model with its pWCET bounds and diagnostics
+ * @param fit The model.
+ * @param name A name to the model (e.g. the timer name).
+ * @param fp Output file.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_pwcet_write(const meas_pwcet *fit, const char *name, FILE *fp)
+{
+	static const char *methods[] = {"Gumbel", "GEV", "GPD"};
+	double ps[4] = {1e-3, 1e-6, 1e-9, 1e-12};
+	unsigned int i;
+
+	if (fit == NULL || fp == NULL || fit->method < MEAS_PWCET_GUMBEL || fit->method > MEAS_PWCET_POT)
+		return(FALSE);
+
+	fprintf(fp, " %-*.*s\n", MAX_NAME_SIZE, MAX_NAME_SIZE, name);
+	if (fit->method == MEAS_PWCET_POT)
+		fprintf(fp, "   model                : %s, peaks over %.0f\n", methods[fit->method], fit->location);
+	else
+		fprintf(fp, "   model                : %s, maxima of %u samples\n", methods[fit->method], fit->block_size);
+	fprintf(fp, "   samples / fitted     : %lu / %lu\n", fit->n, fit->nfit);
+	fprintf(fp, "   mu / sigma / xi      : %.1f / %.1f / %.4f\n", fit->location, fit->scale, fit->shape);
+	fprintf(fp, "   KS distance / p      : %.4f / %.3f\n", fit->ks, fit->ks_p);
+	fprintf(fp, "   lag-1 autocorrelation: %.3f\n", fit->lag1);
+	fprintf(fp, "   observed max         : %lu\n", fit->max);
+
+	for (i = 0; i < 4; i++) {
+		fprintf(fp, "   pWCET %-14g : %.0f\n", ps[i], meas_pwcet_bound(fit, ps[i]));
+	}
+
+	if (fit->warnings & MEAS_PWCET_FEW_SAMPLES)
+		fprintf(fp, "   WARNING: too few %s to trust the bounds\n",
+				fit->method == MEAS_PWCET_POT ? "peaks" : "block maxima");
+	if (fit->warnings & MEAS_PWCET_POOR_FIT)
+		fprintf(fp, "   WARNING: the model does not fit the data (KS test)\n");
+	if (fit->warnings & MEAS_PWCET_DEPENDENT)
+		fprintf(fp, "   WARNING: correlated samples, EVT assumes independent ones\n");
+	if (fit->warnings & MEAS_PWCET_HEAVY_TAIL)
+		fprintf(fp, "   WARNING: heavy tail (xi > 0), bounds grow without limit\n");
+
+	return(TRUE);
+}
+
+
+/**
+ * Fit a Gumbel or GEV distribution to block maxima (probability weighted
+ * moments)
+ * @param fit The model (method set).
+ * @param maxima Sorted block maxima.
+ * @param m Number of maxima.
+ * @return FALSE if the maxima can not be fitted, TRUE otherwise.
+ */
+static int fit_block_maxima(meas_pwcet *fit, double *maxima, unsigned long m)
+{
+	double b0 = 0, b1 = 0, b2 = 0, c, k, g;
+	unsigned long i;
+
+	fit->nfit = m;
+	if (m < 3)
+		return(FALSE);
+
+	for (i = 0; i < m; i++) {
+		b0 += maxima[i];
+		b1 += maxima[i] * i / (m - 1);
+		b2 += maxima[i] * ((double)i * ((double)i - 1)) / ((double)(m - 1) * (m - 2));
+	}
+	b0 /= m;
+	b1 /= m;
+	b2 /= m;
+
+	/* Constant maxima: no spread to model */
+	if (2 * b1 - b0 <= 0)
+		return(FALSE);
+
+	if (fit->method == MEAS_PWCET_GEV) {
+		/* Hosking, Wallis and Wood (1985); their k is -xi */
+		c = (2 * b1 - b0) / (3 * b2 - b0) - log(2) / log(3);
+		k = 7.8590 * c + 2.9554 * c * c;
+		if (fabs(k) >= PWCET_ZERO_SHAPE) {
+			g = tgamma(1 + k);
+			fit->scale    = (2 * b1 - b0) * k / (g * (1 - pow(2, -k)));
+			fit->location = b0 + fit->scale * (g - 1) / k;
+			fit->shape    = -k;
+			return(TRUE);
+		}
+	}
+
+	fit->scale    = (2 * b1 - b0) / log(2);
+	fit->location = b0 - EULER_GAMMA * fit->scale;
+	fit->shape    = 0;
+	return(TRUE);
+}
+
+
+/**
+ * Fit a generalized Pareto distribution to peaks over a threshold
+ * (probability weighted moments, Hosking and Wallis 1987)
+ * @param fit The model.
+ * @param peaks Sorted excesses over the threshold.
+ * @param m Number of peaks.
+ * @param threshold The threshold.
+ * @return FALSE if the peaks can not be fitted, TRUE otherwise.
+ */
+static int fit_peaks(meas_pwcet *fit, double *peaks, unsigned long m, double threshold)
+{
+	double a0 = 0, a1 = 0, k;
+	unsigned long i;
+
+	fit->nfit     = m;
+	fit->location = threshold;
+	if (m < 3)
+		return(FALSE);
+
+	for (i = 0; i < m; i++) {
+		a0 += peaks[i];
+		a1 += peaks[i] * (m - 1 - i) / (m - 1);
+	}
+	a0 /= m;
+	a1 /= m;
+
+	if (a0 <= 0 || a0 - 2 * a1 <= 0)
+		return(FALSE);
+
+	/* Their k is -xi */
+	k = a0 / (a0 - 2 * a1) - 2;
+	fit->scale = 2 * a0 * a1 / (a0 - 2 * a1);
+	fit->shape = (fabs(k) < PWCET_ZERO_SHAPE) ? 0 : -k;
+	return(TRUE);
+}
+
+
+/**
+ * Distribution function of a model (of block maxima, or of the excesses
+ * over the threshold)
+ * @param fit The model.
+ * @param x The value.
+ * @return double P(X <= x).
+ */
+static double cdf(const meas_pwcet *fit, double x)
+{
+	double z, t;
+
+	if (fit->method == MEAS_PWCET_POT) {
+		if (x <= 0)
+			return(0);
+		if (fit->shape == 0)
+			return(1 - exp(-x / fit->scale));
+		t = 1 + fit->shape * x / fit->scale;
+		return((t <= 0) ? 1 : 1 - pow(t, -1 / fit->shape));
+	}
+
+	z = (x - fit->location) / fit->scale;
+	if (fit->shape == 0)
+		return(exp(-exp(-z)));
+
+	t = 1 + fit->shape * z;
+	if (t <= 0)
+		return((fit->shape > 0) ? 0 : 1);
+	return(exp(-pow(t, -1 / fit->shape)));
+}
+
+
+/**
+ * Kolmogorov-Smirnov test of a fitted model
+ * @param fit The model.
+ * @param v Sorted fitted values.
+ * @param m Number of values.
+ * @param alpha Significance level.
+ */
+static void goodness_of_fit(meas_pwcet *fit, const double *v, unsigned long m, double alpha)
+{
+	double d = 0, f;
+	unsigned long i;
+
+	for (i = 0; i < m; i++) {
+		f = cdf(fit, v[i]);
+		if (f - (double)i / m > d)
+			d = f - (double)i / m;
+		if ((double)(i + 1) / m - f > d)
+			d = (double)(i + 1) / m - f;
+	}
+
+	fit->ks   = d;
+	fit->ks_p = ks_pvalue(d, m);
+	if (fit->ks_p < alpha)
+		fit->warnings |= MEAS_PWCET_POOR_FIT;
+}
+
+
+/**
+ * Asymptotic p-value of a Kolmogorov-Smirnov distance
+ * @param d The distance.
+ * @param m Number of values.
+ * @return double The p-value.
+ */
+static double ks_pvalue(double d, unsigned long m)
+{
+	double lambda, term, sum = 0, sign = 1;
+	int k;
+
+	lambda = (sqrt(m) + 0.12 + 0.11 / sqrt(m)) * d;
+	if (lambda < 0.3)
+		return(1);
+
+	for (k = 1; k <= 100; k++) {
+		term = sign * exp(-2 * k * k * lambda * lambda);
+		sum += term;
+		if (fabs(term) < 1e-12)
+			break;
+		sign = -sign;
+	}
+
+	sum *= 2;
+	return((sum < 0) ? 0 : ((sum > 1) ? 1 : sum));
+}
+
+
+/**
+ * Lag-1 autocorrelation of samples
+ * @param values The samples.
+ * @param n Number of samples.
+ * @return double The autocorrelation (0 with fewer than 3 samples or no variance).
+ */
+static double lag1(const unsigned long *values, unsigned long n)
+{
+	double mean = 0, num = 0, den = 0;
+	unsigned long i;
+
+	if (n < 3)
+		return(0);
+
+	for (i = 0; i < n; i++) {
+		mean += values[i];
+	}
+	mean /= n;
+
+	for (i = 0; i < n; i++) {
+		den += (values[i] - mean) * (values[i] - mean);
+		if (i + 1 < n)
+			num += (values[i] - mean) * (values[i + 1] - mean);
+	}
+
+	return((den > 0) ? num / den : 0);
+}
+
+
+/**
+ * Compare two unsigned longs (for qsort)
+ */
+static int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long*)a;
+	unsigned long y = *(const unsigned long*)b;
+
+	return((x > y) - (x < y));
+}
+
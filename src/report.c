@@ -32,10 +32,19 @@
  */
 #define TEXTBUFFER_SIZE 1024
 
+extern void *_libmeas_alloc(meas_t *mst, int pool, size_t size);
+extern void _libmeas_free(meas_t *mst, void *ptr);
+extern int _libmeas_list_add(meas_t *mst, int pool, llist **list, llist **tail, void *element);
+extern void _libmeas_rt_violation(meas_t *mst);
+extern unsigned long _libmeas_locks_lost(void);
+
 /**
  * static functions
  */
 static int append_text(struct _text_buffer *buffer, char *text);
+static int append_name(struct _text_buffer *buffer, const char *name);
+static void report_cpus(struct _text_buffer *buffer, meas_cpu_stats *cpus);
+static void report_lock(struct _text_buffer *buffer, const char *mode, meas_lock_stats *stats);
 
 
 /**
@@ -44,22 +53,50 @@ static int append_text(struct _text_buffer *buffer, char *text);
  * NOTE2: This function will just generate the report, use meas_show_report
  *        to print it.
  * @param mst The meas user structure. 
- * @param parameters Parameters of report (REPORT_TIMERS, REPORT_COUNTERS or REPORT_SHOW_ALL).
+ * @param parameters Parameters of report (REPORT_TIMERS, REPORT_COUNTERS, REPORT_USER_ITEMS,
+ *                   REPORT_BENCHMARKS, REPORT_RT, REPORT_LATENCY, REPORT_CHILDREN,
+ *                   REPORT_THREADS, REPORT_LOCKS or REPORT_SHOW_ALL).
  * @return FALSE on error, TRUE otherwise.
  */
 int meas_generate_report(meas_t **mst, int parameters)
 {
-	meas_t *umst = *mst;
+	meas_t *umst;
 	meas_clock *clock;
 	meas_counter *counter;
 	meas_report_item *item;
+	meas_bench *bench;
+	meas_task *task;
+	meas_latency *lat;
+	meas_histogram *hist;
+	meas_child_stats *child;
+	meas_thread_info *thread, delta;
+	meas_budget *budget;
+	meas_overrun *overrun;
+	meas_mutex *m;
+	meas_lock_stats excl, shared;
+	unsigned long lost;
+	unsigned long long elapsed;
+	meas_sample_stats stats;
+	double pcts[3] = {50.0, 99.0, 99.9};
+	unsigned long qs[3];
+	unsigned int i;
+	char label[32];
+	llist *tmp;
 	time_t curtime;
 	char line[1024];
-	int i, j, k;
 
-	if(mst == NULL)
+	if(mst == NULL || *mst == NULL)
 		return(FALSE);
-	
+
+	umst = *mst;
+
+	/* Replace any previous report */
+	umst->report.pos       = 0;
+	umst->report.truncated = FALSE;
+	if (umst->report.text != NULL) {
+		umst->report.text[0] = '\0';
+	}
+
 	/* Header */
 	append_text(&umst->report, "****************************************************************\n"); 
 	append_text(&umst->report, "* libmeas - A measurement system for critical embedded systems *\n");
@@ -71,23 +108,71 @@ int meas_generate_report(meas_t **mst, int parameters)
 	strftime(line, 1023, " Generated on %a %b %T %Y\n\n", localtime(&curtime));
 	append_text(&umst->report, line);
 
+	if (umst->rt != NULL) {
+		sprintf(line, " Hard real-time mode: %lu bytes reserved, %lu violations%s\n\n",
+				umst->rt->size, meas_rt_violations(umst),
+				umst->rt->locked ? ", memory locked" : "");
+		append_text(&umst->report, line);
+	}
+
 	/* Timers */
 	if ((parameters & REPORT_TIMERS)) {
 		append_text(&umst->report, "============================ TIMERS ============================\n");
 		append_text(&umst->report, " TIMER NAME                          NUMBER OF TICKS            \n");
 		append_text(&umst->report, "================================================================\n");
 
-		for (i = 0; i < llist_length(umst->timers); i++) {
-			clock = (meas_clock*)llist_nth(umst->timers, i);
+		foreach(umst->timers, tmp) {
+			clock = (meas_clock*)tmp->element;
 			if (clock != NULL) {
-				sprintf(line, " %.35s", clock->name);
+				append_name(&umst->report, clock->name);
+			 	sprintf(line, "   %ld\n", clock->interv);
 				append_text(&umst->report, line);
-				for (k = 0; k < (MAX_NAME_SIZE - strlen(clock->name)); k++) {
-					sprintf(line, " ");
+
+				if (meas_samples_stats(clock, &stats, pcts, 3, qs) == TRUE) {
+					sprintf(line, "   samples / dropped    : %lu / %lu\n", stats.n, clock->samples->dropped);
+					append_text(&umst->report, line);
+					sprintf(line, "   min / max / mean     : %lu / %lu / %.1f\n", stats.min, stats.max, stats.mean);
+					append_text(&umst->report, line);
+					sprintf(line, "   stddev               : %.1f\n", stats.stddev);
+					append_text(&umst->report, line);
+					sprintf(line, "   p50 / p99 / p99.9    : %lu / %lu / %lu\n", qs[0], qs[1], qs[2]);
+					append_text(&umst->report, line);
+				}
+
+				if (clock->sketch != NULL && clock->sketch->count > 0) {
+					sprintf(line, "   sketch n / error     : %lu / %g%% (%lu collapsed)\n",
+							clock->sketch->count, clock->sketch->alpha * 100, clock->sketch->collapsed);
+					append_text(&umst->report, line);
+					sprintf(line, "   ~p50 / p99 / p99.9   : %lu / %lu / %lu\n",
+							meas_sketch_percentile(clock->sketch, 50),
+							meas_sketch_percentile(clock->sketch, 99),
+							meas_sketch_percentile(clock->sketch, 99.9));
+					append_text(&umst->report, line);
+				}
+
+				if (clock->cpus != NULL)
+					report_cpus(&umst->report, clock->cpus);
+
+				if (clock->waits > 0) {
+					sprintf(line, "   active / waiting     : %.1f / %.1f (mean of %lu paused operations)\n",
+							(double)clock->active_total / clock->waits,
+							(double)clock->wait_total / clock->waits, clock->waits);
+					append_text(&umst->report, line);
+				}
+
+				if (clock->budget != NULL) {
+					budget = clock->budget;
+					sprintf(line, "   budget / overruns    : %lu / %lu (worst %lu)\n",
+							budget->budget, budget->overruns, budget->worst);
+					append_text(&umst->report, line);
+					if (budget->overruns > 0) {
+						overrun = &budget->history[(budget->overruns - 1) % MEAS_BUDGET_HISTORY];
+						sprintf(line, "   last overrun         : %lu at %lu\n", overrun->interval, overrun->time);
+						append_text(&umst->report, line);
+					}
+					sprintf(line, "   hangs / suppressed   : %lu / %lu\n", budget->running, budget->suppressed);
 					append_text(&umst->report, line);
 				}
-			 	sprintf(line, "   %ld\n", clock->interv);
-				append_text(&umst->report, line);
 			}
 		}
 
@@ -100,15 +185,10 @@ int meas_generate_report(meas_t **mst, int parameters)
 		append_text(&umst->report, " COUNTER NAME                         VALUE                     \n");
 		append_text(&umst->report, "================================================================\n");
 
-		for (j = 0; j < llist_length(umst->counters); j++) {
-			counter = (meas_counter*)llist_nth(umst->counters, j);
+		foreach(umst->counters, tmp) {
+			counter = (meas_counter*)tmp->element;
 			if (counter != NULL) {
-				sprintf(line, " %.35s", counter->name);
-				append_text(&umst->report, line);
-				for (k = 0; k < (MAX_NAME_SIZE - strlen(counter->name)); k++) {
-					sprintf(line, " ");
-					append_text(&umst->report, line);
-				}
+				append_name(&umst->report, counter->name);
 				sprintf(line, "   %ld\n", meas_get_counter(*counter));
 				append_text(&umst->report, line);
 			}
@@ -123,17 +203,156 @@ int meas_generate_report(meas_t **mst, int parameters)
 		append_text(&umst->report, " ITEM NAME                            VALUE                     \n");
 		append_text(&umst->report, "================================================================\n");
 
-		for (j = 0; j < llist_length(umst->report_items); j++) {
-			item = (meas_report_item*)llist_nth(umst->report_items, j);
+		foreach(umst->report_items, tmp) {
+			item = (meas_report_item*)tmp->element;
 			if (item != NULL) {
-				sprintf(line, " %.35s", item->name);
+				append_name(&umst->report, item->name);
+
+				sprintf(line, item->fmt, item->value);
+				append_text(&umst->report, line);
+			}
+		}
+
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	/* Benchmarks */
+	if ((parameters & REPORT_BENCHMARKS) && umst->benchmarks != NULL) {
+		append_text(&umst->report, "========================== BENCHMARKS ==========================\n");
+		append_text(&umst->report, " BENCHMARK NAME                       TICKS PER ITERATION       \n");
+		append_text(&umst->report, "================================================================\n");
+
+		foreach(umst->benchmarks, tmp) {
+			bench = (meas_bench*)tmp->element;
+			if (bench != NULL) {
+				append_name(&umst->report, bench->name);
+				sprintf(line, "   %.1f\n", bench->median);
+				append_text(&umst->report, line);
+
+				sprintf(line, "   samples x iterations : %u x %lu\n", bench->nsamples, bench->iterations);
+				append_text(&umst->report, line);
+				sprintf(line, "   min / max / mean     : %.1f / %.1f / %.1f\n", bench->min, bench->max, bench->mean);
+				append_text(&umst->report, line);
+				sprintf(line, "   median +- MAD        : %.1f +- %.1f\n", bench->median, bench->mad);
+				append_text(&umst->report, line);
+				sprintf(line, "   %2.0f%% CI of median     : [%.1f, %.1f]\n", bench->confidence * 100.0, bench->ci_low, bench->ci_high);
+				append_text(&umst->report, line);
+				sprintf(line, "   outliers low / high  : %u / %u\n", bench->outliers_low, bench->outliers_high);
+				append_text(&umst->report, line);
+			}
+		}
+
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	/* Periodic real-time tasks */
+	if ((parameters & REPORT_RT) && umst->tasks != NULL) {
+		append_text(&umst->report, "=========================== RT TASKS ===========================\n");
+		append_text(&umst->report, " TASK NAME                            DEADLINE MISSES / JOBS    \n");
+		append_text(&umst->report, "================================================================\n");
+
+		foreach(umst->tasks, tmp) {
+			task = (meas_task*)tmp->element;
+			if (task != NULL) {
+				append_name(&umst->report, task->name);
+				sprintf(line, "   %lu / %lu (%.2f%%)\n", task->misses, task->jobs,
+						task->jobs > 0 ? (100.0 * task->misses) / task->jobs : 0.0);
+				append_text(&umst->report, line);
+
+				sprintf(line, "   period / deadline    : %lu / %lu\n", task->period, task->deadline);
+				append_text(&umst->report, line);
+				sprintf(line, "   jitter min/avg/max   : %lu / %.1f / %lu (p99 %lu)\n",
+						task->jitter.min, meas_hist_mean(&task->jitter), task->jitter.max,
+						meas_hist_percentile(&task->jitter, 99.0));
 				append_text(&umst->report, line);
-				for (k = 0; k < (MAX_NAME_SIZE - strlen(item->name)); k++) {
-					sprintf(line, " ");
+				sprintf(line, "   response min/avg/max : %lu / %.1f / %lu (p99 %lu)\n",
+						task->response.min, meas_hist_mean(&task->response), task->response.max,
+						meas_hist_percentile(&task->response, 99.0));
+				append_text(&umst->report, line);
+				sprintf(line, "   longest miss run     : %lu\n", task->max_miss_run);
+				append_text(&umst->report, line);
+				sprintf(line, "   skipped releases     : %lu\n", task->skipped);
+				append_text(&umst->report, line);
+			}
+		}
+
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	/* Wakeup latency probes */
+	if ((parameters & REPORT_LATENCY) && umst->latencies != NULL) {
+		append_text(&umst->report, "======================= WAKEUP LATENCY =========================\n");
+		append_text(&umst->report, " PROBE NAME                           MAX. LATENCY (ns)         \n");
+		append_text(&umst->report, "================================================================\n");
+
+		foreach(umst->latencies, tmp) {
+			lat = (meas_latency*)tmp->element;
+			if (lat != NULL) {
+				hist = &lat->threads[0].hist;
+				for (i = 1; i < lat->nthreads; i++) {
+					if (lat->threads[i].hist.max > hist->max)
+						hist = &lat->threads[i].hist;
+				}
+
+				append_name(&umst->report, lat->name);
+				sprintf(line, "   %lu\n", hist->max);
+				append_text(&umst->report, line);
+
+				sprintf(line, "   interval / threads   : %lu / %u\n", lat->interval, lat->nthreads);
+				append_text(&umst->report, line);
+				if (lat->unpinned > 0) {
+					sprintf(line, "   unpinned threads     : %u (pinning failed)\n", lat->unpinned);
+					append_text(&umst->report, line);
+				}
+				append_text(&umst->report, "   cpu                  : min / avg / max (p99, p99.9)\n");
+
+				for (i = 0; i < lat->nthreads; i++) {
+					hist = &lat->threads[i].hist;
+					if (lat->threads[i].cpu < 0) {
+						sprintf(label, "any%s", lat->threads[i].fifo ? " (FIFO)" : "");
+					} else {
+						sprintf(label, "%d%s", lat->threads[i].cpu, lat->threads[i].fifo ? " (FIFO)" : "");
+					}
+					sprintf(line, "   %-20s : %lu / %.1f / %lu (%lu, %lu)%s\n", label,
+							hist->min, meas_hist_mean(hist), hist->max,
+							meas_hist_percentile(hist, 99.0), meas_hist_percentile(hist, 99.9),
+							hist->overflow > 0 ? " overflow" : "");
 					append_text(&umst->report, line);
 				}
+			}
+		}
 
-				sprintf(line, item->fmt, item->value);
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	/* Child processes */
+	if ((parameters & REPORT_CHILDREN) && umst->children != NULL) {
+		append_text(&umst->report, "=========================== CHILDREN ===========================\n");
+		append_text(&umst->report, " CHILD GROUP NAME                     CHILDREN (FAILED)         \n");
+		append_text(&umst->report, "================================================================\n");
+
+		foreach(umst->children, tmp) {
+			child = (meas_child_stats*)tmp->element;
+			if (child != NULL) {
+				append_name(&umst->report, child->name);
+				sprintf(line, "   %lu (%lu)\n", child->nchildren, child->nfailed);
+				append_text(&umst->report, line);
+
+				sprintf(line, "   wall min/avg/max     : %lu / %.1f / %lu\n", child->wall_min,
+						child->nchildren > 0 ? (double)child->wall_total / child->nchildren : 0.0,
+						child->wall_max);
+				append_text(&umst->report, line);
+				sprintf(line, "   user / system (s)    : %ld.%06ld / %ld.%06ld\n",
+						(long)child->utime.tv_sec, (long)child->utime.tv_usec,
+						(long)child->stime.tv_sec, (long)child->stime.tv_usec);
+				append_text(&umst->report, line);
+				sprintf(line, "   max. RSS (KB)        : %ld\n", child->maxrss);
+				append_text(&umst->report, line);
+				sprintf(line, "   faults minor / major : %ld / %ld\n", child->minflt, child->majflt);
+				append_text(&umst->report, line);
+				sprintf(line, "   ctx sw vol. / invol. : %ld / %ld\n", child->nvcsw, child->nivcsw);
+				append_text(&umst->report, line);
+				sprintf(line, "   blocks in / out      : %ld / %ld\n", child->inblock, child->oublock);
 				append_text(&umst->report, line);
 			}
 		}
@@ -141,6 +360,82 @@ int meas_generate_report(meas_t **mst, int parameters)
 		append_text(&umst->report, "----------------------------------------------------------------\n\n");
 	}
 
+	/* Per-thread resources */
+	if ((parameters & REPORT_THREADS) && umst->threads != NULL) {
+		append_text(&umst->report, "=========================== THREADS ============================\n");
+		append_text(&umst->report, " THREAD NAME (TID)                    CPU % (LAST INTERVAL)     \n");
+		append_text(&umst->report, "================================================================\n");
+
+		elapsed = umst->threads->time - umst->threads->prev_time;
+		for (i = 0; i < umst->threads->n; i++) {
+			meas_threads_delta(umst->threads, i, &delta);
+			thread = &umst->threads->threads[i];
+
+			sprintf(label, "%s (%d)", thread->name, thread->tid);
+			append_name(&umst->report, label);
+			if (umst->threads->prev_time > 0 && elapsed > 0) {
+				sprintf(line, "   %.1f\n", (100.0 * (delta.utime + delta.stime)) / elapsed);
+			} else {
+				sprintf(line, "   -\n");
+			}
+			append_text(&umst->report, line);
+
+			sprintf(line, "   user / system (ms)   : %.1f / %.1f (+%.1f / +%.1f)\n",
+					thread->utime / 1e6, thread->stime / 1e6, delta.utime / 1e6, delta.stime / 1e6);
+			append_text(&umst->report, line);
+			sprintf(line, "   cpu / rq wait (ms)   : %.1f / %.1f (+%.1f / +%.1f)\n",
+					thread->run / 1e6, thread->wait / 1e6, delta.run / 1e6, delta.wait / 1e6);
+			append_text(&umst->report, line);
+			sprintf(line, "   ctx sw vol. / invol. : %lu / %lu (+%lu / +%lu)\n",
+					thread->nvcsw, thread->nivcsw, delta.nvcsw, delta.nivcsw);
+			append_text(&umst->report, line);
+			sprintf(line, "   last cpu             : %d\n", thread->cpu);
+			append_text(&umst->report, line);
+		}
+
+		if (umst->threads->dropped > 0) {
+			sprintf(line, "   (%lu threads beyond the capacity)\n", umst->threads->dropped);
+			append_text(&umst->report, line);
+		}
+
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	/* Lock contention */
+	if ((parameters & REPORT_LOCKS) && umst->locks != NULL) {
+		append_text(&umst->report, "============================ LOCKS =============================\n");
+		append_text(&umst->report, " LOCK NAME                            ACQUISITIONS              \n");
+		append_text(&umst->report, "================================================================\n");
+
+		foreach(umst->locks, tmp) {
+			m = (meas_mutex*)tmp->element;
+			meas_mutex_stats(m, FALSE, &excl);
+			meas_mutex_stats(m, TRUE, &shared);
+
+			append_name(&umst->report, m->name);
+			sprintf(line, "   %lu\n", excl.acquisitions + shared.acquisitions);
+			append_text(&umst->report, line);
+
+			if (m->type == MEAS_LOCK_RWLOCK) {
+				report_lock(&umst->report, "write ", &excl);
+				report_lock(&umst->report, "read ", &shared);
+			} else {
+				report_lock(&umst->report, "", &excl);
+			}
+		}
+
+		if ((lost = _libmeas_locks_lost()) > 0) {
+			sprintf(line, " %lu acquisitions lost (lock tables full)\n", lost);
+			append_text(&umst->report, line);
+		}
+		append_text(&umst->report, "----------------------------------------------------------------\n\n");
+	}
+
+	if (umst->report.truncated) {
+		_libmeas_rt_violation(umst);
+		return(FALSE);
+	}
+
 	return(TRUE);
 }
 
@@ -167,15 +462,16 @@ void meas_write_report(meas_t *mst, FILE *fp)
  * @param value Item value.
  * @return int TRUE if item was added, FALSE on error.
  */
-int meas_add_report_item(meas_t **mst, char *name, char *fmt, long value)
+int meas_add_report_item(meas_t **mst, const char *name, const char *fmt, long value)
 {
-	meas_t *umst = *mst;
+	meas_t *umst;
 	meas_report_item *nitem;
 	
 	if (mst == NULL)
 		return(FALSE);
 
-	if ((nitem = (meas_report_item*)malloc(sizeof(meas_report_item))) == NULL )
+	umst = *mst;
+	if ((nitem = (meas_report_item*)_libmeas_alloc(umst, MEAS_RT_REPORT_ITEMS, sizeof(meas_report_item))) == NULL )
 		return(FALSE);
 
 
@@ -183,7 +479,10 @@ int meas_add_report_item(meas_t **mst, char *name, char *fmt, long value)
 	strcpy(nitem->fmt, fmt);
 	nitem->value = value;
 
-	llist_add(&umst->report_items, nitem);
+	if (_libmeas_list_add(umst, MEAS_RT_REPORT_ITEMS, &umst->report_items, NULL, nitem) == FALSE) {
+		_libmeas_free(umst, nitem);
+		return(FALSE);
+	}
 
 	return(TRUE);
 }
@@ -208,6 +507,12 @@ static int append_text(struct _text_buffer *buffer, char *text)
 	free_ch = buffer->size - buffer->pos;
 
 	if (tsize >= free_ch) {
+		/* Preallocated buffers never grow: truncate */
+		if (buffer->fixed) {
+			buffer->truncated = TRUE;
+			return(FALSE);
+		}
+
 		nblocks = (buffer->size / TEXTBUFFER_SIZE) + 1;
 		iblocks = ((tsize - free_ch) / TEXTBUFFER_SIZE) + 1;
 
@@ -219,8 +524,92 @@ static int append_text(struct _text_buffer *buffer, char *text)
 		}
 	}
 
-	strcat(&buffer->text[buffer->pos], text);
+	/* Copy with the terminator: new memory from realloc is not initialized */
+	memcpy(&buffer->text[buffer->pos], text, tsize + 1);
 	buffer->pos  += tsize;
 	return(TRUE);
 }
 
+
+/**
+ * Append an element name padded to the value column.
+ * @param buffer The text buffer.
+ * @param name The element name.
+ * @return TRUE if text was appended, FALSE otherwise.
+ */
+static int append_name(struct _text_buffer *buffer, const char *name)
+{
+	char line[MAX_NAME_SIZE + 3];
+
+	sprintf(line, " %-*.*s", MAX_NAME_SIZE, MAX_NAME_SIZE, name);
+	return(append_text(buffer, line));
+}
+
+
+/**
+ * Append the per-CPU breakdown and the migration rate of a timer.
+ * @param buffer The text buffer.
+ * @param cpus CPU placement of the timer.
+ */
+static void report_cpus(struct _text_buffer *buffer, meas_cpu_stats *cpus)
+{
+	unsigned long total;
+	unsigned int i;
+	char label[32], line[256];
+
+	total = cpus->migrations + cpus->unknown;
+	for (i = 0; i < cpus->ncpus; i++) {
+		total += cpus->cpu[i].count;
+	}
+
+	if (total == 0)
+		return;
+
+	sprintf(line, "   migrations           : %lu / %lu (%.2f%%)\n", cpus->migrations, total,
+			(100.0 * cpus->migrations) / total);
+	append_text(buffer, line);
+
+	for (i = 0; i < cpus->ncpus; i++) {
+		if (cpus->cpu[i].count == 0)
+			continue;
+
+		sprintf(label, "cpu %u", i);
+		sprintf(line, "   %-21s: n %lu, mean %.1f, min / max %lu / %lu\n", label,
+				cpus->cpu[i].count, (double)cpus->cpu[i].total / cpus->cpu[i].count,
+				cpus->cpu[i].min, cpus->cpu[i].max);
+		append_text(buffer, line);
+	}
+
+	if (cpus->migrated.count > 0) {
+		sprintf(line, "   migrated             : n %lu, mean %.1f, min / max %lu / %lu\n",
+				cpus->migrated.count, (double)cpus->migrated.total / cpus->migrated.count,
+				cpus->migrated.min, cpus->migrated.max);
+		append_text(buffer, line);
+	}
+}
+
+
+/**
+ * Append the acquisitions of a lock in one mode
+ * @param buffer The text buffer.
+ * @param mode Prefix of the labels ("", "write " or "read ").
+ * @param stats Statistics of the mode.
+ */
+static void report_lock(struct _text_buffer *buffer, const char *mode, meas_lock_stats *stats)
+{
+	char label[32], line[256];
+
+	snprintf(label, sizeof(label), "%scontended", mode);
+	sprintf(line, "   %-21s: %lu / %lu (%.1f%%)\n", label, stats->contended, stats->acquisitions,
+			(stats->acquisitions > 0) ? (100.0 * stats->contended) / stats->acquisitions : 0.0);
+	append_text(buffer, line);
+
+	snprintf(label, sizeof(label), "%swait tot. / max", mode);
+	sprintf(line, "   %-21s: %llu / %lu\n", label, stats->wait, stats->wait_max);
+	append_text(buffer, line);
+
+	snprintf(label, sizeof(label), "%shold tot. / max", mode);
+	sprintf(line, "   %-21s: %llu / %lu\n", label, stats->hold, stats->hold_max);
+	append_text(buffer, line);
+}
+
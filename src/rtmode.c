@@ -0,0 +1,357 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Hard real-time mode
+ *
+ * meas_init_rt allocates every element a meas_t will ever need in one
+ * block, touches each page of it and optionally locks the process memory.
+ * Creating timers, counters, tasks and report items then takes memory from
+ * that block. Calls needing more memory than reserved fail (or, for the
+ * report, truncate) and are counted as violations (meas_rt_violations).
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <alloca.h>
+#include <sys/mman.h>
+
+/**
+ * Alignment of the elements of the block (elements never share a cache
+ * line)
+ */
+#define RT_ALIGN MEAS_CACHE_LINE
+
+#define RT_ROUND(size) (((size) + (RT_ALIGN - 1)) & ~((unsigned long)RT_ALIGN - 1))
+
+extern size_t _libmeas_task_size(void);
+
+/**
+ * static functions
+ */
+static int in_block(meas_t *mst, void *ptr);
+static void prefault_stack(unsigned long size);
+
+
+/**
+ * Fill hard real-time mode capacities with default values
+ * (64 timers, 64 counters, 8 tasks, 16 report items, 64 KiB of report,
+ *  no sampler buffers, 64 KiB of stack, memory not locked).
+ * @param opts Capacities.
+ */
+void meas_rt_defaults(meas_rt_opts *opts)
+{
+	opts->max_timers       = 64;
+	opts->max_counters     = 64;
+	opts->max_tasks        = 8;
+	opts->max_report_items = 16;
+	opts->report_size      = 64 * 1024;
+	opts->trace_threads    = 0;
+	opts->stack_size       = 64 * 1024;
+	opts->lock_memory      = FALSE;
+}
+
+
+/**
+ * Initialize user structures in hard real-time mode: every element is
+ * preallocated and prefaulted here, later calls do not allocate.
+ * Benchmarks, latency probes, child processes, thread and lock probes,
+ * timer samples, sketches, CPU tracking and budgets and meas_snapshot_reset
+ * are not real-time operations: they still allocate and count as
+ * violations (so does growing a sample array, which is refused in
+ * meas_stop_clock). meas_calibrate is process-wide (it
+ * takes no meas_t), allocates and is not counted: call it before this.
+ * @param mst The user libmeas structure
+ * @param opts Capacities (NULL for defaults, see meas_rt_defaults).
+ * @return int FALSE on error (including mlockall failure). TRUE otherwise
+ * @see meas_close
+ */
+int meas_init_rt(meas_t **mst, const meas_rt_opts *opts)
+{
+	meas_rt_opts dopts;
+	meas_rt *rt;
+	unsigned long size, node, pool[MEAS_RT_NPOOLS];
+	long pagesize;
+	void *block;
+	char *next;
+	int i;
+
+	if (mst == NULL)
+		return(FALSE);
+
+	if (opts == NULL) {
+		meas_rt_defaults(&dopts);
+		opts = &dopts;
+	}
+
+	/* Keep freed heap memory mapped: no fault on later reuse */
+	if (opts->lock_memory) {
+		mallopt(M_TRIM_THRESHOLD, -1);
+		mallopt(M_MMAP_MAX, 0);
+	}
+
+	if (meas_init(mst) == FALSE)
+		return(FALSE);
+
+	/* Each element is stored with its list node */
+	node = RT_ROUND(sizeof(llist));
+	pool[MEAS_RT_TIMERS]       = opts->max_timers * (RT_ROUND(sizeof(meas_clock)) + node);
+	pool[MEAS_RT_COUNTERS]     = opts->max_counters * (RT_ROUND(sizeof(meas_counter)) + node);
+	pool[MEAS_RT_TASKS]        = opts->max_tasks * (RT_ROUND(_libmeas_task_size()) + node);
+	pool[MEAS_RT_REPORT_ITEMS] = opts->max_report_items * (RT_ROUND(sizeof(meas_report_item)) + node);
+
+	size = RT_ROUND(sizeof(meas_rt)) + RT_ROUND(opts->report_size + 1);
+	for (i = 0; i < MEAS_RT_NPOOLS; i++) {
+		size += pool[i];
+	}
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	if (pagesize < RT_ALIGN)
+		pagesize = RT_ALIGN;
+
+	if (posix_memalign(&block, pagesize, size) != 0) {
+		meas_close(mst);
+		return(FALSE);
+	}
+
+	/* Touch every page */
+	memset(block, 0, size);
+
+	rt = (meas_rt*)block;
+	rt->base = (char*)block;
+	rt->size = size;
+	next     = rt->base + RT_ROUND(sizeof(meas_rt));
+
+	(*mst)->report.text  = next;
+	(*mst)->report.size  = opts->report_size + 1;
+	(*mst)->report.fixed = TRUE;
+	next += RT_ROUND(opts->report_size + 1);
+
+	for (i = 0; i < MEAS_RT_NPOOLS; i++) {
+		rt->next[i] = next;
+		rt->end[i]  = next + pool[i];
+		next += pool[i];
+	}
+
+	(*mst)->rt = rt;
+
+	if (opts->trace_threads > 0 && meas_sampler_reserve(opts->trace_threads) == FALSE) {
+		meas_close(mst);
+		return(FALSE);
+	}
+
+	if (opts->stack_size > 0)
+		prefault_stack(opts->stack_size);
+
+	if (opts->lock_memory) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+			meas_close(mst);
+			return(FALSE);
+		}
+		rt->locked = TRUE;
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Number of calls that needed memory beyond the reserved capacities
+ * @param mst The meas user structure.
+ * @return unsigned long Violations (0 if not in hard real-time mode).
+ */
+unsigned long meas_rt_violations(meas_t *mst)
+{
+	if (mst == NULL || mst->rt == NULL)
+		return(0);
+
+	return(__atomic_load_n(&mst->rt->violations, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Allocate zeroed memory for an element of a meas_t
+ * @param mst The meas user structure.
+ * @param pool Pool of the element in hard real-time mode (MEAS_RT_TIMERS, ...).
+ * @param size Size of the element.
+ * @return void* NULL on error (or exhausted capacity) or the memory.
+ */
+void *_libmeas_alloc(meas_t *mst, int pool, size_t size)
+{
+	meas_rt *rt = mst->rt;
+	void *ptr;
+
+	if (rt == NULL) {
+		if (posix_memalign(&ptr, MEAS_CACHE_LINE, size) != 0)
+			return(NULL);
+		memset(ptr, 0, size);
+		return(ptr);
+	}
+
+	size = RT_ROUND(size);
+	if (rt->next[pool] + size > rt->end[pool]) {
+		__atomic_add_fetch(&rt->violations, 1, __ATOMIC_RELAXED);
+		return(NULL);
+	}
+
+	ptr = rt->next[pool];
+	rt->next[pool] += size;
+	return(ptr);
+}
+
+
+/**
+ * Free memory returned by _libmeas_alloc (block memory is released by
+ * meas_close)
+ * @param mst The meas user structure.
+ * @param ptr The memory.
+ */
+void _libmeas_free(meas_t *mst, void *ptr)
+{
+	if (!in_block(mst, ptr))
+		free(ptr);
+}
+
+
+/**
+ * Add an element to the end of a list of a meas_t
+ * @param mst The meas user structure.
+ * @param pool Pool of the node in hard real-time mode (MEAS_RT_TIMERS, ...).
+ * @param list The list.
+ * @param tail Last node of the list (NULL if not tracked).
+ * @param element The element.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int _libmeas_list_add(meas_t *mst, int pool, llist **list, llist **tail, void *element)
+{
+	llist *node, *last;
+
+	if (mst->rt == NULL) {
+		if (tail != NULL)
+			return(llist_add_tail(list, tail, element));
+		return(llist_add(list, element));
+	}
+
+	if ((node = (llist*)_libmeas_alloc(mst, pool, sizeof(llist))) == NULL)
+		return(FALSE);
+
+	node->element = element;
+	node->next    = NULL;
+
+	last = (tail != NULL) ? *tail : NULL;
+	if (last == NULL && *list != NULL) {
+		for (last = *list; last->next != NULL; last = last->next);
+	}
+
+	if (last == NULL) {
+		*list = node;
+	} else {
+		last->next = node;
+	}
+
+	if (tail != NULL)
+		*tail = node;
+
+	return(TRUE);
+}
+
+
+/**
+ * Destroy a list of a meas_t (nodes and elements)
+ * @param mst The meas user structure.
+ * @param list The list.
+ */
+void _libmeas_list_destroy(meas_t *mst, llist **list)
+{
+	llist *node, *next;
+
+	if (mst->rt == NULL) {
+		llist_destroy(list);
+		return;
+	}
+
+	for (node = *list; node != NULL; node = next) {
+		next = node->next;
+		_libmeas_free(mst, node->element);
+		_libmeas_free(mst, node);
+	}
+	*list = NULL;
+}
+
+
+/**
+ * Count a call that needed to allocate in hard real-time mode
+ * @param mst The meas user structure.
+ */
+void _libmeas_rt_violation(meas_t *mst)
+{
+	if (mst != NULL && mst->rt != NULL)
+		__atomic_add_fetch(&mst->rt->violations, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Release the block of a meas_t in hard real-time mode
+ * @param mst The meas user structure.
+ */
+void _libmeas_rt_release(meas_t *mst)
+{
+	if (mst->rt == NULL)
+		return;
+
+	if (mst->rt->locked)
+		munlockall();
+
+	free(mst->rt->base);
+	mst->rt = NULL;
+}
+
+
+/**
+ * Check if memory belongs to the block of a meas_t
+ * @param mst The meas user structure.
+ * @param ptr The memory.
+ * @return TRUE if ptr is in the block.
+ */
+static int in_block(meas_t *mst, void *ptr)
+{
+	return(mst->rt != NULL && (char*)ptr >= mst->rt->base &&
+		   (char*)ptr < mst->rt->base + mst->rt->size);
+}
+
+
+/**
+ * Touch the pages of the stack the calling thread will use
+ * @param size Bytes of stack.
+ */
+static void __attribute__((noinline)) prefault_stack(unsigned long size)
+{
+	volatile char *stack = (volatile char*)alloca(size);
+	unsigned long i;
+
+	for (i = 0; i < size; i += 1024) {
+		stack[i] = 0;
+	}
+}
+
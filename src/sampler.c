@@ -0,0 +1,547 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Sampling profiler
+ *
+ * Each attached thread gets a timer on its own CPU-time clock that sends
+ * SIGPROF to that thread. The handler records the interrupted stack and
+ * a copy of the name of the innermost running meas_clock (the clock may
+ * be gone when the samples are written) into a per-thread ring buffer
+ * (single producer: the handler, single consumer: meas_sampler_write).
+ *
+ * Stacks are unwound by following the frame pointers from the registers
+ * of the signal context, bounded by the thread stack (backtrace() is not
+ * async-signal-safe). Code built without -fno-omit-frame-pointer gives
+ * truncated stacks.
+ *
+ * The buffer of a thread that exits or detaches is reused by the next
+ * attached thread once its samples were written or cleared.
+ *
+ * Output (symbolized offline by measfold):
+ *   libmeas-samples 1
+ *   map <start> <end> <offset> <path>
+ *   sample <tid> <region> <nframes> <pc> ... (innermost first)
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
+
+#ifndef sigev_notify_thread_id
+	#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/**
+ * Number of samples of each thread buffer
+ */
+#define SAMPLER_BUFFER_SIZE 4096
+
+/**
+ * Stack sample
+ */
+struct sample {
+	char region[MAX_NAME_SIZE];		/* Copied: the clock may be gone when written */
+	unsigned int nframes;
+	void *pc[MEAS_SAMPLER_DEPTH];
+};
+
+/**
+ * Per-thread sample buffer
+ */
+struct sampler_buffer {
+	struct sampler_buffer *next;
+	pid_t tid;
+	timer_t timer;
+	int armed;
+	int released;				/* Owner exited or detached */
+	unsigned long stack_lo;		/* Stack bounds of the owner */
+	unsigned long stack_hi;
+	unsigned long head;			/* Written by the handler */
+	unsigned long tail;			/* Written by the consumer */
+	unsigned long dropped;
+	struct sample samples[SAMPLER_BUFFER_SIZE];
+};
+
+extern meas_clock *_libmeas_running_clock(void);
+
+/**
+ * Buffer of the calling thread
+ */
+static __thread struct sampler_buffer *thread_buffer = NULL;
+
+/**
+ * All buffers (lock-free list, never freed: released buffers are reused)
+ */
+static struct sampler_buffer *buffers = NULL;
+
+/**
+ * Preallocated buffers not yet used by any thread (see meas_sampler_reserve)
+ */
+static struct sampler_buffer *spare = NULL;
+
+/**
+ * Sampler state
+ */
+static volatile sig_atomic_t running = 0;
+static int handler_installed = 0;
+static struct timespec period;
+
+/**
+ * Releases the buffer of an exiting thread
+ */
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+
+/**
+ * static functions
+ */
+static void sigprof_handler(int sig, siginfo_t *info, void *ucontext);
+static unsigned int walk_stack(struct sampler_buffer *buf, const ucontext_t *uc, void **pc);
+static struct sampler_buffer *take_buffer(void);
+static void release_buffer(void *buf);
+static void disarm(struct sampler_buffer *buf);
+static void key_init(void);
+static void write_name(FILE *fp, const char *name);
+
+
+/**
+ * Start the sampling profiler and attach the calling thread.
+ * Other threads must call meas_sampler_attach.
+ * @param frequency Samples per second of thread CPU time.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sampler_start(unsigned int frequency)
+{
+	struct sigaction sa;
+
+	if (frequency == 0 || running)
+		return(FALSE);
+
+	if (pthread_once(&buffer_once, key_init) != 0)
+		return(FALSE);
+
+	if (!handler_installed) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = sigprof_handler;
+		sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+
+		if (sigaction(SIGPROF, &sa, NULL) < 0)
+			return(FALSE);
+
+		handler_installed = 1;
+	}
+
+	period.tv_sec  = 0;
+	period.tv_nsec = 1000000000L / frequency;
+	if (frequency == 1) {
+		period.tv_sec  = 1;
+		period.tv_nsec = 0;
+	}
+
+	running = 1;
+	if (meas_sampler_attach() == FALSE) {
+		running = 0;
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Attach the calling thread to the running sampler
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sampler_attach(void)
+{
+	struct sampler_buffer *buf = thread_buffer;
+	struct itimerspec its;
+	struct sigevent sev;
+	pthread_attr_t attr;
+	void *stack;
+	size_t size;
+
+	if (!running)
+		return(FALSE);
+
+	if (buf == NULL) {
+		if ((buf = take_buffer()) == NULL)
+			return(FALSE);
+
+		buf->tid = (pid_t)syscall(SYS_gettid);
+
+		/* Without stack bounds only the interrupted pc is recorded */
+		buf->stack_lo = buf->stack_hi = 0;
+		if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+			if (pthread_attr_getstack(&attr, &stack, &size) == 0) {
+				buf->stack_lo = (unsigned long)stack;
+				buf->stack_hi = (unsigned long)stack + size;
+			}
+			pthread_attr_destroy(&attr);
+		}
+
+		thread_buffer = buf;
+		pthread_setspecific(buffer_key, buf);
+	}
+
+	if (buf->armed)
+		return(TRUE);
+
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo  = SIGPROF;
+	sev.sigev_notify_thread_id = buf->tid;
+
+	if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &buf->timer) < 0)
+		return(FALSE);
+
+	its.it_interval = period;
+	its.it_value    = period;
+	if (timer_settime(buf->timer, 0, &its, NULL) < 0) {
+		timer_delete(buf->timer);
+		return(FALSE);
+	}
+
+	buf->armed = 1;
+	return(TRUE);
+}
+
+
+/**
+ * Preallocate and prefault the buffers of threads attached later, so
+ * meas_sampler_attach does not allocate
+ * @param nthreads Number of buffers.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sampler_reserve(unsigned int nthreads)
+{
+	struct sampler_buffer *buf;
+	unsigned int i;
+
+	for (i = 0; i < nthreads; i++) {
+		if ((buf = (struct sampler_buffer*)malloc(sizeof(struct sampler_buffer))) == NULL)
+			return(FALSE);
+
+		/* Touch every page */
+		memset(buf, 0, sizeof(struct sampler_buffer));
+
+		do {
+			buf->next = spare;
+		} while (!__sync_bool_compare_and_swap(&spare, buf->next, buf));
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Detach the calling thread from the sampler (its samples are kept until
+ * written, then the buffer is reused by other threads)
+ */
+void meas_sampler_detach(void)
+{
+	struct sampler_buffer *buf = thread_buffer;
+
+	if (buf != NULL) {
+		pthread_setspecific(buffer_key, NULL);
+		release_buffer(buf);
+	}
+}
+
+
+/**
+ * Stop the sampler on every thread (samples are kept until
+ * meas_sampler_clear)
+ */
+void meas_sampler_stop(void)
+{
+	struct sampler_buffer *buf;
+
+	running = 0;
+
+	for (buf = buffers; buf != NULL; buf = buf->next) {
+		disarm(buf);
+	}
+}
+
+
+/**
+ * Discard every recorded sample
+ */
+void meas_sampler_clear(void)
+{
+	struct sampler_buffer *buf;
+
+	for (buf = buffers; buf != NULL; buf = buf->next) {
+		__atomic_store_n(&buf->tail, __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		buf->dropped = 0;
+	}
+}
+
+
+/**
+ * Write the recorded samples and the executable mappings of the process.
+ * Region names are read from the clocks, so this must be called before
+ * meas_close. Written samples are consumed.
+ * @param fp Output stream.
+ * @return int Number of samples written or -1 on error.
+ */
+int meas_sampler_write(FILE *fp)
+{
+	struct sampler_buffer *buf;
+	struct sample *s;
+	unsigned long head, tail, start, end, offset;
+	char line[1024], perms[8], path[1024];
+	unsigned int i;
+	int n = 0;
+	FILE *maps;
+
+	if (fp == NULL)
+		return(-1);
+
+	fprintf(fp, "libmeas-samples 1\n");
+
+	/* Executable file mappings, for offline symbolization */
+	if ((maps = fopen("/proc/self/maps", "r")) != NULL) {
+		while (fgets(line, sizeof(line), maps) != NULL) {
+			if (sscanf(line, "%lx-%lx %7s %lx %*s %*s %1023s", &start, &end,
+						perms, &offset, path) != 5)
+				continue;
+
+			if (perms[2] == 'x' && path[0] == '/') {
+				fprintf(fp, "map %lx %lx %lx %s\n", start, end, offset, path);
+			}
+		}
+		fclose(maps);
+	}
+
+	for (buf = buffers; buf != NULL; buf = buf->next) {
+		head = __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE);
+
+		for (tail = buf->tail; tail != head; tail++) {
+			s = &buf->samples[tail % SAMPLER_BUFFER_SIZE];
+
+			fprintf(fp, "sample %d ", (int)buf->tid);
+			write_name(fp, s->region);
+			fprintf(fp, " %u", s->nframes);
+			for (i = 0; i < s->nframes; i++) {
+				fprintf(fp, " %lx", (unsigned long)s->pc[i]);
+			}
+			fputc('\n', fp);
+			n++;
+		}
+
+		__atomic_store_n(&buf->tail, tail, __ATOMIC_RELEASE);
+
+		if (buf->dropped > 0) {
+			fprintf(fp, "dropped %d %lu\n", (int)buf->tid, buf->dropped);
+		}
+	}
+
+	return(ferror(fp) ? -1 : n);
+}
+
+
+/**
+ * SIGPROF handler: record the stack and the active region
+ * (async-signal-safe, no allocation)
+ */
+static void sigprof_handler(int sig, siginfo_t *info, void *ucontext)
+{
+	struct sampler_buffer *buf = thread_buffer;
+	meas_clock *region = _libmeas_running_clock();
+	struct sample *s;
+	unsigned long head;
+	int saved_errno = errno;
+
+	if (!running || buf == NULL) {
+		errno = saved_errno;
+		return;
+	}
+
+	head = buf->head;
+	if (head - __atomic_load_n(&buf->tail, __ATOMIC_ACQUIRE) >= SAMPLER_BUFFER_SIZE) {
+		buf->dropped++;
+		errno = saved_errno;
+		return;
+	}
+
+	s = &buf->samples[head % SAMPLER_BUFFER_SIZE];
+	if (region != NULL) {
+		memcpy(s->region, region->name, MAX_NAME_SIZE);
+		s->region[MAX_NAME_SIZE - 1] = '\0';
+	} else {
+		s->region[0] = '\0';
+	}
+	s->nframes = walk_stack(buf, (const ucontext_t*)ucontext, s->pc);
+
+	__atomic_store_n(&buf->head, head + 1, __ATOMIC_RELEASE);
+	errno = saved_errno;
+}
+
+
+/**
+ * Unwind the interrupted stack following the frame pointers
+ * (async-signal-safe: only reads memory inside the thread stack)
+ * @param buf Buffer of the thread, with its stack bounds.
+ * @param uc Signal context.
+ * @param pc Output, interrupted pc first and then the return addresses.
+ * @return unsigned int Number of frames.
+ */
+static unsigned int walk_stack(struct sampler_buffer *buf, const ucontext_t *uc, void **pc)
+{
+	unsigned long fp, next;
+	unsigned int n = 0;
+
+#if defined(__x86_64__)
+	pc[n++] = (void*)uc->uc_mcontext.gregs[REG_RIP];
+	fp      = (unsigned long)uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__i386__)
+	pc[n++] = (void*)uc->uc_mcontext.gregs[REG_EIP];
+	fp      = (unsigned long)uc->uc_mcontext.gregs[REG_EBP];
+#elif defined(__aarch64__)
+	pc[n++] = (void*)uc->uc_mcontext.pc;
+	fp      = (unsigned long)uc->uc_mcontext.regs[29];
+#else
+	(void)uc;
+	return(0);
+#endif
+
+	/* Each frame holds the caller frame pointer and the return address */
+	while (n < MEAS_SAMPLER_DEPTH &&
+			fp >= buf->stack_lo && fp + 2 * sizeof(void*) <= buf->stack_hi &&
+			(fp & (sizeof(void*) - 1)) == 0) {
+		pc[n] = ((void**)fp)[1];
+		if (pc[n] == NULL)
+			break;
+		n++;
+
+		/* The stack grows down: callers have higher frames */
+		next = ((unsigned long*)fp)[0];
+		if (next <= fp)
+			break;
+		fp = next;
+	}
+
+	return(n);
+}
+
+
+/**
+ * Take a released and drained buffer, a reserved one or a new one, and
+ * publish new buffers in the global list
+ * @return struct sampler_buffer* Buffer or NULL on error.
+ */
+static struct sampler_buffer *take_buffer(void)
+{
+	struct sampler_buffer *buf;
+
+	/* Nodes are never unlinked, so the walk needs no lock */
+	for (buf = buffers; buf != NULL; buf = buf->next) {
+		if (__atomic_load_n(&buf->released, __ATOMIC_ACQUIRE) &&
+				buf->tail == __atomic_load_n(&buf->head, __ATOMIC_ACQUIRE) &&
+				__sync_bool_compare_and_swap(&buf->released, 1, 0)) {
+			buf->dropped = 0;
+			return(buf);
+		}
+	}
+
+	/* Take a reserved buffer (never pushed back: no ABA) */
+	do {
+		buf = spare;
+	} while (buf != NULL && !__sync_bool_compare_and_swap(&spare, buf, buf->next));
+
+	if (buf == NULL &&
+			(buf = (struct sampler_buffer*)calloc(1, sizeof(struct sampler_buffer))) == NULL)
+		return(NULL);
+
+	/* Publish in the global list */
+	do {
+		buf->next = buffers;
+	} while (!__sync_bool_compare_and_swap(&buffers, buf->next, buf));
+
+	return(buf);
+}
+
+
+/**
+ * Stop sampling into a buffer and hand it over for reuse
+ * (thread exit destructor and meas_sampler_detach)
+ * @param buf Buffer of the calling thread.
+ */
+static void release_buffer(void *buf)
+{
+	struct sampler_buffer *b = (struct sampler_buffer*)buf;
+
+	disarm(b);
+	thread_buffer = NULL;
+	__atomic_store_n(&b->released, 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Delete the timer of a buffer (once, if the owner and
+ * meas_sampler_stop race)
+ * @param buf Buffer.
+ */
+static void disarm(struct sampler_buffer *buf)
+{
+	if (__atomic_exchange_n(&buf->armed, 0, __ATOMIC_ACQ_REL))
+		timer_delete(buf->timer);
+}
+
+
+/**
+ * Create the key that releases buffers of exiting threads
+ */
+static void key_init(void)
+{
+	pthread_key_create(&buffer_key, release_buffer);
+}
+
+
+/**
+ * Write a region name without whitespace ("-" for no region)
+ * @param fp Output stream.
+ * @param name Region name.
+ */
+static void write_name(FILE *fp, const char *name)
+{
+	if (name[0] == '\0') {
+		fputc('-', fp);
+		return;
+	}
+
+	for (; *name != '\0'; name++) {
+		fputc(isspace((unsigned char)*name) ? '_' : *name, fp);
+	}
+}
+
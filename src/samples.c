@@ -0,0 +1,490 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Raw sample capture: every interval of a timer, with exact statistics
+ *
+ * Quantiles are found without copying the samples (the captured order is
+ * kept for export): a histogram of the high bits locates the bucket of
+ * each rank, and only the samples of those buckets are copied and
+ * quickselected. Reductions use independent accumulators so the compiler
+ * can vectorize and pipeline them.
+ */
+#include <meas.h>
+#include <util.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * Partitions smaller than this are finished by insertion sort
+ */
+#define SELECT_CUTOFF 16
+
+/**
+ * Independent accumulators of the reductions
+ */
+#define LANES 4
+
+/**
+ * Histogram buckets of the quantile search
+ */
+#define BUCKETS 65536
+
+/**
+ * static functions
+ */
+static void reduce(const unsigned long *v, unsigned long n, meas_sample_stats *stats);
+static int radix_select(const unsigned long *v, unsigned long n, unsigned long min,
+						unsigned long max, const unsigned long *ranks, unsigned int nranks,
+						unsigned long *found);
+static void multi_select(unsigned long *v, unsigned long lo, unsigned long hi,
+						 const unsigned long *ranks, unsigned int nranks,
+						 unsigned long long *seed);
+static void insertion_sort(unsigned long *v, unsigned long lo, unsigned long hi);
+static unsigned long rank_of(double p, unsigned long n);
+
+
+/**
+ * Keep every interval of a timer (appended by meas_stop_clock)
+ * In hard real-time mode this allocates (a violation) and the array does
+ * not grow: the first sample beyond the capacity counts as a violation,
+ * later ones are dropped.
+ * @param clock The timer.
+ * @param capacity Number of samples preallocated.
+ * @param grow TRUE to double the array when full, FALSE to drop samples.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_clock_capture(meas_clock *clock, unsigned long capacity, int grow)
+{
+	meas_samples *samples;
+
+	if (clock == NULL || capacity == 0 || clock->samples != NULL)
+		return(FALSE);
+
+	_libmeas_rt_violation(clock->mst);
+
+	if ((samples = (meas_samples*)calloc(1, sizeof(meas_samples))) == NULL)
+		return(FALSE);
+
+	if ((samples->values = (unsigned long*)malloc(sizeof(unsigned long) * capacity)) == NULL) {
+		free(samples);
+		return(FALSE);
+	}
+
+	/* Touch every page now, not in the measured code */
+	memset(samples->values, 0, sizeof(unsigned long) * capacity);
+
+	samples->capacity = capacity;
+	samples->grow     = grow;
+	clock->samples    = samples;
+	return(TRUE);
+}
+
+
+/**
+ * Append a sample (called by meas_stop_clock)
+ * @param mst Owner of the timer (NULL if unknown).
+ * @param samples The sample array.
+ * @param value The sample.
+ */
+void _libmeas_samples_add(meas_t *mst, meas_samples *samples, unsigned long value)
+{
+	unsigned long *nvalues;
+
+	if (samples->n == samples->capacity) {
+		/* Hard real-time mode: never realloc in meas_stop_clock */
+		if (samples->grow && mst != NULL && mst->rt != NULL) {
+			_libmeas_rt_violation(mst);
+			samples->grow = FALSE;
+		}
+
+		if (!samples->grow ||
+				(nvalues = (unsigned long*)realloc(samples->values,
+						sizeof(unsigned long) * samples->capacity * 2)) == NULL) {
+			samples->dropped++;
+			return;
+		}
+
+		samples->values    = nvalues;
+		samples->capacity *= 2;
+	}
+
+	samples->values[samples->n++] = value;
+}
+
+
+/**
+ * Release the captured samples of a timer
+ * @param clock The timer.
+ */
+void meas_clock_release_samples(meas_clock *clock)
+{
+	if (clock != NULL && clock->samples != NULL) {
+		free(clock->samples->values);
+		free(clock->samples);
+		clock->samples = NULL;
+	}
+}
+
+
+/**
+ * Exact statistics of the captured samples of a timer
+ * @param clock The timer.
+ * @param stats Returned count, min., max., mean and standard deviation.
+ * @param p Percentiles to compute (0 to 100, nearest rank), may be NULL.
+ * @param np Number of percentiles.
+ * @param values Returned percentiles (np values), may be NULL.
+ * @return FALSE on error (or no samples), TRUE otherwise.
+ */
+int meas_samples_stats(meas_clock *clock, meas_sample_stats *stats, const double *p,
+					   unsigned int np, unsigned long *values)
+{
+	meas_samples *samples;
+	unsigned long *found, *ranks, n, r;
+	unsigned int i, j, nranks;
+
+	if (clock == NULL || clock->samples == NULL || clock->samples->n == 0 || stats == NULL)
+		return(FALSE);
+
+	samples = clock->samples;
+	n = samples->n;
+	reduce(samples->values, n, stats);
+
+	if (p == NULL || values == NULL || np == 0)
+		return(TRUE);
+
+	found = (unsigned long*)malloc(sizeof(unsigned long) * np);
+	ranks = (unsigned long*)malloc(sizeof(unsigned long) * np);
+	if (found == NULL || ranks == NULL) {
+		free(found);
+		free(ranks);
+		return(FALSE);
+	}
+
+	/* Distinct ranks in increasing order */
+	for (i = 0; i < np; i++) {
+		r = rank_of(p[i], n);
+		for (j = i; j > 0 && ranks[j - 1] > r; j--) {
+			ranks[j] = ranks[j - 1];
+		}
+		ranks[j] = r;
+	}
+
+	for (i = 1, nranks = 1; i < np; i++) {
+		if (ranks[i] != ranks[nranks - 1])
+			ranks[nranks++] = ranks[i];
+	}
+
+	if (radix_select(samples->values, n, stats->min, stats->max, ranks, nranks, found) == FALSE) {
+		free(found);
+		free(ranks);
+		return(FALSE);
+	}
+
+	for (i = 0; i < np; i++) {
+		r = rank_of(p[i], n);
+		for (j = 0; ranks[j] != r; j++);
+		values[i] = found[j];
+	}
+
+	free(found);
+	free(ranks);
+	return(TRUE);
+}
+
+
+/**
+ * Write the captured samples of a timer (capture order):
+ * "libmeas-intervals 1", "<name> <n> <dropped>" and one sample per line.
+ * @param clock The timer.
+ * @param fp Output stream.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_samples_write(meas_clock *clock, FILE *fp)
+{
+	meas_samples *samples;
+	unsigned long i;
+
+	if (clock == NULL || clock->samples == NULL || fp == NULL)
+		return(FALSE);
+
+	samples = clock->samples;
+	fprintf(fp, "libmeas-intervals 1\n");
+	fprintf(fp, "%s %lu %lu\n", clock->name[0] != '\0' ? clock->name : "-", samples->n,
+			samples->dropped);
+
+	for (i = 0; i < samples->n; i++) {
+		fprintf(fp, "%lu\n", samples->values[i]);
+	}
+
+	return(ferror(fp) ? FALSE : TRUE);
+}
+
+
+/**
+ * Min., max., mean and standard deviation of a vector
+ * @param v The vector.
+ * @param n Number of elements (at least 1).
+ * @param stats Returned statistics.
+ */
+static void reduce(const unsigned long *v, unsigned long n, meas_sample_stats *stats)
+{
+	unsigned long min[LANES], max[LANES], i;
+	unsigned long long sum[LANES], total;
+	double var[LANES], mean, dev, m2;
+	unsigned int j;
+
+	for (j = 0; j < LANES; j++) {
+		min[j] = v[0];
+		max[j] = v[0];
+		sum[j] = 0;
+		var[j] = 0;
+	}
+
+	for (i = 0; i + LANES <= n; i += LANES) {
+		for (j = 0; j < LANES; j++) {
+			min[j]  = (v[i + j] < min[j]) ? v[i + j] : min[j];
+			max[j]  = (v[i + j] > max[j]) ? v[i + j] : max[j];
+			sum[j] += v[i + j];
+		}
+	}
+	for (; i < n; i++) {
+		min[0]  = (v[i] < min[0]) ? v[i] : min[0];
+		max[0]  = (v[i] > max[0]) ? v[i] : max[0];
+		sum[0] += v[i];
+	}
+
+	stats->n   = n;
+	stats->min = min[0];
+	stats->max = max[0];
+	total      = sum[0];
+	for (j = 1; j < LANES; j++) {
+		stats->min = (min[j] < stats->min) ? min[j] : stats->min;
+		stats->max = (max[j] > stats->max) ? max[j] : stats->max;
+		total     += sum[j];
+	}
+	mean = (double)total / (double)n;
+	stats->mean = mean;
+
+	/* Second pass: a sum of squares would cancel */
+	for (i = 0; i + LANES <= n; i += LANES) {
+		for (j = 0; j < LANES; j++) {
+			dev     = (double)v[i + j] - mean;
+			var[j] += dev * dev;
+		}
+	}
+	for (; i < n; i++) {
+		dev     = (double)v[i] - mean;
+		var[0] += dev * dev;
+	}
+
+	m2 = 0;
+	for (j = 0; j < LANES; j++) {
+		m2 += var[j];
+	}
+	stats->stddev = (n > 1) ? sqrt(m2 / (double)(n - 1)) : 0;
+}
+
+
+/**
+ * Samples of several ranks: count the samples per bucket of their high
+ * bits, then quickselect the samples of the buckets holding a rank.
+ * Buckets one value wide give the sample without a second pass.
+ * @param v The samples.
+ * @param n Number of samples.
+ * @param min Smallest sample.
+ * @param max Largest sample.
+ * @param ranks Requested ranks, increasing.
+ * @param nranks Number of ranks.
+ * @param found Returned sample of each rank.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int radix_select(const unsigned long *v, unsigned long n, unsigned long min,
+						unsigned long max, const unsigned long *ranks, unsigned int nranks,
+						unsigned long *found)
+{
+	unsigned long *count, *buf, below, nbuf, c, b, i;
+	unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+	unsigned char *target;
+	unsigned int shift, j;
+
+	for (shift = 0; ((max - min) >> shift) >= BUCKETS; shift++);
+
+	count  = (unsigned long*)calloc(BUCKETS, sizeof(unsigned long));
+	target = (unsigned char*)calloc(BUCKETS, sizeof(unsigned char));
+	if (count == NULL || target == NULL) {
+		free(count);
+		free(target);
+		return(FALSE);
+	}
+
+	for (i = 0; i < n; i++) {
+		count[(v[i] - min) >> shift]++;
+	}
+
+	/* Ranks inside the copy of the target buckets (in bucket order);
+	 * count[b] becomes the copy position of a target bucket */
+	below = 0;
+	nbuf  = 0;
+	for (b = 0, j = 0; b < BUCKETS && j < nranks; b++) {
+		c = count[b];
+		if (ranks[j] < below + c) {
+			if (shift == 0) {
+				for (; j < nranks && ranks[j] < below + c; j++) {
+					found[j] = min + b;
+				}
+			} else {
+				for (; j < nranks && ranks[j] < below + c; j++) {
+					found[j] = nbuf + (ranks[j] - below);
+				}
+				target[b] = 1;
+				count[b]  = nbuf;
+				nbuf     += c;
+			}
+		}
+		below += c;
+	}
+
+	if (nbuf > 0) {
+		if ((buf = (unsigned long*)malloc(sizeof(unsigned long) * nbuf)) == NULL) {
+			free(count);
+			free(target);
+			return(FALSE);
+		}
+
+		for (i = 0; i < n; i++) {
+			b = (v[i] - min) >> shift;
+			if (target[b])
+				buf[count[b]++] = v[i];
+		}
+
+		/* Afterwards buf[r] holds the sample of rank r */
+		multi_select(buf, 0, nbuf, found, nranks, &seed);
+		for (j = 0; j < nranks; j++) {
+			found[j] = buf[found[j]];
+		}
+		free(buf);
+	}
+
+	free(count);
+	free(target);
+	return(TRUE);
+}
+
+
+/**
+ * Quickselect of several ranks at once: partition around a random pivot
+ * (three-way, timers have many equal samples) and only descend into the
+ * parts holding a requested rank.
+ * @param v The vector.
+ * @param lo First index of the part.
+ * @param hi End of the part (exclusive).
+ * @param ranks Requested ranks inside [lo, hi), increasing.
+ * @param nranks Number of ranks.
+ * @param seed Random state.
+ */
+static void multi_select(unsigned long *v, unsigned long lo, unsigned long hi,
+						 const unsigned long *ranks, unsigned int nranks,
+						 unsigned long long *seed)
+{
+	unsigned long pivot, lt, gt, i, tmp;
+	unsigned int nleft, nmid;
+
+	while (nranks > 0) {
+		if (hi - lo <= SELECT_CUTOFF) {
+			insertion_sort(v, lo, hi);
+			return;
+		}
+
+		pivot = v[lo + (util_xorshift(seed) % (hi - lo))];
+
+		/* [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot */
+		lt = lo;
+		gt = hi;
+		i  = lo;
+		while (i < gt) {
+			if (v[i] < pivot) {
+				tmp = v[i]; v[i] = v[lt]; v[lt] = tmp;
+				lt++;
+				i++;
+			} else if (v[i] > pivot) {
+				gt--;
+				tmp = v[i]; v[i] = v[gt]; v[gt] = tmp;
+			} else {
+				i++;
+			}
+		}
+
+		for (nleft = 0; nleft < nranks && ranks[nleft] < lt; nleft++);
+		for (nmid = nleft; nmid < nranks && ranks[nmid] < gt; nmid++);
+
+		/* Recurse on the left part, loop on the right one */
+		if (nleft > 0)
+			multi_select(v, lo, lt, ranks, nleft, seed);
+
+		ranks  += nmid;
+		nranks -= nmid;
+		lo      = gt;
+	}
+}
+
+
+/**
+ * Sort a part of a vector
+ * @param v The vector.
+ * @param lo First index.
+ * @param hi End (exclusive).
+ */
+static void insertion_sort(unsigned long *v, unsigned long lo, unsigned long hi)
+{
+	unsigned long i, j, x;
+
+	for (i = lo + 1; i < hi; i++) {
+		x = v[i];
+		for (j = i; j > lo && v[j - 1] > x; j--) {
+			v[j] = v[j - 1];
+		}
+		v[j] = x;
+	}
+}
+
+
+/**
+ * Nearest rank of a percentile
+ * @param p Percentile (0 to 100).
+ * @param n Number of samples.
+ * @return unsigned long Index in the sorted samples.
+ */
+static unsigned long rank_of(double p, unsigned long n)
+{
+	double r = ceil((p / 100.0) * (double)n);
+
+	if (r < 1)
+		return(0);
+	if (r > n)
+		return(n - 1);
+	return((unsigned long)r - 1);
+}
+
@@ -0,0 +1,395 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Mergeable quantile sketches (DDSketch)
+ *
+ * A value v > 0 is counted in the bin of key ceil(log_gamma(v)), with
+ * gamma = (1 + alpha) / (1 - alpha): every value of a bin is within a
+ * relative error alpha of the bin representative. The bins are a fixed
+ * window of consecutive keys; when the values span more keys than the
+ * window holds, the lowest keys are collapsed into the first bin, so the
+ * high quantiles (the tail of a latency distribution) keep the guarantee.
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/**
+ * Magic string and version of the export format
+ */
+#define SKETCH_MAGIC   "libmeas-sketch"
+#define SKETCH_VERSION 1
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static void add_key(meas_sketch *sk, int key, unsigned long n);
+static void move_window(meas_sketch *sk, int offset);
+
+
+/**
+ * Initialize an empty sketch
+ * @param sk The sketch.
+ * @param alpha Relative error guarantee (0 < alpha < 1, e.g. 0.01).
+ * @param nbins Number of bins (0 for MEAS_SKETCH_BINS).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sketch_init(meas_sketch *sk, double alpha, unsigned int nbins)
+{
+	if (sk == NULL || alpha <= 0 || alpha >= 1)
+		return(FALSE);
+
+	memset(sk, 0, sizeof(meas_sketch));
+	sk->nbins = (nbins > 0) ? nbins : MEAS_SKETCH_BINS;
+	if ((sk->bins = (unsigned long*)calloc(sk->nbins, sizeof(unsigned long))) == NULL)
+		return(FALSE);
+
+	sk->alpha         = alpha;
+	sk->gamma         = (1 + alpha) / (1 - alpha);
+	sk->inv_log_gamma = 1 / log(sk->gamma);
+	return(TRUE);
+}
+
+
+/**
+ * Release the bins of a sketch
+ * @param sk The sketch.
+ */
+void meas_sketch_free(meas_sketch *sk)
+{
+	if (sk != NULL && sk->bins != NULL) {
+		free(sk->bins);
+		sk->bins = NULL;
+	}
+}
+
+
+/**
+ * Add a value to a sketch
+ * @param sk The sketch.
+ * @param value The value.
+ */
+void meas_sketch_add(meas_sketch *sk, unsigned long value)
+{
+	if (sk->count == 0 || value < sk->min)
+		sk->min = value;
+	if (value > sk->max)
+		sk->max = value;
+	sk->count++;
+	sk->sum += value;
+
+	if (value == 0) {
+		sk->zero++;
+	} else {
+		add_key(sk, (int)ceil(log((double)value) * sk->inv_log_gamma), 1);
+	}
+}
+
+
+/**
+ * Merge a sketch into another one (both must have the same alpha)
+ * @param dst Destination sketch.
+ * @param src Sketch added to dst.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sketch_merge(meas_sketch *dst, const meas_sketch *src)
+{
+	unsigned int i;
+
+	if (dst == NULL || src == NULL || dst->alpha != src->alpha)
+		return(FALSE);
+
+	if (src->count == 0)
+		return(TRUE);
+
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count     += src->count;
+	dst->sum       += src->sum;
+	dst->zero      += src->zero;
+	dst->collapsed += src->collapsed;
+
+	/* Highest keys first: the window moves up at most once */
+	for (i = src->nbins; i-- > 0;) {
+		if (src->bins[i] > 0)
+			add_key(dst, src->offset + (int)i, src->bins[i]);
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Estimate a percentile from a sketch (nearest rank, within a relative
+ * error alpha unless it falls in collapsed bins)
+ * @param sk The sketch.
+ * @param p Percentile (0 to 100).
+ * @return unsigned long The percentile (0 for empty sketches).
+ */
+unsigned long meas_sketch_percentile(const meas_sketch *sk, double p)
+{
+	unsigned long rank, seen;
+	double r, value;
+	unsigned int i;
+
+	if (sk->count == 0)
+		return(0);
+
+	r = ceil((p / 100.0) * (double)sk->count);
+	rank = (r < 1) ? 1 : (r > sk->count) ? sk->count : (unsigned long)r;
+
+	seen = sk->zero;
+	if (seen >= rank)
+		return(sk->min);
+
+	for (i = 0; i < sk->nbins; i++) {
+		seen += sk->bins[i];
+		if (seen >= rank)
+			break;
+	}
+
+	if (i == sk->nbins)
+		return(sk->max);
+
+	value = 2 * pow(sk->gamma, sk->offset + (int)i) / (sk->gamma + 1);
+	if (value < sk->min)
+		return(sk->min);
+	if (value > sk->max)
+		return(sk->max);
+	return((unsigned long)(value + 0.5));
+}
+
+
+/**
+ * Write a sketch:
+ * "libmeas-sketch 1",
+ * "<name> <alpha> <nbins> <count> <zero> <min> <max> <sum> <collapsed> <nkeys>"
+ * and "<key> <count>" for each non-empty bin.
+ * @param sk The sketch.
+ * @param name A name to the sketch (e.g. the timer name).
+ * @param fp Output stream.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sketch_write(const meas_sketch *sk, const char *name, FILE *fp)
+{
+	unsigned int i, nkeys;
+
+	if (sk == NULL || fp == NULL)
+		return(FALSE);
+
+	for (i = 0, nkeys = 0; i < sk->nbins; i++) {
+		if (sk->bins[i] > 0)
+			nkeys++;
+	}
+
+	fprintf(fp, "%s %d\n", SKETCH_MAGIC, SKETCH_VERSION);
+	fprintf(fp, "%s %.17g %u %lu %lu %lu %lu %.17g %lu %u\n",
+			(name != NULL && name[0] != '\0') ? name : "-", sk->alpha, sk->nbins,
+			sk->count, sk->zero, sk->min, sk->max, sk->sum, sk->collapsed, nkeys);
+
+	for (i = 0; i < sk->nbins; i++) {
+		if (sk->bins[i] > 0)
+			fprintf(fp, "%d %lu\n", sk->offset + (int)i, sk->bins[i]);
+	}
+
+	return(ferror(fp) ? FALSE : TRUE);
+}
+
+
+/**
+ * Read a sketch written by meas_sketch_write (release it with
+ * meas_sketch_free)
+ * @param sk The sketch (initialized here).
+ * @param name Returned name (MAX_NAME_SIZE bytes), may be NULL.
+ * @param fp Input stream.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_sketch_read(meas_sketch *sk, char *name, FILE *fp)
+{
+	char magic[32], sname[MAX_NAME_SIZE];
+	unsigned long count, zero, min, max, collapsed, n;
+	unsigned int nbins, nkeys, i;
+	double alpha, sum;
+	int version, key;
+
+	if (sk == NULL || fp == NULL)
+		return(FALSE);
+
+	if (fscanf(fp, "%31s %d", magic, &version) != 2 ||
+			strcmp(magic, SKETCH_MAGIC) != 0 || version != SKETCH_VERSION)
+		return(FALSE);
+
+	if (fscanf(fp, "%34s %lf %u %lu %lu %lu %lu %lf %lu %u", sname, &alpha, &nbins, &count,
+			   &zero, &min, &max, &sum, &collapsed, &nkeys) != 10)
+		return(FALSE);
+
+	if (meas_sketch_init(sk, alpha, nbins) == FALSE)
+		return(FALSE);
+
+	for (i = 0; i < nkeys; i++) {
+		if (fscanf(fp, "%d %lu", &key, &n) != 2) {
+			meas_sketch_free(sk);
+			return(FALSE);
+		}
+		add_key(sk, key, n);
+	}
+
+	sk->count      = count;
+	sk->zero       = zero;
+	sk->min        = min;
+	sk->max        = max;
+	sk->sum        = sum;
+	sk->collapsed += collapsed;
+
+	if (name != NULL)
+		strcpy(name, sname);
+
+	return(TRUE);
+}
+
+
+/**
+ * Keep a quantile sketch of the intervals of a timer (fed by
+ * meas_stop_clock)
+ * @param clock The timer.
+ * @param alpha Relative error guarantee (e.g. 0.01).
+ * @param nbins Number of bins (0 for MEAS_SKETCH_BINS).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_clock_sketch(meas_clock *clock, double alpha, unsigned int nbins)
+{
+	meas_sketch *sk;
+
+	if (clock == NULL || clock->sketch != NULL)
+		return(FALSE);
+
+	_libmeas_rt_violation(clock->mst);
+
+	if ((sk = (meas_sketch*)malloc(sizeof(meas_sketch))) == NULL)
+		return(FALSE);
+
+	if (meas_sketch_init(sk, alpha, nbins) == FALSE) {
+		free(sk);
+		return(FALSE);
+	}
+
+	clock->sketch = sk;
+	return(TRUE);
+}
+
+
+/**
+ * Release the quantile sketch of a timer
+ * @param clock The timer.
+ */
+void meas_clock_release_sketch(meas_clock *clock)
+{
+	if (clock != NULL && clock->sketch != NULL) {
+		meas_sketch_free(clock->sketch);
+		free(clock->sketch);
+		clock->sketch = NULL;
+	}
+}
+
+
+/**
+ * Count n values in the bin of a key, moving the window when needed
+ * @param sk The sketch.
+ * @param key The key.
+ * @param n Number of values.
+ */
+static void add_key(meas_sketch *sk, int key, unsigned long n)
+{
+	int lowest;
+
+	if (sk->used == 0) {
+		/* First key: centered window */
+		sk->offset = key - (int)(sk->nbins / 2);
+		sk->lo = key;
+		sk->hi = key;
+	} else if (key < sk->offset) {
+		/* Move down as far as the highest key allows */
+		lowest = sk->hi - (int)sk->nbins + 1;
+		move_window(sk, (key > lowest) ? key : lowest);
+	} else if (key >= sk->offset + (int)sk->nbins) {
+		move_window(sk, key - (int)sk->nbins + 1);
+	}
+
+	if (key < sk->offset) {
+		sk->collapsed += n;
+		key = sk->offset;
+	}
+
+	sk->bins[key - sk->offset] += n;
+	sk->used += n;
+	if (key < sk->lo)
+		sk->lo = key;
+	if (key > sk->hi)
+		sk->hi = key;
+}
+
+
+/**
+ * Move the window of bins to start at a new key (keys below it are
+ * collapsed into the first bin; no key above the window may be in use)
+ * @param sk The sketch.
+ * @param offset Key of the first bin.
+ */
+static void move_window(meas_sketch *sk, int offset)
+{
+	unsigned long low;
+	unsigned int shift, i;
+
+	if (offset > sk->offset) {
+		shift = (unsigned int)(offset - sk->offset);
+		low = 0;
+		for (i = 0; i <= shift && i < sk->nbins; i++) {
+			low += sk->bins[i];
+		}
+		sk->collapsed += low - ((shift < sk->nbins) ? sk->bins[shift] : 0);
+
+		if (shift < sk->nbins) {
+			memmove(sk->bins + 1, sk->bins + shift + 1,
+					sizeof(unsigned long) * (sk->nbins - shift - 1));
+			memset(sk->bins + sk->nbins - shift, 0, sizeof(unsigned long) * shift);
+		} else {
+			memset(sk->bins + 1, 0, sizeof(unsigned long) * (sk->nbins - 1));
+		}
+		sk->bins[0] = low;
+
+		if (sk->lo < offset)
+			sk->lo = offset;
+	} else if (offset < sk->offset) {
+		shift = (unsigned int)(sk->offset - offset);
+		memmove(sk->bins + shift, sk->bins, sizeof(unsigned long) * (sk->nbins - shift));
+		memset(sk->bins, 0, sizeof(unsigned long) * shift);
+	}
+
+	sk->offset = offset;
+}
+
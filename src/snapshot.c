@@ -0,0 +1,738 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Asynchronous reports
+ *
+ * meas_reporter_snapshot copies the timers (with their samples, sketches,
+ * CPU placement and budgets), counters, periodic tasks, child process
+ * groups and per-thread resources of a meas_t into one of two preallocated
+ * buffers (a shadow meas_t) and wakes a low-priority worker thread. The
+ * worker formats the shadow with meas_generate_report and writes it, so
+ * the instrumented thread only pays for the copy. Timers, counters and
+ * tasks updated by other threads are read under their sequence locks;
+ * samples and sketches have no lock: snapshot them from the thread that
+ * stops their timers.
+ *
+ * Report items, benchmarks and latency probes never change once listed and
+ * are shared with the live meas_t. Lock statistics are not snapshotted:
+ * they are merged from the per-thread tables when the worker formats them.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <seqlock.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+/**
+ * Copies retried before keeping a torn one
+ */
+#define SNAPSHOT_RETRIES 8
+
+/**
+ * Snapshot buffer states
+ */
+#define SNAP_FREE      0
+#define SNAP_CAPTURING 1
+#define SNAP_READY     2
+#define SNAP_BUSY      3
+
+extern size_t _libmeas_task_size(void);
+
+/**
+ * Shadow list: preallocated nodes and element copies
+ */
+struct shadow_list {
+	unsigned int capacity;
+	size_t size;				/* Size of each element */
+	llist *nodes;
+	char *elements;
+};
+
+/**
+ * Shadow of the extensions of a timer (storage sized at
+ * meas_reporter_start, NULL for extensions not enabled then)
+ */
+struct shadow_timer {
+	meas_samples samples;
+	unsigned long *values;
+	unsigned long nvalues;		/* Capacity of values */
+	meas_sketch sketch;
+	unsigned long *bins;
+	unsigned int nbins;
+	meas_cpu_stats *cpus;
+	unsigned int ncpus;
+	meas_budget budget;
+};
+
+/**
+ * Snapshot buffer
+ */
+struct snapshot_buffer {
+	int state;
+	unsigned long seq;			/* Order of capture */
+	meas_t view;				/* Shadow formatted by the worker */
+	struct shadow_list timers;
+	struct shadow_timer *ext;	/* One per timer */
+	struct shadow_list counters;
+	struct shadow_list tasks;
+	struct shadow_list children;
+	meas_threads threads;		/* No capacity: no probe at meas_reporter_start */
+};
+
+/**
+ * Asynchronous reporter
+ */
+struct _meas_reporter {
+	meas_t *mst;
+	FILE *fp;
+	int parameters;
+	struct snapshot_buffer bufs[2];
+	unsigned long next_seq;
+	unsigned long dropped;		/* Snapshots refused: both buffers in use */
+	unsigned long truncated;	/* Elements created after meas_reporter_start */
+	unsigned long torn;			/* Copies kept after SNAPSHOT_RETRIES */
+	int stop;
+	sem_t ready;
+	pthread_t worker;
+};
+
+/**
+ * static functions
+ */
+static int shadow_init(struct shadow_list *shadow, llist *list, size_t size);
+static int ext_init(struct snapshot_buffer *buf, llist *list);
+static int threads_init(meas_threads *shadow, meas_threads *thr);
+static llist *capture_timers(meas_reporter *rep, struct shadow_list *shadow, struct shadow_timer *ext,
+							 llist *list);
+static void capture_ext(meas_reporter *rep, struct shadow_timer *ext, meas_clock *copy);
+static llist *capture_counters(meas_reporter *rep, struct shadow_list *shadow, llist *list);
+static llist *capture_tasks(meas_reporter *rep, struct shadow_list *shadow, llist *list);
+static llist *capture_children(meas_reporter *rep, struct shadow_list *shadow, llist *list);
+static meas_threads *capture_threads(meas_reporter *rep, meas_threads *shadow, meas_threads *thr);
+static void link_nodes(struct shadow_list *shadow, unsigned int n);
+static void *reporter_worker(void *arg);
+static void free_buffers(meas_reporter *rep);
+
+
+/**
+ * Start an asynchronous reporter. Shadow buffers are sized for the
+ * elements existing now: create timers, counters, tasks and child groups,
+ * enable samples, sketches and CPU tracking and create the thread probe
+ * before.
+ * @param mst The meas user structure.
+ * @param fp Output stream of the reports (written by the worker thread).
+ * @param parameters Parameters of report (see meas_generate_report).
+ * @return NULL on error or the reporter.
+ */
+meas_reporter *meas_reporter_start(meas_t **mst, FILE *fp, int parameters)
+{
+	meas_reporter *rep;
+	struct snapshot_buffer *buf;
+	int i;
+
+	if (mst == NULL || *mst == NULL || fp == NULL)
+		return(NULL);
+
+	if ((rep = (meas_reporter*)calloc(1, sizeof(meas_reporter))) == NULL)
+		return(NULL);
+
+	rep->mst        = *mst;
+	rep->fp         = fp;
+	rep->parameters = parameters;
+
+	for (i = 0; i < 2; i++) {
+		buf = &rep->bufs[i];
+		buf->state = SNAP_FREE;
+
+		if (shadow_init(&buf->timers, rep->mst->timers, sizeof(meas_clock)) == FALSE ||
+				ext_init(buf, rep->mst->timers) == FALSE ||
+				shadow_init(&buf->counters, rep->mst->counters, sizeof(meas_counter)) == FALSE ||
+				shadow_init(&buf->tasks, rep->mst->tasks, _libmeas_task_size()) == FALSE ||
+				shadow_init(&buf->children, rep->mst->children, sizeof(meas_child_stats)) == FALSE ||
+				threads_init(&buf->threads, rep->mst->threads) == FALSE) {
+			free_buffers(rep);
+			free(rep);
+			return(NULL);
+		}
+	}
+
+	if (sem_init(&rep->ready, 0, 0) < 0) {
+		free_buffers(rep);
+		free(rep);
+		return(NULL);
+	}
+
+	if (pthread_create(&rep->worker, NULL, reporter_worker, rep) != 0) {
+		sem_destroy(&rep->ready);
+		free_buffers(rep);
+		free(rep);
+		return(NULL);
+	}
+
+	return(rep);
+}
+
+
+/**
+ * Capture the current values and hand them to the worker thread.
+ * Never blocks: if the worker still holds both buffers the snapshot is
+ * dropped.
+ * @param rep The reporter.
+ * @return FALSE if the snapshot was dropped, TRUE otherwise.
+ */
+int meas_reporter_snapshot(meas_reporter *rep)
+{
+	struct snapshot_buffer *buf = NULL;
+	meas_t *mst;
+	int i;
+
+	if (rep == NULL)
+		return(FALSE);
+
+	for (i = 0; i < 2; i++) {
+		if (__sync_bool_compare_and_swap(&rep->bufs[i].state, SNAP_FREE, SNAP_CAPTURING)) {
+			buf = &rep->bufs[i];
+			break;
+		}
+	}
+
+	if (buf == NULL) {
+		__atomic_add_fetch(&rep->dropped, 1, __ATOMIC_RELAXED);
+		return(FALSE);
+	}
+
+	mst = rep->mst;
+	buf->view.timers   = capture_timers(rep, &buf->timers, buf->ext, mst->timers);
+	buf->view.counters = capture_counters(rep, &buf->counters, mst->counters);
+	buf->view.tasks    = capture_tasks(rep, &buf->tasks, mst->tasks);
+	buf->view.children = capture_children(rep, &buf->children, mst->children);
+	buf->view.threads  = capture_threads(rep, &buf->threads, mst->threads);
+
+	/* Immutable once created: shared with the live structure */
+	buf->view.report_items = mst->report_items;
+	buf->view.benchmarks   = mst->benchmarks;
+	buf->view.latencies    = mst->latencies;
+	buf->view.rt           = mst->rt;
+
+	/* Not snapshotted: statistics merged when formatted */
+	buf->view.locks        = mst->locks;
+
+	buf->seq = __atomic_fetch_add(&rep->next_seq, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&buf->state, SNAP_READY, __ATOMIC_RELEASE);
+	sem_post(&rep->ready);
+
+	return(TRUE);
+}
+
+
+/**
+ * Number of snapshots dropped because the worker was busy
+ * @param rep The reporter.
+ * @return unsigned long Dropped snapshots.
+ */
+unsigned long meas_reporter_dropped(meas_reporter *rep)
+{
+	if (rep == NULL)
+		return(0);
+
+	return(__atomic_load_n(&rep->dropped, __ATOMIC_RELAXED));
+}
+
+
+/**
+ * Write the pending snapshots, stop the worker thread and free the reporter
+ * @param rep The reporter.
+ */
+void meas_reporter_stop(meas_reporter **rep)
+{
+	meas_reporter *urep;
+
+	if (rep == NULL || *rep == NULL)
+		return;
+
+	urep = *rep;
+	__atomic_store_n(&urep->stop, TRUE, __ATOMIC_RELEASE);
+	sem_post(&urep->ready);
+	pthread_join(urep->worker, NULL);
+
+	sem_destroy(&urep->ready);
+	free_buffers(urep);
+	free(urep);
+	*rep = NULL;
+}
+
+
+/**
+ * Worker thread: format and write the captured snapshots, oldest first
+ * @param arg The reporter.
+ */
+static void *reporter_worker(void *arg)
+{
+	meas_reporter *rep = (meas_reporter*)arg;
+	struct snapshot_buffer *buf;
+	struct sched_param param;
+	meas_t *view;
+	int i;
+
+	/* Run only when the CPU would be idle */
+	memset(&param, 0, sizeof(param));
+	pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+
+	for (;;) {
+		while (sem_wait(&rep->ready) < 0);
+
+		for (;;) {
+			buf = NULL;
+			for (i = 0; i < 2; i++) {
+				if (__atomic_load_n(&rep->bufs[i].state, __ATOMIC_ACQUIRE) == SNAP_READY &&
+						(buf == NULL || rep->bufs[i].seq < buf->seq))
+					buf = &rep->bufs[i];
+			}
+
+			if (buf == NULL)
+				break;
+
+			buf->state = SNAP_BUSY;
+			view = &buf->view;
+			meas_generate_report(&view, rep->parameters);
+			meas_write_report(view, rep->fp);
+
+			if (rep->truncated > 0 || rep->torn > 0) {
+				fprintf(rep->fp, " Snapshots: %lu elements created after start omitted, %lu inconsistent copies\n\n",
+						__atomic_load_n(&rep->truncated, __ATOMIC_RELAXED),
+						__atomic_load_n(&rep->torn, __ATOMIC_RELAXED));
+			}
+			fflush(rep->fp);
+			__atomic_store_n(&buf->state, SNAP_FREE, __ATOMIC_RELEASE);
+		}
+
+		if (__atomic_load_n(&rep->stop, __ATOMIC_ACQUIRE))
+			break;
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * Allocate a shadow of a list
+ * @param shadow The shadow list.
+ * @param list The live list (its length is the capacity).
+ * @param size Size of each element.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int shadow_init(struct shadow_list *shadow, llist *list, size_t size)
+{
+	llist *tmp;
+
+	shadow->capacity = 0;
+	foreach(list, tmp) {
+		shadow->capacity++;
+	}
+
+	shadow->size     = size;
+	shadow->nodes    = (llist*)calloc(shadow->capacity + 1, sizeof(llist));
+
+	/* Copies keep the alignment of timers and counters */
+	if (posix_memalign((void**)&shadow->elements, MEAS_CACHE_LINE, (shadow->capacity + 1) * size) != 0)
+		shadow->elements = NULL;
+	else
+		memset(shadow->elements, 0, (shadow->capacity + 1) * size);
+
+	return(shadow->nodes != NULL && shadow->elements != NULL);
+}
+
+
+/**
+ * Allocate the shadows of the extensions of the timers of a list
+ * @param buf The snapshot buffer (timers shadow already allocated).
+ * @param list The live list of timers.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int ext_init(struct snapshot_buffer *buf, llist *list)
+{
+	struct shadow_timer *ext;
+	meas_clock *clock;
+	unsigned int n = 0;
+	llist *tmp;
+
+	if ((buf->ext = (struct shadow_timer*)calloc(buf->timers.capacity + 1,
+					sizeof(struct shadow_timer))) == NULL)
+		return(FALSE);
+
+	foreach(list, tmp) {
+		if (n == buf->timers.capacity)
+			break;
+
+		clock = (meas_clock*)tmp->element;
+		ext   = &buf->ext[n++];
+
+		if (clock->samples != NULL) {
+			ext->nvalues = clock->samples->capacity;
+			if ((ext->values = (unsigned long*)malloc(sizeof(unsigned long) * ext->nvalues)) == NULL)
+				return(FALSE);
+		}
+
+		if (clock->sketch != NULL) {
+			ext->nbins = clock->sketch->nbins;
+			if ((ext->bins = (unsigned long*)malloc(sizeof(unsigned long) * ext->nbins)) == NULL)
+				return(FALSE);
+		}
+
+		if (clock->cpus != NULL) {
+			ext->ncpus = clock->cpus->ncpus;
+			if ((ext->cpus = (meas_cpu_stats*)malloc(sizeof(meas_cpu_stats) +
+							(sizeof(meas_timer_acc) * ext->ncpus))) == NULL)
+				return(FALSE);
+		}
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Allocate the shadow of a per-thread resource probe
+ * @param shadow The shadow probe.
+ * @param thr The live probe (NULL: none).
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int threads_init(meas_threads *shadow, meas_threads *thr)
+{
+	memset(shadow, 0, sizeof(meas_threads));
+	shadow->dirfd = -1;
+
+	if (thr == NULL)
+		return(TRUE);
+
+	shadow->capacity = thr->capacity;
+	shadow->threads  = (meas_thread_info*)calloc(thr->capacity, sizeof(meas_thread_info));
+	shadow->prev     = (meas_thread_info*)calloc(thr->capacity, sizeof(meas_thread_info));
+
+	return(shadow->threads != NULL && shadow->prev != NULL);
+}
+
+
+/**
+ * Copy the timers of a list
+ * @param rep The reporter.
+ * @param shadow Shadow of the list.
+ * @param ext Shadows of the extensions of each timer.
+ * @param list The live list.
+ * @return llist* The shadow list.
+ */
+static llist *capture_timers(meas_reporter *rep, struct shadow_list *shadow, struct shadow_timer *ext,
+							 llist *list)
+{
+	meas_clock *clock, *copy;
+	unsigned int n = 0, s, retries;
+	llist *tmp;
+
+	foreach(list, tmp) {
+		if (n == shadow->capacity) {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		clock = (meas_clock*)tmp->element;
+		copy  = (meas_clock*)(shadow->elements + (n * shadow->size));
+		retries = 0;
+		do {
+			s = seq_read_begin(&clock->seq);
+			memcpy(copy, clock, sizeof(meas_clock));
+
+			/* CPU placement is updated under the timer lock */
+			if (copy->cpus != NULL && ext[n].cpus != NULL && copy->cpus->ncpus == ext[n].ncpus)
+				memcpy(ext[n].cpus, copy->cpus, sizeof(meas_cpu_stats) +
+					   (sizeof(meas_timer_acc) * ext[n].ncpus));
+		} while (seq_read_retry(&clock->seq, s) && ++retries < SNAPSHOT_RETRIES);
+
+		if (retries == SNAPSHOT_RETRIES)
+			__atomic_add_fetch(&rep->torn, 1, __ATOMIC_RELAXED);
+
+		copy->parent = NULL;
+		copy->chain  = NULL;
+		copy->mst    = NULL;
+		capture_ext(rep, &ext[n], copy);
+		n++;
+	}
+
+	link_nodes(shadow, n);
+	return(n > 0 ? shadow->nodes : NULL);
+}
+
+
+/**
+ * Point the extensions of a timer copy to their shadows, copying samples,
+ * sketch and budget (extensions enabled after meas_reporter_start are
+ * omitted and counted as truncated)
+ * @param rep The reporter.
+ * @param ext Shadows of the extensions of the timer.
+ * @param copy The timer copy (CPU placement already copied).
+ */
+static void capture_ext(meas_reporter *rep, struct shadow_timer *ext, meas_clock *copy)
+{
+	meas_samples *samples = copy->samples;
+	meas_sketch *sketch = copy->sketch;
+	meas_budget *budget = copy->budget;
+	unsigned long n;
+
+	copy->samples = NULL;
+	if (samples != NULL) {
+		if (ext->values != NULL) {
+			/* Values beyond the shadow capacity are reported as dropped */
+			n = samples->n;
+			ext->samples         = *samples;
+			ext->samples.values  = ext->values;
+			ext->samples.n       = (n < ext->nvalues) ? n : ext->nvalues;
+			ext->samples.dropped = samples->dropped + (n - ext->samples.n);
+			memcpy(ext->values, samples->values, sizeof(unsigned long) * ext->samples.n);
+			copy->samples = &ext->samples;
+		} else {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	copy->sketch = NULL;
+	if (sketch != NULL) {
+		if (ext->bins != NULL && sketch->nbins == ext->nbins) {
+			ext->sketch      = *sketch;
+			ext->sketch.bins = ext->bins;
+			memcpy(ext->bins, sketch->bins, sizeof(unsigned long) * ext->nbins);
+			copy->sketch = &ext->sketch;
+		} else {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (copy->cpus != NULL) {
+		if (ext->cpus != NULL && copy->cpus->ncpus == ext->ncpus) {
+			ext->cpus->cpu = (meas_timer_acc*)(ext->cpus + 1);
+			copy->cpus = ext->cpus;
+		} else {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+			copy->cpus = NULL;
+		}
+	}
+
+	/* Fixed size: always copied, without its notification target */
+	copy->budget = NULL;
+	if (budget != NULL) {
+		ext->budget          = *budget;
+		ext->budget.fn       = NULL;
+		ext->budget.ctx      = NULL;
+		ext->budget.watchdog = NULL;
+		copy->budget = &ext->budget;
+	}
+}
+
+
+/**
+ * Copy the counters of a list
+ * @param rep The reporter.
+ * @param shadow Shadow of the list.
+ * @param list The live list.
+ * @return llist* The shadow list.
+ */
+static llist *capture_counters(meas_reporter *rep, struct shadow_list *shadow, llist *list)
+{
+	meas_counter *counter, *copy;
+	unsigned int n = 0;
+	llist *tmp;
+
+	foreach(list, tmp) {
+		if (n == shadow->capacity) {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		counter = (meas_counter*)tmp->element;
+		copy    = (meas_counter*)(shadow->elements + (n * shadow->size));
+
+		/* A single word: no lock needed */
+		memcpy(copy, counter, sizeof(meas_counter));
+		copy->value = __atomic_load_n(&counter->value, __ATOMIC_RELAXED);
+		n++;
+	}
+
+	link_nodes(shadow, n);
+	return(n > 0 ? shadow->nodes : NULL);
+}
+
+
+/**
+ * Copy the periodic tasks (and their histograms) of a list
+ * @param rep The reporter.
+ * @param shadow Shadow of the list.
+ * @param list The live list.
+ * @return llist* The shadow list.
+ */
+static llist *capture_tasks(meas_reporter *rep, struct shadow_list *shadow, llist *list)
+{
+	meas_task *task, *copy;
+	unsigned long *buckets;
+	unsigned int n = 0, s, retries;
+	llist *tmp;
+
+	foreach(list, tmp) {
+		if (n == shadow->capacity) {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		task = (meas_task*)tmp->element;
+		copy = (meas_task*)(shadow->elements + (n * shadow->size));
+		retries = 0;
+		do {
+			s = seq_read_begin(&task->seq);
+			memcpy(copy, task, shadow->size);
+		} while (seq_read_retry(&task->seq, s) && ++retries < SNAPSHOT_RETRIES);
+
+		if (retries == SNAPSHOT_RETRIES)
+			__atomic_add_fetch(&rep->torn, 1, __ATOMIC_RELAXED);
+
+		/* Buckets are stored right after the task */
+		buckets = (unsigned long*)(copy + 1);
+		copy->jitter.buckets    = buckets + (task->jitter.buckets - (unsigned long*)(task + 1));
+		copy->response.buckets  = buckets + (task->response.buckets - (unsigned long*)(task + 1));
+		copy->miss_runs.buckets = buckets + (task->miss_runs.buckets - (unsigned long*)(task + 1));
+		copy->on_miss = NULL;
+		n++;
+	}
+
+	link_nodes(shadow, n);
+	return(n > 0 ? shadow->nodes : NULL);
+}
+
+
+/**
+ * Copy the child process groups of a list
+ * @param rep The reporter.
+ * @param shadow Shadow of the list.
+ * @param list The live list.
+ * @return llist* The shadow list.
+ */
+static llist *capture_children(meas_reporter *rep, struct shadow_list *shadow, llist *list)
+{
+	unsigned int n = 0;
+	llist *tmp;
+
+	foreach(list, tmp) {
+		if (n == shadow->capacity) {
+			__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+
+		memcpy(shadow->elements + (n * shadow->size), tmp->element, sizeof(meas_child_stats));
+		n++;
+	}
+
+	link_nodes(shadow, n);
+	return(n > 0 ? shadow->nodes : NULL);
+}
+
+
+/**
+ * Copy the last two snapshots of a per-thread resource probe
+ * @param rep The reporter.
+ * @param shadow The shadow probe.
+ * @param thr The live probe (NULL: none).
+ * @return meas_threads* The shadow probe or NULL.
+ */
+static meas_threads *capture_threads(meas_reporter *rep, meas_threads *shadow, meas_threads *thr)
+{
+	if (thr == NULL)
+		return(NULL);
+
+	/* Probe created after meas_reporter_start */
+	if (shadow->threads == NULL || thr->capacity != shadow->capacity) {
+		__atomic_add_fetch(&rep->truncated, 1, __ATOMIC_RELAXED);
+		return(NULL);
+	}
+
+	shadow->n         = thr->n;
+	shadow->nprev     = thr->nprev;
+	shadow->time      = thr->time;
+	shadow->prev_time = thr->prev_time;
+	shadow->dropped   = thr->dropped;
+	memcpy(shadow->threads, thr->threads, sizeof(meas_thread_info) * thr->n);
+	memcpy(shadow->prev, thr->prev, sizeof(meas_thread_info) * thr->nprev);
+
+	return(shadow);
+}
+
+
+/**
+ * Chain the first n nodes of a shadow list to their copies
+ * @param shadow The shadow list.
+ * @param n Number of elements.
+ */
+static void link_nodes(struct shadow_list *shadow, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		shadow->nodes[i].element = shadow->elements + (i * shadow->size);
+		shadow->nodes[i].next    = (i + 1 < n) ? &shadow->nodes[i + 1] : NULL;
+	}
+}
+
+
+/**
+ * Free the snapshot buffers of a reporter
+ * @param rep The reporter.
+ */
+static void free_buffers(meas_reporter *rep)
+{
+	struct snapshot_buffer *buf;
+	unsigned int j;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		buf = &rep->bufs[i];
+		free(buf->timers.nodes);
+		free(buf->timers.elements);
+		free(buf->counters.nodes);
+		free(buf->counters.elements);
+		free(buf->tasks.nodes);
+		free(buf->tasks.elements);
+		free(buf->children.nodes);
+		free(buf->children.elements);
+		free(buf->threads.threads);
+		free(buf->threads.prev);
+		free(buf->view.report.text);
+
+		if (buf->ext != NULL) {
+			for (j = 0; j < buf->timers.capacity; j++) {
+				free(buf->ext[j].values);
+				free(buf->ext[j].bins);
+				free(buf->ext[j].cpus);
+			}
+			free(buf->ext);
+		}
+	}
+}
+
@@ -0,0 +1,183 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Child processes: per-child wall time, resource usage and exit status
+ *
+ * Children are started with posix_spawn and reaped with wait4, which
+ * returns the resource usage of that child only (RUSAGE_CHILDREN only
+ * gives the sum over every reaped child). Children started under the
+ * same name are aggregated for the report.
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static void timeval_add(struct timeval *tv, const struct timeval *add);
+
+
+/**
+ * Start a child process (searched in PATH like execvp)
+ * @param mst The meas user structure.
+ * @param child Returned child (pass it to meas_wait).
+ * @param name Name of the group of children (useful for report visualization).
+ * @param argv Command and arguments (NULL terminated).
+ * @param envp Environment (NULL for the environment of the caller).
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_spawn(meas_t **mst, meas_child *child, const char *name, char *const argv[],
+			   char *const envp[])
+{
+	meas_t *umst;
+	meas_child_stats *stats;
+	pid_t pid;
+
+	if (mst == NULL || *mst == NULL || child == NULL || name == NULL || argv == NULL ||
+			argv[0] == NULL)
+		return(FALSE);
+
+	umst = *mst;
+	if ((stats = meas_get_child_stats(mst, name)) == NULL) {
+		_libmeas_rt_violation(umst);
+		if ((stats = (meas_child_stats*)calloc(1, sizeof(meas_child_stats))) == NULL)
+			return(FALSE);
+
+		strncpy(stats->name, name, MAX_NAME_SIZE - 1);
+		if (llist_add(&umst->children, stats) == FALSE) {
+			free(stats);
+			return(FALSE);
+		}
+	}
+
+	memset(child, 0, sizeof(meas_child));
+	child->stats = stats;
+	child->start = meas_get_ticks();
+
+	if ((errno = posix_spawnp(&pid, argv[0], NULL, NULL, argv, envp ? envp : environ)) != 0)
+		return(FALSE);
+
+	child->pid = (int)pid;
+	return(TRUE);
+}
+
+
+/**
+ * Wait for a child started by meas_spawn and record its wall time (until
+ * it is reaped: call it as soon as the child is expected to end), its
+ * resource usage and its exit status.
+ * @param child The child.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_wait(meas_child *child)
+{
+	meas_child_stats *stats;
+	pid_t ret;
+
+	if (child == NULL || child->pid <= 0)
+		return(FALSE);
+
+	do {
+		ret = wait4((pid_t)child->pid, &child->status, 0, &child->usage);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return(FALSE);
+
+	child->wall = meas_get_ticks() - child->start;
+	child->pid  = -child->pid;
+
+	stats = child->stats;
+	if (stats->nchildren == 0 || child->wall < stats->wall_min)
+		stats->wall_min = child->wall;
+	if (child->wall > stats->wall_max)
+		stats->wall_max = child->wall;
+	stats->wall_total += child->wall;
+	stats->nchildren++;
+
+	if (!WIFEXITED(child->status) || WEXITSTATUS(child->status) != 0)
+		stats->nfailed++;
+
+	timeval_add(&stats->utime, &child->usage.ru_utime);
+	timeval_add(&stats->stime, &child->usage.ru_stime);
+	if (child->usage.ru_maxrss > stats->maxrss)
+		stats->maxrss = child->usage.ru_maxrss;
+	stats->minflt  += child->usage.ru_minflt;
+	stats->majflt  += child->usage.ru_majflt;
+	stats->nvcsw   += child->usage.ru_nvcsw;
+	stats->nivcsw  += child->usage.ru_nivcsw;
+	stats->inblock += child->usage.ru_inblock;
+	stats->oublock += child->usage.ru_oublock;
+
+	return(TRUE);
+}
+
+
+/**
+ * Return the aggregated resources of the children spawned under a name
+ * @param mst The meas user structure.
+ * @param name Name of the group.
+ * @return NULL if no child was spawned under this name, the group otherwise.
+ */
+meas_child_stats *meas_get_child_stats(meas_t **mst, const char *name)
+{
+	meas_child_stats *stats;
+	llist *tmp;
+
+	if (mst == NULL || *mst == NULL || name == NULL)
+		return(NULL);
+
+	foreach((*mst)->children, tmp) {
+		stats = (meas_child_stats*)tmp->element;
+		if (strncmp(stats->name, name, MAX_NAME_SIZE - 1) == 0)
+			return(stats);
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * Add a timeval to another one
+ * @param tv The sum.
+ * @param add Value added.
+ */
+static void timeval_add(struct timeval *tv, const struct timeval *add)
+{
+	tv->tv_sec  += add->tv_sec;
+	tv->tv_usec += add->tv_usec;
+	if (tv->tv_usec >= 1000000) {
+		tv->tv_sec++;
+		tv->tv_usec -= 1000000;
+	}
+}
+
@@ -0,0 +1,277 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * ELF symbol tables (symbolization outside the hot path)
+ */
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <link.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Max. number of loadable segments kept
+ */
+#define SYMTAB_MAX_SEGMENTS 16
+
+/**
+ * Function symbol
+ */
+struct symbol {
+	unsigned long addr;
+	unsigned long size;
+	const char *name;
+};
+
+/**
+ * Loadable segment (file offset to virtual address)
+ */
+struct segment {
+	unsigned long offset;
+	unsigned long vaddr;
+	unsigned long filesz;
+};
+
+/**
+ * Symbol table of an ELF file
+ */
+struct _meas_symtab {
+	void *image;
+	size_t size;
+	unsigned int nsyms;
+	struct symbol *syms;
+	unsigned int nsegs;
+	struct segment segs[SYMTAB_MAX_SEGMENTS];
+};
+
+/**
+ * static functions
+ */
+static unsigned int add_symbols(meas_symtab *tab, const ElfW(Shdr) *sh, const ElfW(Shdr) *shdrs,
+								unsigned int nsh, unsigned int pos);
+static int cmp_symbol(const void *a, const void *b);
+
+
+/**
+ * Load the function symbols of an ELF file (.symtab and .dynsym) of the
+ * native class.
+ * @param path File path.
+ * @return NULL on error or the symbol table (free with meas_symtab_free).
+ */
+meas_symtab *meas_symtab_load(const char *path)
+{
+	meas_symtab *tab;
+	const ElfW(Ehdr) *eh;
+	const ElfW(Phdr) *ph;
+	const ElfW(Shdr) *sh;
+	struct stat st;
+	unsigned int i, total;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return(NULL);
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ElfW(Ehdr))) {
+		close(fd);
+		return(NULL);
+	}
+
+	if ((tab = (meas_symtab*)calloc(1, sizeof(meas_symtab))) == NULL) {
+		close(fd);
+		return(NULL);
+	}
+
+	tab->size  = st.st_size;
+	tab->image = mmap(NULL, tab->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (tab->image == MAP_FAILED) {
+		free(tab);
+		return(NULL);
+	}
+
+	eh = (const ElfW(Ehdr)*)tab->image;
+	if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+			eh->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32) ||
+			eh->e_phoff + ((size_t)eh->e_phnum * sizeof(ElfW(Phdr))) > tab->size ||
+			eh->e_shoff + ((size_t)eh->e_shnum * sizeof(ElfW(Shdr))) > tab->size) {
+		meas_symtab_free(&tab);
+		return(NULL);
+	}
+
+	/* Loadable segments */
+	ph = (const ElfW(Phdr)*)((const char*)tab->image + eh->e_phoff);
+	for (i = 0; i < eh->e_phnum && tab->nsegs < SYMTAB_MAX_SEGMENTS; i++) {
+		if (ph[i].p_type == PT_LOAD) {
+			tab->segs[tab->nsegs].offset = ph[i].p_offset;
+			tab->segs[tab->nsegs].vaddr  = ph[i].p_vaddr;
+			tab->segs[tab->nsegs].filesz = ph[i].p_filesz;
+			tab->nsegs++;
+		}
+	}
+
+	/* Function symbols */
+	sh = (const ElfW(Shdr)*)((const char*)tab->image + eh->e_shoff);
+	for (i = 0, total = 0; i < eh->e_shnum; i++) {
+		if ((sh[i].sh_type == SHT_SYMTAB || sh[i].sh_type == SHT_DYNSYM) && sh[i].sh_entsize != 0)
+			total += sh[i].sh_size / sh[i].sh_entsize;
+	}
+
+	if ((tab->syms = (struct symbol*)malloc(sizeof(struct symbol) * (total + 1))) == NULL) {
+		meas_symtab_free(&tab);
+		return(NULL);
+	}
+
+	for (i = 0; i < eh->e_shnum; i++) {
+		if (sh[i].sh_type == SHT_SYMTAB || sh[i].sh_type == SHT_DYNSYM)
+			tab->nsyms = add_symbols(tab, &sh[i], sh, eh->e_shnum, tab->nsyms);
+	}
+
+	qsort(tab->syms, tab->nsyms, sizeof(struct symbol), cmp_symbol);
+	return(tab);
+}
+
+
+/**
+ * Find the function containing a file offset
+ * @param tab Symbol table.
+ * @param offset Offset inside the file (address - mapping start + mapping offset).
+ * @param symoff Returned offset from the start of the function (may be NULL).
+ * @return const char* Function name or NULL if not found.
+ */
+const char *meas_symtab_lookup(meas_symtab *tab, unsigned long offset, unsigned long *symoff)
+{
+	unsigned long vaddr = 0;
+	unsigned int i, lo, hi, mid;
+	int found = 0;
+
+	if (tab == NULL || tab->nsyms == 0)
+		return(NULL);
+
+	/* File offset to link-time virtual address */
+	for (i = 0; i < tab->nsegs; i++) {
+		if (offset >= tab->segs[i].offset &&
+				offset < tab->segs[i].offset + tab->segs[i].filesz) {
+			vaddr = offset - tab->segs[i].offset + tab->segs[i].vaddr;
+			found = 1;
+			break;
+		}
+	}
+
+	if (!found || vaddr < tab->syms[0].addr)
+		return(NULL);
+
+	/* Last symbol starting at or before vaddr */
+	lo = 0;
+	hi = tab->nsyms;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (tab->syms[mid].addr <= vaddr) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (tab->syms[lo].size != 0 && vaddr >= tab->syms[lo].addr + tab->syms[lo].size)
+		return(NULL);
+
+	if (symoff != NULL)
+		*symoff = vaddr - tab->syms[lo].addr;
+
+	return(tab->syms[lo].name);
+}
+
+
+/**
+ * Free a symbol table
+ * @param tab Symbol table.
+ */
+void meas_symtab_free(meas_symtab **tab)
+{
+	if (tab == NULL || *tab == NULL)
+		return;
+
+	if ((*tab)->image != NULL && (*tab)->image != MAP_FAILED)
+		munmap((*tab)->image, (*tab)->size);
+
+	free((*tab)->syms);
+	free(*tab);
+	*tab = NULL;
+}
+
+
+/**
+ * Add the defined function symbols of a symbol section
+ * @param tab Symbol table.
+ * @param sh Symbol section.
+ * @param shdrs All section headers.
+ * @param nsh Number of sections.
+ * @param pos Number of symbols already in the table.
+ * @return unsigned int New number of symbols.
+ */
+static unsigned int add_symbols(meas_symtab *tab, const ElfW(Shdr) *sh, const ElfW(Shdr) *shdrs,
+								unsigned int nsh, unsigned int pos)
+{
+	const ElfW(Sym) *sym;
+	const char *strtab;
+	unsigned int i, n;
+
+	if (sh->sh_link >= nsh ||
+			sh->sh_offset + sh->sh_size > tab->size ||
+			shdrs[sh->sh_link].sh_offset + shdrs[sh->sh_link].sh_size > tab->size)
+		return(pos);
+
+	sym    = (const ElfW(Sym)*)((const char*)tab->image + sh->sh_offset);
+	strtab = (const char*)tab->image + shdrs[sh->sh_link].sh_offset;
+	n      = sh->sh_size / sh->sh_entsize;
+
+	for (i = 0; i < n; i++) {
+		if (ELF64_ST_TYPE(sym[i].st_info) != STT_FUNC || sym[i].st_shndx == SHN_UNDEF ||
+				sym[i].st_value == 0 || sym[i].st_name >= shdrs[sh->sh_link].sh_size)
+			continue;
+
+		tab->syms[pos].addr = sym[i].st_value;
+		tab->syms[pos].size = sym[i].st_size;
+		tab->syms[pos].name = strtab + sym[i].st_name;
+		pos++;
+	}
+
+	return(pos);
+}
+
+
+/**
+ * Compare two symbols by address (for qsort)
+ */
+static int cmp_symbol(const void *a, const void *b)
+{
+	const struct symbol *sa = (const struct symbol*)a;
+	const struct symbol *sb = (const struct symbol*)b;
+
+	return((sa->addr > sb->addr) - (sa->addr < sb->addr));
+}
+
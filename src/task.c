@@ -0,0 +1,211 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * Periodic real-time tasks: release jitter, response time and deadline
+ * misses.
+ *
+ * The first meas_task_begin defines the release of job 0; job k is
+ * released at origin + k * period. An activation belongs to the latest
+ * release not older than the next job, so releases passed while a job
+ * overran count as skipped instead of piling up as jitter. Jitter is the
+ * delay between the nominal release and meas_task_begin, response time is
+ * the delay between the nominal release and meas_task_end.
+ */
+#include <meas.h>
+#include <seqlock.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Number of buckets of jitter and response time histograms
+ */
+#define TASK_BUCKETS 100
+
+/**
+ * Number of buckets of the consecutive misses histogram
+ */
+#define TASK_MISS_RUN_BUCKETS 64
+
+extern void *_libmeas_alloc(meas_t *mst, int pool, size_t size);
+extern void _libmeas_free(meas_t *mst, void *ptr);
+extern int _libmeas_list_add(meas_t *mst, int pool, llist **list, llist **tail, void *element);
+
+size_t _libmeas_task_size(void);
+
+
+/**
+ * Create a periodic task monitor
+ * @param mst The meas user structure.
+ * @param name A name to the task (useful for report visualization).
+ * @param period Task period (in ticks, see meas_get_ticks).
+ * @param deadline Relative deadline (in ticks). 0 means deadline = period.
+ * @return NULL on error or the created task.
+ */
+meas_task *meas_create_task(meas_t **mst, const char *name, unsigned long period,
+							unsigned long deadline)
+{
+	meas_t *umst;
+	meas_task *ntask;
+	unsigned long *buckets;
+
+	if (mst == NULL || *mst == NULL || period == 0)
+		return(NULL);
+
+	umst = *mst;
+	if ((ntask = (meas_task*)_libmeas_alloc(umst, MEAS_RT_TASKS, _libmeas_task_size())) == NULL)
+		return(NULL);
+
+	buckets = (unsigned long*)(ntask + 1);
+
+	ntask->state = TASK_ST_IDLE;
+	strncpy(ntask->name, name, MAX_NAME_SIZE - 1);
+	ntask->period   = period;
+	ntask->deadline = (deadline > 0) ? deadline : period;
+
+	/* Jitter within one period, response time up to twice the deadline */
+	meas_hist_setup(&ntask->jitter, 0, period / TASK_BUCKETS, TASK_BUCKETS, buckets);
+	meas_hist_setup(&ntask->response, 0, (2 * ntask->deadline) / TASK_BUCKETS, TASK_BUCKETS,
+					buckets + TASK_BUCKETS);
+	meas_hist_setup(&ntask->miss_runs, 1, 1, TASK_MISS_RUN_BUCKETS, buckets + (2 * TASK_BUCKETS));
+
+	if (_libmeas_list_add(umst, MEAS_RT_TASKS, &umst->tasks, &umst->tasks_tail, ntask) == FALSE) {
+		_libmeas_free(umst, ntask);
+		return(NULL);
+	}
+
+	return(ntask);
+}
+
+
+/**
+ * Set the function called on each deadline miss.
+ * The callback runs in the thread calling meas_task_end, right after the
+ * miss is recorded, and must not block.
+ * @param task The task.
+ * @param fn Callback (NULL to disable).
+ * @param ctx Argument passed to the callback.
+ */
+void meas_task_on_miss(meas_task *task, meas_task_miss_fn fn, void *ctx)
+{
+	if (task == NULL)
+		return;
+
+	task->miss_ctx = ctx;
+	__atomic_store_n(&task->on_miss, fn, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Mark the start of an activation (job) of a task
+ * @param task The task.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_task_begin(meas_task *task)
+{
+	unsigned long now = meas_get_ticks();
+	unsigned long job;
+
+	if (task == NULL || task->state == TASK_ST_RUNNING)
+		return(FALSE);
+
+	seq_write_begin(&task->seq);
+	if (task->jobs == 0) {
+		task->origin = now;
+		task->job    = 0;
+	} else {
+		/* Early activations take the next release, late ones the latest */
+		job = (now - task->origin) / task->period;
+		if (job > task->job + 1) {
+			task->skipped += job - (task->job + 1);
+			task->job = job;
+		} else {
+			task->job++;
+		}
+	}
+
+	task->release = task->origin + (task->job * task->period);
+	task->start   = now;
+	task->state   = TASK_ST_RUNNING;
+
+	/* Early activations have no release jitter */
+	meas_hist_add(&task->jitter, (now > task->release) ? now - task->release : 0);
+	seq_write_end(&task->seq);
+
+	return(TRUE);
+}
+
+
+/**
+ * Mark the completion of the current activation of a task
+ * @param task The task.
+ * @return TRUE if the deadline was met, FALSE if it was missed (or on error).
+ */
+int meas_task_end(meas_task *task)
+{
+	unsigned long now = meas_get_ticks();
+	unsigned long response;
+	meas_task_miss_fn fn;
+
+	if (task == NULL || task->state != TASK_ST_RUNNING)
+		return(FALSE);
+
+	seq_write_begin(&task->seq);
+	task->state = TASK_ST_IDLE;
+	task->jobs++;
+
+	/* Early activations respond from their start */
+	response = now - ((task->start < task->release) ? task->start : task->release);
+	meas_hist_add(&task->response, response);
+
+	if (response <= task->deadline) {
+		if (task->miss_run > 0) {
+			meas_hist_add(&task->miss_runs, task->miss_run);
+			task->miss_run = 0;
+		}
+		seq_write_end(&task->seq);
+		return(TRUE);
+	}
+
+	/* Deadline miss */
+	task->misses++;
+	task->miss_run++;
+	if (task->miss_run > task->max_miss_run)
+		task->max_miss_run = task->miss_run;
+	seq_write_end(&task->seq);
+
+	fn = __atomic_load_n(&task->on_miss, __ATOMIC_ACQUIRE);
+	if (fn != NULL)
+		fn(task, response, task->miss_ctx);
+
+	return(FALSE);
+}
+
+
+/**
+ * Size of a task with its histogram buckets (stored right after it)
+ * @return size_t Size in bytes.
+ */
+size_t _libmeas_task_size(void)
+{
+	return(sizeof(meas_task) + (sizeof(unsigned long) * ((2 * TASK_BUCKETS) + TASK_MISS_RUN_BUCKETS)));
+}
+
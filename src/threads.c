@@ -0,0 +1,422 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * Per-thread resources from /proc/self/task
+ *
+ * The task directory and the stat, schedstat and status files of every
+ * thread stay open between snapshots; a snapshot only rewinds the
+ * directory and reads each file with pread into a stack buffer, parsed in
+ * place (no allocation). Threads that exited are closed, new ones are
+ * opened. The previous snapshot is kept to compute deltas.
+ */
+#define _GNU_SOURCE
+#include <meas.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+/**
+ * Read buffers (status is the largest file)
+ */
+#define STAT_BUFSIZE   1024
+#define STATUS_BUFSIZE 4096
+
+extern void _libmeas_rt_violation(meas_t *mst);
+
+/**
+ * static functions
+ */
+static int read_thread(meas_thread_info *info, unsigned long long tick_ns);
+static int open_thread(meas_threads *thr, meas_thread_info *info, int tid);
+static void close_thread(meas_thread_info *info);
+static ssize_t read_file(int fd, char *buf, size_t size);
+static const char *skip_fields(const char *p, unsigned int n);
+static unsigned long long parse_ull(const char **p);
+static unsigned long status_field(const char *buf, const char *key);
+
+
+/**
+ * Create the per-thread resource probe of a meas structure (one per
+ * meas_t, shown by the report) and take a first snapshot.
+ * @param mst The meas user structure.
+ * @param capacity Max. number of threads followed.
+ * @return NULL on error or the probe.
+ */
+meas_threads *meas_threads_create(meas_t **mst, unsigned int capacity)
+{
+	meas_threads *thr;
+
+	if (mst == NULL || *mst == NULL || (*mst)->threads != NULL || capacity == 0)
+		return(NULL);
+
+	_libmeas_rt_violation(*mst);
+
+	if ((thr = (meas_threads*)calloc(1, sizeof(meas_threads))) == NULL)
+		return(NULL);
+
+	thr->threads = (meas_thread_info*)calloc(capacity, sizeof(meas_thread_info));
+	thr->prev    = (meas_thread_info*)calloc(capacity, sizeof(meas_thread_info));
+	thr->seen    = (unsigned char*)malloc(capacity);
+	thr->dirfd   = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	/* fdopendir owns a duplicate: dirfd stays usable for openat */
+	if (thr->threads == NULL || thr->prev == NULL || thr->seen == NULL || thr->dirfd < 0 ||
+			(thr->dir = fdopendir(dup(thr->dirfd))) == NULL) {
+		if (thr->dirfd >= 0)
+			close(thr->dirfd);
+		free(thr->threads);
+		free(thr->prev);
+		free(thr->seen);
+		free(thr);
+		return(NULL);
+	}
+
+	thr->capacity = capacity;
+	thr->mst = *mst;
+	(*mst)->threads = thr;
+
+	meas_threads_update(thr);
+	return(thr);
+}
+
+
+/**
+ * Take a new snapshot of every thread (the last one becomes the previous)
+ * @param thr The probe.
+ * @return int Number of threads (-1 on error).
+ */
+int meas_threads_update(meas_threads *thr)
+{
+	meas_thread_info tmp;
+	struct dirent *ent;
+	struct timespec ts;
+	unsigned long long tick_ns;
+	unsigned int i, j, n;
+	int tid;
+
+	if (thr == NULL)
+		return(-1);
+
+	tick_ns = 1000000000ULL / (unsigned long long)sysconf(_SC_CLK_TCK);
+
+	memcpy(thr->prev, thr->threads, sizeof(meas_thread_info) * thr->n);
+	thr->nprev     = thr->n;
+	thr->prev_time = thr->time;
+	thr->dropped   = 0;
+	memset(thr->seen, 0, thr->capacity);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	thr->time = ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+
+	rewinddir((DIR*)thr->dir);
+	while ((ent = readdir((DIR*)thr->dir)) != NULL) {
+		if (ent->d_name[0] < '0' || ent->d_name[0] > '9')
+			continue;
+		tid = atoi(ent->d_name);
+
+		for (i = 0; i < thr->n && thr->threads[i].tid != tid; i++);
+		if (i == thr->n) {
+			if (thr->n == thr->capacity) {
+				thr->dropped++;
+				continue;
+			}
+			if (open_thread(thr, &thr->threads[i], tid) == FALSE)
+				continue;
+			thr->n++;
+		}
+
+		/* A thread that exited meanwhile is dropped below */
+		if (read_thread(&thr->threads[i], tick_ns) == TRUE)
+			thr->seen[i] = 1;
+	}
+
+	/* Close the threads that exited, keep the order of the others */
+	for (i = 0, n = 0; i < thr->n; i++) {
+		if (!thr->seen[i]) {
+			close_thread(&thr->threads[i]);
+			continue;
+		}
+		thr->threads[n++] = thr->threads[i];
+	}
+	thr->n = n;
+
+	/* Sorted by tid (mostly sorted already) */
+	for (i = 1; i < thr->n; i++) {
+		tmp = thr->threads[i];
+		for (j = i; j > 0 && thr->threads[j - 1].tid > tmp.tid; j--) {
+			thr->threads[j] = thr->threads[j - 1];
+		}
+		thr->threads[j] = tmp;
+	}
+
+	return((int)thr->n);
+}
+
+
+/**
+ * Resources used by a thread between the previous and the last snapshot
+ * (everything since its start for a new thread; cpu and name are the
+ * last ones)
+ * @param thr The probe.
+ * @param i Index of the thread in the last snapshot.
+ * @param delta Returned resources.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int meas_threads_delta(meas_threads *thr, unsigned int i, meas_thread_info *delta)
+{
+	const meas_thread_info *cur, *prev = NULL;
+	unsigned int lo = 0, hi, mid;
+
+	if (thr == NULL || i >= thr->n || delta == NULL)
+		return(FALSE);
+
+	cur = &thr->threads[i];
+	*delta = *cur;
+
+	/* Both snapshots are sorted by tid */
+	hi = thr->nprev;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (thr->prev[mid].tid < cur->tid) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo < thr->nprev && thr->prev[lo].tid == cur->tid)
+		prev = &thr->prev[lo];
+
+	if (prev != NULL) {
+		delta->utime  -= prev->utime;
+		delta->stime  -= prev->stime;
+		delta->run    -= prev->run;
+		delta->wait   -= prev->wait;
+		delta->nvcsw  -= prev->nvcsw;
+		delta->nivcsw -= prev->nivcsw;
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Close a per-thread resource probe
+ * @param thr The probe.
+ */
+void meas_threads_free(meas_threads **thr)
+{
+	meas_threads *t;
+	unsigned int i;
+
+	if (thr == NULL || *thr == NULL)
+		return;
+
+	t = *thr;
+	for (i = 0; i < t->n; i++) {
+		close_thread(&t->threads[i]);
+	}
+
+	closedir((DIR*)t->dir);
+	close(t->dirfd);
+	free(t->threads);
+	free(t->prev);
+	free(t->seen);
+
+	if (t->mst->threads == t)
+		t->mst->threads = NULL;
+	free(t);
+	*thr = NULL;
+}
+
+
+/**
+ * Read the files of a thread
+ * @param info The thread.
+ * @param tick_ns Length of a clock tick (ns).
+ * @return FALSE if the thread exited, TRUE otherwise.
+ */
+static int read_thread(meas_thread_info *info, unsigned long long tick_ns)
+{
+	char buf[STATUS_BUFSIZE];
+	const char *p, *open, *close;
+	size_t len;
+
+	/* "tid (comm) state ...": comm may hold spaces and parentheses */
+	if (read_file(info->fd_stat, buf, STAT_BUFSIZE) <= 0)
+		return(FALSE);
+
+	if ((open = strchr(buf, '(')) == NULL || (close = strrchr(buf, ')')) == NULL || close < open)
+		return(FALSE);
+
+	len = (size_t)(close - open - 1);
+	if (len >= MEAS_THREAD_NAME)
+		len = MEAS_THREAD_NAME - 1;
+	memcpy(info->name, open + 1, len);
+	info->name[len] = '\0';
+
+	/* Fields 14 (utime), 15 (stime) and 39 (processor) */
+	p = skip_fields(close + 1, 11);
+	info->utime = parse_ull(&p) * tick_ns;
+	info->stime = parse_ull(&p) * tick_ns;
+	p = skip_fields(p, 23);
+	info->cpu = (int)parse_ull(&p);
+
+	if (info->fd_schedstat >= 0 && read_file(info->fd_schedstat, buf, STAT_BUFSIZE) > 0) {
+		p = buf;
+		info->run  = parse_ull(&p);
+		info->wait = parse_ull(&p);
+	}
+
+	if (info->fd_status >= 0 && read_file(info->fd_status, buf, STATUS_BUFSIZE) > 0) {
+		info->nvcsw  = status_field(buf, "\nvoluntary_ctxt_switches:");
+		info->nivcsw = status_field(buf, "\nnonvoluntary_ctxt_switches:");
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Open the files of a new thread
+ * @param thr The probe.
+ * @param info Returned thread.
+ * @param tid Thread id.
+ * @return FALSE on error, TRUE otherwise.
+ */
+static int open_thread(meas_threads *thr, meas_thread_info *info, int tid)
+{
+	char path[64];
+
+	memset(info, 0, sizeof(meas_thread_info));
+	info->tid = tid;
+
+	snprintf(path, sizeof(path), "%d/stat", tid);
+	if ((info->fd_stat = openat(thr->dirfd, path, O_RDONLY | O_CLOEXEC)) < 0)
+		return(FALSE);
+
+	/* Optional: schedstat needs CONFIG_SCHED_INFO */
+	snprintf(path, sizeof(path), "%d/schedstat", tid);
+	info->fd_schedstat = openat(thr->dirfd, path, O_RDONLY | O_CLOEXEC);
+	snprintf(path, sizeof(path), "%d/status", tid);
+	info->fd_status = openat(thr->dirfd, path, O_RDONLY | O_CLOEXEC);
+
+	return(TRUE);
+}
+
+
+/**
+ * Close the files of a thread
+ * @param info The thread.
+ */
+static void close_thread(meas_thread_info *info)
+{
+	if (info->fd_stat >= 0)
+		close(info->fd_stat);
+	if (info->fd_schedstat >= 0)
+		close(info->fd_schedstat);
+	if (info->fd_status >= 0)
+		close(info->fd_status);
+}
+
+
+/**
+ * Read a whole /proc file from its start
+ * @param fd File descriptor.
+ * @param buf Buffer (terminated).
+ * @param size Size of buf.
+ * @return ssize_t Bytes read (<= 0 on error or if the thread exited).
+ */
+static ssize_t read_file(int fd, char *buf, size_t size)
+{
+	ssize_t n;
+
+	if ((n = pread(fd, buf, size - 1, 0)) < 0)
+		return(n);
+
+	buf[n] = '\0';
+	return(n);
+}
+
+
+/**
+ * Skip space separated fields
+ * @param p Position (before a separator).
+ * @param n Number of fields.
+ * @return Position before the next field.
+ */
+static const char *skip_fields(const char *p, unsigned int n)
+{
+	while (n > 0 && *p != '\0') {
+		while (*p == ' ')
+			p++;
+		while (*p != ' ' && *p != '\0')
+			p++;
+		n--;
+	}
+
+	return(p);
+}
+
+
+/**
+ * Parse an unsigned number (leading spaces are skipped)
+ * @param p Position, moved after the number.
+ * @return unsigned long long The number.
+ */
+static unsigned long long parse_ull(const char **p)
+{
+	unsigned long long v = 0;
+	const char *s = *p;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	while (*s >= '0' && *s <= '9') {
+		v = (v * 10) + (unsigned long long)(*s - '0');
+		s++;
+	}
+
+	*p = s;
+	return(v);
+}
+
+
+/**
+ * Value of a "key: value" line of a status file
+ * @param buf Contents of the file.
+ * @param key Key with its leading newline and trailing colon.
+ * @return unsigned long The value (0 if missing).
+ */
+static unsigned long status_field(const char *buf, const char *key)
+{
+	const char *p;
+
+	if ((p = strstr(buf, key)) == NULL)
+		return(0);
+
+	p += strlen(key);
+	return((unsigned long)parse_ull(&p));
+}
+
@@ -23,75 +23,489 @@
  * Functions for time measurement
  */
 #include <meas.h>
+#include <seqlock.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/times.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 
 extern char _libmeas_use_syscall;
+extern void *_libmeas_alloc(meas_t *mst, int pool, size_t size);
+extern void _libmeas_free(meas_t *mst, void *ptr);
+extern int _libmeas_list_add(meas_t *mst, int pool, llist **list, llist **tail, void *element);
+extern void _libmeas_samples_add(meas_t *mst, meas_samples *samples, unsigned long value);
+extern void _libmeas_cpus_start(meas_cpu_stats *cpus);
+extern void _libmeas_cpus_stop(meas_cpu_stats *cpus, unsigned long interv);
+extern void _libmeas_budget_overrun(meas_clock *clock, meas_budget *b, unsigned long now);
+
+meas_clock *_libmeas_running_clock(void);
+
+/**
+ * Default number of start/stop pairs measured by meas_calibrate
+ */
+#define CALIBRATION_PAIRS 10001
+
+/**
+ * Max. nesting of running clocks followed by the parent walks
+ */
+#define CLOCK_MAX_DEPTH 64
+
+/**
+ * Cost of an empty start/stop pair (see meas_calibrate)
+ */
+static unsigned long clock_overhead = 0;
+
+/**
+ * Subtract clock_overhead from measured intervals
+ */
+static char compensate_overhead = FALSE;
+
+/**
+ * Innermost running clock of the calling thread (sampler region tag)
+ */
+__thread meas_clock *_libmeas_active_clock = NULL;
+
+/**
+ * Chain value of the clocks stopped or paused by a thread not owning
+ * the chain they are linked in: only the owner unlinks them (never
+ * walked itself)
+ */
+static meas_clock *left_chain = NULL;
+#define CHAIN_LEFT (&left_chain)
+
+/**
+ * Key clearing the chain of an exiting thread
+ */
+static pthread_once_t chain_once = PTHREAD_ONCE_INIT;
+static pthread_key_t chain_key;
+static __thread int chain_registered = FALSE;
 
 /**
  * static functions
  */
 static unsigned long getjiffies(void);
+static int cmp_ulong(const void *a, const void *b);
+static void enter_clock(meas_clock *clock);
+static void leave_clock(meas_clock *clock);
+static meas_clock **find_link(meas_clock *clock);
+static void drop_left(void);
+static void chain_exit(void *arg);
+static void chain_key_init(void);
 
 
 /**
  * Start or/and create a timer
  * @param mst The meas user structure. This argument is necessary only in the first call to create the clock (second argument will be NULL). After that, you can just pass NULL to mst and pass the clock in second argument.
- * @param clock The clock created with this function. Use NULL in the first call.
- * @param name A name to the clock (useful for report visualization).
+ * @param clock The clock created with this function. Use NULL in the first call. A clock allocated by the caller must be zeroed.
+ * @param name A name to the clock (useful for report visualization). Only used when the clock is created.
  * @return NULL if both mst and clock are different of NULL or the created clock.
  */
-meas_clock *meas_start_clock(meas_t **mst, meas_clock *clock, char *name)
+meas_clock *meas_start_clock(meas_t **mst, meas_clock *clock, const char *name)
 {
-	meas_t *umst = *mst;
+	meas_t *umst;
 	meas_clock *ntimer;
 
 	if(mst != NULL && clock == NULL) {
-		if((ntimer = (meas_clock*)malloc(sizeof(meas_clock))) == NULL)
+		umst = *mst;
+		if((ntimer = (meas_clock*)_libmeas_alloc(umst, MEAS_RT_TIMERS, sizeof(meas_clock))) == NULL)
 			return(NULL);
 
 		ntimer->interv = 0;
-		llist_add(&umst->timers, ntimer);
+		ntimer->mst    = umst;
+		strncpy(ntimer->name, name, MAX_NAME_SIZE - 1);
+		ntimer->name[MAX_NAME_SIZE - 1] = '\0';
+		if (_libmeas_list_add(umst, MEAS_RT_TIMERS, &umst->timers, &umst->timers_tail, ntimer) == FALSE) {
+			_libmeas_free(umst, ntimer);
+			return(NULL);
+		}
 	} else if(mst == NULL && clock != NULL) {
 		ntimer = clock;
 	} else {
 		return(NULL);
 	}
 
-	ntimer->state = TIMER_ST_RUNNING;
+	/* Nest inside the running clock of this thread (a restart keeps its place) */
+	if (ntimer->state != TIMER_ST_RUNNING)
+		enter_clock(ntimer);
+
+	seq_write_begin(&ntimer->seq);
+	ntimer->state   = TIMER_ST_RUNNING;
+	ntimer->npauses = 0;
+	if (ntimer->cpus != NULL)
+		_libmeas_cpus_start(ntimer->cpus);
+	seq_write_end(&ntimer->seq);
+
+	/* Read the clock last: nothing above is part of the interval */
 	ntimer->start_time = getjiffies();
-	strcpy(ntimer->name, name);
 	return(ntimer);
 }
 
 
 /**
  * Stop a timer
- * @param clock The timer
+ * If overhead compensation is enabled (see meas_compensate_overhead), the
+ * calibrated cost of an empty start/stop pair is subtracted from the interval.
+ * The interval of an operation that was paused is its active time; the
+ * rest of its elapsed time is recorded as waiting time.
+ * @param clock The timer (running or paused)
  * @return TRUE if the timer was stopped or FALSE if the timer was already stopped.
  */
 int meas_stop_clock(meas_clock *clock)
 {
-	if(clock == NULL)
+	unsigned long now = getjiffies();
+	meas_timer_acc *acc;
+	meas_budget *budget;
+
+	if(clock == NULL || clock->state == TIMER_ST_STOPPED)
 		return(FALSE);
 
-	clock->state    = TIMER_ST_STOPPED;
-	clock->end_time = getjiffies();
+	seq_write_begin(&clock->seq);
+	clock->end_time = now;
 	clock->interv   = clock->end_time - clock->start_time;
 
+	/* Paused operation: active time only */
+	if (clock->npauses > 0) {
+		clock->interv = clock->active + ((clock->state == TIMER_ST_RUNNING) ? clock->interv : 0);
+		clock->wait   = (now - clock->op_start) - clock->interv;
+		clock->active_total += clock->interv;
+		clock->wait_total   += clock->wait;
+		clock->waits++;
+		clock->npauses = 0;
+	}
+	clock->state = TIMER_ST_STOPPED;
+
+	if (compensate_overhead) {
+		clock->interv = (clock->interv > clock_overhead) ? clock->interv - clock_overhead : 0;
+	}
+
+	/* Odd sequence visible before reading the epoch (see meas_snapshot_reset) */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	acc = &clock->acc[__atomic_load_n(&clock->epoch, __ATOMIC_ACQUIRE) & 1];
+	if (acc->count == 0 || clock->interv < acc->min)
+		acc->min = clock->interv;
+	if (clock->interv > acc->max)
+		acc->max = clock->interv;
+	acc->total += clock->interv;
+	acc->count++;
+	if (clock->cpus != NULL)
+		_libmeas_cpus_stop(clock->cpus, clock->interv);
+	seq_write_end(&clock->seq);
+
+	if (clock->samples != NULL)
+		_libmeas_samples_add(clock->mst, clock->samples, clock->interv);
+	if (clock->sketch != NULL)
+		meas_sketch_add(clock->sketch, clock->interv);
+	/* One load: the budget may be released meanwhile (it is retired, not freed) */
+	budget = __atomic_load_n(&clock->budget, __ATOMIC_ACQUIRE);
+	if (budget != NULL && clock->interv > budget->budget)
+		_libmeas_budget_overrun(clock, budget, now);
+
+	leave_clock(clock);
 	return(TRUE);
 }
 
 
+/**
+ * Pause a running timer: until meas_resume_clock, the operation is
+ * waiting, not active. The paused timer can be resumed or stopped by
+ * another thread (handed over with the usual synchronization, e.g. a
+ * queue); pause the innermost running timer of the thread.
+ * @param clock The timer.
+ * @return FALSE if the timer is not running, TRUE otherwise.
+ */
+int meas_pause_clock(meas_clock *clock)
+{
+	unsigned long now = getjiffies();
+
+	if (clock == NULL || clock->state != TIMER_ST_RUNNING)
+		return(FALSE);
+
+	seq_write_begin(&clock->seq);
+	if (clock->npauses == 0) {
+		clock->op_start = clock->start_time;
+		clock->active   = 0;
+	}
+	clock->active += now - clock->start_time;
+	clock->npauses++;
+	clock->state = TIMER_ST_PAUSED;
+	seq_write_end(&clock->seq);
+
+	leave_clock(clock);
+	return(TRUE);
+}
+
+
+/**
+ * Resume a paused timer (in the calling thread)
+ * @param clock The timer.
+ * @return FALSE if the timer is not paused, TRUE otherwise.
+ */
+int meas_resume_clock(meas_clock *clock)
+{
+	if (clock == NULL || clock->state != TIMER_ST_PAUSED)
+		return(FALSE);
+
+	enter_clock(clock);
+
+	seq_write_begin(&clock->seq);
+	clock->state = TIMER_ST_RUNNING;
+	if (clock->cpus != NULL)
+		_libmeas_cpus_start(clock->cpus);
+	seq_write_end(&clock->seq);
+
+	/* Read the clock last: nothing above is active time */
+	clock->start_time = getjiffies();
+	return(TRUE);
+}
+
+
+/**
+ * Measure the cost of an empty start/stop pair on this machine.
+ * The median of npairs measurements is kept as the clock overhead
+ * (see meas_compensate_overhead). It allocates: call it at start-up, before
+ * entering hard real-time mode (not counted as a violation).
+ * @param npairs Number of start/stop pairs to measure (0 for default).
+ * @return unsigned long The clock overhead (in ticks).
+ */
+unsigned long meas_calibrate(unsigned int npairs)
+{
+	meas_clock clock;
+	unsigned long *values;
+	unsigned int i;
+	char compensate = compensate_overhead;
+
+	if (npairs == 0)
+		npairs = CALIBRATION_PAIRS;
+
+	if ((values = (unsigned long*)malloc(sizeof(unsigned long) * npairs)) == NULL)
+		return(clock_overhead);
+
+	memset(&clock, 0, sizeof(meas_clock));
+
+	/* Measure raw intervals */
+	compensate_overhead = FALSE;
+	for (i = 0; i < npairs; i++) {
+		meas_start_clock(NULL, &clock, NULL);
+		meas_stop_clock(&clock);
+		values[i] = clock.interv;
+	}
+	compensate_overhead = compensate;
+
+	/* Median */
+	qsort(values, npairs, sizeof(unsigned long), cmp_ulong);
+	clock_overhead = values[npairs / 2];
+
+	free(values);
+	return(clock_overhead);
+}
+
+
+/**
+ * Enable or disable the subtraction of the clock overhead from intervals.
+ * meas_calibrate should be called before enabling it.
+ * @param enable TRUE to enable, FALSE to disable.
+ */
+void meas_compensate_overhead(int enable)
+{
+	compensate_overhead = (enable ? TRUE : FALSE);
+}
+
+
+/**
+ * Return the innermost running clock of the calling thread
+ * @return meas_clock* The clock or NULL if no clock is running.
+ */
+meas_clock *meas_active_clock(void)
+{
+	return(_libmeas_running_clock());
+}
+
+
+/**
+ * Innermost clock running in the calling thread: clocks of its chain
+ * left to other threads are skipped (async-signal-safe, see the sampler)
+ * @return meas_clock* The clock or NULL if no clock is running.
+ */
+meas_clock *_libmeas_running_clock(void)
+{
+	meas_clock *clock = _libmeas_active_clock;
+	unsigned int depth;
+
+	for (depth = 0; clock != NULL && clock->chain == CHAIN_LEFT && depth < CLOCK_MAX_DEPTH; depth++) {
+		clock = clock->parent;
+	}
+
+	return((clock != NULL && clock->chain == CHAIN_LEFT) ? NULL : clock);
+}
+
+
+/**
+ * Return the calibrated clock overhead
+ * @return unsigned long Clock overhead (in ticks), 0 if not calibrated.
+ */
+unsigned long meas_get_overhead(void)
+{
+	return(clock_overhead);
+}
+
+
+/**
+ * Read the clock used by timers
+ * @return unsigned long Current time (in ticks).
+ */
+unsigned long meas_get_ticks(void)
+{
+	return(getjiffies());
+}
+
+
+/**
+ * Make a clock the innermost running clock of the calling thread. Only
+ * the thread owning a chain changes it: a clock still linked in the chain
+ * of another thread (stopped or paused there by this one) is not nested
+ * here, so that no chain ever reaches into another one.
+ * @param clock The clock started or resumed (not running).
+ */
+static void enter_clock(meas_clock *clock)
+{
+	meas_clock **chain = __atomic_load_n(&clock->chain, __ATOMIC_ACQUIRE);
+	meas_clock **link;
+
+	if (chain == &_libmeas_active_clock || chain == CHAIN_LEFT) {
+		/* Left in this chain: unlink before moving it to the head */
+		if ((link = find_link(clock)) != NULL)
+			*link = clock->parent;
+		else if (chain == CHAIN_LEFT)
+			return;
+	} else if (chain != NULL) {
+		return;
+	}
+
+	if (!chain_registered) {
+		pthread_once(&chain_once, chain_key_init);
+		pthread_setspecific(chain_key, &_libmeas_active_clock);
+		chain_registered = TRUE;
+	}
+
+	drop_left();
+	clock->parent = _libmeas_active_clock;
+	_libmeas_active_clock = clock;
+	__atomic_store_n(&clock->chain, &_libmeas_active_clock, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Remove a clock stopped or paused from the chain of running clocks of
+ * the calling thread (also when it is not the innermost one), so that a
+ * clock is never linked twice. A clock linked in the chain of another
+ * thread is only marked as left there, with its parent intact: the
+ * owner unlinks it when it reaches the head of its chain.
+ * @param clock The clock stopped or paused.
+ */
+static void leave_clock(meas_clock *clock)
+{
+	meas_clock **chain = __atomic_load_n(&clock->chain, __ATOMIC_ACQUIRE);
+	meas_clock **link;
+
+	if (chain == &_libmeas_active_clock || chain == CHAIN_LEFT) {
+		if ((link = find_link(clock)) != NULL) {
+			*link = clock->parent;
+			clock->parent = NULL;
+			__atomic_store_n(&clock->chain, NULL, __ATOMIC_RELEASE);
+		}
+	} else if (chain != NULL) {
+		__atomic_compare_exchange_n(&clock->chain, &chain, CHAIN_LEFT, FALSE,
+									__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+
+	drop_left();
+}
+
+
+/**
+ * Unlink the clocks left to other threads from the head of the chain of
+ * the calling thread (their parents are read before they are released:
+ * another thread may nest them at once)
+ */
+static void drop_left(void)
+{
+	meas_clock *head;
+	unsigned int depth;
+
+	for (depth = 0; (head = _libmeas_active_clock) != NULL &&
+			__atomic_load_n(&head->chain, __ATOMIC_ACQUIRE) == CHAIN_LEFT &&
+			depth < CLOCK_MAX_DEPTH; depth++) {
+		_libmeas_active_clock = head->parent;
+		__atomic_store_n(&head->chain, NULL, __ATOMIC_RELEASE);
+	}
+}
+
+
+/**
+ * Find a clock in the chain of running clocks of the calling thread
+ * (at most CLOCK_MAX_DEPTH clocks are followed, through the clocks left
+ * to other threads but never into another chain)
+ * @param clock The clock.
+ * @return meas_clock** The link pointing to the clock or NULL if not found.
+ */
+static meas_clock **find_link(meas_clock *clock)
+{
+	meas_clock **link = &_libmeas_active_clock;
+	meas_clock **chain;
+	unsigned int depth;
+
+	for (depth = 0; *link != NULL && depth < CLOCK_MAX_DEPTH; depth++) {
+		chain = __atomic_load_n(&(*link)->chain, __ATOMIC_ACQUIRE);
+		if (chain != &_libmeas_active_clock && chain != CHAIN_LEFT)
+			break;
+		if (*link == clock)
+			return(link);
+		link = &(*link)->parent;
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * Release the clocks still linked in the chain of an exiting thread, so
+ * that other threads can nest them again
+ * @param arg The chain (head of the thread).
+ */
+static void chain_exit(void *arg)
+{
+	meas_clock **chain = (meas_clock**)arg;
+	meas_clock *clock, *parent;
+	unsigned int depth;
+
+	for (depth = 0, clock = *chain; clock != NULL && depth < CLOCK_MAX_DEPTH; depth++, clock = parent) {
+		parent = clock->parent;
+		__atomic_store_n(&clock->chain, NULL, __ATOMIC_RELEASE);
+	}
+	*chain = NULL;
+	chain_registered = FALSE;
+}
+
+
+/**
+ * Create the key running chain_exit at thread exit
+ */
+static void chain_key_init(void)
+{
+	pthread_key_create(&chain_key, chain_exit);
+}
+
+
 /**
  * Function to count clock ticks of the system
  * This function use the getjiffies() system call. The kernel needs to be
- * patched with getjiffies patch.
+ * patched with getjiffies patch. Otherwise, CLOCK_MONOTONIC nanoseconds are
+ * returned.
  * @return unsigned long
  */
 static unsigned long getjiffies(void)
@@ -100,20 +514,34 @@ static unsigned long getjiffies(void)
 	struct timespec ts;
 
 	if (_libmeas_use_syscall == 1) {
+		/* Check the return value: errno may hold a stale error */
 		jiffies = syscall(SYS_getjiffies);
-		if (errno != 0) {
+		if (jiffies == (unsigned long)-1) {
 			fprintf(stderr, "libmeas CRITICAL ERROR: getjiffies()\n");
 			return(0);
 		}
 	} else {
-		if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
+		if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
 			fprintf(stderr, "libmeas CRITICAL ERROR: clock_gettime(): %s\n", strerror(errno));
 			return(0);
 		}
 
-		jiffies = (unsigned long)ts.tv_nsec;
+		/* Nanoseconds: tv_nsec alone wraps every second */
+		jiffies = ((unsigned long)ts.tv_sec * 1000000000UL) + (unsigned long)ts.tv_nsec;
 	}
 
 	return(jiffies);
 }
 
+
+/**
+ * Compare two unsigned longs (for qsort)
+ */
+static int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long*)a;
+	unsigned long y = *(const unsigned long*)b;
+
+	return((x > y) - (x < y));
+}
+
@@ -0,0 +1,209 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Automatic function instrumentation (built with
+ * -finstrument-functions and linked with libmeas-autoprof)
+ */
+
+#define NLOOPS 1000
+#define NCALLS 1000000
+#define FIB    15
+#define NTHREADS 4
+
+volatile unsigned long sink;
+
+void __attribute__ ((noinline)) leaf(unsigned long n);
+void __attribute__ ((noinline)) middle(void);
+void __attribute__ ((noinline)) skipped(void);
+unsigned long __attribute__ ((noinline)) fib(unsigned int n);
+void __attribute__ ((noinline)) empty(void);
+void __attribute__ ((noinline, no_instrument_function)) empty_plain(void);
+void *worker(void *arg);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_autoprof_func fleaf, fmiddle, ffib, fskipped;
+	unsigned long t_plain, t_hooked;
+	pthread_t thread;
+	double callee;
+	unsigned int i;
+	int ret = 0;
+
+	meas_autoprof_filter("skip*", FALSE);
+
+	for (i = 0; i < NLOOPS; i++) {
+		middle();
+	}
+	fib(FIB);
+
+	if (meas_autoprof_get((void*)leaf, &fleaf) == FALSE ||
+			meas_autoprof_get((void*)middle, &fmiddle) == FALSE ||
+			meas_autoprof_get((void*)fib, &ffib) == FALSE)
+		return(1);
+
+	/* Excluded: its time is self time of middle */
+	if (meas_autoprof_get((void*)skipped, &fskipped) == TRUE)
+		ret = 1;
+
+	printf("leaf: %lu calls, middle: %lu calls, fib: %lu calls\n", fleaf.calls, fmiddle.calls, ffib.calls);
+	if (fleaf.calls != 2 * NLOOPS || fmiddle.calls != NLOOPS || ffib.calls != 1973)
+		ret = 1;
+
+	/* leaf is only called by middle: the callee time of middle is exactly
+	 * the time of leaf in ticks (up to the tick to ns scale, computed by
+	 * each call of meas_autoprof_get) */
+	callee = (double)(fmiddle.inclusive - fmiddle.self);
+	printf("middle callees: %.0f ns, leaf: %llu ns\n", callee, fleaf.inclusive);
+	if (fmiddle.self > fmiddle.inclusive ||
+			fabs(callee - (double)fleaf.inclusive) > 2.0 + 1e-4 * (double)fleaf.inclusive)
+		ret = 1;
+
+	/* Exited threads (one after the other, reusing the same table) */
+	for (i = 0; i < NTHREADS; i++) {
+		if (pthread_create(&thread, NULL, worker, NULL) != 0 || pthread_join(thread, NULL) != 0)
+			return(1);
+	}
+
+	if (meas_autoprof_get((void*)middle, &fmiddle) == FALSE ||
+			meas_autoprof_get((void*)skipped, &fskipped) == TRUE)
+		return(1);
+
+	printf("middle: %lu calls after %d threads\n", fmiddle.calls, NTHREADS);
+	if (fmiddle.calls != (NTHREADS + 1) * NLOOPS)
+		ret = 1;
+
+	/* Cost of the hooks */
+	t_plain = meas_get_ticks();
+	for (i = 0; i < NCALLS; i++) {
+		empty_plain();
+	}
+	t_plain = meas_get_ticks() - t_plain;
+
+	t_hooked = meas_get_ticks();
+	for (i = 0; i < NCALLS; i++) {
+		empty();
+	}
+	t_hooked = meas_get_ticks() - t_hooked;
+
+	printf("hooks: %.1f ticks per call\n", (double)(t_hooked - t_plain) / NCALLS);
+
+	if (meas_autoprof_write(stdout) < 4)
+		ret = 1;
+
+	return(ret);
+}
+
+
+/**
+ * Thread timing middle
+ * @param arg Unused.
+ * @return NULL.
+ */
+void *worker(void *arg)
+{
+	unsigned int i;
+
+	for (i = 0; i < NLOOPS; i++) {
+		middle();
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * CPU-bound work
+ * @param n Number of iterations.
+ */
+void leaf(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		sink += i;
+	}
+}
+
+
+/**
+ * Two timed callees and one excluded
+ */
+void middle(void)
+{
+	leaf(1000);
+	skipped();
+	leaf(1000);
+}
+
+
+/**
+ * Excluded by the filter
+ */
+void skipped(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < 2000; i++) {
+		sink ^= i;
+	}
+}
+
+
+/**
+ * Recursive calls
+ * @param n Rank.
+ * @return unsigned long Fibonacci number.
+ */
+unsigned long fib(unsigned int n)
+{
+	return((n < 2) ? n : fib(n - 1) + fib(n - 2));
+}
+
+
+/**
+ * Empty function (hooked)
+ */
+void empty(void)
+{
+	__asm__ volatile ("");
+}
+
+
+/**
+ * Empty function (not hooked)
+ */
+void empty_plain(void)
+{
+	__asm__ volatile ("");
+}
+
@@ -0,0 +1,165 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <meas.h>
+
+/*
+ * Test - Time budgets: overruns, rate limit and hangs caught by the
+ * watchdog; budgets released with pending notifications or while running,
+ * and re-armed.
+ */
+
+#define NLOOPS    100
+#define NOVER     10
+#define BUDGET    1000000UL		/* 1 ms */
+#define HANG      50000			/* us */
+#define NREARMS   1000
+
+int overruns, hangs;
+
+void on_budget(meas_clock *clock, int kind, unsigned long interval, unsigned long time, void *ctx);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *t_loop, *t_limited, *t_hang;
+	meas_budget *seen[NREARMS];
+	unsigned int i, j, nseen = 0;
+	int delivered, ret = 0;
+
+	meas_init(&mst);
+
+	t_loop    = meas_start_clock(&mst, NULL, "T_LOOP");
+	meas_stop_clock(t_loop);
+	t_limited = meas_start_clock(&mst, NULL, "T_LIMITED");
+	meas_stop_clock(t_limited);
+	t_hang    = meas_start_clock(&mst, NULL, "T_HANG");
+	meas_stop_clock(t_hang);
+
+	meas_clock_budget(&mst, t_loop, BUDGET, 0, on_budget, NULL);
+	meas_clock_budget(&mst, t_limited, BUDGET, 1000000000UL, on_budget, NULL);
+	meas_clock_budget(&mst, t_hang, 5 * BUDGET, 0, on_budget, NULL);
+
+	/* Every tenth interval over budget */
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, t_loop, NULL);
+		if (i % (NLOOPS / NOVER) == 0)
+			usleep(2000);
+		meas_stop_clock(t_loop);
+	}
+
+	/* Callbacks only run when drained */
+	if (overruns != 0 || t_loop->budget->overruns != NOVER || t_loop->budget->worst < 2 * BUDGET)
+		ret = 1;
+	delivered = meas_budget_drain(&mst);
+	printf("%d overruns delivered\n", delivered);
+	if (delivered != NOVER || overruns != NOVER)
+		ret = 1;
+
+	/* One notification per second at most */
+	for (i = 0; i < 5; i++) {
+		meas_start_clock(NULL, t_limited, NULL);
+		usleep(2000);
+		meas_stop_clock(t_limited);
+	}
+	delivered = meas_budget_drain(&mst);
+	if (delivered != 1 || t_limited->budget->suppressed != 4)
+		ret = 1;
+
+	/* Hang caught while still running */
+	meas_watchdog_start(&mst, 1);
+	meas_start_clock(NULL, t_hang, NULL);
+	usleep(HANG);
+	printf("hangs seen before the end of the region: %d\n", hangs);
+	if (hangs != 1)
+		ret = 1;
+	meas_stop_clock(t_hang);
+	meas_watchdog_stop(&mst);
+	meas_budget_drain(&mst);
+
+	if (t_hang->budget->running != 1 || t_hang->budget->overruns != 1 || meas_budget_dropped(&mst) != 0)
+		ret = 1;
+
+	/* Pending notifications of a released budget are discarded */
+	meas_start_clock(NULL, t_loop, NULL);
+	usleep(2000);
+	meas_stop_clock(t_loop);
+	meas_clock_release_budget(t_loop);
+	if (meas_budget_drain(&mst) != 0)
+		ret = 1;
+
+	/* Released while running, with the watchdog scanning */
+	meas_clock_budget(&mst, t_loop, BUDGET, 0, on_budget, NULL);
+	meas_watchdog_start(&mst, 1);
+	meas_start_clock(NULL, t_loop, NULL);
+	usleep(2000);
+	meas_clock_release_budget(t_loop);
+	usleep(2000);
+	meas_stop_clock(t_loop);
+	meas_watchdog_stop(&mst);
+	meas_budget_drain(&mst);
+	if (t_loop->budget != NULL)
+		ret = 1;
+
+	/* Re-armed budgets reuse the released ones */
+	for (i = 0; i < NREARMS; i++) {
+		if (meas_clock_budget(&mst, t_loop, BUDGET, 0, on_budget, NULL) == FALSE ||
+				t_loop->budget->overruns != 0)
+			ret = 1;
+
+		for (j = 0; j < nseen && seen[j] != t_loop->budget; j++);
+		if (j == nseen && nseen < NREARMS)
+			seen[nseen++] = t_loop->budget;
+		meas_clock_release_budget(t_loop);
+	}
+	printf("%d re-arms: %u distinct budgets\n", NREARMS, nseen);
+	if (nseen > 3)
+		ret = 1;
+
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Budget notification
+ */
+void on_budget(meas_clock *clock, int kind, unsigned long interval, unsigned long time, void *ctx)
+{
+	if (kind == MEAS_BUDGET_RUNNING) {
+		printf("%s running for %lu ticks\n", clock->name, interval);
+		__atomic_add_fetch(&hangs, 1, __ATOMIC_RELAXED);
+	} else if (clock->budget->min_gap == 0 && clock->budget->budget == BUDGET) {
+		__atomic_add_fetch(&overruns, 1, __ATOMIC_RELAXED);
+	}
+}
+
@@ -0,0 +1,171 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <meas.h>
+
+/*
+ * Test - Trace compression: size and speed on a timer trace, exact
+ * decoding, memory and file outputs.
+ */
+
+#define NEVENTS 2000000UL
+#define NTIMERS 8
+#define MEM_SIZE (16 * 1024 * 1024)
+
+/**
+ * Reference trace
+ */
+struct trace {
+	unsigned long long *ts;
+	long *value;
+	int *id;
+	unsigned long pos;
+	int mismatch;
+};
+
+static const char *names[NTIMERS] = {
+	"T_READ", "T_FILTER", "T_CONTROL", "T_WRITE", "T_LOG", "T_IDLE", "T_COMM", "T_WATCHDOG"
+};
+
+int check(unsigned long long ts, const char *name, long value, void *ctx);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_codec enc;
+	meas_codec_mem mem;
+	struct trace tr;
+	unsigned long long seed = 88172645463325252ULL, now = 1000000;
+	unsigned long i, t_enc, t_dec;
+	int ids[NTIMERS], j, ret = 0;
+	long n;
+	double raw, ratio;
+	FILE *fp;
+
+	tr.ts    = (unsigned long long*)malloc(sizeof(unsigned long long) * NEVENTS);
+	tr.value = (long*)malloc(sizeof(long) * NEVENTS);
+	tr.id    = (int*)malloc(sizeof(int) * NEVENTS);
+	mem.base = (char*)malloc(MEM_SIZE);
+	mem.size = MEM_SIZE;
+	mem.used = 0;
+	if (tr.ts == NULL || tr.value == NULL || tr.id == NULL || mem.base == NULL)
+		return(1);
+
+	/* Cyclic timers: 10 us period with a few ticks of jitter */
+	for (i = 0; i < NEVENTS; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		j = (int)(i % NTIMERS);
+		now += 1250 + (seed % 8);
+		tr.ts[i]    = now;
+		tr.id[i]    = j;
+		tr.value[i] = 400 + (j * 100) + (long)((seed >> 8) % 32);
+	}
+
+	meas_codec_init(&enc, 0, meas_codec_mem_sink, &mem);
+	for (j = 0; j < NTIMERS; j++) {
+		ids[j] = meas_codec_name(&enc, names[j]);
+	}
+
+	t_enc = meas_get_ticks();
+	for (i = 0; i < NEVENTS; i++) {
+		meas_codec_put(&enc, ids[tr.id[i]], tr.ts[i], tr.value[i]);
+	}
+	meas_codec_flush(&enc);
+	t_enc = meas_get_ticks() - t_enc;
+
+	/* Raw: 64-bit timestamp, 64-bit value and a 32-bit name id */
+	raw   = (double)NEVENTS * (sizeof(unsigned long long) + sizeof(long) + sizeof(int));
+	ratio = raw / (double)mem.used;
+	printf("%lu events: %lu bytes (%.2f bytes/event), ratio %.1fx\n", NEVENTS, mem.used,
+		   (double)mem.used / NEVENTS, ratio);
+	printf("encoding: %.1f ns/event, %.0f MB/s of raw trace\n", (double)t_enc / NEVENTS,
+		   (raw / 1e6) / ((double)t_enc / 1e9));
+	if (ratio < 5.0 || enc.dropped > 0)
+		ret = 1;
+
+	tr.pos = 0;
+	tr.mismatch = 0;
+	t_dec = meas_get_ticks();
+	n = meas_codec_decode(mem.base, mem.used, check, &tr);
+	t_dec = meas_get_ticks() - t_dec;
+	printf("decoding: %.1f ns/event\n", (double)t_dec / NEVENTS);
+	if (n != (long)NEVENTS || tr.mismatch)
+		ret = 1;
+
+	/* Truncated data is detected */
+	if (meas_codec_decode(mem.base, mem.used - 1, NULL, NULL) >= 0)
+		ret = 1;
+
+	meas_codec_free(&enc);
+
+	/* File output */
+	if ((fp = tmpfile()) == NULL)
+		return(1);
+	meas_codec_init(&enc, 256, meas_codec_file_sink, fp);
+	ids[0] = meas_codec_name(&enc, names[0]);
+	for (i = 0; i < 1000; i++) {
+		meas_codec_put(&enc, ids[0], tr.ts[i], tr.value[i]);
+	}
+	meas_codec_free(&enc);
+
+	mem.used = (unsigned long)ftell(fp);
+	rewind(fp);
+	if (fread(mem.base, 1, mem.used, fp) != mem.used || enc.blocks != 4 ||
+			meas_codec_decode(mem.base, mem.used, NULL, NULL) < 0) {
+		fprintf(stderr, "file output failed\n");
+		ret = 1;
+	}
+	fclose(fp);
+
+	free(tr.ts);
+	free(tr.value);
+	free(tr.id);
+	free(mem.base);
+	return(ret);
+}
+
+
+/**
+ * Compare a decoded event with the reference trace
+ */
+int check(unsigned long long ts, const char *name, long value, void *ctx)
+{
+	struct trace *tr = (struct trace*)ctx;
+	unsigned long i = tr->pos++;
+
+	if (i >= NEVENTS || ts != tr->ts[i] || value != tr->value[i] ||
+			strcmp(name, names[tr->id[i]]) != 0) {
+		tr->mismatch = 1;
+		return(FALSE);
+	}
+
+	return(TRUE);
+}
+
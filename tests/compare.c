@@ -0,0 +1,209 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <meas.h>
+
+/*
+ * Test - Save runs and compare them against a baseline
+ */
+
+#define NSAMPLES 30
+
+void write_run(FILE *fp, double slow_factor, double fast_factor, int shift);
+meas_run *reload(FILE *fp);
+int verdict(meas_cmp_result *res, unsigned int n, const char *name);
+void bench_nop(void *ctx);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *clock;
+	meas_run *base, *cur, *saved;
+	meas_cmp_opts opts;
+	meas_cmp_result *res;
+	meas_bench_opts bopts;
+	unsigned int n, i;
+	int method;
+	FILE *fb, *fc, *fs;
+
+	/* Synthetic runs with known differences */
+	fb = tmpfile();
+	fc = tmpfile();
+	write_run(fb, 1.0, 1.0, 0);
+	write_run(fc, 1.2, 0.8, 7);
+	base = reload(fb);
+	cur  = reload(fc);
+
+	if (base == NULL || cur == NULL)
+		return(1);
+
+	for (method = MEAS_CMP_MANN_WHITNEY; method <= MEAS_CMP_BOOTSTRAP; method++) {
+		meas_cmp_defaults(&opts);
+		opts.method = method;
+
+		if (meas_compare_runs(base, cur, &opts, &res, &n) == FALSE)
+			return(1);
+
+		printf("method %d: %u metrics\n", method, n);
+		if (verdict(res, n, "B_SAME") != MEAS_CMP_UNCHANGED ||
+				verdict(res, n, "B_SLOW") != MEAS_CMP_REGRESSION ||
+				verdict(res, n, "B_FAST") != MEAS_CMP_IMPROVEMENT ||
+				verdict(res, n, "T_SINGLE") != MEAS_CMP_UNTESTED ||
+				verdict(res, n, "B_ONLY_BASE") != -1)
+			return(1);
+
+		free(res);
+	}
+
+	meas_free_run(&base);
+	meas_free_run(&cur);
+
+	/* Round trip of a real structure */
+	meas_init(&mst);
+	meas_create_counter(&mst, 42, "C_ANSWER");
+	clock = meas_start_clock(&mst, NULL, "T WITH SPACES");
+	meas_stop_clock(clock);
+	for (i = 0; i < 2; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		meas_stop_clock(clock);
+	}
+
+	meas_bench_defaults(&bopts);
+	bopts.warmup_time = 1000000UL;
+	bopts.sample_time =  100000UL;
+	bopts.nsamples    = 10;
+	meas_bench_run(&mst, "B_NOP", bench_nop, NULL, &bopts);
+
+	fs = tmpfile();
+	meas_save_run(mst, fs);
+	if ((saved = reload(fs)) == NULL || llist_length(saved->metrics) != 3)
+		return(1);
+
+	if (meas_compare_runs(saved, saved, NULL, &res, &n) == FALSE || n != 3 ||
+			verdict(res, n, "T_WITH_SPACES") != MEAS_CMP_UNTESTED ||
+			verdict(res, n, "B_NOP") != MEAS_CMP_UNCHANGED)
+		return(1);
+
+	/* Plain timers are saved as summaries of every interval */
+	for (i = 0; i < n && strcmp(res[i].name, "T_WITH_SPACES") != 0; i++);
+	if (i == n || !res[i].summary || res[i].nbase != 3 || res[i].verdict != MEAS_CMP_UNTESTED)
+		return(1);
+
+	free(res);
+	meas_free_run(&saved);
+	meas_close(&mst);
+	fclose(fb);
+	fclose(fc);
+	fclose(fs);
+
+	printf("OK\n");
+	return(0);
+}
+
+
+/**
+ * Write a synthetic run
+ * @param fp Output stream.
+ * @param slow_factor Factor applied to B_SLOW.
+ * @param fast_factor Factor applied to B_FAST.
+ * @param shift Rotation of the sample order (same distribution, other order).
+ */
+void write_run(FILE *fp, double slow_factor, double fast_factor, int shift)
+{
+	int i;
+	double v;
+
+	fprintf(fp, "libmeas-run 1\n");
+
+	fprintf(fp, "bench B_SAME %d", NSAMPLES);
+	for (i = 0; i < NSAMPLES; i++) {
+		v = 1000.0 + ((i + shift) % NSAMPLES) * 3.0;
+		fprintf(fp, " %f", v);
+	}
+
+	fprintf(fp, "\nbench B_SLOW %d", NSAMPLES);
+	for (i = 0; i < NSAMPLES; i++) {
+		fprintf(fp, " %f", (1000.0 + i * 3.0) * slow_factor);
+	}
+
+	fprintf(fp, "\nbench B_FAST %d", NSAMPLES);
+	for (i = 0; i < NSAMPLES; i++) {
+		fprintf(fp, " %f", (1000.0 + i * 3.0) * fast_factor);
+	}
+
+	fprintf(fp, "\ntimer T_SINGLE 1 %f\n", 500.0 * slow_factor);
+
+	if (shift == 0)
+		fprintf(fp, "bench B_ONLY_BASE 2 1 2\n");
+}
+
+
+/**
+ * Load a run from the beginning of a stream
+ * @param fp Stream.
+ * @return meas_run* The run.
+ */
+meas_run *reload(FILE *fp)
+{
+	rewind(fp);
+	return(meas_load_run(fp));
+}
+
+
+/**
+ * Verdict of a metric
+ * @param res Comparison results.
+ * @param n Number of results.
+ * @param name Metric name.
+ * @return int The verdict or -1 if the metric was not compared.
+ */
+int verdict(meas_cmp_result *res, unsigned int n, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(res[i].name, name) == 0) {
+			printf("  %-14s %10.1f %10.1f %+6.1f%% p=%.2e verdict=%d\n", name,
+					res[i].base_median, res[i].cur_median, res[i].change * 100.0,
+					res[i].p_value, res[i].verdict);
+			return(res[i].verdict);
+		}
+	}
+	return(-1);
+}
+
+
+/**
+ * Empty benchmark
+ * @param ctx Not used.
+ */
+void bench_nop(void *ctx)
+{
+	;
+}
+
@@ -0,0 +1,143 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <meas.h>
+
+/*
+ * Test - CPU placement of timers: per-CPU breakdown and migrations.
+ */
+
+#define NLOOPS 10000
+#define SPIN   1000
+
+volatile unsigned long sink;
+
+int pin(int cpu);
+void spin(unsigned long n);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *clock, *plain;
+	unsigned long t_plain, t_tracked;
+	unsigned int i;
+	long ncpus;
+	int ret = 0;
+
+	meas_init(&mst);
+
+	clock = meas_start_clock(&mst, NULL, "T_TRACKED");
+	meas_stop_clock(clock);
+	plain = meas_start_clock(&mst, NULL, "T_PLAIN");
+	meas_stop_clock(plain);
+
+	if (meas_clock_track_cpus(clock) == FALSE)
+		return(1);
+
+	/* Every interval on CPU 0 */
+	if (pin(0) == FALSE)
+		return(1);
+
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		spin(SPIN);
+		meas_stop_clock(clock);
+	}
+
+	if (clock->cpus->cpu[0].count != NLOOPS || clock->cpus->migrations != 0)
+		ret = 1;
+
+	/* Forced migration in the middle of an interval */
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus > 1) {
+		meas_start_clock(NULL, clock, NULL);
+		pin(1);
+		meas_stop_clock(clock);
+
+		if (clock->cpus->migrations != 1 || clock->cpus->migrated.count != 1)
+			ret = 1;
+	} else {
+		printf("one CPU online: migration not tested\n");
+	}
+
+	/* Cost of tracking (start/stop pairs without work) */
+	t_plain = meas_get_ticks();
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, plain, NULL);
+		meas_stop_clock(plain);
+	}
+	t_plain = meas_get_ticks() - t_plain;
+
+	t_tracked = meas_get_ticks();
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		meas_stop_clock(clock);
+	}
+	t_tracked = meas_get_ticks() - t_tracked;
+
+	printf("start/stop pair: %lu ticks, %lu ticks tracked\n", t_plain / NLOOPS, t_tracked / NLOOPS);
+
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Pin the calling thread to a CPU
+ * @param cpu The CPU.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return(sched_setaffinity(0, sizeof(set), &set) == 0 ? TRUE : FALSE);
+}
+
+
+/**
+ * CPU-bound work
+ * @param n Number of iterations.
+ */
+void spin(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		sink += i;
+	}
+}
+
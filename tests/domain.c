@@ -0,0 +1,140 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <meas.h>
+
+/*
+ * Test - Multi-process aggregation: workers publish to a shared domain,
+ * one of them dies without detaching.
+ */
+
+#define NWORKERS 3
+#define NEVENTS  1000
+#define NLOOPS   10
+
+volatile unsigned long sink;
+
+void worker(const char *domain, int id);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_interval *totals;
+	unsigned int n, i;
+	char domain[MAX_NAME_SIZE];
+	long events = 0;
+	unsigned long loops = 0;
+	int status, ret = 0, reaped;
+	pid_t pids[NWORKERS];
+
+	snprintf(domain, sizeof(domain), "test-%d", (int)getpid());
+
+	for (i = 0; i < NWORKERS; i++) {
+		if ((pids[i] = fork()) == 0)
+			worker(domain, i);
+	}
+
+	for (i = 0; i < NWORKERS; i++) {
+		waitpid(pids[i], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			ret = 1;
+	}
+
+	meas_domain_report(domain, MEAS_DOMAIN_PROCESSES | MEAS_DOMAIN_TOTAL, stdout);
+
+	if (meas_domain_totals(domain, &totals, &n) == FALSE) {
+		meas_domain_unlink(domain);
+		return(1);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(totals[i].name, "C_EVENTS") == 0)
+			events = totals[i].value;
+		if (strcmp(totals[i].name, "T_WORK") == 0)
+			loops = totals[i].count;
+	}
+	free(totals);
+
+	printf("C_EVENTS total: %ld, T_WORK intervals: %lu\n", events, loops);
+	if (events != NEVENTS * (NWORKERS * (NWORKERS + 1) / 2) || loops != (NLOOPS + 1) * NWORKERS)
+		ret = 1;
+
+	/* Exited and dead workers are reaped */
+	reaped = meas_domain_reap(domain);
+	printf("%d slots reaped\n", reaped);
+	if (reaped != NWORKERS || meas_domain_totals(domain, &totals, &n) == FALSE || n != 0)
+		ret = 1;
+
+	meas_domain_unlink(domain);
+	return(ret);
+}
+
+
+/**
+ * Worker process
+ * @param domain Name of the domain.
+ * @param id Worker number (the last one dies without detaching).
+ */
+void worker(const char *domain, int id)
+{
+	meas_t *mst;
+	meas_counter *events;
+	meas_clock *t_work;
+	char tag[MAX_NAME_SIZE];
+	int i;
+
+	meas_init(&mst);
+	snprintf(tag, sizeof(tag), "worker%d", id);
+	if (meas_domain_attach(&mst, domain, tag) == NULL)
+		_exit(1);
+
+	events = meas_create_counter(&mst, 0, "C_EVENTS");
+	t_work = meas_start_clock(&mst, NULL, "T_WORK");
+	meas_stop_clock(t_work);
+
+	for (i = 0; i < NEVENTS * (id + 1); i++) {
+		meas_inc_counter(events);
+	}
+
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, t_work, NULL);
+		sink += i;
+		meas_stop_clock(t_work);
+	}
+
+	meas_domain_publish(mst->domain);
+
+	if (id == NWORKERS - 1)
+		_exit(0);
+
+	meas_close(&mst);
+	_exit(0);
+}
+
@@ -0,0 +1,147 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Interval harvesting while writer threads keep counting: no event
+ * may be lost or counted twice (nor a stop of a stopped timer counted).
+ */
+
+#define NTHREADS 4
+#define LOOPS    200000
+
+meas_t *mst;
+meas_counter *c_events;
+meas_clock *timers[NTHREADS];
+
+void *writer(void *arg);
+void harvest(long *events, unsigned long *intervals, int *nharvests);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	pthread_t threads[NTHREADS];
+	int joined[NTHREADS] = {0};
+	unsigned long intervals = 0;
+	long events = 0;
+	int i, nharvests = 0, running = NTHREADS;
+	char name[MAX_NAME_SIZE];
+
+	meas_init(&mst);
+	c_events = meas_create_counter(&mst, 0, "C_EVENTS");
+
+	for (i = 0; i < NTHREADS; i++) {
+		sprintf(name, "T_WRITER%d", i);
+		timers[i] = meas_start_clock(&mst, NULL, name);
+		meas_stop_clock(timers[i]);
+	}
+
+	/* Drop the creation intervals */
+	harvest(&events, &intervals, &nharvests);
+	events = 0;
+	intervals = 0;
+	nharvests = 0;
+
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_create(&threads[i], NULL, writer, timers[i]);
+	}
+
+	/* Collector: harvest every millisecond while the writers run */
+	while (running > 0) {
+		usleep(1000);
+		harvest(&events, &intervals, &nharvests);
+
+		running = 0;
+		for (i = 0; i < NTHREADS; i++) {
+			if (!joined[i])
+				joined[i] = (pthread_tryjoin_np(threads[i], NULL) == 0);
+			running += !joined[i];
+		}
+	}
+
+	/* Stopping a stopped timer adds no interval */
+	if (meas_stop_clock(timers[0]) == TRUE)
+		intervals++;
+	harvest(&events, &intervals, &nharvests);
+
+	printf("%d harvests: %ld events, %lu timer intervals (expected %d)\n",
+		   nharvests, events, intervals, NTHREADS * LOOPS);
+
+	meas_close(&mst);
+	return((events == NTHREADS * LOOPS && intervals == NTHREADS * LOOPS) ? 0 : 1);
+}
+
+
+/**
+ * Count events and time each one
+ * @param arg Timer of the thread.
+ */
+void *writer(void *arg)
+{
+	meas_clock *clock = (meas_clock*)arg;
+	int i;
+
+	for (i = 0; i < LOOPS; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		meas_inc_counter(c_events);
+		meas_stop_clock(clock);
+	}
+
+	return(NULL);
+}
+
+
+/**
+ * Harvest an interval and add it to the totals
+ * @param events Total of events.
+ * @param intervals Total of timer intervals.
+ * @param nharvests Number of harvests.
+ */
+void harvest(long *events, unsigned long *intervals, int *nharvests)
+{
+	meas_interval *values;
+	unsigned int n, i;
+
+	if (meas_snapshot_reset(&mst, &values, &n, NULL) == FALSE)
+		return;
+
+	for (i = 0; i < n; i++) {
+		if (values[i].kind == MEAS_RUN_COUNTER) {
+			*events += values[i].value;
+		} else {
+			*intervals += values[i].count;
+		}
+	}
+
+	free(values);
+	(*nharvests)++;
+}
+
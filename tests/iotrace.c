@@ -0,0 +1,174 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <meas.h>
+
+/*
+ * Test - Blocking I/O tracing (linked with libmeas-iotrace; any program
+ * can be traced with LD_PRELOAD=libmeas-iotrace.so instead)
+ */
+
+#define NWRITES  64
+#define BLOCK    4096
+#define NPREADS  16
+#define NSENDS   1000
+#define NOPENS   20000
+#define NALARMS  200
+
+static int sv[2];
+static volatile int alarms = 0;
+
+void *sender(void *arg);
+void on_alarm(int sig);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	char path[64], buf[BLOCK];
+	meas_iotrace_file st;
+	pthread_t tid;
+	unsigned long got;
+	struct itimerval timer;
+	ssize_t n;
+	int fd, i, ret = 0;
+
+	snprintf(path, sizeof(path), "/tmp/meas_iotrace_%d", (int)getpid());
+	memset(buf, 'x', sizeof(buf));
+
+	/* Sequential writes, sync and positioned reads */
+	if ((fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0600)) < 0)
+		return(1);
+	for (i = 0; i < NWRITES; i++) {
+		write(fd, buf, BLOCK);
+	}
+	fsync(fd);
+	for (i = 0; i < NPREADS; i++) {
+		pread(fd, buf, BLOCK, (off_t)i * BLOCK);
+	}
+
+	if (meas_iotrace_fd(fd, &st) == FALSE || strcmp(st.path, path) != 0)
+		ret = 1;
+	close(fd);
+
+	/* Reopened: same file */
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return(1);
+	while (read(fd, buf, BLOCK) > 0);
+	close(fd);
+	unlink(path);
+
+	if (open("/nonexistent/meas_iotrace", O_RDONLY) >= 0)
+		ret = 1;
+
+	/* Socket written by another thread */
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0 ||
+			pthread_create(&tid, NULL, sender, NULL) != 0)
+		return(1);
+	for (got = 0; got < NSENDS * 64 && (n = recv(sv[1], buf, 64, 0)) > 0; got += n);
+	pthread_join(tid, NULL);
+
+	if (meas_iotrace_path(path, &st) == FALSE)
+		return(1);
+
+	printf("%s: %lu opens, %lu writes (%llu bytes), %lu reads (%llu bytes), %lu syncs\n", path,
+		   st.op[MEAS_IOTRACE_OPEN].calls, st.op[MEAS_IOTRACE_WRITE].calls,
+		   st.op[MEAS_IOTRACE_WRITE].bytes, st.op[MEAS_IOTRACE_READ].calls,
+		   st.op[MEAS_IOTRACE_READ].bytes, st.op[MEAS_IOTRACE_SYNC].calls);
+
+	if (st.op[MEAS_IOTRACE_OPEN].calls != 2 || st.op[MEAS_IOTRACE_CLOSE].calls != 2 ||
+			st.op[MEAS_IOTRACE_WRITE].calls != NWRITES ||
+			st.op[MEAS_IOTRACE_WRITE].bytes != NWRITES * BLOCK ||
+			st.op[MEAS_IOTRACE_SYNC].calls != 1 ||
+			st.op[MEAS_IOTRACE_READ].bytes != (NPREADS + NWRITES) * BLOCK ||
+			st.op[MEAS_IOTRACE_SYNC].max < 1)
+		ret = 1;
+
+	if (meas_iotrace_path("/nonexistent/meas_iotrace", &st) == FALSE ||
+			st.op[MEAS_IOTRACE_OPEN].errors != 1)
+		ret = 1;
+
+	if (meas_iotrace_fd(sv[1], &st) == FALSE || st.op[MEAS_IOTRACE_READ].bytes != NSENDS * 64 ||
+			meas_iotrace_fd(sv[0], &st) == FALSE || st.op[MEAS_IOTRACE_WRITE].calls != NSENDS)
+		ret = 1;
+
+	if (meas_iotrace_write(stdout) < 4)
+		ret = 1;
+
+	/* Signal handlers doing I/O while the thread is inside the tracer */
+	signal(SIGALRM, on_alarm);
+	timer.it_interval.tv_sec  = 0;
+	timer.it_interval.tv_usec = 100;
+	timer.it_value = timer.it_interval;
+	setitimer(ITIMER_REAL, &timer, NULL);
+	for (i = 0; i < NOPENS || alarms < NALARMS; i++) {
+		snprintf(path, sizeof(path), "/nonexistent/meas_iotrace_%d", i % 2000);
+		open(path, O_RDONLY);
+	}
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_REAL, &timer, NULL);
+	printf("%d alarms during %d opens\n", alarms, i);
+
+	return(ret);
+}
+
+
+/**
+ * Send NSENDS messages of 64 bytes
+ */
+void *sender(void *arg)
+{
+	char msg[64];
+	int i;
+
+	memset(msg, 'y', sizeof(msg));
+	for (i = 0; i < NSENDS; i++) {
+		send(sv[0], msg, sizeof(msg), 0);
+	}
+	return(NULL);
+}
+
+
+/**
+ * Write to a pipe not yet named (the tracer would intern its path)
+ */
+void on_alarm(int sig)
+{
+	int p[2];
+
+	if (pipe(p) == 0) {
+		write(p[1], "x", 1);
+		close(p[0]);
+		close(p[1]);
+	}
+	alarms++;
+}
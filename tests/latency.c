@@ -0,0 +1,97 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <meas.h>
+
+/*
+ * Test - Wakeup latency probe (cyclictest-style)
+ * Usage: latency [-t threads] [-i interval ns] [-l loops] [-p fifo priority]
+ * Defaults are short enough for "make check"; run it on the target board
+ * with more loops and -p to validate a real-time kernel.
+ */
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_latency *lat;
+	meas_latency_opts opts;
+	cpu_set_t allowed;
+	unsigned int i;
+	int opt, ret = 0;
+
+	meas_latency_defaults(&opts);
+	opts.loops = 200;
+
+	while ((opt = getopt(argc, argv, "t:i:l:p:")) != -1) {
+		switch (opt) {
+			case 't':
+				opts.nthreads = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				opts.interval = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				opts.loops = strtoul(optarg, NULL, 10);
+				break;
+			case 'p':
+				opts.priority = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-t threads] [-i interval] [-l loops] [-p priority]\n", argv[0]);
+				return(1);
+		}
+	}
+
+	meas_init(&mst);
+
+	if ((lat = meas_latency_run(&mst, "L_WAKEUP", &opts)) == NULL) {
+		fprintf(stderr, "latency probe failed\n");
+		return(1);
+	}
+
+	/* Every wakeup must be accounted, on a CPU the process may use */
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	for (i = 0; i < lat->nthreads; i++) {
+		if (lat->threads[i].hist.count != opts.loops)
+			ret = 1;
+		if (lat->threads[i].cpu >= 0 && !CPU_ISSET(lat->threads[i].cpu, &allowed))
+			ret = 1;
+	}
+	if (opts.nthreads == 0 && lat->nthreads != (unsigned int)CPU_COUNT(&allowed))
+		ret = 1;
+
+	meas_generate_report(&mst, REPORT_LATENCY);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
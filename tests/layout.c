@@ -0,0 +1,139 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Layout of timers and counters: every element starts a cache line,
+ * threads incrementing their own counter do not share lines.
+ */
+
+#define NTHREADS  4
+#define NINCS     10000000UL
+#define NCOUNTERS 1000
+
+void *incrementer(void *arg);
+int aligned(void *ptr);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst, *rst;
+	meas_counter *counters[NTHREADS], *c;
+	meas_clock *clock;
+	pthread_t tids[NTHREADS];
+	unsigned long t_inc, t_scan;
+	char name[MAX_NAME_SIZE];
+	unsigned int i;
+	int ret = 0;
+
+	meas_init(&mst);
+
+	/* Counters created one after the other (neighbours in memory) */
+	for (i = 0; i < NTHREADS; i++) {
+		sprintf(name, "C_THREAD_%u", i);
+		counters[i] = meas_create_counter(&mst, 0, name);
+		if (!aligned(counters[i]))
+			ret = 1;
+	}
+
+	clock = meas_start_clock(&mst, NULL, "T_LAYOUT");
+	meas_stop_clock(clock);
+	if (!aligned(clock) || !aligned(clock->acc))
+		ret = 1;
+
+	printf("sizeof(meas_counter) = %lu, sizeof(meas_clock) = %lu\n",
+		   (unsigned long)sizeof(meas_counter), (unsigned long)sizeof(meas_clock));
+
+	/* Hard real-time mode takes elements from one block */
+	if (meas_init_rt(&rst, NULL) == FALSE)
+		return(1);
+	for (i = 0; i < 3; i++) {
+		if (!aligned(meas_create_counter(&rst, 0, "C_RT")) ||
+				!aligned(meas_start_clock(&rst, NULL, "T_RT")))
+			ret = 1;
+	}
+	meas_close(&rst);
+
+	/* Concurrent increments of neighbour counters */
+	t_inc = meas_get_ticks();
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_create(&tids[i], NULL, incrementer, counters[i]);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_join(tids[i], NULL);
+		if (meas_get_counter(*counters[i]) != NINCS)
+			ret = 1;
+	}
+	t_inc = meas_get_ticks() - t_inc;
+	printf("%d threads: %.2f ticks per increment\n", NTHREADS, (double)t_inc / NINCS);
+
+	/* Report scan */
+	for (i = 0; i < NCOUNTERS; i++) {
+		sprintf(name, "C_%u", i);
+		c = meas_create_counter(&mst, i, name);
+		if (!aligned(c))
+			ret = 1;
+	}
+	t_scan = meas_get_ticks();
+	meas_generate_report(&mst, REPORT_COUNTERS);
+	t_scan = meas_get_ticks() - t_scan;
+	printf("report of %d counters: %lu ticks\n", NCOUNTERS + NTHREADS, t_scan);
+
+	meas_close(&mst);
+	return(ret);
+}
+
+
+/**
+ * Increment a counter NINCS times
+ * @param arg The counter.
+ */
+void *incrementer(void *arg)
+{
+	meas_counter *counter = (meas_counter*)arg;
+	unsigned long i;
+
+	for (i = 0; i < NINCS; i++) {
+		meas_inc_counter(counter);
+	}
+	return(NULL);
+}
+
+
+/**
+ * Check the cache line alignment of an element
+ * @param ptr The element.
+ * @return TRUE if ptr starts a cache line.
+ */
+int aligned(void *ptr)
+{
+	return(ptr != NULL && ((uintptr_t)ptr % MEAS_CACHE_LINE) == 0);
+}
+
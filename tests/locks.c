@@ -0,0 +1,178 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Lock contention profiling
+ */
+
+#define NTHREADS 4
+#define NLOOPS   10000
+#define HOLD_US  50000
+#define NMANY    120		/* More locks than a thread table holds */
+
+static meas_mutex *m_shared, *m_blocked, *m_rw, *m_many[NMANY];
+static unsigned long total = 0;
+
+void *worker(void *arg);
+void *blocked(void *arg);
+void *lock_many(void *arg);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_mutex *m_idle;
+	meas_lock_stats st, rd;
+	pthread_t tids[NTHREADS], tid;
+	int i, ret = 0;
+
+	meas_init(&mst);
+
+	m_shared  = meas_create_mutex(&mst, "M_SHARED");
+	m_blocked = meas_create_mutex(&mst, "M_BLOCKED");
+	m_rw      = meas_create_rwlock(&mst, "RW_TABLE");
+	m_idle    = meas_create_mutex(&mst, NULL);
+
+	/* Uncontended */
+	meas_mutex_lock(m_idle);
+	meas_mutex_unlock(m_idle);
+
+	/* Forced contention: held while another thread tries to lock */
+	meas_mutex_lock(m_blocked);
+	pthread_create(&tid, NULL, blocked, NULL);
+	usleep(HOLD_US);
+	meas_mutex_unlock(m_blocked);
+	pthread_join(tid, NULL);
+
+	/* Threads sharing a mutex and a read-write lock */
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_create(&tids[i], NULL, worker, NULL);
+	}
+	for (i = 0; i < NTHREADS; i++) {
+		pthread_join(tids[i], NULL);
+	}
+
+	/* Exited threads are kept in the statistics */
+	meas_mutex_stats(m_shared, FALSE, &st);
+	printf("M_SHARED: %lu acquisitions, %lu contended (total %lu)\n", st.acquisitions, st.contended, total);
+	if (st.acquisitions != NTHREADS * NLOOPS || total != NTHREADS * NLOOPS)
+		ret = 1;
+
+	meas_mutex_stats(m_blocked, FALSE, &st);
+	printf("M_BLOCKED: %lu acquisitions, %lu contended, wait max %lu\n", st.acquisitions, st.contended, st.wait_max);
+	if (st.acquisitions != 2 || st.contended != 1 || st.wait_max < (HOLD_US / 2) * 1000UL ||
+			st.hold_max < (HOLD_US / 2) * 1000UL)
+		ret = 1;
+
+	meas_mutex_stats(m_rw, FALSE, &st);
+	meas_mutex_stats(m_rw, TRUE, &rd);
+	if (st.acquisitions != NTHREADS * (NLOOPS / 10) || rd.acquisitions != NTHREADS * NLOOPS)
+		ret = 1;
+
+	meas_mutex_stats(m_idle, FALSE, &st);
+	if (st.acquisitions != 1 || st.contended != 0 || st.wait != 0)
+		ret = 1;
+
+	/* Exited threads using more locks together than a thread table holds */
+	for (i = 0; i < NMANY; i++) {
+		m_many[i] = meas_create_mutex(&mst, NULL);
+	}
+	for (i = 0; i < 2; i++) {
+		pthread_create(&tid, NULL, lock_many, &m_many[i * (NMANY / 2)]);
+		pthread_join(tid, NULL);
+	}
+	for (i = 0; i < NMANY; i++) {
+		meas_mutex_stats(m_many[i], FALSE, &st);
+		if (st.acquisitions != 1)
+			ret = 1;
+	}
+
+	meas_generate_report(&mst, REPORT_LOCKS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Increment the total under the shared mutex, read (and sometimes write)
+ * under the read-write lock
+ */
+void *worker(void *arg)
+{
+	unsigned long v = 0;
+	int i;
+
+	for (i = 0; i < NLOOPS; i++) {
+		meas_mutex_lock(m_shared);
+		total++;
+		meas_mutex_unlock(m_shared);
+
+		meas_mutex_rdlock(m_rw);
+		v += total;
+		meas_mutex_unlock(m_rw);
+
+		if ((i % 10) == 0) {
+			meas_mutex_lock(m_rw);
+			v++;
+			meas_mutex_unlock(m_rw);
+		}
+	}
+	return((void*)v);
+}
+
+
+/**
+ * Lock a mutex held by the main thread
+ */
+void *blocked(void *arg)
+{
+	meas_mutex_lock(m_blocked);
+	meas_mutex_unlock(m_blocked);
+	return(NULL);
+}
+
+
+/**
+ * Lock half of the many locks once
+ * @param arg First lock.
+ */
+void *lock_many(void *arg)
+{
+	meas_mutex **m = (meas_mutex**)arg;
+	int i;
+
+	for (i = 0; i < NMANY / 2; i++) {
+		meas_mutex_lock(m[i]);
+		meas_mutex_unlock(m[i]);
+	}
+	return(NULL);
+}
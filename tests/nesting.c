@@ -0,0 +1,110 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Nesting of running clocks (meas_active_clock) with restarts,
+ * out of order stops and clocks stopped by another thread. A broken
+ * chain used to loop forever: the alarm turns a hang into a failure.
+ */
+
+#define TIMEOUT 10
+
+void *stopper(void *arg);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *a, *b, *c;
+	pthread_t tid;
+	int ret = 0;
+
+	alarm(TIMEOUT);
+	meas_init(&mst);
+
+	/* Restart of an outer clock while an inner one runs */
+	a = meas_start_clock(&mst, NULL, "T_A");
+	b = meas_start_clock(&mst, NULL, "T_B");
+	meas_start_clock(NULL, a, NULL);
+	if (meas_active_clock() != b)
+		ret = 1;
+	meas_stop_clock(a);
+	printf("stopped a\n");
+	if (meas_active_clock() != b)
+		ret = 1;
+	meas_stop_clock(b);
+	if (meas_active_clock() != NULL)
+		ret = 1;
+
+	/* Out of order stop, then restart of the stopped clock */
+	meas_start_clock(NULL, a, NULL);
+	meas_start_clock(NULL, b, NULL);
+	meas_stop_clock(a);
+	meas_start_clock(NULL, a, NULL);
+	if (meas_active_clock() != a)
+		ret = 1;
+	meas_stop_clock(a);
+	if (meas_active_clock() != b)
+		ret = 1;
+	meas_stop_clock(b);
+	if (meas_active_clock() != NULL)
+		ret = 1;
+
+	/* Middle clock stopped by another thread, then restarted here */
+	c = meas_start_clock(&mst, NULL, "T_C");
+	meas_start_clock(NULL, a, NULL);
+	meas_start_clock(NULL, b, NULL);
+	pthread_create(&tid, NULL, stopper, a);
+	pthread_join(tid, NULL);
+	meas_start_clock(NULL, a, NULL);
+	if (meas_active_clock() != a)
+		ret = 1;
+	meas_stop_clock(a);
+	meas_stop_clock(b);
+	meas_stop_clock(c);
+	if (meas_active_clock() != NULL)
+		ret = 1;
+	printf("stopped all\n");
+
+	meas_close(&mst);
+	return(ret);
+}
+
+
+/**
+ * Stop a clock started by the main thread
+ * @param arg The timer.
+ */
+void *stopper(void *arg)
+{
+	meas_stop_clock((meas_clock*)arg);
+	return(NULL);
+}
+
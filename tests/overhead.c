@@ -0,0 +1,199 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <meas.h>
+
+/*
+ * Benchmark - Cost of libmeas itself
+ */
+
+/**
+ * Number of metrics used by the scaling benchmarks
+ */
+static unsigned int sizes[] = {10, 1000, 100000};
+
+#define NSIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+/**
+ * Number of empty regions measured after calibration
+ */
+#define CALIBRATION_CHECKS 1000
+
+/**
+ * Registration / report context
+ */
+struct scale_ctx {
+	unsigned int nmetrics;
+	meas_t *mst;
+};
+
+void bench_inc(void *ctx);
+void bench_start_stop(void *ctx);
+void bench_register(void *ctx);
+void bench_report(void *ctx);
+void fill(meas_t **mst, unsigned int nmetrics);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_counter *counter;
+	meas_clock *clock;
+	meas_bench_opts opts, slow;
+	struct scale_ctx ctx[NSIZES];
+	char name[MAX_NAME_SIZE];
+	unsigned long total;
+	unsigned int i;
+
+	meas_init(&mst);
+
+	meas_bench_defaults(&opts);
+	opts.warmup_time = 20000000UL;
+	opts.sample_time =  2000000UL;
+	opts.nsamples    = 20;
+
+	/* Big registrations and reports take longer than a sample */
+	slow = opts;
+	slow.warmup_time = 0;
+	slow.sample_time = 0;
+	slow.nsamples    = 5;
+
+	/* Per-call costs */
+	counter = meas_create_counter(&mst, 0, "C_BENCH");
+	meas_bench_run(&mst, "COUNTER_INC", bench_inc, counter, &opts);
+
+	clock = meas_start_clock(&mst, NULL, "T_BENCH");
+	meas_stop_clock(clock);
+	meas_bench_run(&mst, "START_STOP", bench_start_stop, clock, &opts);
+
+	/* Scaling with the number of metrics */
+	for (i = 0; i < NSIZES; i++) {
+		ctx[i].nmetrics = sizes[i];
+
+		sprintf(name, "REGISTER_%u", sizes[i]);
+		if (meas_bench_run(&mst, name, bench_register, &ctx[i],
+					sizes[i] > 1000 ? &slow : &opts) == NULL)
+			return(1);
+
+		meas_init(&ctx[i].mst);
+		fill(&ctx[i].mst, sizes[i]);
+
+		sprintf(name, "REPORT_%u", sizes[i]);
+		if (meas_bench_run(&mst, name, bench_report, &ctx[i],
+					sizes[i] > 1000 ? &slow : &opts) == NULL)
+			return(1);
+
+		meas_close(&ctx[i].mst);
+	}
+
+	/* Calibration */
+	meas_add_report_item(&mst, "CLOCK_OVERHEAD", "%ld\n", meas_calibrate(0));
+
+	/* Empty regions should now measure (close to) zero */
+	meas_compensate_overhead(TRUE);
+	for (i = 0, total = 0; i < CALIBRATION_CHECKS; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		meas_stop_clock(clock);
+		total += clock->interv;
+	}
+	meas_compensate_overhead(FALSE);
+	meas_add_report_item(&mst, "EMPTY_COMPENSATED_AVG", "%ld\n", total / CALIBRATION_CHECKS);
+
+	meas_generate_report(&mst, REPORT_BENCHMARKS | REPORT_USER_ITEMS);
+	meas_write_report(mst, stdout);
+
+	meas_close(&mst);
+	return(0);
+}
+
+
+/**
+ * Counter increment
+ * @param ctx The counter.
+ */
+void bench_inc(void *ctx)
+{
+	meas_inc_counter((meas_counter*)ctx);
+}
+
+
+/**
+ * Empty start/stop pair
+ * @param ctx The clock.
+ */
+void bench_start_stop(void *ctx)
+{
+	meas_start_clock(NULL, (meas_clock*)ctx, NULL);
+	meas_stop_clock((meas_clock*)ctx);
+}
+
+
+/**
+ * Register nmetrics counters and timers in a new structure
+ * @param ctx Scale context.
+ */
+void bench_register(void *ctx)
+{
+	struct scale_ctx *c = (struct scale_ctx*)ctx;
+	meas_t *mst;
+
+	meas_init(&mst);
+	fill(&mst, c->nmetrics);
+	meas_close(&mst);
+}
+
+
+/**
+ * Generate a report of nmetrics counters and timers
+ * @param ctx Scale context.
+ */
+void bench_report(void *ctx)
+{
+	struct scale_ctx *c = (struct scale_ctx*)ctx;
+
+	meas_generate_report(&c->mst, REPORT_TIMERS | REPORT_COUNTERS);
+}
+
+
+/**
+ * Create nmetrics counters and timers
+ * @param mst The meas user structure.
+ * @param nmetrics Number of metrics of each kind.
+ */
+void fill(meas_t **mst, unsigned int nmetrics)
+{
+	meas_clock *clock;
+	char name[MAX_NAME_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < nmetrics; i++) {
+		sprintf(name, "METRIC_%u", i);
+		meas_create_counter(mst, i, name);
+		clock = meas_start_clock(mst, NULL, name);
+		meas_stop_clock(clock);
+	}
+}
+
@@ -0,0 +1,230 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Pausable timers: an operation started in one thread, paused,
+ * and resumed and stopped in another one. A timer paused by another
+ * thread leaves the chain of running clocks of its owner intact, is no
+ * longer its active clock once resumed elsewhere, and is released when
+ * its owner exits.
+ */
+
+#define WAIT_US  20000
+#define NOPS     5
+
+volatile unsigned long sink;
+meas_clock *crosser_active;
+
+void *resumer(void *arg);
+void *crosser(void *arg);
+void *lender(void *arg);
+void *owner(void *arg);
+void spin(unsigned long n);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *op, *outer, *inner;
+	pthread_t tid;
+	unsigned int i;
+	int ret = 0;
+
+	meas_init(&mst);
+
+	outer = meas_start_clock(&mst, NULL, "T_OUTER");
+	op    = meas_start_clock(&mst, NULL, "T_ASYNC_OP");
+	meas_stop_clock(op);
+
+	for (i = 0; i < NOPS; i++) {
+		meas_start_clock(NULL, op, NULL);
+		spin(100000);
+		if (meas_pause_clock(op) == FALSE || meas_pause_clock(op) == TRUE)
+			ret = 1;
+
+		/* Paused: back to the enclosing timer of this thread */
+		if (meas_active_clock() != outer)
+			ret = 1;
+
+		usleep(WAIT_US);
+		pthread_create(&tid, NULL, resumer, op);
+		pthread_join(tid, NULL);
+
+		printf("operation %u: active %lu, waited %lu\n", i, op->interv, op->wait);
+		if (op->state != TIMER_ST_STOPPED || op->wait < WAIT_US * 1000UL || op->interv >= op->wait)
+			ret = 1;
+	}
+
+	if (op->waits != NOPS)
+		ret = 1;
+
+	/* Stopped while paused: the pause is waiting time */
+	meas_start_clock(NULL, op, NULL);
+	spin(100000);
+	meas_pause_clock(op);
+	usleep(WAIT_US);
+	meas_stop_clock(op);
+	if (op->wait < WAIT_US * 1000UL || op->interv >= WAIT_US * 1000UL)
+		ret = 1;
+
+	/* A restart discards the paused operation */
+	meas_start_clock(NULL, op, NULL);
+	meas_pause_clock(op);
+	usleep(WAIT_US);
+	meas_start_clock(NULL, op, NULL);
+	meas_stop_clock(op);
+	if (op->interv >= WAIT_US * 1000UL || op->waits != NOPS + 1)
+		ret = 1;
+
+	/* Paused, resumed and stopped by another thread while nested here */
+	inner = meas_start_clock(&mst, NULL, "T_INNER");
+	meas_stop_clock(inner);
+	meas_start_clock(NULL, op, NULL);
+	meas_start_clock(NULL, inner, NULL);
+	pthread_create(&tid, NULL, crosser, op);
+	pthread_join(tid, NULL);
+	if (op->state != TIMER_ST_STOPPED || crosser_active != NULL || meas_active_clock() != inner)
+		ret = 1;
+	meas_stop_clock(inner);
+	if (meas_active_clock() != outer)
+		ret = 1;
+
+	/* Paused and resumed by another thread while at the head here: running there */
+	meas_start_clock(NULL, op, NULL);
+	pthread_create(&tid, NULL, lender, op);
+	pthread_join(tid, NULL);
+	if (op->state != TIMER_ST_RUNNING || meas_active_clock() != outer)
+		ret = 1;
+	meas_stop_clock(op);
+	if (meas_active_clock() != outer)
+		ret = 1;
+
+	/* Started by a thread that exited before the handoff */
+	pthread_create(&tid, NULL, owner, op);
+	pthread_join(tid, NULL);
+	if (meas_stop_clock(op) == FALSE)
+		ret = 1;
+	meas_start_clock(NULL, op, NULL);
+	if (meas_active_clock() != op)
+		ret = 1;
+	meas_stop_clock(op);
+	if (meas_active_clock() != outer)
+		ret = 1;
+
+	meas_stop_clock(outer);
+	if (meas_active_clock() != NULL)
+		ret = 1;
+
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Resume an operation, work a bit and stop it
+ * @param arg The timer.
+ */
+void *resumer(void *arg)
+{
+	meas_clock *op = (meas_clock*)arg;
+
+	if (meas_resume_clock(op) == FALSE || meas_active_clock() != op)
+		return(NULL);
+
+	spin(100000);
+	meas_stop_clock(op);
+
+	return(NULL);
+}
+
+
+/**
+ * Pause, resume and stop an operation nested in the chain of another
+ * thread: it must not become part of the chain of this one
+ * @param arg The timer.
+ */
+void *crosser(void *arg)
+{
+	meas_clock *op = (meas_clock*)arg;
+
+	meas_pause_clock(op);
+	meas_resume_clock(op);
+	crosser_active = meas_active_clock();
+	meas_stop_clock(op);
+
+	return(NULL);
+}
+
+
+/**
+ * Pause and resume an operation running at the head of the chain of
+ * another thread, and leave it running
+ * @param arg The timer.
+ */
+void *lender(void *arg)
+{
+	meas_clock *op = (meas_clock*)arg;
+
+	meas_pause_clock(op);
+	meas_resume_clock(op);
+	spin(100000);
+
+	return(NULL);
+}
+
+
+/**
+ * Start an operation and exit while it runs
+ * @param arg The timer.
+ */
+void *owner(void *arg)
+{
+	meas_start_clock(NULL, (meas_clock*)arg, NULL);
+	return(NULL);
+}
+
+
+/**
+ * CPU-bound work
+ * @param n Number of iterations.
+ */
+void spin(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		sink += i;
+	}
+}
+
@@ -0,0 +1,210 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <meas.h>
+
+/*
+ * Test - Persistent log: a process killed abruptly, a damaged area, a
+ * second session and a file that is not a log. Run "measrecover plog.out" to see the records.
+ */
+
+#define LOG_PATH "plog.out"
+#define NOT_LOG_PATH "plog.txt"
+#define LOG_SIZE 65536
+#define NITER    20000
+
+/**
+ * What a reader found
+ */
+struct recovered {
+	int nrecords;
+	int nevents;
+	int nsnapshots;
+	unsigned long long last_seq;
+	int ordered;
+	unsigned int last_session;
+	long last_iter;
+	long last_event;
+};
+
+void child(void);
+int collect(const meas_plog_rec *rec, void *ctx);
+int recover(struct recovered *r);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_plog *plog;
+	struct recovered r1, r2, r3;
+	struct stat st;
+	pid_t pid;
+	FILE *fp;
+	int status, ret = 0;
+
+	unlink(LOG_PATH);
+
+	if ((pid = fork()) == 0)
+		child();
+	waitpid(pid, &status, 0);
+	if (!WIFSIGNALED(status))
+		return(1);
+
+	/* Last state written before the kill */
+	if (recover(&r1) < 0)
+		return(1);
+	printf("killed: %d records (%d snapshots, %d events), last C_ITER %ld, last event %ld\n",
+		   r1.nrecords, r1.nsnapshots, r1.nevents, r1.last_iter, r1.last_event);
+	if (!r1.ordered || r1.last_iter != NITER || r1.last_event != NITER - 1 || r1.last_session != 1)
+		ret = 1;
+
+	/* Damage an area in the middle of the ring */
+	if (stat(LOG_PATH, &st) != 0 || (fp = fopen(LOG_PATH, "r+")) == NULL)
+		return(1);
+	fseek(fp, st.st_size / 2, SEEK_SET);
+	fwrite("garbage!garbage!", 1, 16, fp);
+	fclose(fp);
+
+	if (recover(&r2) < 0)
+		return(1);
+	printf("damaged: %d records, last C_ITER %ld\n", r2.nrecords, r2.last_iter);
+	if (r2.nrecords < r1.nrecords - 2 || r2.nrecords >= r1.nrecords || r2.last_iter != NITER)
+		ret = 1;
+
+	/* A new session continues the log */
+	meas_init(&mst);
+	if ((plog = meas_plog_open(&mst, LOG_PATH, LOG_SIZE, 0)) == NULL)
+		return(1);
+	meas_plog_event(plog, "E_RESTART", 1);
+	meas_close(&mst);
+
+	if (recover(&r3) < 0)
+		return(1);
+	printf("restarted: %d records, last session %u, last event %ld\n",
+		   r3.nrecords, r3.last_session, r3.last_event);
+	if (!r3.ordered || r3.last_session != 2 || r3.last_event != 1 || r3.last_seq <= r2.last_seq)
+		ret = 1;
+
+	/* A file that is not a log is never overwritten */
+	if ((fp = fopen(NOT_LOG_PATH, "w")) == NULL)
+		return(1);
+	fputs("not a log\n", fp);
+	fclose(fp);
+	meas_init(&mst);
+	if (meas_plog_open(&mst, NOT_LOG_PATH, LOG_SIZE, 0) != NULL)
+		ret = 1;
+	meas_close(&mst);
+	if (stat(NOT_LOG_PATH, &st) != 0 || st.st_size != 10)
+		ret = 1;
+	unlink(NOT_LOG_PATH);
+
+	return(ret);
+}
+
+
+/**
+ * Process killed while logging
+ */
+void child(void)
+{
+	meas_t *mst;
+	meas_plog *plog;
+	meas_counter *iter;
+	meas_clock *t_iter;
+	int i;
+
+	meas_init(&mst);
+	if ((plog = meas_plog_open(&mst, LOG_PATH, LOG_SIZE, 0)) == NULL)
+		_exit(1);
+
+	iter   = meas_create_counter(&mst, 0, "C_ITER");
+	t_iter = meas_start_clock(&mst, NULL, "T_ITER");
+	meas_stop_clock(t_iter);
+
+	for (i = 0; i < NITER; i++) {
+		meas_start_clock(NULL, t_iter, NULL);
+		meas_inc_counter(iter);
+		meas_stop_clock(t_iter);
+
+		if ((i % 10) == 9)
+			meas_plog_event(plog, "E_ITER", i);
+		if ((i % 100) == 99)
+			meas_plog_snapshot(plog);
+	}
+
+	/* No meas_close: every record is in the mapping only */
+	kill(getpid(), SIGKILL);
+	_exit(0);
+}
+
+
+/**
+ * Record callback
+ */
+int collect(const meas_plog_rec *rec, void *ctx)
+{
+	struct recovered *r = (struct recovered*)ctx;
+	unsigned int i;
+
+	if (r->nrecords > 0 && rec->seq <= r->last_seq)
+		r->ordered = 0;
+	r->last_seq     = rec->seq;
+	r->last_session = rec->session;
+	r->nrecords++;
+
+	if (rec->type == MEAS_PLOG_EVENT) {
+		r->nevents++;
+		r->last_event = rec->value;
+	} else if (rec->type == MEAS_PLOG_SNAPSHOT) {
+		r->nsnapshots++;
+		for (i = 0; i < rec->nmetrics; i++) {
+			if (strcmp(rec->metrics[i].name, "C_ITER") == 0)
+				r->last_iter = rec->metrics[i].value;
+		}
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Read the log
+ * @param r Returned summary.
+ * @return int Number of records (-1 on error).
+ */
+int recover(struct recovered *r)
+{
+	memset(r, 0, sizeof(struct recovered));
+	r->ordered = 1;
+	return(meas_plog_read(LOG_PATH, collect, r));
+}
+
@@ -0,0 +1,143 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <meas.h>
+
+/*
+ * Test - Probabilistic WCET: models fitted to Gumbel samples of known
+ * quantiles, and to a timer.
+ */
+
+#define NSAMPLES 100000
+#define MU       10000.0
+#define BETA     200.0
+#define NLOOPS   20000
+
+volatile unsigned long sink;
+
+int check(const char *name, meas_pwcet *fit, double tolerance);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *clock;
+	meas_pwcet_opts opts;
+	meas_pwcet fit;
+	meas_histogram hist;
+	unsigned long *values, i, j;
+	double u;
+	int ret = 0;
+
+	/* Gumbel samples: the bound at p is MU - BETA * ln(-ln(1 - p)) */
+	if ((values = (unsigned long*)malloc(sizeof(unsigned long) * NSAMPLES)) == NULL)
+		return(1);
+
+	meas_hist_init(&hist, 0, 10, 10000);
+	srand(1);
+	for (i = 0; i < NSAMPLES; i++) {
+		u = (rand() + 1.0) / (RAND_MAX + 2.0);
+		values[i] = (unsigned long)(MU - BETA * log(-log(u)));
+		meas_hist_add(&hist, values[i]);
+	}
+
+	meas_pwcet_defaults(&opts);
+	if (meas_pwcet_fit(values, NSAMPLES, &opts, &fit) == FALSE)
+		return(1);
+	ret |= check("gumbel", &fit, 0.02);
+
+	opts.method = MEAS_PWCET_GEV;
+	if (meas_pwcet_fit(values, NSAMPLES, &opts, &fit) == FALSE)
+		return(1);
+	ret |= check("gev", &fit, 0.1);
+
+	opts.method = MEAS_PWCET_POT;
+	if (meas_pwcet_fit(values, NSAMPLES, &opts, &fit) == FALSE)
+		return(1);
+	ret |= check("pot", &fit, 0.05);
+
+	if (meas_pwcet_hist(&hist, NULL, &fit) == FALSE)
+		return(1);
+	ret |= check("histogram", &fit, 0.05);
+	meas_hist_free(&hist);
+
+	/* Too few maxima */
+	meas_pwcet_defaults(&opts);
+	if (meas_pwcet_fit(values, 1000, &opts, &fit) == FALSE || !(fit.warnings & MEAS_PWCET_FEW_SAMPLES))
+		ret = 1;
+
+	/* Correlated samples (slow drift) */
+	for (i = 0; i < NSAMPLES; i++) {
+		values[i] += (i / 1000) * 100;
+	}
+	if (meas_pwcet_fit(values, NSAMPLES, &opts, &fit) == FALSE || !(fit.warnings & MEAS_PWCET_DEPENDENT))
+		ret = 1;
+	free(values);
+
+	/* A timer */
+	meas_init(&mst);
+	clock = meas_start_clock(&mst, NULL, "T_PWCET");
+	meas_stop_clock(clock);
+	meas_clock_capture(clock, NLOOPS, FALSE);
+	for (i = 0; i < NLOOPS; i++) {
+		meas_start_clock(NULL, clock, NULL);
+		for (j = 0; j < 1000; j++) {
+			sink += j;
+		}
+		meas_stop_clock(clock);
+	}
+
+	if (meas_pwcet_clock(clock, NULL, &fit) == FALSE)
+		ret = 1;
+	else
+		meas_pwcet_write(&fit, clock->name, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Compare the bound at 1e-9 with the exact one
+ * @param name Model name.
+ * @param fit The model.
+ * @param tolerance Max. relative error.
+ * @return 0 if within the tolerance, 1 otherwise.
+ */
+int check(const char *name, meas_pwcet *fit, double tolerance)
+{
+	double exact, bound;
+
+	exact = MU - BETA * log(-log1p(-1e-9));
+	bound = meas_pwcet_bound(fit, 1e-9);
+	meas_pwcet_write(fit, name, stdout);
+	printf("   exact 1e-9           : %.0f (error %.2f%%)\n\n", exact, 100 * (bound - exact) / exact);
+
+	return(fabs(bound - exact) / exact <= tolerance ? 0 : 1);
+}
+
@@ -0,0 +1,174 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <meas.h>
+
+/*
+ * Test - Raw sample capture: exact quantiles checked against a full sort,
+ * and export of the captured intervals.
+ *
+ * Timing run: quantile <nsamples> (e.g. 100000000) also requires the
+ * statistics and quantiles to take less than one second.
+ */
+
+#define NSAMPLES 5000000UL
+#define MAX_TIME 1000000000UL		/* 1 s, timing run only */
+#define NLOOPS   1000
+#define NPCTS    7
+#define WIDE     9973
+
+volatile unsigned long sink;
+
+int cmp_ulong(const void *a, const void *b);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *t_loop, *t_synth, t_stats;
+	meas_sample_stats stats;
+	double pcts[NPCTS] = {0, 25, 50, 90, 99, 99.9, 100};
+	unsigned long values[NPCTS], *sorted, i, rank, nsamples = NSAMPLES;
+	unsigned long long seed = 88172645463325252ULL;
+	char line[256];
+	int ret = 0, nlines = 0, j;
+	FILE *fp;
+
+	if (argc > 1 && (nsamples = strtoul(argv[1], NULL, 10)) == 0)
+		return(1);
+
+	meas_init(&mst);
+
+	/* Real intervals */
+	t_loop = meas_start_clock(&mst, NULL, "T_LOOP");
+	meas_stop_clock(t_loop);
+	meas_clock_capture(t_loop, 64, TRUE);
+	for (j = 0; j < NLOOPS; j++) {
+		meas_start_clock(NULL, t_loop, NULL);
+		sink += j;
+		meas_stop_clock(t_loop);
+	}
+
+	if (meas_samples_stats(t_loop, &stats, NULL, 0, NULL) == FALSE || stats.n != NLOOPS) {
+		fprintf(stderr, "captured %lu intervals instead of %d\n", stats.n, NLOOPS);
+		ret = 1;
+	}
+
+	if ((fp = tmpfile()) != NULL) {
+		meas_samples_write(t_loop, fp);
+		rewind(fp);
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			nlines++;
+		}
+		fclose(fp);
+		if (nlines != NLOOPS + 2)
+			ret = 1;
+	}
+
+	/* Synthetic heavy-tailed samples with many duplicates */
+	t_synth = meas_start_clock(&mst, NULL, "T_SYNTH");
+	meas_stop_clock(t_synth);
+	if (meas_clock_capture(t_synth, nsamples, FALSE) == FALSE)
+		return(1);
+
+	for (i = 0; i < nsamples; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		t_synth->samples->values[i] = 100 + (seed % 1000) * ((seed >> 32) % 16 == 0 ? 50 : 1);
+	}
+	t_synth->samples->n = nsamples;
+
+	memset(&t_stats, 0, sizeof(t_stats));
+	meas_start_clock(NULL, &t_stats, NULL);
+	meas_samples_stats(t_synth, &stats, pcts, NPCTS, values);
+	meas_stop_clock(&t_stats);
+	printf("%lu samples: stats and %d quantiles in %lu ticks\n", nsamples, NPCTS, t_stats.interv);
+	if (argc > 1 && t_stats.interv >= MAX_TIME)
+		ret = 1;
+
+	/* Reference: full sort */
+	if ((sorted = (unsigned long*)malloc(sizeof(unsigned long) * nsamples)) == NULL)
+		return(1);
+	memcpy(sorted, t_synth->samples->values, sizeof(unsigned long) * nsamples);
+	qsort(sorted, nsamples, sizeof(unsigned long), cmp_ulong);
+
+	for (j = 0; j < NPCTS; j++) {
+		rank = (unsigned long)((pcts[j] / 100.0) * nsamples + 0.999999);
+		rank = (rank > 0) ? rank - 1 : 0;
+		if (rank >= nsamples)
+			rank = nsamples - 1;
+
+		printf("p%-5g: %lu (sorted: %lu)\n", pcts[j], values[j], sorted[rank]);
+		if (values[j] != sorted[rank])
+			ret = 1;
+	}
+
+	if (stats.min != sorted[0] || stats.max != sorted[nsamples - 1])
+		ret = 1;
+
+	/* Wide range: the buckets of the ranks hold several values */
+	for (i = 0; i < nsamples; i++) {
+		t_synth->samples->values[i] *= WIDE;
+		sorted[i] *= WIDE;
+	}
+	meas_samples_stats(t_synth, &stats, pcts, NPCTS, values);
+	for (j = 0; j < NPCTS; j++) {
+		rank = (unsigned long)((pcts[j] / 100.0) * nsamples + 0.999999);
+		rank = (rank > 0) ? rank - 1 : 0;
+		if (rank >= nsamples)
+			rank = nsamples - 1;
+
+		if (values[j] != sorted[rank]) {
+			fprintf(stderr, "wide p%g: %lu (sorted: %lu)\n", pcts[j], values[j], sorted[rank]);
+			ret = 1;
+		}
+	}
+
+	free(sorted);
+
+	/* Keep the report small */
+	meas_clock_release_samples(t_synth);
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Compare two unsigned longs (for qsort)
+ */
+int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long*)a, y = *(const unsigned long*)b;
+
+	return((x > y) - (x < y));
+}
+
@@ -25,10 +25,26 @@
 
 
 /*
- * Test - Use time measurement with sort functions
+ * Test - Benchmark Fibonacci functions
  */
+
+/**
+ * Fibonacci position used by the benchmarks
+ */
+#define FIB_N 20
+
+/**
+ * Benchmark context
+ */
+struct fib_ctx {
+	int n;
+	int result;
+};
+
 int r_fibonacci(int x);
 int nr_fibonacci(int x);
+void bench_rec(void *ctx);
+void bench_nonrec(void *ctx);
 
 
 meas_t *mst;
@@ -39,27 +55,34 @@ meas_counter *c1, *c2;
  */
 int main(int argc, char **argv)
 {
-	int v1, v2;
-	meas_clock *t1, *t2;
+	struct fib_ctx f1, f2;
+	meas_bench_opts opts;
 
 	meas_init(&mst);
 
 	c1 = meas_create_counter(&mst, 0, "C_REC");
 	c2 = meas_create_counter(&mst, 0, "C_NONREC");
 
+	meas_bench_defaults(&opts);
+	opts.warmup_time = 50000000UL;
+	opts.sample_time =  5000000UL;
+	opts.nsamples    = 20;
 
 	/* Recursive version */
-	t1 = meas_start_clock(&mst, NULL, "T_REC");
-	v1 = r_fibonacci(35);
-	meas_stop_clock(t1);
+	f1.n = FIB_N;
+	if (meas_bench_run(&mst, "BENCH_REC", bench_rec, &f1, &opts) == NULL)
+		return(1);
 
 	/* Non recursive version */
-	t2 = meas_start_clock(&mst, NULL, "T_NONREC");
-	v2 = nr_fibonacci(35);
-	meas_stop_clock(t2);
+	f2.n = FIB_N;
+	if (meas_bench_run(&mst, "BENCH_NONREC", bench_nonrec, &f2, &opts) == NULL)
+		return(1);
+
+	if (f1.result != f2.result)
+		return(1);
 
-	meas_add_report_item(&mst, "REC_VALUE", "%d\n", v1);
-	meas_add_report_item(&mst, "NONREC_VALUE", "%d\n", v2);
+	meas_add_report_item(&mst, "REC_VALUE", "%d\n", f1.result);
+	meas_add_report_item(&mst, "NONREC_VALUE", "%d\n", f2.result);
 
 	meas_add_report_item(&mst, "N_SWAPS", "%d\n", meas_get_nswap(&mst, RUSAGE_SELF));
 	meas_add_report_item(&mst, "N_CONTEXT_SWITCHES", "%d\n", meas_get_cswitches(&mst, RUSAGE_SELF));
@@ -74,6 +97,30 @@ int main(int argc, char **argv)
 }
 
 
+/**
+ * Recursive Fibonacci iteration
+ * @param ctx Fibonacci context.
+ */
+void bench_rec(void *ctx)
+{
+	struct fib_ctx *f = (struct fib_ctx*)ctx;
+
+	f->result = r_fibonacci(f->n);
+}
+
+
+/**
+ * Non-recursive Fibonacci iteration
+ * @param ctx Fibonacci context.
+ */
+void bench_nonrec(void *ctx)
+{
+	struct fib_ctx *f = (struct fib_ctx*)ctx;
+
+	f->result = nr_fibonacci(f->n);
+}
+
+
 /**
  * Generate Fibonacci number (recursive version)
  * @param n Position of the number at Fibobacci sequence.
@@ -0,0 +1,118 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <meas.h>
+
+/*
+ * Test - Periodic task with induced deadline misses
+ * Every MISS_EVERY-th job runs longer than its deadline. A second task
+ * overruns several periods: the next job takes the latest release.
+ */
+
+#define PERIOD     2000000UL	/* 2 ms */
+#define DEADLINE   1000000UL	/* 1 ms */
+#define NJOBS      200
+#define MISS_EVERY 20
+
+void busy_wait(unsigned long ticks);
+void on_miss(meas_task *task, unsigned long response, void *ctx);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_task *task, *skip;
+	struct timespec next;
+	unsigned long ncallbacks = 0;
+	int i;
+
+	meas_init(&mst);
+
+	if ((task = meas_create_task(&mst, "T_CONTROL", PERIOD, DEADLINE)) == NULL)
+		return(1);
+
+	meas_task_on_miss(task, on_miss, &ncallbacks);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < NJOBS; i++) {
+		meas_task_begin(task);
+		busy_wait((i % MISS_EVERY) == MISS_EVERY - 1 ? DEADLINE + (DEADLINE / 2) : DEADLINE / 10);
+		meas_task_end(task);
+
+		next.tv_nsec += PERIOD;
+		if (next.tv_nsec >= 1000000000L) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000L;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	printf("%lu misses, %lu callbacks\n", task->misses, ncallbacks);
+
+	if ((skip = meas_create_task(&mst, "T_OVERRUN", PERIOD, DEADLINE)) == NULL)
+		return(1);
+
+	meas_task_begin(skip);
+	busy_wait(3 * PERIOD + (PERIOD / 2));
+	meas_task_end(skip);
+	meas_task_begin(skip);
+	meas_task_end(skip);
+
+	printf("%lu skipped releases, jitter max %lu\n", skip->skipped, skip->jitter.max);
+
+	meas_generate_report(&mst, REPORT_RT);
+	meas_write_report(mst, stdout);
+
+	i = (task->misses >= NJOBS / MISS_EVERY && ncallbacks == task->misses &&
+		 task->response.count == NJOBS &&
+		 skip->skipped >= 2 && skip->jitter.max < PERIOD) ? 0 : 1;
+
+	meas_close(&mst);
+	return(i);
+}
+
+
+/**
+ * Spin for a number of ticks
+ * @param ticks Ticks to spin.
+ */
+void busy_wait(unsigned long ticks)
+{
+	unsigned long start = meas_get_ticks();
+
+	while (meas_get_ticks() - start < ticks);
+}
+
+
+/**
+ * Deadline miss callback: count the misses
+ */
+void on_miss(meas_task *task, unsigned long response, void *ctx)
+{
+	(*(unsigned long*)ctx)++;
+}
+
@@ -0,0 +1,133 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <meas.h>
+
+/*
+ * Test - Hard real-time mode: no page faults and no allocation after
+ * meas_init_rt, violations counted once the capacities are exhausted and
+ * for allocating calls (a growing sample array is refused in stop).
+ */
+
+#define NTIMERS 4
+#define LOOPS   10000
+
+long minor_faults(void);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_rt_opts opts;
+	meas_clock *timers[NTIMERS];
+	meas_counter *counter;
+	meas_task *task;
+	long faults;
+	int i, j, ret = 0;
+
+	meas_rt_defaults(&opts);
+	opts.max_timers   = NTIMERS;
+	opts.max_counters = 1;
+	opts.max_tasks    = 1;
+	opts.lock_memory  = TRUE;
+
+	/* mlockall needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK */
+	if (meas_init_rt(&mst, &opts) == FALSE) {
+		printf("mlockall not permitted, running without locked memory\n");
+		opts.lock_memory = FALSE;
+		if (meas_init_rt(&mst, &opts) == FALSE)
+			return(1);
+	}
+
+	for (i = 0; i < NTIMERS; i++) {
+		timers[i] = meas_start_clock(&mst, NULL, "T_RT");
+		meas_stop_clock(timers[i]);
+	}
+	counter = meas_create_counter(&mst, 0, "C_RT");
+	task    = meas_create_task(&mst, "T_LOOP", 1000000, 0);
+
+	if (counter == NULL || task == NULL || meas_rt_violations(mst) != 0) {
+		fprintf(stderr, "elements within capacity must not fail\n");
+		return(1);
+	}
+
+	/* Steady state: no page fault */
+	faults = minor_faults();
+	for (i = 0; i < LOOPS; i++) {
+		meas_task_begin(task);
+		for (j = 0; j < NTIMERS; j++) {
+			meas_start_clock(NULL, timers[j], NULL);
+			meas_inc_counter(counter);
+			meas_stop_clock(timers[j]);
+		}
+		meas_task_end(task);
+	}
+	faults = minor_faults() - faults;
+	printf("%ld page faults in %d loops\n", faults, LOOPS);
+	if (faults != 0)
+		ret = 1;
+
+	/* Capacity exhausted */
+	if (meas_start_clock(&mst, NULL, "T_EXTRA") != NULL || meas_rt_violations(mst) != 1) {
+		fprintf(stderr, "exhausted capacity must be reported\n");
+		ret = 1;
+	}
+
+	/* Capture allocates, growth in meas_stop_clock is refused */
+	meas_clock_capture(timers[0], 4, TRUE);
+	for (i = 0; i < 8; i++) {
+		meas_start_clock(NULL, timers[0], NULL);
+		meas_stop_clock(timers[0]);
+	}
+	if (meas_rt_violations(mst) != 3 || timers[0]->samples->capacity != 4 ||
+			timers[0]->samples->dropped != 4) {
+		fprintf(stderr, "sample capture must not grow in hard real-time mode\n");
+		ret = 1;
+	}
+
+	meas_generate_report(&mst, REPORT_SHOW_ALL);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Minor page faults of the process
+ * @return long Number of minor faults.
+ */
+long minor_faults(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return(usage.ru_minflt);
+}
+
@@ -0,0 +1,128 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <meas.h>
+
+/*
+ * Test - Sampling profiler attributing samples to timed regions
+ * Run "measfold sampler.out" to get the folded stacks.
+ * Built with -fno-omit-frame-pointer, so stacks unwind past the leaf.
+ */
+
+#define FREQUENCY 1000
+#define SPIN      50000000UL
+
+volatile unsigned long sink;
+
+void spin_outer(unsigned long n);
+void spin_inner(unsigned long n);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *t1, *t2;
+	char line[4096], region[MAX_NAME_SIZE];
+	int tid, nframes, n_outer = 0, n_inner = 0, n_deep = 0, written;
+	FILE *fp;
+
+	meas_init(&mst);
+
+	if (meas_sampler_start(FREQUENCY) == FALSE) {
+		fprintf(stderr, "sampler not available\n");
+		return(1);
+	}
+
+	t1 = meas_start_clock(&mst, NULL, "T_OUTER");
+	spin_outer(SPIN);
+	t2 = meas_start_clock(&mst, NULL, "T_INNER");
+	spin_inner(SPIN);
+	meas_stop_clock(t2);
+	meas_stop_clock(t1);
+
+	meas_sampler_stop();
+
+	/* Samples outlive their regions */
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	if ((fp = fopen("sampler.out", "w+")) == NULL)
+		return(1);
+
+	written = meas_sampler_write(fp);
+	printf("%d samples written to sampler.out\n", written);
+
+	/* Samples must be tagged with the innermost running clock */
+	rewind(fp);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "sample %d %34s %d", &tid, region, &nframes) == 3) {
+			if (strcmp(region, "T_OUTER") == 0)
+				n_outer++;
+			else if (strcmp(region, "T_INNER") == 0)
+				n_inner++;
+
+			/* Interrupted pc plus at least the caller */
+			if (nframes >= 2)
+				n_deep++;
+		}
+	}
+	fclose(fp);
+
+	printf("T_OUTER: %d samples, T_INNER: %d samples, %d unwound\n", n_outer, n_inner, n_deep);
+
+	return((written > 0 && n_outer > 0 && n_inner > 0 && n_deep > 0) ? 0 : 1);
+}
+
+
+/**
+ * CPU-bound work (outer region)
+ * @param n Number of iterations.
+ */
+void spin_outer(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		sink += i;
+	}
+}
+
+
+/**
+ * CPU-bound work (inner region)
+ * @param n Number of iterations.
+ */
+void spin_inner(unsigned long n)
+{
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		sink ^= i;
+	}
+}
+
@@ -0,0 +1,170 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <meas.h>
+
+/*
+ * Test - Quantile sketch against raw samples: accuracy, insert cost,
+ * merge and export.
+ */
+
+#define NVALUES 2000000UL
+#define NLOOPS  1000
+#define NPCTS   5
+#define ALPHA   0.01
+
+volatile unsigned long sink;
+
+unsigned long next_value(unsigned long long *seed);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_clock *t_loop, raw;
+	meas_sketch sk, half[2], merged, loaded;
+	meas_sample_stats stats;
+	double pcts[NPCTS] = {50, 90, 99, 99.9, 99.99};
+	unsigned long exact[NPCTS], approx, i, t_raw, t_sketch;
+	unsigned long long seed = 88172645463325252ULL;
+	double err, limit;
+	char name[MAX_NAME_SIZE];
+	int ret = 0, j;
+	FILE *fp;
+
+	meas_init(&mst);
+
+	/* Sketch fed by a timer */
+	t_loop = meas_start_clock(&mst, NULL, "T_LOOP");
+	meas_stop_clock(t_loop);
+	meas_clock_sketch(t_loop, ALPHA, 0);
+	for (j = 0; j < NLOOPS; j++) {
+		meas_start_clock(NULL, t_loop, NULL);
+		sink += j;
+		meas_stop_clock(t_loop);
+	}
+	if (t_loop->sketch->count != NLOOPS)
+		ret = 1;
+
+	/* Same values in raw samples and in sketches */
+	memset(&raw, 0, sizeof(raw));
+	if (meas_clock_capture(&raw, NVALUES, FALSE) == FALSE ||
+			meas_sketch_init(&sk, ALPHA, 0) == FALSE ||
+			meas_sketch_init(&half[0], ALPHA, 0) == FALSE ||
+			meas_sketch_init(&half[1], ALPHA, 0) == FALSE ||
+			meas_sketch_init(&merged, ALPHA, 0) == FALSE)
+		return(1);
+
+	t_raw = meas_get_ticks();
+	for (i = 0; i < NVALUES; i++) {
+		raw.samples->values[i] = next_value(&seed);
+	}
+	raw.samples->n = NVALUES;
+	t_raw = meas_get_ticks() - t_raw;
+
+	seed = 88172645463325252ULL;
+	t_sketch = meas_get_ticks();
+	for (i = 0; i < NVALUES; i++) {
+		meas_sketch_add(&sk, next_value(&seed));
+	}
+	t_sketch = meas_get_ticks() - t_sketch;
+
+	printf("insert: raw %.2f ticks/value, sketch %.2f ticks/value\n",
+		   (double)t_raw / NVALUES, (double)t_sketch / NVALUES);
+	printf("memory: raw %lu bytes, sketch %lu bytes\n",
+		   (unsigned long)(sizeof(unsigned long) * NVALUES),
+		   (unsigned long)(sizeof(meas_sketch) + sizeof(unsigned long) * sk.nbins));
+
+	meas_samples_stats(&raw, &stats, pcts, NPCTS, exact);
+
+	for (j = 0; j < NPCTS; j++) {
+		approx = meas_sketch_percentile(&sk, pcts[j]);
+		err    = ((double)approx - (double)exact[j]) / (double)exact[j];
+		if (err < 0)
+			err = -err;
+
+		/* Integer rounding of the estimate on top of alpha */
+		limit = ALPHA + (0.5 / (double)exact[j]) + 1e-9;
+		printf("p%-6g: exact %lu, sketch %lu, error %.4f%%\n", pcts[j], exact[j], approx, err * 100);
+		if (err > limit)
+			ret = 1;
+	}
+
+	/* Two halves merged give the same sketch */
+	for (i = 0; i < NVALUES; i++) {
+		meas_sketch_add(&half[i & 1], raw.samples->values[i]);
+	}
+	meas_sketch_merge(&merged, &half[0]);
+	meas_sketch_merge(&merged, &half[1]);
+	for (j = 0; j < NPCTS; j++) {
+		if (meas_sketch_percentile(&merged, pcts[j]) != meas_sketch_percentile(&sk, pcts[j])) {
+			fprintf(stderr, "merged p%g differs\n", pcts[j]);
+			ret = 1;
+		}
+	}
+
+	/* Export and import */
+	if ((fp = tmpfile()) == NULL)
+		return(1);
+	meas_sketch_write(&sk, "T_SYNTH", fp);
+	rewind(fp);
+	if (meas_sketch_read(&loaded, name, fp) == FALSE || strcmp(name, "T_SYNTH") != 0 ||
+			loaded.count != sk.count || meas_sketch_percentile(&loaded, 99) != meas_sketch_percentile(&sk, 99)) {
+		fprintf(stderr, "sketch export/import failed\n");
+		ret = 1;
+	}
+	fclose(fp);
+
+	meas_sketch_free(&loaded);
+	meas_sketch_free(&merged);
+	meas_sketch_free(&half[0]);
+	meas_sketch_free(&half[1]);
+	meas_sketch_free(&sk);
+	meas_clock_release_samples(&raw);
+
+	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Pseudo-random heavy-tailed value (xorshift)
+ * @param seed Random state.
+ * @return unsigned long The value.
+ */
+unsigned long next_value(unsigned long long *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return(100 + (*seed % 1000) * ((*seed >> 32) % 16 == 0 ? 50 : 1) + ((*seed >> 40) % 64 == 0 ? 1000000 : 0));
+}
+
@@ -0,0 +1,160 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <meas.h>
+
+/*
+ * Test - Asynchronous reports: the loop thread only takes snapshots while
+ * another thread keeps updating a timer. Timer extensions, child groups
+ * and per-thread resources must reach the reports.
+ */
+
+#define NSNAPSHOTS 50
+#define LOOPS      1000
+
+meas_t *mst;
+meas_clock *t_shared;
+volatile int done = 0;
+
+void *mutator(void *arg);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_reporter *rep;
+	meas_clock *t_loop, t_snap;
+	meas_counter *c_loop;
+	meas_threads *thr;
+	meas_child child;
+	char *argv_true[] = {"true", NULL};
+	unsigned long cost, max_cost = 0, dropped;
+	char line[256];
+	pthread_t thread;
+	int i, j, reports = 0, sections = 0;
+	FILE *fp;
+
+	meas_init(&mst);
+
+	t_loop   = meas_start_clock(&mst, NULL, "T_LOOP");
+	t_shared = meas_start_clock(&mst, NULL, "T_SHARED");
+	meas_stop_clock(t_loop);
+	meas_stop_clock(t_shared);
+	c_loop = meas_create_counter(&mst, 0, "C_LOOP");
+
+	meas_clock_capture(t_loop, NSNAPSHOTS, FALSE);
+	meas_clock_sketch(t_loop, 0.01, 0);
+	meas_clock_budget(&mst, t_loop, 1000000000UL, 0, NULL, NULL);
+
+	if (meas_spawn(&mst, &child, "P_TRUE", argv_true, NULL) == FALSE || meas_wait(&child) == FALSE)
+		return(1);
+
+	if ((thr = meas_threads_create(&mst, 64)) == NULL || meas_threads_update(thr) == FALSE)
+		return(1);
+
+	if ((fp = tmpfile()) == NULL)
+		return(1);
+
+	if ((rep = meas_reporter_start(&mst, fp, REPORT_TIMERS | REPORT_COUNTERS |
+								   REPORT_CHILDREN | REPORT_THREADS)) == NULL)
+		return(1);
+
+	pthread_create(&thread, NULL, mutator, NULL);
+
+	memset(&t_snap, 0, sizeof(t_snap));
+	for (i = 0; i < NSNAPSHOTS; i++) {
+		meas_start_clock(NULL, t_loop, NULL);
+		for (j = 0; j < LOOPS; j++) {
+			meas_inc_counter(c_loop);
+		}
+		meas_stop_clock(t_loop);
+
+		/* The only report cost paid by this thread */
+		meas_start_clock(NULL, &t_snap, NULL);
+		meas_reporter_snapshot(rep);
+		meas_stop_clock(&t_snap);
+
+		cost = t_snap.interv;
+		if (cost > max_cost)
+			max_cost = cost;
+
+		/* Idle time of the loop period */
+		usleep(1000);
+	}
+
+	done = 1;
+	pthread_join(thread, NULL);
+
+	dropped = meas_reporter_dropped(rep);
+	meas_reporter_stop(&rep);
+
+	rewind(fp);
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (strstr(line, "ANALYSIS REPORT") != NULL)
+			reports++;
+
+		/* Sections of the last report */
+		if (strstr(line, "ANALYSIS REPORT") != NULL)
+			sections = 0;
+		if (strstr(line, "samples / dropped") != NULL)
+			sections |= 0x01;
+		if (strstr(line, "sketch n / error") != NULL)
+			sections |= 0x02;
+		if (strstr(line, "budget / overruns") != NULL)
+			sections |= 0x04;
+		if (strstr(line, "P_TRUE") != NULL)
+			sections |= 0x08;
+		if (strstr(line, "= THREADS =") != NULL)
+			sections |= 0x10;
+	}
+	fclose(fp);
+
+	printf("%d snapshots, %d reports written, %lu dropped, max. snapshot cost %lu ticks, sections 0x%x\n",
+		   NSNAPSHOTS, reports, dropped, max_cost, sections);
+
+	meas_close(&mst);
+	return((reports + dropped == NSNAPSHOTS && reports > 0 && sections == 0x1f) ? 0 : 1);
+}
+
+
+/**
+ * Keep updating the shared timer
+ */
+void *mutator(void *arg)
+{
+	while (!done) {
+		meas_start_clock(NULL, t_shared, NULL);
+		meas_stop_clock(t_shared);
+		sched_yield();
+	}
+
+	return(NULL);
+}
+
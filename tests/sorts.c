@@ -21,22 +21,35 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <meas.h>
 
 #define WORST_CASE  0
 #define RANDOM_CASE 1
 
-#define T1_SIZE 18000
+#define T1_SIZE  2000
 #define T2_SIZE 18000
 
 
 /*
- * Test - Use time measurement with sort functions
+ * Test - Benchmark sort functions
  */
 
+/**
+ * Benchmark context: each iteration sorts a fresh copy of src
+ */
+struct sort_ctx {
+	int *src;
+	int *work;
+	int size;
+};
+
 int *create_v(int mode, int size);
 void bubble(int *v, int size);
 void heapsort(int a[], int n);
+void bench_bubble(void *ctx);
+void bench_heapsort(void *ctx);
 
 
 /**
@@ -44,31 +57,37 @@ void heapsort(int a[], int n);
  */
 int main(int argc, char **argv)
 {
-	int *t1;
-	int *t2;
+	struct sort_ctx c1, c2;
 	meas_t *mst;
-	meas_clock *timer1, *timer2;
+	meas_bench_opts opts;
 
 	meas_init(&mst);
 
 	/* Create vectors */
-	t1 = create_v(WORST_CASE,  T1_SIZE);
-	t2 = create_v(WORST_CASE, T2_SIZE);
-
-	if(t1 == NULL || t2 == NULL)
+	c1.size = T1_SIZE;
+	c1.src  = create_v(WORST_CASE, T1_SIZE);
+	c1.work = create_v(WORST_CASE, T1_SIZE);
+	c2.size = T2_SIZE;
+	c2.src  = create_v(WORST_CASE, T2_SIZE);
+	c2.work = create_v(WORST_CASE, T2_SIZE);
+
+	if(c1.src == NULL || c1.work == NULL || c2.src == NULL || c2.work == NULL)
 		return(1);
 
 	/* Sort */
-	timer1 = meas_start_clock(&mst, NULL, "TIMER_BUBBLE");
-	bubble(t1, T1_SIZE);
-	meas_stop_clock(timer1);
+	meas_bench_defaults(&opts);
+	opts.warmup_time = 50000000UL;
+	opts.sample_time =  5000000UL;
+	opts.nsamples    = 20;
 
-	timer2 = meas_start_clock(&mst, NULL, "TIMER_HEAP");
-	heapsort(t2, T2_SIZE);
-	meas_stop_clock(timer2);
+	if (meas_bench_run(&mst, "BENCH_BUBBLE", bench_bubble, &c1, &opts) == NULL)
+		return(1);
+
+	if (meas_bench_run(&mst, "BENCH_HEAP", bench_heapsort, &c2, &opts) == NULL)
+		return(1);
 
 	/* Generate and write report */
-	meas_generate_report(&mst, REPORT_TIMERS);
+	meas_generate_report(&mst, REPORT_BENCHMARKS);
 	meas_write_report(mst, stdout);
 
 	meas_close(&mst);
@@ -77,6 +96,32 @@ int main(int argc, char **argv)
 }
 
 
+/**
+ * Bubble sort iteration
+ * @param ctx Sort context.
+ */
+void bench_bubble(void *ctx)
+{
+	struct sort_ctx *c = (struct sort_ctx*)ctx;
+
+	memcpy(c->work, c->src, sizeof(int) * c->size);
+	bubble(c->work, c->size);
+}
+
+
+/**
+ * Heap sort iteration
+ * @param ctx Sort context.
+ */
+void bench_heapsort(void *ctx)
+{
+	struct sort_ctx *c = (struct sort_ctx*)ctx;
+
+	memcpy(c->work, c->src, sizeof(int) * c->size);
+	heapsort(c->work, c->size);
+}
+
+
 /**
  * create integer vectors
  * @param mode WORST_CASE: elements from END to BEGIN | RANDOM_CASE: random elements
@@ -0,0 +1,130 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <meas.h>
+
+/*
+ * Test - Child processes: per-child wall time, resource usage and exit
+ * status, aggregated by name.
+ */
+
+#define NWORKERS  3
+#define WORK_MB   32
+#define WORK_SPIN 100000000UL
+
+volatile unsigned long sink;
+
+int work(void);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_child workers[NWORKERS], failing;
+	meas_child_stats *stats;
+	char *wargv[3], *fargv[4];
+	int i, ret = 0;
+
+	if (argc > 1 && strcmp(argv[1], "work") == 0)
+		return(work());
+
+	meas_init(&mst);
+
+	/* Workers run at the same time */
+	wargv[0] = argv[0];
+	wargv[1] = "work";
+	wargv[2] = NULL;
+	for (i = 0; i < NWORKERS; i++) {
+		if (meas_spawn(&mst, &workers[i], "WORKER", wargv, NULL) == FALSE)
+			return(1);
+	}
+
+	for (i = 0; i < NWORKERS; i++) {
+		meas_wait(&workers[i]);
+		printf("worker %d: %lu ticks, user %ld.%06ld s, max. RSS %ld KB, status %d\n", i,
+			   workers[i].wall, (long)workers[i].usage.ru_utime.tv_sec,
+			   (long)workers[i].usage.ru_utime.tv_usec, workers[i].usage.ru_maxrss,
+			   WEXITSTATUS(workers[i].status));
+
+		/* Resources of this child only */
+		if (workers[i].usage.ru_maxrss < WORK_MB * 1024 || !WIFEXITED(workers[i].status) ||
+				WEXITSTATUS(workers[i].status) != 0)
+			ret = 1;
+	}
+
+	fargv[0] = "sh";
+	fargv[1] = "-c";
+	fargv[2] = "exit 3";
+	fargv[3] = NULL;
+	if (meas_spawn(&mst, &failing, "FAILING", fargv, NULL) == FALSE || meas_wait(&failing) == FALSE ||
+			WEXITSTATUS(failing.status) != 3)
+		ret = 1;
+
+	stats = meas_get_child_stats(&mst, "WORKER");
+	if (stats == NULL || stats->nchildren != NWORKERS || stats->nfailed != 0 ||
+			stats->maxrss < WORK_MB * 1024)
+		ret = 1;
+
+	stats = meas_get_child_stats(&mst, "FAILING");
+	if (stats == NULL || stats->nchildren != 1 || stats->nfailed != 1)
+		ret = 1;
+
+	/* A group needs a name */
+	if (meas_spawn(&mst, &failing, NULL, fargv, NULL) == TRUE)
+		ret = 1;
+
+	meas_generate_report(&mst, REPORT_CHILDREN);
+	meas_write_report(mst, stdout);
+	meas_close(&mst);
+
+	return(ret);
+}
+
+
+/**
+ * Child: touch some memory and spin
+ * @return int Exit status.
+ */
+int work(void)
+{
+	unsigned long i;
+	char *mem;
+
+	if ((mem = (char*)malloc(WORK_MB * 1024 * 1024)) == NULL)
+		return(1);
+	memset(mem, 1, WORK_MB * 1024 * 1024);
+
+	for (i = 0; i < WORK_SPIN; i++) {
+		sink += i ^ (unsigned long)mem[i % (WORK_MB * 1024 * 1024)];
+	}
+
+	free(mem);
+	return(0);
+}
+
@@ -0,0 +1,145 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <meas.h>
+
+/*
+ * Test - Per-thread resources: a spinning and a sleeping thread.
+ */
+
+#define RUN_TIME_US 300000
+#define NUPDATES    1000
+
+volatile int stop;
+volatile unsigned long sink;
+
+void *spinner(void *arg);
+void *sleeper(void *arg);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_threads *thr;
+	meas_thread_info delta, spinning, sleeping;
+	pthread_t t1, t2;
+	unsigned long t_update;
+	unsigned int i;
+	int n, found = 0, ret = 0;
+
+	meas_init(&mst);
+
+	pthread_create(&t1, NULL, spinner, NULL);
+	pthread_create(&t2, NULL, sleeper, NULL);
+	pthread_setname_np(t1, "spinner");
+	pthread_setname_np(t2, "sleeper");
+
+	if ((thr = meas_threads_create(&mst, 64)) == NULL)
+		return(1);
+
+	usleep(RUN_TIME_US);
+	n = meas_threads_update(thr);
+	printf("%d threads\n", n);
+
+	memset(&spinning, 0, sizeof(spinning));
+	memset(&sleeping, 0, sizeof(sleeping));
+	for (i = 0; i < thr->n; i++) {
+		meas_threads_delta(thr, i, &delta);
+		if (strcmp(delta.name, "spinner") == 0) {
+			spinning = delta;
+			found++;
+		} else if (strcmp(delta.name, "sleeper") == 0) {
+			sleeping = delta;
+			found++;
+		}
+	}
+	if (n != 3 || found != 2)
+		ret = 1;
+
+	/* Relative only: the CPU share of the spinner depends on the load */
+	if (found == 2 && (spinning.utime + spinning.stime < sleeping.utime + sleeping.stime ||
+					   sleeping.nvcsw <= spinning.nvcsw))
+		ret = 1;
+
+	/* schedstat is optional (kernels without CONFIG_SCHEDSTATS) */
+	if (found == 2 && spinning.fd_schedstat >= 0 &&
+			(spinning.run == 0 || spinning.run <= sleeping.run))
+		ret = 1;
+
+	meas_generate_report(&mst, REPORT_THREADS);
+	meas_write_report(mst, stdout);
+
+	/* Cost of a snapshot */
+	t_update = meas_get_ticks();
+	for (i = 0; i < NUPDATES; i++) {
+		meas_threads_update(thr);
+	}
+	t_update = meas_get_ticks() - t_update;
+	printf("update: %lu ticks per snapshot of %u threads\n", t_update / NUPDATES, thr->n);
+
+	stop = 1;
+	pthread_join(t1, NULL);
+	pthread_join(t2, NULL);
+
+	/* Exited threads are dropped */
+	if (meas_threads_update(thr) != 1)
+		ret = 1;
+
+	meas_close(&mst);
+	return(ret);
+}
+
+
+/**
+ * CPU-bound thread
+ */
+void *spinner(void *arg)
+{
+	unsigned long i = 0;
+
+	while (!stop) {
+		sink += i++;
+	}
+	return(NULL);
+}
+
+
+/**
+ * Thread sleeping most of the time
+ */
+void *sleeper(void *arg)
+{
+	while (!stop) {
+		usleep(1000);
+	}
+	return(NULL);
+}
+
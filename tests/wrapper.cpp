@@ -0,0 +1,98 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+#include <cstdio>
+#include <meas.hpp>
+
+/*
+ * Test - C++ wrapper (RAII timers and named counters)
+ */
+
+static constexpr char c_calls[] = "C_CALLS";
+static constexpr char c_early[] = "C_EARLY_RETURNS";
+
+int work(meas::Timer &timer, int n);
+
+/* Destroyed after the global session: the counter must still be valid */
+static struct at_exit {
+	~at_exit()
+	{
+		meas::Counter<c_calls>::inc();
+	}
+} at_exit;
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas::Session &session = meas::Session::global();
+	meas::Timer timer(session, "T_WORK");
+	int i, sum = 0;
+
+	for (i = 0; i < 100; i++) {
+		sum += work(timer, i);
+	}
+
+	/* Every early return must have stopped the timer */
+	if (timer.get() == nullptr || timer.get()->state != TIMER_ST_STOPPED)
+		return(1);
+
+	if (meas::Counter<c_calls>::get() != 100 ||
+			meas::Counter<c_early>::get() != 50)
+		return(1);
+
+	/* Same name, same slot */
+	if (meas::Counter<c_calls>::slot() != meas::Registry::counter(c_calls, meas::detail::hash(c_calls)))
+		return(1);
+
+	meas_add_report_item(session.ptr(), "SUM", "%ld\n", sum);
+	session.write_report(stdout);
+
+	return(0);
+}
+
+
+/**
+ * Timed function with an early return path
+ * @param timer Timer handle.
+ * @param n Input value.
+ * @return int Some work result.
+ */
+int work(meas::Timer &timer, int n)
+{
+	meas::ScopedTimer guard(timer);
+	int i, r = 0;
+
+	meas::Counter<c_calls>::inc();
+
+	if (n % 2) {
+		meas::Counter<c_early>::inc();
+		return(n);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		r += (i * n) % 7;
+	}
+	return(r);
+}
+
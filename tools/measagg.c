@@ -0,0 +1,103 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * measagg - Aggregated report of a shared multi-process domain
+ *
+ * Exit status: 0 on success, 1 on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <meas.h>
+
+void usage(const char *prog);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	int opt, views = 0, reap = 0, unlink_domain = 0, n;
+
+	while ((opt = getopt(argc, argv, "ptruh")) != -1) {
+		switch (opt) {
+			case 'p':
+				views |= MEAS_DOMAIN_PROCESSES;
+				break;
+			case 't':
+				views |= MEAS_DOMAIN_TOTAL;
+				break;
+			case 'r':
+				reap = 1;
+				break;
+			case 'u':
+				unlink_domain = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return(1);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return(1);
+	}
+
+	if (views == 0)
+		views = MEAS_DOMAIN_PROCESSES | MEAS_DOMAIN_TOTAL;
+
+	if (meas_domain_report(argv[optind], views, stdout) == FALSE) {
+		fprintf(stderr, "measagg: %s: no such domain\n", argv[optind]);
+		return(1);
+	}
+
+	if (reap) {
+		if ((n = meas_domain_reap(argv[optind])) < 0)
+			return(1);
+		printf(" %d slots of exited or dead processes freed\n", n);
+	}
+
+	if (unlink_domain && meas_domain_unlink(argv[optind]) == FALSE) {
+		perror("measagg");
+		return(1);
+	}
+
+	return(0);
+}
+
+
+/**
+ * Print usage
+ * @param prog Program name.
+ */
+void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] <domain>\n", prog);
+	fprintf(stderr, "  -p   per-process view\n");
+	fprintf(stderr, "  -t   total view (default: both views)\n");
+	fprintf(stderr, "  -r   free the slots of exited and dead processes after the report\n");
+	fprintf(stderr, "  -u   remove the domain after the report\n");
+}
+
@@ -0,0 +1,177 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * meascmp - Compare a saved run against a baseline
+ *
+ * Exit status: 0 if no significant regression exceeds the threshold,
+ *              1 otherwise, 2 on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <meas.h>
+
+/**
+ * Default regression threshold (percent)
+ */
+#define DEF_THRESHOLD 5.0
+
+void usage(const char *prog);
+meas_run *load(const char *path);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_cmp_opts opts;
+	meas_cmp_result *res;
+	meas_run *base, *cur;
+	unsigned int n, i, untested = 0, summaries = 0, shown = 0;
+	double threshold = DEF_THRESHOLD;
+	int opt, verbose = 0, failed = 0;
+	const char *kind;
+
+	meas_cmp_defaults(&opts);
+
+	while ((opt = getopt(argc, argv, "a:t:n:bvh")) != -1) {
+		switch (opt) {
+			case 'a':
+				opts.alpha = atof(optarg);
+				break;
+			case 't':
+				threshold = atof(optarg);
+				break;
+			case 'n':
+				opts.min_samples = (unsigned int)atoi(optarg);
+				break;
+			case 'b':
+				opts.method = MEAS_CMP_BOOTSTRAP;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return(2);
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+		return(2);
+	}
+
+	if ((base = load(argv[optind])) == NULL || (cur = load(argv[optind + 1])) == NULL)
+		return(2);
+
+	if (meas_compare_runs(base, cur, &opts, &res, &n) == FALSE) {
+		fprintf(stderr, "meascmp: comparison failed\n");
+		return(2);
+	}
+
+	printf(" %-36s %13s  %13s  %7s  %8s\n", "METRIC NAME", "BASELINE", "CURRENT", "CHANGE", "P-VALUE");
+	for (i = 0; i < n; i++) {
+		if (res[i].summary)
+			summaries++;
+		else if (res[i].verdict == MEAS_CMP_UNTESTED)
+			untested++;
+
+		if (!verbose && res[i].verdict != MEAS_CMP_REGRESSION &&
+				res[i].verdict != MEAS_CMP_IMPROVEMENT)
+			continue;
+
+		switch (res[i].kind) {
+			case MEAS_RUN_TIMER:   kind = "T"; break;
+			case MEAS_RUN_COUNTER: kind = "C"; break;
+			default:               kind = "B"; break;
+		}
+
+		printf(" %s %-34.34s %13.1f  %13.1f  %+6.1f%%  %.2e  %s\n", kind, res[i].name,
+				res[i].base_median, res[i].cur_median, res[i].change * 100.0, res[i].p_value,
+				res[i].verdict == MEAS_CMP_REGRESSION  ? "REGRESSION" :
+				res[i].verdict == MEAS_CMP_IMPROVEMENT ? "improvement" :
+				res[i].summary                         ? "untested (mean)" :
+				res[i].verdict == MEAS_CMP_UNTESTED    ? "untested" : "");
+		shown++;
+
+		if (res[i].verdict == MEAS_CMP_REGRESSION && (res[i].change * 100.0) > threshold)
+			failed = 1;
+	}
+
+	if (shown == 0)
+		printf(" (no significant change)\n");
+
+	printf("\n %u metrics compared, %u without enough samples (min. %u)\n",
+			n, untested, opts.min_samples);
+	if (summaries > 0)
+		printf(" %u timers saved without captured samples (means only, untested)\n", summaries);
+
+	free(res);
+	meas_free_run(&base);
+	meas_free_run(&cur);
+
+	return(failed);
+}
+
+
+/**
+ * Print usage
+ * @param prog Program name.
+ */
+void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] <baseline> <current>\n", prog);
+	fprintf(stderr, "  -a ALPHA   significance level (default 0.01)\n");
+	fprintf(stderr, "  -t PCT     fail on significant regressions above PCT%% (default %.0f)\n", DEF_THRESHOLD);
+	fprintf(stderr, "  -n N       min. samples per side to test a metric (default 5)\n");
+	fprintf(stderr, "  -b         bootstrap test instead of Mann-Whitney U\n");
+	fprintf(stderr, "  -v         show every metric, not only significant changes\n");
+	fprintf(stderr, "Benchmarks and timers with captured samples (meas_clock_capture) are tested;\n");
+	fprintf(stderr, "other timers are saved as count/total/min/max and only their means compared.\n");
+}
+
+
+/**
+ * Load a saved run from a file
+ * @param path File path.
+ * @return meas_run* The run or NULL on error.
+ */
+meas_run *load(const char *path)
+{
+	meas_run *run;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return(NULL);
+	}
+
+	if ((run = meas_load_run(fp)) == NULL) {
+		fprintf(stderr, "meascmp: %s: not a libmeas run\n", path);
+	}
+
+	fclose(fp);
+	return(run);
+}
+
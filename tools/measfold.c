@@ -0,0 +1,275 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+/*
+ * measfold - Symbolize sampling profiler output (meas_sampler_write) into
+ *            folded stacks per region: "region;outer;...;inner count"
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <meas.h>
+
+/**
+ * Max. size of a folded stack
+ */
+#define MAX_STACK 8192
+
+/**
+ * Executable mapping of the profiled process
+ */
+struct mapping {
+	unsigned long start;
+	unsigned long end;
+	unsigned long offset;
+	char *path;
+	meas_symtab *symtab;
+	int loaded;
+};
+
+struct mapping *maps  = NULL;
+unsigned int nmaps    = 0;
+char **stacks         = NULL;
+unsigned int nstacks  = 0;
+unsigned int capacity = 0;
+
+void usage(const char *prog);
+int parse_sample(char *line, int with_tid);
+void symbolize(unsigned long pc, char *out, size_t size);
+int add_stack(const char *stack);
+int cmp_string(const void *a, const void *b);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	FILE *fp;
+	char *line = NULL, path[1024];
+	size_t len = 0;
+	unsigned long start, end, offset, dropped;
+	unsigned int i, j;
+	int opt, with_tid = 0, tid;
+
+	while ((opt = getopt(argc, argv, "th")) != -1) {
+		switch (opt) {
+			case 't':
+				with_tid = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return(2);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return(2);
+	}
+
+	if ((fp = fopen(argv[optind], "r")) == NULL) {
+		perror(argv[optind]);
+		return(2);
+	}
+
+	if (getline(&line, &len, fp) < 0 || strncmp(line, "libmeas-samples 1", 17) != 0) {
+		fprintf(stderr, "measfold: %s: not a libmeas sample file\n", argv[optind]);
+		return(2);
+	}
+
+	while (getline(&line, &len, fp) >= 0) {
+		if (strncmp(line, "map ", 4) == 0) {
+			if (sscanf(line + 4, "%lx %lx %lx %1023s", &start, &end, &offset, path) != 4)
+				continue;
+
+			maps = (struct mapping*)realloc(maps, sizeof(struct mapping) * (nmaps + 1));
+			if (maps == NULL)
+				return(2);
+
+			maps[nmaps].start  = start;
+			maps[nmaps].end    = end;
+			maps[nmaps].offset = offset;
+			maps[nmaps].path   = strdup(path);
+			maps[nmaps].symtab = NULL;
+			maps[nmaps].loaded = 0;
+			nmaps++;
+		} else if (strncmp(line, "sample ", 7) == 0) {
+			if (parse_sample(line + 7, with_tid) == FALSE)
+				return(2);
+		} else if (sscanf(line, "dropped %d %lu", &tid, &dropped) == 2) {
+			fprintf(stderr, "measfold: thread %d dropped %lu samples\n", tid, dropped);
+		}
+	}
+	fclose(fp);
+	free(line);
+
+	/* Count identical stacks */
+	qsort(stacks, nstacks, sizeof(char*), cmp_string);
+	for (i = 0; i < nstacks; i = j) {
+		for (j = i + 1; j < nstacks && strcmp(stacks[i], stacks[j]) == 0; j++);
+		printf("%s %u\n", stacks[i], j - i);
+	}
+
+	for (i = 0; i < nstacks; i++) {
+		free(stacks[i]);
+	}
+	free(stacks);
+
+	for (i = 0; i < nmaps; i++) {
+		meas_symtab_free(&maps[i].symtab);
+		free(maps[i].path);
+	}
+	free(maps);
+
+	return(0);
+}
+
+
+/**
+ * Print usage
+ * @param prog Program name.
+ */
+void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-t] <samples file>\n", prog);
+	fprintf(stderr, "  -t   add the thread id after the region name\n");
+}
+
+
+/**
+ * Parse and fold a sample line: "<tid> <region> <n> <pc> ..."
+ * @param line Sample line (after the keyword).
+ * @param with_tid Add the thread id to the stack.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int parse_sample(char *line, int with_tid)
+{
+	char stack[MAX_STACK], frame[512], region[MAX_NAME_SIZE];
+	unsigned long pcs[MEAS_SAMPLER_DEPTH];
+	unsigned int n, i;
+	int tid, used, pos;
+	size_t slen;
+	char *p;
+
+	if (sscanf(line, "%d %34s %u%n", &tid, region, &n, &used) != 3)
+		return(TRUE);
+
+	p = line + used;
+	for (i = 0; i < n && i < MEAS_SAMPLER_DEPTH; i++) {
+		if (sscanf(p, "%lx%n", &pcs[i], &used) != 1)
+			break;
+		p += used;
+	}
+	n = i;
+
+	if (with_tid) {
+		pos = snprintf(stack, sizeof(stack), "%s;[tid %d]", region, tid);
+	} else {
+		pos = snprintf(stack, sizeof(stack), "%s", region);
+	}
+
+	/* Outermost frame first; return addresses point after the call */
+	for (i = n; i > 0; i--) {
+		symbolize(i == 1 ? pcs[i - 1] : pcs[i - 1] - 1, frame, sizeof(frame));
+
+		slen = strlen(frame);
+		if (pos + slen + 2 >= sizeof(stack))
+			break;
+
+		stack[pos++] = ';';
+		memcpy(&stack[pos], frame, slen + 1);
+		pos += slen;
+	}
+
+	return(add_stack(stack));
+}
+
+
+/**
+ * Symbolize an address of the profiled process
+ * @param pc Address.
+ * @param out Output buffer.
+ * @param size Size of the output buffer.
+ */
+void symbolize(unsigned long pc, char *out, size_t size)
+{
+	const char *name, *base;
+	unsigned long offset;
+	unsigned int i;
+
+	for (i = 0; i < nmaps; i++) {
+		if (pc >= maps[i].start && pc < maps[i].end)
+			break;
+	}
+
+	if (i == nmaps) {
+		snprintf(out, size, "[unknown]");
+		return;
+	}
+
+	if (!maps[i].loaded) {
+		maps[i].symtab = meas_symtab_load(maps[i].path);
+		maps[i].loaded = 1;
+	}
+
+	offset = pc - maps[i].start + maps[i].offset;
+	name   = meas_symtab_lookup(maps[i].symtab, offset, NULL);
+
+	if (name != NULL) {
+		snprintf(out, size, "%s", name);
+	} else {
+		base = strrchr(maps[i].path, '/');
+		snprintf(out, size, "[%s+0x%lx]", base != NULL ? base + 1 : maps[i].path, offset);
+	}
+}
+
+
+/**
+ * Store a folded stack
+ * @param stack Folded stack.
+ * @return FALSE on error, TRUE otherwise.
+ */
+int add_stack(const char *stack)
+{
+	if (nstacks == capacity) {
+		capacity = capacity ? capacity * 2 : 1024;
+		if ((stacks = (char**)realloc(stacks, sizeof(char*) * capacity)) == NULL)
+			return(FALSE);
+	}
+
+	if ((stacks[nstacks] = strdup(stack)) == NULL)
+		return(FALSE);
+
+	nstacks++;
+	return(TRUE);
+}
+
+
+/**
+ * Compare two strings (for qsort)
+ */
+int cmp_string(const void *a, const void *b)
+{
+	return(strcmp(*(char* const*)a, *(char* const*)b));
+}
+
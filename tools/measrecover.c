@@ -0,0 +1,178 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * measrecover - Last consistent state of a persistent log (see
+ *               meas_plog_open), e.g. after a reset
+ *
+ * Exit status: 0 on success, 1 on error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <meas.h>
+
+/**
+ * Reader state
+ */
+struct state {
+	int all;						/* Print every record */
+	int nrecords;
+	int nsessions;
+	meas_plog_rec last;				/* Last snapshot */
+	meas_interval *metrics;
+	unsigned long events_after;		/* Events after the last snapshot */
+	meas_plog_rec last_rec;
+};
+
+void usage(const char *prog);
+int record(const meas_plog_rec *rec, void *ctx);
+void print_time(unsigned long long ns);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	struct state st;
+	unsigned int i;
+	int opt;
+
+	memset(&st, 0, sizeof(st));
+
+	while ((opt = getopt(argc, argv, "ah")) != -1) {
+		switch (opt) {
+			case 'a':
+				st.all = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return(1);
+		}
+	}
+
+	if (argc - optind != 1) {
+		usage(argv[0]);
+		return(1);
+	}
+
+	if (meas_plog_read(argv[optind], record, &st) < 0) {
+		fprintf(stderr, "measrecover: %s: not a libmeas persistent log\n", argv[optind]);
+		return(1);
+	}
+
+	printf(" %d records, %d sessions\n", st.nrecords, st.nsessions);
+	if (st.nrecords > 0) {
+		printf(" last record: session %u (pid %d), ", st.last_rec.session, st.last_rec.pid);
+		print_time(st.last_rec.time);
+		printf("\n");
+	}
+
+	if (st.metrics == NULL) {
+		printf(" no snapshot\n");
+		return(0);
+	}
+
+	printf("\n last snapshot: session %u (pid %d), ", st.last.session, st.last.pid);
+	print_time(st.last.time);
+	printf(", %lu events after it\n", st.events_after);
+
+	for (i = 0; i < st.last.nmetrics; i++) {
+		if (st.metrics[i].kind == MEAS_RUN_TIMER) {
+			printf("   T %-34s %lu x, %ld ticks (min. %lu, max. %lu)\n", st.metrics[i].name,
+				   st.metrics[i].count, st.metrics[i].value, st.metrics[i].min, st.metrics[i].max);
+		} else {
+			printf("   C %-34s %ld\n", st.metrics[i].name, st.metrics[i].value);
+		}
+	}
+
+	free(st.metrics);
+	return(0);
+}
+
+
+/**
+ * Print usage
+ * @param prog Program name.
+ */
+void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] <log>\n", prog);
+	fprintf(stderr, "  -a   print every record\n");
+}
+
+
+/**
+ * Record callback
+ */
+int record(const meas_plog_rec *rec, void *ctx)
+{
+	struct state *st = (struct state*)ctx;
+
+	st->nrecords++;
+	st->last_rec = *rec;
+
+	switch (rec->type) {
+		case MEAS_PLOG_SESSION:
+			st->nsessions++;
+			if (st->all)
+				printf(" %llu session %u (pid %d)\n", rec->seq, rec->session, rec->pid);
+			break;
+
+		case MEAS_PLOG_SNAPSHOT:
+			free(st->metrics);
+			if ((st->metrics = (meas_interval*)malloc(sizeof(meas_interval) * (rec->nmetrics + 1))) == NULL)
+				return(FALSE);
+			memcpy(st->metrics, rec->metrics, sizeof(meas_interval) * rec->nmetrics);
+			st->last = *rec;
+			st->events_after = 0;
+			if (st->all)
+				printf(" %llu snapshot (%u metrics)\n", rec->seq, rec->nmetrics);
+			break;
+
+		case MEAS_PLOG_EVENT:
+			st->events_after++;
+			if (st->all)
+				printf(" %llu event %s %ld\n", rec->seq, rec->name, rec->value);
+			break;
+	}
+
+	return(TRUE);
+}
+
+
+/**
+ * Print a CLOCK_REALTIME time
+ * @param ns Nanoseconds since the Epoch.
+ */
+void print_time(unsigned long long ns)
+{
+	char buf[64];
+	time_t t = (time_t)(ns / 1000000000ULL);
+
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
+	printf("%s.%06llu", buf, (ns % 1000000000ULL) / 1000);
+}
+
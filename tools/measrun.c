@@ -0,0 +1,177 @@
+ /*
+  * libmeas - A measurement system for critical embedded systems
+  *
+  * Copyright (C) 2009 Renê de Souza Pinto
+  *
+  * This file is part of libmeas
+  *
+  * libmeas is free software: you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published by
+  * the Free Software Foundation, either version 3 of the License, or
+  * (at your option) any later version.
+  *
+  * libmeas is distributed in the hope that it will be useful,
+  * but WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  * GNU General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+  */
+
+
+/*
+ * measrun - Measure a command: wall time, CPU time and memory of each run
+ *
+ * Exit status: exit status of the last run, 127 if it could not be
+ *              started, 2 on usage error.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <meas.h>
+#include <util.h>
+
+/**
+ * Measured quantities
+ */
+#define Q_WALL   0
+#define Q_USER   1
+#define Q_SYSTEM 2
+#define Q_RSS    3
+#define NQ       4
+
+void usage(const char *prog);
+void print_stats(const char *label, double *v, unsigned int n);
+
+
+/**
+ * Main
+ */
+int main(int argc, char **argv)
+{
+	meas_t *mst;
+	meas_child child;
+	double *q[NQ];
+	unsigned int runs = 1, i, j;
+	int opt, quiet = 0, report = 0, status = 0;
+	const char *name;
+
+	while ((opt = getopt(argc, argv, "+n:qrh")) != -1) {
+		switch (opt) {
+			case 'n':
+				runs = (unsigned int)atoi(optarg);
+				break;
+			case 'q':
+				quiet = 1;
+				break;
+			case 'r':
+				report = 1;
+				break;
+			default:
+				usage(argv[0]);
+				return(2);
+		}
+	}
+
+	if (optind >= argc || runs == 0) {
+		usage(argv[0]);
+		return(2);
+	}
+
+	for (j = 0; j < NQ; j++) {
+		if ((q[j] = (double*)malloc(sizeof(double) * runs)) == NULL)
+			return(2);
+	}
+
+	name = strrchr(argv[optind], '/') ? strrchr(argv[optind], '/') + 1 : argv[optind];
+	meas_init(&mst);
+
+	for (i = 0; i < runs; i++) {
+		if (meas_spawn(&mst, &child, name, &argv[optind], NULL) == FALSE) {
+			perror(argv[optind]);
+			return(127);
+		}
+		if (meas_wait(&child) == FALSE) {
+			perror("measrun");
+			return(127);
+		}
+
+		q[Q_WALL][i]   = (double)child.wall;
+		q[Q_USER][i]   = child.usage.ru_utime.tv_sec + (child.usage.ru_utime.tv_usec / 1e6);
+		q[Q_SYSTEM][i] = child.usage.ru_stime.tv_sec + (child.usage.ru_stime.tv_usec / 1e6);
+		q[Q_RSS][i]    = (double)child.usage.ru_maxrss;
+		status = WIFEXITED(child.status) ? WEXITSTATUS(child.status) : 128 + WTERMSIG(child.status);
+
+		if (!quiet) {
+			fprintf(stderr, "measrun: run %u: %lu ticks, user %.3f s, system %.3f s, "
+					"max. RSS %ld KB, status %d\n", i + 1, child.wall, q[Q_USER][i],
+					q[Q_SYSTEM][i], child.usage.ru_maxrss, status);
+		}
+	}
+
+	fprintf(stderr, "\nmeasrun: %s, %u runs, %lu failed\n", name, runs,
+			meas_get_child_stats(&mst, name)->nfailed);
+	fprintf(stderr, " %-16s %14s %14s %14s %14s %14s\n", "", "MIN", "MEDIAN", "MEAN", "MAX", "STDDEV");
+	print_stats("wall (ticks)", q[Q_WALL], runs);
+	print_stats("user (s)", q[Q_USER], runs);
+	print_stats("system (s)", q[Q_SYSTEM], runs);
+	print_stats("max. RSS (KB)", q[Q_RSS], runs);
+
+	if (report) {
+		meas_generate_report(&mst, REPORT_CHILDREN);
+		meas_write_report(mst, stderr);
+	}
+
+	for (j = 0; j < NQ; j++) {
+		free(q[j]);
+	}
+	meas_close(&mst);
+
+	return(status);
+}
+
+
+/**
+ * Print usage
+ * @param prog Program name.
+ */
+void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] <command> [arguments]\n", prog);
+	fprintf(stderr, "  -n N   run the command N times (default 1)\n");
+	fprintf(stderr, "  -q     do not print each run\n");
+	fprintf(stderr, "  -r     print the libmeas report of the children\n");
+}
+
+
+/**
+ * Print min., median, mean, max. and standard deviation of a quantity
+ * @param label Name of the quantity.
+ * @param v Values (sorted in place).
+ * @param n Number of values.
+ */
+void print_stats(const char *label, double *v, unsigned int n)
+{
+	double mean = 0, var = 0, median;
+	unsigned int i;
+
+	qsort(v, n, sizeof(double), util_cmp_double);
+
+	for (i = 0; i < n; i++) {
+		mean += v[i];
+	}
+	mean /= n;
+
+	for (i = 0; i < n; i++) {
+		var += (v[i] - mean) * (v[i] - mean);
+	}
+
+	median = (n % 2) ? v[n / 2] : (v[(n / 2) - 1] + v[n / 2]) / 2;
+	fprintf(stderr, " %-16s %14.6g %14.6g %14.6g %14.6g %14.6g\n", label, v[0], median, mean,
+			v[n - 1], n > 1 ? sqrt(var / (n - 1)) : 0.0);
+}
+